@@ -153,6 +153,9 @@ typedef struct GCDetails_ {
   Time elapsed_ns;
 } GCDetails;
 
+// Number of buckets in RTSStats.sync_stop_histogram
+#define SYNC_STOP_HISTOGRAM_SIZE 16
+
 //
 // Stats about the RTS currently, and since the start of execution
 //
@@ -241,6 +244,32 @@ typedef struct _RTSStats {
     // The number of times a GC thread has iterated it's outer loop across all
     // parallel GCs
   uint64_t scav_find_work;
+
+  // -----------------------------------
+  // Static objects
+
+    // The number of static objects scavenged across all major GCs
+  uint64_t scavenged_static_objects;
+    // The number of times major GCs reached a settled static object and
+    // did not scavenge it again, summed across all major GCs
+  uint64_t skipped_static_objects;
+
+  // -----------------------------------
+  // Time to stop for a sync (threaded RTS only)
+
+    // Number of times all the Capabilities were stopped, for a GC or
+    // otherwise
+  uint64_t syncs;
+    // The longest time any Capability took to stop for a sync, the
+    // Capability, and the thread it was running when the sync started
+    // (0 if none)
+  Time max_sync_stop_ns;
+  uint32_t max_sync_stop_cap;
+  uint32_t max_sync_stop_thread;
+    // How long Capabilities took to stop, counting each Capability we
+    // had to wait for in each sync: bucket 0 is under 1us, bucket i is
+    // [2^(i-1), 2^i) us, and the last bucket is everything longer
+  uint64_t sync_stop_histogram[SYNC_STOP_HISTOGRAM_SIZE];
 } RTSStats;
 
 void getRTSStats (RTSStats *s);
@@ -307,6 +307,36 @@
  */
 #define TSO_ALLOC_LIMIT 256
 
+/*
+ * TSO_STEALABLE is set while a TSO is on a Capability's steal queue,
+ * where any Capability may take it.  See Note [Thread stealing] in
+ * Capability.c.
+ */
+#define TSO_STEALABLE 512
+
+/*
+ * TSO_STM_WOKEN is set while a thread that was woken from an STM retry
+ * runs its transaction again.  See Note [STM wakeups] in STM.c.
+ */
+#define TSO_STM_WOKEN 1024
+
+/*
+ * TSO_ALLOC_SLICE is set while the thread's timeslice ends when it has
+ * allocated its budget, i.e. when alloc_limit drops below slice_end.
+ * See Note [Allocation slices] in Schedule.c.
+ */
+#define TSO_ALLOC_SLICE 2048
+
+/*
+ * Priority classes of threads (tso->prio), from the most urgent.  Keep
+ * these in sync with GHC.Conc.Sync.ThreadPriority.  See
+ * Note [Priority classes] in Schedule.c.
+ */
+#define TSO_PRIO_HIGH    0
+#define TSO_PRIO_NORMAL  1
+#define TSO_PRIO_LOW     2
+#define TSO_PRIO_CLASSES 3
+
 /*
  * The number of times we spin in a spin lock before yielding (see
  * #3758).  To tune this value, use the benchmark in #3758: run the
@@ -320,7 +350,9 @@
    Spare workers per Capability in the threaded RTS
 
    No more than MAX_SPARE_WORKERS will be kept in the thread pool
-   associated with each Capability.
+   associated with each Capability, unless +RTS --min-workers or
+   --worker-idle-timeout say otherwise (see Note [Worker pool] in
+   rts/Capability.c).
    -------------------------------------------------------------------------- */
 
 #define MAX_SPARE_WORKERS 6
@@ -181,12 +181,21 @@
 
 #define EVENT_USER_BINARY_MSG              181
 
+#define EVENT_STEAL_THREAD        182 /* (thread, victim_cap)   */
+#define EVENT_CAP_HANDOFF         183 /* (taskID, latency, spun) */
+#define EVENT_WORKER_COUNTERS     184 /* (created, reused, retired) */
+#define EVENT_SYNC_STOP           185 /* (sync_type, n_waited, cap,
+                                          time, thread)          */
+#define EVENT_STM_ABORT           186 /* (thread, tvar, reason) */
+#define EVENT_RUN_QUEUE_DELAY     187 /* (thread, prio, delay)  */
+#define EVENT_ALLOC_SAMPLE_BEGIN  188 /* (profile_id, era)      */
+
 /*
  * The highest event code +1 that ghc itself emits. Note that some event
  * ranges higher than this are reserved but not currently emitted by ghc.
  * This must match the size of the EventDesc[] array in EventLog.c
  */
-#define NUM_GHC_EVENT_TAGS        182
+#define NUM_GHC_EVENT_TAGS        189
 
 #if 0  /* DEPRECATED EVENTS: */
 /* we don't actually need to record the thread, it's implicit */
@@ -234,6 +243,13 @@
 #define CAPSET_TYPE_OSPROCESS   2  /* caps belong to the same OS process */
 #define CAPSET_TYPE_CLOCKDOMAIN 3  /* caps share a local clock/time      */
 
+/*
+ * Reason values for EVENT_STM_ABORT
+ */
+#define STM_ABORT_CONFLICT      1  /* a TVar it read has changed          */
+#define STM_ABORT_IRREVOCABLE   2  /* another transaction is irrevocable  */
+#define STM_ABORT_OTHER         3  /* e.g. version counter overflow       */
+
 /*
  * Heap profile breakdown types. See EVENT_HEAP_PROF_BEGIN.
  */
@@ -244,7 +260,8 @@ typedef enum {
     HEAP_PROF_BREAKDOWN_TYPE_DESCR,
     HEAP_PROF_BREAKDOWN_RETAINER,
     HEAP_PROF_BREAKDOWN_BIOGRAPHY,
-    HEAP_PROF_BREAKDOWN_CLOSURE_TYPE
+    HEAP_PROF_BREAKDOWN_CLOSURE_TYPE,
+    HEAP_PROF_BREAKDOWN_ALLOC_SITE
 } HeapProfBreakdown;
 
 #if !defined(EVENTLOG_CONSTANTS_ONLY)
@@ -144,6 +144,11 @@ typedef struct _PROFILING_FLAGS {
     bool		showCCSOnException;
 
     uint32_t    maxRetainerSetSize;
+    uint32_t    retainerSliceSize;  /* objects visited per GC by an
+                                       incremental retainer traversal,
+                                       or 0 to traverse the whole heap */
+    uint32_t    allocSampleBytes;   /* bytes of allocation between
+                                       allocation-site samples, or 0 */
 
     uint32_t    ccsLength;
 
@@ -175,7 +180,13 @@ typedef struct _TRACE_FLAGS {
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _CONCURRENT_FLAGS {
     Time ctxtSwitchTime;         /* units: TIME_RESOLUTION */
-    int ctxtSwitchTicks;         /* derived */
+    int ctxtSwitchTicks;         /* derived: 0 for -C0, -1 if the timer
+                                    never switches (--alloc-slice) */
+    uint32_t prioAging;          /* run a waiting thread of a lower priority
+                                    class after this many threads of
+                                    more urgent ones (0 = never) */
+    uint64_t allocSlice;         /* end a thread's timeslice when it has
+                                    allocated this many bytes (0 = never) */
 } CONCURRENT_FLAGS;
 
 /*
@@ -198,6 +209,16 @@ typedef struct _MISC_FLAGS {
     bool internalCounters;       /* See Note [Internal Counter Stats] */
     StgWord linkerMemBase;       /* address to ask the OS for memory
                                   * for the linker, NULL ==> off */
+    bool ioUring;                /* use the io_uring I/O manager */
+    uint32_t stmIndexThreshold;  /* index the entries of a TRec in a hash
+                                  * table once it has this many (zero
+                                  * disables) */
+    uint32_t stmIrrevocableAfter; /* run a transaction irrevocably after
+                                   * this many failed commits (zero
+                                   * disables) */
+    bool stmPreciseWakeup;       /* wake a thread blocked in retry only if
+                                  * a TVar it read now has a different
+                                  * value */
 } MISC_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -227,8 +248,35 @@ typedef struct _PAR_FLAGS {
                                   * GC (default: use all nNodes). */
 
   bool           setAffinity;    /* force thread affinity with CPUs */
+  uint32_t       affinityMode;   /* how to place Capabilities on CPUs
+                                  * with -qa: AFFINITY_* */
+
+  Time           ffiGracePeriod; /* keep the Capability reserved for
+                                  * a safe foreign call expected to
+                                  * return within this time (zero
+                                  * disables) */
+
+  uint32_t       minSpareWorkers; /* start this many spare workers per
+                                   * Capability, and keep them */
+  uint32_t       maxWorkers;     /* never run more worker OS threads
+                                  * than this (zero: no limit) */
+  Time           workerIdleTimeout;
+                                 /* spare workers exit after being idle
+                                  * this long; zero means keep at most
+                                  * MAX_SPARE_WORKERS per Capability */
+
+  bool           stmVersionClock; /* validate STM reads against a global
+                                   * version clock (see Note [STM version
+                                   * clock] in STM.c) */
+  Time           autoCapsInterval; /* enable and disable Capabilities
+                                    * with the load, looking every this
+                                    * long (zero disables) */
 } PAR_FLAGS;
 
+#define AFFINITY_ROUND_ROBIN 0   /* -qa: Capability i on CPU i */
+#define AFFINITY_COMPACT     1   /* -qa=compact: fill each socket in turn */
+#define AFFINITY_SPREAD      2   /* -qa=spread: alternate between sockets */
+
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _TICKY_FLAGS {
     bool showTickyStats;
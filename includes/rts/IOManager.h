@@ -29,6 +29,19 @@ void     setIOManagerControlFd   (uint32_t cap_no, int fd);
 void     setTimerManagerControlFd(int fd);
 void     setIOManagerWakeupFd   (int fd);
 
+// The io_uring I/O manager, used by GHC.IO.URing.  The requests return
+// an id for ioURingCancel(), or 0 if the request could not be made.
+// Implementation in posix/IOURing.c
+HsBool   ioURingEnabled (void);
+HsWord64 ioURingRead    (int fd, void *buf, size_t len, HsInt64 offset,
+                         HsStablePtr mvar);
+HsWord64 ioURingWrite   (int fd, const void *buf, size_t len, HsInt64 offset,
+                         HsStablePtr mvar);
+HsWord64 ioURingAccept  (int fd, void *addr, void *addrlen, int flags,
+                         HsStablePtr mvar);
+HsWord64 ioURingTimeout (HsWord64 usecs, HsStablePtr mvar);
+void     ioURingCancel  (HsWord64 id);
+
 #endif
 
 //
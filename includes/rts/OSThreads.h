@@ -181,6 +181,19 @@ extern void closeCondition        ( Condition* pCond );
 extern bool broadcastCondition    ( Condition* pCond );
 extern bool signalCondition       ( Condition* pCond );
 extern bool waitCondition         ( Condition* pCond, Mutex* pMut );
+// false if the timeout expired first
+extern bool timedWaitCondition    ( Condition* pCond, Mutex* pMut,
+                                    Time timeout );
+
+#if defined(linux_HOST_OS)
+//
+// Futexes: sleep while *addr == val, and wake up n sleepers on addr.
+// futexWait() returns false if the timeout (0 for none) expired first.
+//
+extern bool futexWait             ( volatile uint32_t *addr, uint32_t val,
+                                    Time timeout );
+extern void futexWake             ( volatile uint32_t *addr, uint32_t n );
+#endif
 
 //
 // Mutexes
@@ -45,6 +45,10 @@ int     cmp_thread                       (StgPtr tso1, StgPtr tso2);
 int     rts_getThreadId                  (StgPtr tso);
 void    rts_enableThreadAllocationLimit  (StgPtr tso);
 void    rts_disableThreadAllocationLimit (StgPtr tso);
+void    rts_setThreadPriority            (StgPtr tso, HsInt prio);
+HsInt   rts_getThreadPriority            (StgPtr tso);
+void    rts_setThreadAllocationSlice     (StgPtr tso, HsInt bytes);
+HsInt   rts_getThreadAllocationSlice     (StgPtr tso);
 
 #if !defined(mingw32_HOST_OS)
 pid_t  forkProcess     (HsStablePtr *entry);
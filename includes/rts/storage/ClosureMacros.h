@@ -415,8 +415,6 @@ closure_sizeW_ (const StgClosure *p, const StgInfoTable *info)
         return stack_sizeW((StgStack*)p);
     case BCO:
         return bco_sizeW((StgBCO *)p);
-    case TREC_CHUNK:
-        return sizeofW(StgTRecChunk);
     default:
         return sizeW_fromITBL(info);
     }
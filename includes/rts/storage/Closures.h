@@ -311,6 +311,7 @@ typedef struct StgTVarWatchQueue_ {
   StgClosure                *closure; // StgTSO
   struct StgTVarWatchQueue_ *next_queue_entry;
   struct StgTVarWatchQueue_ *prev_queue_entry;
+  StgClosure                *expected_value; // what the waiter read
 } StgTVarWatchQueue;
 
 typedef struct {
@@ -331,13 +332,19 @@ typedef struct {
 #endif
 } TRecEntry;
 
+/* TRec chunks come in TREC_CHUNK_CLASSES sizes: TREC_CHUNK_NUM_ENTRIES << k
+ * entries for size class k.  They are not heap objects: they live in a
+ * per-Capability arena outside the heap, and the GC finds their entries
+ * through the TRec that points to them.  See Note [TRec chunk arena] in
+ * STM.c */
 #define TREC_CHUNK_NUM_ENTRIES 16
+#define TREC_CHUNK_CLASSES     7
 
 typedef struct StgTRecChunk_ {
-  StgHeader                  header;
   struct StgTRecChunk_      *prev_chunk;
   StgWord                    next_entry_idx;
-  TRecEntry                  entries[TREC_CHUNK_NUM_ENTRIES];
+  StgWord                    size;         /* number of entries */
+  TRecEntry                  entries[];
 } StgTRecChunk;
 
 typedef enum {
@@ -351,8 +358,17 @@ typedef enum {
 struct StgTRecHeader_ {
   StgHeader                  header;
   struct StgTRecHeader_     *enclosing_trec;
-  StgTRecChunk              *current_chunk;
+  StgTRecChunk              *current_chunk; /* not a heap pointer */
   TRecState                  state;
+  StgWord                    has_writes;   /* a TVar has been written */
+  StgWord                    read_version; /* with --stm-version-clock */
+  struct TRecIndex_         *index;        /* see Note [TRec index] */
+  StgWord                    index_epoch;
+  StgWord                    irrevocable;  /* holds the irrevocable token */
+  StgWord                    conflict;     /* address of the TVar that last
+                                              failed validation, or 0 */
+  StgWord                    wakeup_stamp; /* the last commit to wake this
+                                              waiting TRec's thread */
 };
 
 typedef struct {
@@ -54,11 +54,10 @@ typedef union {
   StgAsyncIOResult *async_result;
 #endif
 #if !defined(THREADED_RTS)
-  StgWord target;
-    // Only for the non-threaded RTS: the target time for a thread
-    // blocked in threadDelay, in units of 1ms.  This is a
-    // compromise: we don't want to take up much space in the TSO.  If
-    // you want better resolution for threadDelay, use -threaded.
+  StgWord sleeping_index;
+    // Only for the non-threaded RTS: the position of a thread blocked
+    // in threadDelay in the sleeping queue, which also holds its
+    // target time.  See Note [Sleeping queue] in rts/SleepingQueue.c.
 #endif
 } StgTSOBlockInfo;
 
@@ -173,6 +172,43 @@ typedef struct StgTSO_ {
      */
     StgWord32  tot_stack_size;
 
+    /*
+     * Consecutive failed commits of the thread's current atomically
+     * block, and the number of times it must still yield before running
+     * it again.  See Note [STM contention management] in STM.c.
+     */
+    StgWord16  stm_retries;
+    StgWord16  stm_backoff;
+
+    /*
+     * The thread's priority class (TSO_PRIO_*), and the class whose
+     * part of the run queue the thread is in, or was last in.  They
+     * differ when the priority has been changed since the thread was
+     * queued, or when the thread has been aged.  See
+     * Note [Priority classes] in Schedule.c.
+     */
+    StgWord16  prio;
+    StgWord16  run_queue_prio;
+
+    /*
+     * When the thread was put on the run queue, in nanoseconds (modulo
+     * the word size), if the scheduler is traced; for the
+     * EVENT_RUN_QUEUE_DELAY event.
+     */
+    StgWord    run_queue_time;
+
+    /*
+     * The allocation budget of the thread's timeslices, in bytes (0: the
+     * +RTS --alloc-slice default), and the value of alloc_limit at which
+     * the current timeslice ends, if TSO_ALLOC_SLICE is set in flags.
+     * See Note [Allocation slices] in Schedule.c.
+     *
+     * Use only PK_Int64/ASSIGN_Int64 macros to get/set these in C code,
+     * like alloc_limit.
+     */
+    StgInt64   alloc_slice;
+    StgInt64   slice_end;
+
 #if defined(TICKY_TICKY)
     /* TICKY-specific stuff would go here. */
 #endif
@@ -240,7 +276,7 @@ void dirty_STACK (Capability *cap, StgStack *stack);
 
         BlockedOnRead          NULL                 blocked_queue
         BlockedOnWrite         NULL                 blocked_queue
-        BlockedOnDelay         NULL                 blocked_queue
+        BlockedOnDelay         index in queue       sleeping queue
 
       tso->link == END_TSO_QUEUE, if the thread is currently running.
 
@@ -58,6 +58,11 @@ module GHC.Conc.Sync
         , ThreadStatus(..), BlockReason(..)
         , threadStatus
         , threadCapability
+        , ThreadPriority(..)
+        , setThreadPriority
+        , threadPriority
+        , setThreadAllocationSlice
+        , threadAllocationSlice
 
         , newStablePtrPrimMVar, PrimMVar
 
@@ -595,6 +600,78 @@ threadCapability (ThreadId t) = IO $ \s ->
    case threadStatus# t s of
      (# s', _, cap#, locked# #) -> (# s', (I# cap#, isTrue# (locked# /=# 0#)) #)
 
+-- | The priority class of a thread.  When a capability chooses the next
+-- thread to run, it prefers a thread of a more urgent class, but a
+-- thread that has waited behind too many more urgent ones runs anyway
+-- (see the @--prio-aging@ RTS option).
+--
+-- @since 4.12.0.0
+data ThreadPriority
+  = HighPriority
+  | NormalPriority
+        -- ^the priority of a new thread
+  | LowPriority
+  deriving ( Eq   -- ^ @since 4.12.0.0
+           , Ord  -- ^ @since 4.12.0.0
+           , Show -- ^ @since 4.12.0.0
+           )
+
+-- | Set the priority class of a thread.  If the thread is waiting to
+-- run, the new priority applies from the next time it waits.
+--
+-- @since 4.12.0.0
+setThreadPriority :: ThreadId -> ThreadPriority -> IO ()
+setThreadPriority (ThreadId t) prio = rts_setThreadPriority t (fromPrio prio)
+  where
+    -- NB. keep these in sync with includes/rts/Constants.h
+    fromPrio HighPriority   = 0
+    fromPrio NormalPriority = 1
+    fromPrio LowPriority    = 2
+
+-- | The priority class of a thread.
+--
+-- @since 4.12.0.0
+threadPriority :: ThreadId -> IO ThreadPriority
+threadPriority (ThreadId t) = do
+  prio <- rts_getThreadPriority t
+  return $! toPrio prio
+  where
+    toPrio 0 = HighPriority
+    toPrio 1 = NormalPriority
+    toPrio _ = LowPriority
+
+foreign import ccall unsafe "rts_setThreadPriority"
+  rts_setThreadPriority :: ThreadId# -> Int -> IO ()
+
+foreign import ccall unsafe "rts_getThreadPriority"
+  rts_getThreadPriority :: ThreadId# -> IO Int
+
+-- | Set the allocation budget of a thread's timeslices, in bytes: the
+-- thread is descheduled when it has allocated this much since it was
+-- last scheduled, in addition to the timer set by the @-C@ RTS option.
+-- @0@ means the budget given by the @--alloc-slice@ RTS option, if any.
+-- The new budget applies from the thread's next timeslice.
+--
+-- @since 4.12.0.0
+setThreadAllocationSlice :: ThreadId -> Int -> IO ()
+setThreadAllocationSlice (ThreadId t) bytes
+  | bytes < 0 = errorWithoutStackTrace
+                  "setThreadAllocationSlice: negative budget"
+  | otherwise = rts_setThreadAllocationSlice t bytes
+
+-- | The allocation budget of a thread's timeslices, as set by
+-- 'setThreadAllocationSlice'.
+--
+-- @since 4.12.0.0
+threadAllocationSlice :: ThreadId -> IO Int
+threadAllocationSlice (ThreadId t) = rts_getThreadAllocationSlice t
+
+foreign import ccall unsafe "rts_setThreadAllocationSlice"
+  rts_setThreadAllocationSlice :: ThreadId# -> Int -> IO ()
+
+foreign import ccall unsafe "rts_getThreadAllocationSlice"
+  rts_getThreadAllocationSlice :: ThreadId# -> IO Int
+
 -- | Make a weak pointer to a 'ThreadId'.  It can be important to do
 -- this if you want to hold a reference to a 'ThreadId' while still
 -- allowing the thread to receive the @BlockedIndefinitely@ family of
@@ -46,6 +46,8 @@ import GHC.IO.Exception
 #if defined(mingw32_HOST_OS)
 import GHC.Windows
 import Data.Bool
+#else
+import GHC.IO.URing
 #endif
 
 import Foreign
@@ -494,11 +496,20 @@ uninterruptible while it is blocked in the foreign call.  See #2363.
 So now we always call fdReady() before reading, and if fdReady
 indicates that there's no data, we call threadWaitRead.
 
+NOTE [io_uring]:
+
+With +RTS --io-uring, when a read or write on a non-blocking FD would
+block, we hand the whole operation to the RTS's io_uring I/O manager
+(GHC.IO.URing) rather than waiting for the FD to become ready and trying
+again.  If the operation cannot be started, or the kernel fails it with
+EAGAIN (which it may do for an FD opened with O_NONBLOCK), we fall back
+to threadWaitRead/threadWaitWrite.
+
 -}
 
 readRawBufferPtr :: String -> FD -> Ptr Word8 -> Int -> CSize -> IO Int
 readRawBufferPtr loc !fd !buf !off !len
-  | isNonBlocking fd = unsafe_read -- unsafe is ok, it can't block
+  | isNonBlocking fd = if uringEnabled then uring_read else unsafe_read
   | otherwise    = do r <- throwErrnoIfMinus1 loc
                                 (unsafe_fdReady (fdFD fd) 0 0 0)
                       if r /= 0
@@ -511,6 +522,10 @@ readRawBufferPtr loc !fd !buf !off !len
     read        = if threaded then safe_read else unsafe_read
     unsafe_read = do_read (c_read (fdFD fd) (buf `plusPtr` off) len)
     safe_read   = do_read (c_safe_read (fdFD fd) (buf `plusPtr` off) len)
+    -- See NOTE [io_uring]
+    uring_read  = uringRetry loc unsafe_read
+                    (c_read (fdFD fd) (buf `plusPtr` off) len)
+                    (uringRead (fdFD fd) (buf `plusPtr` off) len (-1))
 
 -- return: -1 indicates EOF, >=0 is bytes read
 readRawBufferPtrNoBlock :: String -> FD -> Ptr Word8 -> Int -> CSize -> IO Int
@@ -531,7 +546,7 @@ readRawBufferPtrNoBlock loc !fd !buf !off !len
 
 writeRawBufferPtr :: String -> FD -> Ptr Word8 -> Int -> CSize -> IO CInt
 writeRawBufferPtr loc !fd !buf !off !len
-  | isNonBlocking fd = unsafe_write -- unsafe is ok, it can't block
+  | isNonBlocking fd = if uringEnabled then uring_write else unsafe_write
   | otherwise   = do r <- unsafe_fdReady (fdFD fd) 1 0 0
                      if r /= 0
                         then write
@@ -543,6 +558,10 @@ writeRawBufferPtr loc !fd !buf !off !len
     write         = if threaded then safe_write else unsafe_write
     unsafe_write  = do_write (c_write (fdFD fd) (buf `plusPtr` off) len)
     safe_write    = do_write (c_safe_write (fdFD fd) (buf `plusPtr` off) len)
+    -- See NOTE [io_uring]
+    uring_write   = uringRetry loc unsafe_write
+                      (c_write (fdFD fd) (buf `plusPtr` off) len)
+                      (uringWrite (fdFD fd) (buf `plusPtr` off) len (-1))
 
 writeRawBufferPtrNoBlock :: String -> FD -> Ptr Word8 -> Int -> CSize -> IO CInt
 writeRawBufferPtrNoBlock loc !fd !buf !off !len
@@ -562,6 +581,33 @@ writeRawBufferPtrNoBlock loc !fd !buf !off !len
 isNonBlocking :: FD -> Bool
 isNonBlocking fd = fdIsNonBlocking fd /= 0
 
+-- | @uringRetry loc fallback call uring@ makes the non-blocking system call
+-- @call@, and if it would block, does the operation with @uring@ instead.
+-- If @uring@ cannot start the operation, or it would block too, we run
+-- @fallback@.
+uringRetry :: (Integral a, Num b)
+           => String -> IO b -> IO a -> IO (Maybe Int) -> IO b
+uringRetry loc fallback call uring = loop
+  where
+    loop = do
+      r <- call
+      if r /= -1
+        then return (fromIntegral r)
+        else do
+          errno <- getErrno
+          if errno == eINTR then loop
+          else if errno /= eAGAIN && errno /= eWOULDBLOCK then throwErrno loc
+          else do
+            m <- uring
+            case m of
+              Nothing -> fallback
+              Just n | n >= 0       -> return (fromIntegral n)
+                     | err == eINTR -> loop
+                     | err == eAGAIN || err == eWOULDBLOCK -> fallback
+                     | otherwise    -> ioError (errnoToIOError loc err
+                                                  Nothing Nothing)
+                where err = Errno (fromIntegral (negate n))
+
 foreign import ccall unsafe "fdReady"
   unsafe_fdReady :: CInt -> CBool -> Int64 -> CBool -> IO CInt
 
@@ -0,0 +1,113 @@
+{-# LANGUAGE Trustworthy #-}
+{-# LANGUAGE NoImplicitPrelude #-}
+
+-----------------------------------------------------------------------------
+-- |
+-- Module      :  GHC.IO.URing
+-- Copyright   :  (c) The University of Glasgow, 2018
+-- License     :  see libraries/base/LICENSE
+--
+-- Maintainer  :  libraries@haskell.org
+-- Stability   :  internal
+-- Portability :  non-portable (Linux, threaded RTS)
+--
+-- I\/O through the RTS's io_uring I\/O manager, enabled by
+-- @+RTS --io-uring@.  Each operation is handed to the kernel as a whole,
+-- and the calling thread blocks until it has completed, instead of
+-- waiting for the descriptor to become ready and then making the system
+-- call itself.  See Note [io_uring I/O manager] in rts/posix/IOURing.c.
+--
+-- Every operation returns 'Nothing' if it could not be started, either
+-- because the io_uring I\/O manager is not in use or because too many
+-- operations are in flight; the caller should then fall back to the
+-- usual blocking operations.  Otherwise it returns the result of the
+-- system call: a non-negative value on success, or the negated @errno@
+-- value on failure.
+--
+-- If the calling thread receives an asynchronous exception, the operation
+-- is cancelled, and the exception is only rethrown once the kernel has
+-- finished with the buffer.
+--
+-- @since 4.12.0.0
+-----------------------------------------------------------------------------
+
+module GHC.IO.URing
+    ( uringEnabled
+    , uringRead
+    , uringWrite
+    , uringAccept
+    , uringTimeout
+    ) where
+
+import Foreign.C.Types (CInt(..), CSize(..))
+import Foreign.Ptr (Ptr)
+import GHC.Base
+import GHC.Int (Int64)
+import GHC.IO (mask, onException, uninterruptibleMask_)
+import GHC.MVar (MVar, newEmptyMVar, readMVar)
+import GHC.Stable (StablePtr, newStablePtr, freeStablePtr)
+import GHC.Word (Word8, Word64)
+
+-- | Whether the io_uring I\/O manager is in use.
+uringEnabled :: Bool
+uringEnabled = c_ioURingEnabled
+
+-- | @uringRead fd buf len offset@ reads up to @len@ bytes into @buf@, from
+-- @offset@ in the file, or from the current file position if @offset@ is
+-- -1.
+uringRead :: CInt -> Ptr Word8 -> CSize -> Int64 -> IO (Maybe Int)
+uringRead fd buf len off = request (c_ioURingRead fd buf len off)
+
+-- | @uringWrite fd buf len offset@ writes up to @len@ bytes from @buf@, at
+-- @offset@ in the file, or at the current file position if @offset@ is
+-- -1.
+uringWrite :: CInt -> Ptr Word8 -> CSize -> Int64 -> IO (Maybe Int)
+uringWrite fd buf len off = request (c_ioURingWrite fd buf len off)
+
+-- | @uringAccept fd addr addrlen flags@ is @accept4(fd, addr, addrlen,
+-- flags)@.
+uringAccept :: CInt -> Ptr a -> Ptr CInt -> CInt -> IO (Maybe Int)
+uringAccept fd addr addrlen flags =
+    request (c_ioURingAccept fd addr addrlen flags)
+
+-- | @uringTimeout us@ waits for @us@ microseconds.
+uringTimeout :: Word64 -> IO (Maybe Int)
+uringTimeout us = request (c_ioURingTimeout us)
+
+request :: (StablePtr (MVar Int) -> IO Word64) -> IO (Maybe Int)
+request start = mask $ \restore -> do
+    mv <- newEmptyMVar
+    sp <- newStablePtr mv
+    req <- start sp
+    if req == 0
+      then do freeStablePtr sp
+              return Nothing
+      else do
+        -- The RTS frees sp after filling mv.  We use readMVar, so that
+        -- the handler does not block if the exception arrives after the
+        -- operation has completed.
+        r <- restore (readMVar mv) `onException`
+               (do c_ioURingCancel req
+                   uninterruptibleMask_ (readMVar mv))
+        return (Just r)
+
+foreign import ccall unsafe "ioURingEnabled"
+    c_ioURingEnabled :: Bool
+
+foreign import ccall unsafe "ioURingRead"
+    c_ioURingRead :: CInt -> Ptr Word8 -> CSize -> Int64
+                  -> StablePtr (MVar Int) -> IO Word64
+
+foreign import ccall unsafe "ioURingWrite"
+    c_ioURingWrite :: CInt -> Ptr Word8 -> CSize -> Int64
+                   -> StablePtr (MVar Int) -> IO Word64
+
+foreign import ccall unsafe "ioURingAccept"
+    c_ioURingAccept :: CInt -> Ptr a -> Ptr CInt -> CInt
+                    -> StablePtr (MVar Int) -> IO Word64
+
+foreign import ccall unsafe "ioURingTimeout"
+    c_ioURingTimeout :: Word64 -> StablePtr (MVar Int) -> IO Word64
+
+foreign import ccall unsafe "ioURingCancel"
+    c_ioURingCancel :: Word64 -> IO ()
@@ -0,0 +1,341 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * Allocation-site sampling heap profiler
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+
+#include "AllocSample.h"
+#include "Capability.h"
+#include "Hash.h"
+#include "RtsUtils.h"
+#include "Trace.h"
+#include "sm/GC.h"
+
+#include <string.h>
+
+/*
+ * Note [Allocation-site sampling]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Heap profiling by anything finer than closure type (-hT) needs a
+ * profiling build, which is too expensive to run in production.  With
+ * +RTS --alloc-sample=<n> -l the RTS instead samples roughly one
+ * allocation in every <n> bytes, remembers the object and the code that
+ * allocated it, and at every major GC writes the estimated live bytes
+ * of each allocation site to the eventlog.
+ *
+ * Each Capability counts down cap->alloc_sample_countdown (0 means
+ * sampling is off) at two places:
+ *
+ *   - allocate(), allocateMightFail() and allocatePinned(), where the
+ *     site is the return address of the allocator, i.e. the primop or
+ *     RTS function asking for memory.
+ *
+ *   - stg_gc_noregs, when a heap check has failed and we move on to the
+ *     next nursery block.  Each block counts as BLOCK_SIZE bytes.  The
+ *     object sampled is the first one in the new block, which is
+ *     allocated by the code that failed the heap check as soon as it is
+ *     re-entered.  The site is that code, found from the frame the heap
+ *     check left on the stack (see heapCheckSite()).  If the thread is
+ *     descheduled before it retries, the first word of the block may
+ *     never be written; we recognise this at GC time because the sample
+ *     lies beyond bd->free.
+ *
+ * When the countdown runs out we record a sample: the object, the site,
+ * and a weight equal to the bytes allocated since the previous sample.
+ * Samples are weak: at every GC gcAllocSamples() drops the ones whose
+ * object has died and updates the others to point to the new copy (and
+ * threadAllocSamples() does the same for the compacting collector).
+ * After a major GC, the live bytes of a site are estimated as the sum
+ * of the weights of its surviving samples.
+ *
+ * Sites are code addresses.  With TABLES_NEXT_TO_CODE an info pointer is
+ * the address of the entry code, so the sites symbolise to the
+ * closures' symbols.  We look each site up once with libdw, if it is
+ * available, and fall back to printing the address.
+ *
+ * The samples are written with the heap profiler's eventlog events,
+ * under profile ID ALLOC_SITE_HEAP_PROFILE_ID and break-down type
+ * HEAP_PROF_BREAKDOWN_ALLOC_SITE, except that each one starts with an
+ * EVENT_ALLOC_SAMPLE_BEGIN event carrying the profile ID, rather than
+ * EVENT_HEAP_PROF_SAMPLE_BEGIN, so that tools can tell them from the
+ * censuses of the heap profiler.
+ */
+
+W_ alloc_sample_rate = 0;
+
+typedef struct {
+    StgClosure *obj;    // the sampled object; updated by each GC
+    StgPtr      site;   // code address of the allocating code
+    W_          weight; // bytes of allocation this sample stands for
+} AllocSampleEntry;
+
+typedef struct AllocSite_ {
+    StgPtr             site;
+    char              *label;
+    W_                 live;   // estimated live bytes at this census
+    struct AllocSite_ *link;
+} AllocSite;
+
+static AllocSampleEntry *samples = NULL;
+static uint32_t n_samples = 0;
+static uint32_t samples_size = 0;
+#define INIT_SAMPLES_SIZE 256
+
+// Maps a site to its AllocSite; all AllocSites are also on the list
+// alloc_sites, so that we can report them in a stable order.
+static HashTable *site_table = NULL;
+static AllocSite *alloc_sites = NULL;
+
+// Number of allocation-site censuses so far
+static StgInt alloc_sample_era = 0;
+
+#if defined(THREADED_RTS)
+static Mutex alloc_sample_mutex;
+#endif
+
+/* -----------------------------------------------------------------------------
+ * Initialisation / finalisation
+ * -------------------------------------------------------------------------- */
+
+void
+initAllocSampling (void)
+{
+    if (RtsFlags.ProfFlags.allocSampleBytes == 0) {
+        return;
+    }
+
+    if (RtsFlags.TraceFlags.tracing != TRACE_EVENTLOG) {
+        errorBelch("warning: --alloc-sample has no effect without -l");
+        return;
+    }
+
+    alloc_sample_rate = RtsFlags.ProfFlags.allocSampleBytes;
+
+    samples_size = INIT_SAMPLES_SIZE;
+    samples = stgMallocBytes(samples_size * sizeof(AllocSampleEntry),
+                             "initAllocSampling");
+    site_table = allocHashTable();
+
+#if defined(THREADED_RTS)
+    initMutex(&alloc_sample_mutex);
+#endif
+
+    traceHeapProfBegin(ALLOC_SITE_HEAP_PROFILE_ID);
+}
+
+static void
+freeAllocSite (void *site)
+{
+    stgFree(((AllocSite *)site)->label);
+    stgFree(site);
+}
+
+void
+exitAllocSampling (void)
+{
+    if (samples == NULL) {
+        return;
+    }
+
+    freeHashTable(site_table, freeAllocSite);
+    site_table = NULL;
+    alloc_sites = NULL;
+
+    stgFree(samples);
+    samples = NULL;
+    n_samples = 0;
+    samples_size = 0;
+
+#if defined(THREADED_RTS)
+    closeMutex(&alloc_sample_mutex);
+#endif
+}
+
+/* -----------------------------------------------------------------------------
+ * Taking samples
+ * -------------------------------------------------------------------------- */
+
+void
+allocSampleTake (Capability *cap, StgClosure *p, W_ bytes, StgPtr site)
+{
+    W_ weight;
+
+    // bytes >= cap->alloc_sample_countdown, so the weight is at least
+    // alloc_sample_rate.
+    weight = alloc_sample_rate - cap->alloc_sample_countdown + bytes;
+    cap->alloc_sample_countdown = alloc_sample_rate;
+
+    ACQUIRE_LOCK(&alloc_sample_mutex);
+    if (n_samples == samples_size) {
+        samples_size *= 2;
+        samples = stgReallocBytes(samples,
+                                  samples_size * sizeof(AllocSampleEntry),
+                                  "allocSampleTake");
+    }
+    samples[n_samples].obj    = p;
+    samples[n_samples].site   = site;
+    samples[n_samples].weight = weight;
+    n_samples++;
+    RELEASE_LOCK(&alloc_sample_mutex);
+}
+
+/* Find the code that failed a heap check, given the stack that the
+ * canned heap-check sequences in HeapStackCheck.cmm left behind.
+ */
+static StgPtr
+heapCheckSite (StgPtr sp)
+{
+    const StgInfoTable *info = (const StgInfoTable *)sp[0];
+
+    if (info == &stg_enter_info) {
+        // __stg_gc_enter_1: the closure being entered
+        return (StgPtr)UNTAG_CLOSURE((StgClosure *)sp[1])->header.info;
+    }
+    if (info == &stg_gc_fun_info) {
+        // __stg_gc_fun: the function being called
+        return (StgPtr)UNTAG_CLOSURE((StgClosure *)sp[2])->header.info;
+    }
+    if (info == &stg_ret_v_info || info == &stg_ret_p_info ||
+        info == &stg_ret_n_info || info == &stg_ret_f_info ||
+        info == &stg_ret_d_info || info == &stg_ret_l_info) {
+        // stg_gc_unpt_r1 and friends: the case continuation underneath
+        return (StgPtr)sp[stack_frame_sizeW((StgClosure *)sp)];
+    }
+    // stg_gc_noregs called directly from a continuation
+    return (StgPtr)info;
+}
+
+/* Called from stg_gc_noregs when it has moved on to a new nursery block
+ * and cap->alloc_sample_countdown is non-zero.
+ */
+void
+allocSampleHeapCheck (Capability *cap, StgPtr sp)
+{
+    if (cap->alloc_sample_countdown > BLOCK_SIZE) {
+        cap->alloc_sample_countdown -= BLOCK_SIZE;
+    } else {
+        allocSampleTake(cap, (StgClosure *)cap->r.rCurrentNursery->start,
+                        BLOCK_SIZE, heapCheckSite(sp));
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Reporting
+ * -------------------------------------------------------------------------- */
+
+static char *
+siteLabel (StgPtr site)
+{
+    char buf[256];
+    char *label;
+    LibdwSession *session;
+    Location loc;
+
+    session = libdwPoolTake();
+    if (session != NULL && libdwLookupLocation(session, &loc, site) == 0
+        && loc.function != NULL) {
+        if (loc.source_file != NULL) {
+            snprintf(buf, sizeof(buf), "%s (%s:%" FMT_Word32 ")",
+                     loc.function, loc.source_file, loc.lineno);
+        } else {
+            snprintf(buf, sizeof(buf), "%s", loc.function);
+        }
+    } else {
+        snprintf(buf, sizeof(buf), "%p", (void *)site);
+    }
+    if (session != NULL) {
+        libdwPoolRelease(session);
+    }
+
+    label = stgMallocBytes(strlen(buf) + 1, "siteLabel");
+    strcpy(label, buf);
+    return label;
+}
+
+static void
+reportAllocSites (void)
+{
+    AllocSite *s;
+    uint32_t i;
+
+    for (i = 0; i < n_samples; i++) {
+        s = lookupHashTable(site_table, (StgWord)samples[i].site);
+        if (s == NULL) {
+            s = stgMallocBytes(sizeof(AllocSite), "reportAllocSites");
+            s->site  = samples[i].site;
+            s->label = siteLabel(s->site);
+            s->live  = 0;
+            s->link  = alloc_sites;
+            alloc_sites = s;
+            insertHashTable(site_table, (StgWord)s->site, s);
+        }
+        s->live += samples[i].weight;
+    }
+
+    traceAllocSampleBegin(ALLOC_SITE_HEAP_PROFILE_ID, alloc_sample_era);
+    alloc_sample_era++;
+
+    for (s = alloc_sites; s != NULL; s = s->link) {
+        if (s->live != 0) {
+            traceHeapProfSampleString(ALLOC_SITE_HEAP_PROFILE_ID,
+                                      s->label, s->live);
+            s->live = 0;
+        }
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Garbage collection
+ *
+ * The samples are weak pointers: they do not keep their objects alive.
+ * gcAllocSamples() is called once the heap has been fully evacuated,
+ * before the compacting collector runs (like gcStableNameTable()).
+ * -------------------------------------------------------------------------- */
+
+void
+threadAllocSamples (evac_fn evac, void *user)
+{
+    uint32_t i;
+
+    for (i = 0; i < n_samples; i++) {
+        evac(user, &samples[i].obj);
+    }
+}
+
+void
+gcAllocSamples (bool major)
+{
+    StgClosure *p;
+    uint32_t i, j;
+
+    if (samples == NULL) {
+        return;
+    }
+
+    j = 0;
+    for (i = 0; i < n_samples; i++) {
+        p = samples[i].obj;
+        // A heap-check sample may point to a word that was never
+        // allocated; see Note [Allocation-site sampling].
+        if ((StgPtr)p >= Bdescr((StgPtr)p)->free) {
+            continue;
+        }
+        p = isAlive(p);
+        if (p != NULL) {
+            samples[j] = samples[i];
+            samples[j].obj = p;
+            j++;
+        }
+    }
+    n_samples = j;
+
+    if (major) {
+        reportAllocSites();
+    }
+}
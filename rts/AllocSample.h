@@ -0,0 +1,50 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * Allocation-site sampling heap profiler
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "Capability.h"
+#include "sm/GC.h" // for evac_fn below
+
+#include "BeginPrivate.h"
+
+// The profile ID used for allocation-site samples in the eventlog, to
+// tell them apart from the heap census (profile ID 0).
+#define ALLOC_SITE_HEAP_PROFILE_ID 1
+
+// Bytes of allocation between samples, or 0 if sampling is disabled.
+extern W_ alloc_sample_rate;
+
+void initAllocSampling     ( void );
+void exitAllocSampling     ( void );
+
+void allocSampleTake       ( Capability *cap, StgClosure *p, W_ bytes,
+                             StgPtr site );
+void allocSampleHeapCheck  ( Capability *cap, StgPtr sp );
+
+void threadAllocSamples    ( evac_fn evac, void *user );
+void gcAllocSamples        ( bool major );
+
+/* -----------------------------------------------------------------------------
+   allocSample(): called for every allocate()/allocatePinned().  Only
+   every alloc_sample_rate bytes do we leave the fast path.
+   -------------------------------------------------------------------------- */
+
+INLINE_HEADER void
+allocSample (Capability *cap, StgPtr p, W_ bytes, StgPtr site)
+{
+    if (RTS_UNLIKELY(cap->alloc_sample_countdown != 0)) {
+        if (cap->alloc_sample_countdown > bytes) {
+            cap->alloc_sample_countdown -= bytes;
+        } else {
+            allocSampleTake(cap, (StgClosure *)p, bytes, site);
+        }
+    }
+}
+
+#include "EndPrivate.h"
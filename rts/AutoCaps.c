@@ -0,0 +1,274 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * Scaling the number of enabled Capabilities with the load
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+
+#include "AutoCaps.h"
+#include "Capability.h"
+#include "GetTime.h"
+#include "RtsUtils.h"
+#include "Trace.h"
+
+#include <stdio.h>
+
+/*
+ * Note [Automatic capability scaling]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * With +RTS --auto-caps[=<secs>], an OS thread started by startAutoCaps()
+ * wakes up every <secs> seconds (default 1) and calls setNumCapabilities()
+ * to change the number of enabled Capabilities, between 1 and the number
+ * we started with (-N).  It looks at three things:
+ *
+ *   - The CPU quota of our cgroup, on Linux: cpu.max (cgroup v2), or
+ *     cpu.cfs_quota_us and cpu.cfs_period_us (cgroup v1), under
+ *     /sys/fs/cgroup.  A quota of q CPUs allows at most ceiling(q)
+ *     Capabilities.  Running more than that is worse than useless: the
+ *     kernel throttles the process, and every GC has to wait for the
+ *     Capabilities whose OS threads are not running.  Container
+ *     orchestrators change the quota at runtime, so we read it every time.
+ *
+ *   - The number of threads waiting on the run queues of the enabled
+ *     Capabilities.  If there are any, and the quota allows it, we enable
+ *     up to that many more Capabilities, at most doubling at once.
+ *
+ *   - The CPU time that the process has used since we last looked, as a
+ *     number of CPUs.  If no threads are waiting, and that number is at
+ *     least one less than the number of enabled Capabilities, then one of
+ *     them has been idle, and we disable one.
+ *
+ * So we grow quickly and shrink slowly.  A disabled Capability keeps its
+ * data structures, but does not take part in GC, and at the next GC its
+ * nursery is cut down to a single block (see resizeNurseriesEach()).  Its
+ * nursery is grown back at the first GC after it is enabled again.
+ *
+ * setNumCapabilities() stops all the Capabilities, so we only call it
+ * when the number changes.  The thread gets a bound Task the first time
+ * it calls setNumCapabilities(), like any foreign thread calling into
+ * Haskell, and frees it with hs_thread_done() when it is stopped.
+ *
+ * The child of forkProcess() has no copy of the thread, and may have
+ * auto_caps_lock in whatever state the thread left it.
+ * resetAutoCapsAfterFork() makes the lock and condition afresh and starts
+ * a new thread, so that stopAutoCaps() in the child's hs_exit() does not
+ * wait for a thread that does not exist.
+ *
+ * We read the run queue lengths without taking the Capabilities, which
+ * is fine for an estimate.  We only look at the enabled Capabilities,
+ * which always exist; a program that calls setNumCapabilities() itself
+ * with more than -N may replace the capabilities array under our feet,
+ * so --auto-caps should not be used by such programs.
+ */
+
+#if defined(THREADED_RTS)
+
+// The most Capabilities that we enable
+static uint32_t max_caps;
+
+// Protected by auto_caps_lock
+static Mutex     auto_caps_lock;
+static Condition auto_caps_cond;
+static bool      auto_caps_stop;
+static bool      auto_caps_running;
+
+#if defined(linux_HOST_OS)
+/* Read the first line of a file; false if we cannot */
+static bool
+readLine (const char *path, char *buf, int size)
+{
+    FILE *f;
+    bool ok;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    return ok;
+}
+#endif
+
+/* The number of Capabilities that the CPU quota of our cgroup allows, or
+ * 0 if there is no quota, or we cannot tell.
+ */
+static uint32_t
+quotaCaps (void)
+{
+#if defined(linux_HOST_OS)
+    char buf[64];
+    long long quota, period;
+
+    if (readLine("/sys/fs/cgroup/cpu.max", buf, sizeof(buf))) {
+        // cgroup v2: "<quota> <period>", or "max <period>"
+        if (sscanf(buf, "%lld %lld", &quota, &period) != 2) {
+            return 0;
+        }
+    } else if (readLine("/sys/fs/cgroup/cpu/cpu.cfs_quota_us",
+                        buf, sizeof(buf)) &&
+               sscanf(buf, "%lld", &quota) == 1 &&
+               readLine("/sys/fs/cgroup/cpu/cpu.cfs_period_us",
+                        buf, sizeof(buf)) &&
+               sscanf(buf, "%lld", &period) == 1) {
+        // cgroup v1: the quota is -1 if there is none
+    } else {
+        return 0;
+    }
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return (uint32_t)((quota + period - 1) / period);
+#else
+    return 0;
+#endif
+}
+
+/* Decide how many Capabilities to enable, given that n are enabled now,
+ * that the process has used busy CPUs on average since we last looked,
+ * and that queued threads are waiting to run.
+ */
+static uint32_t
+wantedCaps (uint32_t n, double busy, uint32_t queued)
+{
+    uint32_t limit, quota;
+
+    limit = max_caps;
+    quota = quotaCaps();
+    if (quota != 0 && quota < limit) {
+        limit = quota;
+    }
+
+    if (n > limit) {
+        return limit;
+    } else if (queued > 0) {
+        return stg_min(limit, n + stg_min(queued, n));
+    } else if (n > 1 && busy <= (double)(n - 1)) {
+        return n - 1;
+    } else {
+        return n;
+    }
+}
+
+static void* OSThreadProcAttr
+autoCapsThread (void *arg STG_UNUSED)
+{
+    Time cpu, last_cpu, now, last_now;
+    uint32_t i, n, want, queued;
+    double busy;
+
+    last_cpu = getProcessCPUTime();
+    last_now = getProcessElapsedTime();
+
+    ACQUIRE_LOCK(&auto_caps_lock);
+    while (!auto_caps_stop) {
+        timedWaitCondition(&auto_caps_cond, &auto_caps_lock,
+                           RtsFlags.ParFlags.autoCapsInterval);
+        if (auto_caps_stop) {
+            break;
+        }
+        RELEASE_LOCK(&auto_caps_lock);
+
+        cpu = getProcessCPUTime();
+        now = getProcessElapsedTime();
+        busy = (double)(cpu - last_cpu) / (double)stg_max(now - last_now, 1);
+
+        n = enabled_capabilities;
+        queued = 0;
+        for (i = 0; i < n; i++) {
+            queued += capabilities[i]->n_run_queue;
+        }
+
+        want = wantedCaps(n, busy, queued);
+        if (want != n) {
+            debugTrace(DEBUG_sched,
+                       "auto-caps: %d -> %d capabilities "
+                       "(%d threads waiting, %.2f CPUs busy)",
+                       n, want, queued, busy);
+            setNumCapabilities(want);
+            // don't count the sync in the next measurement
+            cpu = getProcessCPUTime();
+            now = getProcessElapsedTime();
+        }
+        last_cpu = cpu;
+        last_now = now;
+
+        ACQUIRE_LOCK(&auto_caps_lock);
+    }
+    RELEASE_LOCK(&auto_caps_lock);
+
+    hs_thread_done();
+
+    ACQUIRE_LOCK(&auto_caps_lock);
+    auto_caps_running = false;
+    signalCondition(&auto_caps_cond);
+    RELEASE_LOCK(&auto_caps_lock);
+    return NULL;
+}
+
+static void
+startAutoCapsThread (void)
+{
+    OSThreadId tid;
+
+    initMutex(&auto_caps_lock);
+    initCondition(&auto_caps_cond);
+    auto_caps_stop = false;
+    auto_caps_running = true;
+
+    if (createOSThread(&tid, "ghc_autocaps", autoCapsThread, NULL) != 0) {
+        sysErrorBelch("warning: --auto-caps: cannot create thread");
+        auto_caps_running = false;
+    }
+}
+
+void
+startAutoCaps (void)
+{
+    if (RtsFlags.ParFlags.autoCapsInterval == 0) {
+        return;
+    }
+
+    max_caps = enabled_capabilities;
+    startAutoCapsThread();
+}
+
+void
+resetAutoCapsAfterFork (void)
+{
+    if (RtsFlags.ParFlags.autoCapsInterval == 0) {
+        return;
+    }
+
+    // Don't close the old lock and condition: the parent's thread may
+    // have held them when we forked.
+    startAutoCapsThread();
+}
+
+void
+stopAutoCaps (void)
+{
+    if (RtsFlags.ParFlags.autoCapsInterval == 0) {
+        return;
+    }
+
+    // Wait for the thread to finish any setNumCapabilities() it has
+    // started; the Capabilities are still running at this point.
+    ACQUIRE_LOCK(&auto_caps_lock);
+    auto_caps_stop = true;
+    signalCondition(&auto_caps_cond);
+    while (auto_caps_running) {
+        waitCondition(&auto_caps_cond, &auto_caps_lock);
+    }
+    RELEASE_LOCK(&auto_caps_lock);
+
+    closeCondition(&auto_caps_cond);
+    closeMutex(&auto_caps_lock);
+}
+
+#endif /* THREADED_RTS */
@@ -0,0 +1,25 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * Scaling the number of enabled Capabilities with the load
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+#if defined(THREADED_RTS)
+
+// Start and stop the thread that calls setNumCapabilities() when
+// +RTS --auto-caps is on; see Note [Automatic capability scaling].
+void startAutoCaps (void);
+void stopAutoCaps  (void);
+
+// In the child of forkProcess(): the thread is gone, so start another
+void resetAutoCapsAfterFork (void);
+
+#endif
+
+#include "EndPrivate.h"
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include "sm/GC.h" // for evac_fn below
+
 #if !defined(THREADED_RTS)
 /* awaitEvent(bool wait)
  *
@@ -18,4 +20,16 @@
  */
 RTS_PRIVATE void awaitEvent(bool wait);  /* In posix/Select.c or
                                           * win32/AwaitEvent.c */
+
+#if defined(HAVE_SYS_EPOLL_H)
+/* Threads blocked in waitRead# and waitWrite#, when awaitEvent() uses
+ * epoll; see Note [awaitEvent with epoll].  In posix/Select.c.
+ */
+RTS_PRIVATE void blockOnFd         (StgTSO *tso);
+RTS_PRIVATE void removeBlockedOnFd (Capability *cap, StgTSO *tso);
+RTS_PRIVATE bool emptyBlockedOnFd  (void);
+RTS_PRIVATE void markBlockedOnFd   (evac_fn evac, void *user);
+RTS_PRIVATE void resetBlockedOnFd  (void);
+RTS_PRIVATE void freeBlockedOnFd   (void);
+#endif
 #endif
@@ -27,9 +27,11 @@
 #include "STM.h"
 #include "RtsUtils.h"
 #include "sm/OSMem.h"
+#include "AllocSample.h"
 
 #if !defined(mingw32_HOST_OS)
 #include "rts/IOManager.h" // for setIOManagerControlFd()
+#include "posix/IOURing.h"
 #endif
 
 #include <string.h>
@@ -91,6 +93,48 @@ globalWorkToDo (void)
 #endif
 
 #if defined(THREADED_RTS)
+
+// The most sparks findSpark() takes from another Capability at once.
+#define MAX_SPARK_STEAL_BATCH 32
+
+/* Steal up to half of robbed's sparks, but at least one.  The first
+ * useful spark is returned to be run; the others go into our own pool,
+ * where other idle Capabilities can steal them from us in turn.
+ *
+ * Taking more than one spark at a time matters when a single Capability
+ * generates all the sparks (a parallel map, say): otherwise every idle
+ * Capability contends on robbed's pool once for every spark it runs.
+ */
+static StgClosure *
+stealSparks (Capability *cap, Capability *robbed)
+{
+    StgClosurePtr spark, first;
+    long batch;
+
+    batch = (sparkPoolSize(robbed->sparks) + 1) / 2;
+    if (batch > MAX_SPARK_STEAL_BATCH) batch = MAX_SPARK_STEAL_BATCH;
+    if (batch < 1) batch = 1;
+
+    first = NULL;
+    while (batch > 0) {
+        spark = tryStealSpark(robbed->sparks);
+        if (spark == NULL) break;
+        cap->spark_stats.stolen++;
+        if (fizzledSpark(spark)) {
+            cap->spark_stats.fizzled++;
+            traceEventSparkFizzle(cap);
+            continue; // doesn't count towards the batch
+        }
+        if (first == NULL) {
+            first = spark;
+        } else {
+            pushSpark(cap, spark);
+        }
+        batch--;
+    }
+    return first;
+}
+
 StgClosure *
 findSpark (Capability *cap)
 {
@@ -106,6 +150,9 @@ findSpark (Capability *cap)
       return 0;
   }
 
+  // See Note [Spark overflow] in Sparks.c
+  refillSparkPool(cap);
+
   do {
       retry = false;
 
@@ -149,12 +196,7 @@ findSpark (Capability *cap)
           if (emptySparkPoolCap(robbed)) // nothing to steal here
               continue;
 
-          spark = tryStealSpark(robbed->sparks);
-          while (spark != NULL && fizzledSpark(spark)) {
-              cap->spark_stats.fizzled++;
-              traceEventSparkFizzle(cap);
-              spark = tryStealSpark(robbed->sparks);
-          }
+          spark = stealSparks(cap, robbed);
           if (spark == NULL && !emptySparkPoolCap(robbed)) {
               // we conflicted with another thread while trying to steal;
               // try again later.
@@ -191,6 +233,166 @@ anySparks (void)
     }
     return false;
 }
+
+/* -----------------------------------------------------------------------------
+ * Thread stealing
+ *
+ * Note [Thread stealing]
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * schedulePushWork() only runs when the owner of a Capability enters
+ * the scheduler, and only gives threads to Capabilities that it can
+ * grab at that moment.  To spread a burst of forkIO more quickly, a
+ * new thread that may migrate (it is not bound, and was not created by
+ * forkOn) goes on cap->steal_queue instead of the run queue.  This is
+ * a WSDeque, like the spark pool, so idle Capabilities can take threads
+ * from it without holding the victim Capability:
+ *
+ *   - pushStealableThread() pushes the thread and, if the queue was
+ *     empty, prods an idle Capability so that a worker wakes up and
+ *     calls stealThreads() from scheduleFindWork().
+ *
+ *   - stealThreads() takes up to half of the threads on the first
+ *     non-empty steal queue it finds and appends them to its own run
+ *     queue.  If there is still something left it prods another idle
+ *     Capability, so that the wakeups fan out.
+ *
+ *   - The owner moves anything that is left over to its own run queue
+ *     with reclaimStealableThreads() at every scheduleFindWork(), so a
+ *     thread spends at most one trip around the scheduler loop on the
+ *     steal queue, and the run queue keeps fork order.
+ *
+ * The only thing that stops us from using the run queue itself is that
+ * the owner of a Capability can do whatever it likes with the threads
+ * on its run queue.  A thread on the steal queue has no owner, which
+ * we record with TSO_STEALABLE.  Whoever takes it off the queue sets
+ * tso->cap first and then clears TSO_STEALABLE; a thief clears it with
+ * an atomic and, because it is writing to another Capability's thread.
+ *
+ * The one place that may need a stealable thread is throwTo().  It never
+ * waits for TSO_STEALABLE to be cleared, since it holds a Capability, and
+ * the Capability that would clear the flag may be waiting for it (to GC,
+ * say).  Instead, if the target is marked TSO_STEALABLE, throwToMsg():
+ *
+ *   - if tso->cap is its own Capability, takes the thread back with
+ *     reclaimStealableThreads() and starts over;
+ *
+ *   - if a thief took the thread first but has not yet cleared the flag,
+ *     sends the MSG_THROWTO to its own Capability, so that it looks again
+ *     once it next handles its inbox;
+ *
+ *   - otherwise sends the MSG_THROWTO to tso->cap, whose owner does the
+ *     same when it handles it, or forwards it to the thief.
+ *
+ * throwToMsg() must test TSO_STEALABLE *before* it reads tso->cap: reading
+ * them in the other order, it could see the old cap and then the cleared
+ * flag, and treat a stolen thread as its own.  It reads tso->cap again
+ * afterwards, and starts over if the thread moved in between.
+ *
+ * Nothing else touches a thread that has never run: wakeups ignore
+ * NotBlocked threads, and the GC stops all the Capabilities, so it can
+ * follow the steal queues like the spark pools (see markCapability()).
+ *
+ * Stealing obeys +RTS -qm, like schedulePushWork().  Each stolen thread
+ * is recorded with an EVENT_STEAL_THREAD event.
+ * -------------------------------------------------------------------------- */
+
+// The maximum number of threads on a Capability's steal queue; any
+// more go straight on the run queue.
+#define STEAL_QUEUE_SIZE 256
+
+static void
+wakeupIdleCapability (Capability *cap)
+{
+    Capability *cap0;
+    uint32_t i;
+
+    for (i = (cap->no + 1) % n_capabilities; i != cap->no;
+         i = (i + 1) % n_capabilities) {
+        cap0 = capabilities[i];
+        if (!cap0->disabled && cap0->running_task == NULL) {
+            prodCapability(cap0, cap->running_task);
+            return;
+        }
+    }
+}
+
+bool
+pushStealableThread (Capability *cap, StgTSO *tso)
+{
+    bool was_empty;
+
+    if (!RtsFlags.ParFlags.migrate || enabled_capabilities == 1
+        || tso->bound != NULL || tsoLocked(tso)) {
+        return false;
+    }
+
+    was_empty = emptyStealQueue(cap);
+
+    tso->flags |= TSO_STEALABLE;
+    if (!pushWSDeque(cap->steal_queue, tso)) {
+        tso->flags &= ~TSO_STEALABLE;
+        return false;
+    }
+
+    if (was_empty) {
+        wakeupIdleCapability(cap);
+    }
+    return true;
+}
+
+void
+reclaimStealableThreads (Capability *cap)
+{
+    StgTSO *t;
+
+    // stealWSDeque() takes the oldest thread first
+    while ((t = stealWSDeque(cap->steal_queue)) != NULL) {
+        t->flags &= ~TSO_STEALABLE;
+        appendToRunQueue(cap, t);
+    }
+}
+
+void
+stealThreads (Capability *cap)
+{
+    Capability *victim;
+    StgTSO *t;
+    long n;
+    uint32_t i, n_stolen;
+
+    if (!RtsFlags.ParFlags.migrate || cap->disabled
+        || n_capabilities == 1) {
+        return;
+    }
+
+    for (i = (cap->no + 1) % n_capabilities; i != cap->no;
+         i = (i + 1) % n_capabilities) {
+        victim = capabilities[i];
+        if (emptyStealQueue(victim)) continue;
+
+        n = (dequeElements(victim->steal_queue) + 1) / 2;
+        for (n_stolen = 0; n_stolen < n; n_stolen++) {
+            t = stealWSDeque_(victim->steal_queue);
+            if (t == NULL) break;
+            // See Note [Thread stealing] for the order of these writes
+            t->cap = cap;
+            write_barrier();
+            __sync_fetch_and_and(&t->flags, ~(StgWord32)TSO_STEALABLE);
+            appendToRunQueue(cap, t);
+            traceEventStealThread(cap, t, victim->no);
+        }
+
+        if (n_stolen > 0) {
+            debugTrace(DEBUG_sched, "cap %d: stole %d threads from cap %d",
+                       cap->no, n_stolen, victim->no);
+            if (!emptyStealQueue(victim)) {
+                wakeupIdleCapability(cap);
+            }
+            return;
+        }
+    }
+}
 #endif
 
 /* -----------------------------------------------------------------------------
@@ -254,6 +456,10 @@ initCapability (Capability *cap, uint32_t i)
     cap->run_queue_hd      = END_TSO_QUEUE;
     cap->run_queue_tl      = END_TSO_QUEUE;
     cap->n_run_queue       = 0;
+    for (g = 0; g < TSO_PRIO_CLASSES; g++) {
+        cap->run_queue_prio_tl[g] = END_TSO_QUEUE;
+        cap->run_queue_waits[g]   = 0;
+    }
 
 #if defined(THREADED_RTS)
     initMutex(&cap->lock);
@@ -268,17 +474,40 @@ initCapability (Capability *cap, uint32_t i)
     cap->inbox              = (Message*)END_TSO_QUEUE;
     cap->putMVars           = NULL;
     cap->sparks             = allocSparkPool();
+    cap->spark_overflow      = NULL;
+    cap->spark_overflow_hd   = 0;
+    cap->spark_overflow_tl   = 0;
+    cap->spark_overflow_size = 0;
+    cap->steal_queue        = newWSDeque(STEAL_QUEUE_SIZE);
     cap->spark_stats.created    = 0;
     cap->spark_stats.dud        = 0;
     cap->spark_stats.overflowed = 0;
+    cap->spark_stats.dropped    = 0;
     cap->spark_stats.converted  = 0;
     cap->spark_stats.gcd        = 0;
     cap->spark_stats.fizzled    = 0;
+    cap->spark_stats.stolen     = 0;
+    cap->ffi_reservation        = 0;
+    cap->ffi_calls              = 0;
+    cap->ffi_fast_returns       = 0;
+    cap->workers_created        = 0;
+    cap->workers_reused         = 0;
+    cap->workers_retired        = 0;
+    cap->msgs_wakeup            = 0;
+    cap->msgs_throwto           = 0;
+    cap->msgs_blackhole         = 0;
+    cap->inbox_batches          = 0;
+    cap->sync_stopped_at        = 0;
+    cap->sync_thread            = 0;
 #if !defined(mingw32_HOST_OS)
     cap->io_manager_control_wr_fd = -1;
 #endif
+#if defined(USE_IOURING)
+    initIOURing(cap);
+#endif
 #endif
     cap->total_allocated        = 0;
+    cap->alloc_sample_countdown = alloc_sample_rate;
 
     cap->f.stgEagerBlackholeInfo = (W_)&__stg_EAGER_BLACKHOLE_info;
     cap->f.stgGCEnter1     = (StgFunPtr)__stg_gc_enter_1;
@@ -298,9 +527,27 @@ initCapability (Capability *cap, uint32_t i)
     cap->weak_ptr_list_hd = NULL;
     cap->weak_ptr_list_tl = NULL;
     cap->free_tvar_watch_queues = END_STM_WATCH_QUEUE;
-    cap->free_trec_chunks = END_STM_CHUNK_LIST;
     cap->free_trec_headers = NO_TREC;
     cap->transaction_tokens = 0;
+    cap->stm_commits = 0;
+    cap->stm_aborts = 0;
+    cap->stm_ro_commits = 0;
+    cap->stm_ro_aborts = 0;
+    cap->stm_wakeups = 0;
+    cap->stm_wakeups_avoided = 0;
+    cap->stm_spurious_wakeups = 0;
+    cap->stm_spurious_reruns = 0;
+    cap->trec_indexes = NULL;
+    for (g = 0; g < TREC_CHUNK_CLASSES; g++) {
+        cap->free_trec_chunks[g] = END_STM_CHUNK_LIST;
+    }
+    cap->trec_slabs = NULL;
+    cap->trec_slab_free = NULL;
+    cap->trec_slab_end = NULL;
+    cap->trec_slab_bytes = 0;
+    cap->trec_chunk_hint = 0;
+    cap->stm_chunks_carved = 0;
+    cap->stm_chunks_reused = 0;
     cap->context_switch = 0;
     cap->pinned_object_block = NULL;
     cap->pinned_object_blocks = NULL;
@@ -459,7 +706,7 @@ void interruptAllCapabilities(void)
 
 /* ----------------------------------------------------------------------------
  * Give a Capability to a Task.  The task must currently be sleeping
- * on its condition variable.
+ * in waitForWakeup().
  *
  * Requires cap->lock (modifies cap->running_task).
  *
@@ -480,15 +727,8 @@ giveCapabilityToTask (Capability *cap USED_IF_DEBUG, Task *task)
     debugTrace(DEBUG_sched, "passing capability %d to %s %#" FMT_HexWord64,
                cap->no, task->incall->tso ? "bound task" : "worker",
                serialisableTaskId(task));
-    ACQUIRE_LOCK(&task->lock);
-    if (task->wakeup == false) {
-        task->wakeup = true;
-        // the wakeup flag is needed because signalCondition() doesn't
-        // flag the condition if the thread is already runniing, but we want
-        // it to be sticky.
-        signalCondition(&task->cond);
-    }
-    RELEASE_LOCK(&task->lock);
+    // See Note [Task wakeup] in Task.c
+    wakeTask(task);
 }
 #endif
 
@@ -515,6 +755,9 @@ releaseCapability_ (Capability* cap,
     ASSERT_RETURNING_TASKS(cap,task);
 
     cap->running_task = NULL;
+    // Before we look at the inbox; see Note [Lock-free inbox] in
+    // Messages.c
+    store_load_barrier();
 
     // Check to see whether a worker thread can be given
     // the go-ahead to return the result of an external call..
@@ -557,18 +800,24 @@ releaseCapability_ (Capability* cap,
         // is interrupted, we only create a worker task if there
         // are threads that need to be completed.  If the system is
         // shutting down, we never create a new worker.
+        // If we have reached --max-workers, we leave the Capability
+        // free; see Note [Worker pool].
         if (sched_state < SCHED_SHUTTING_DOWN || !emptyRunQueue(cap)) {
             debugTrace(DEBUG_sched,
                        "starting new worker on capability %d", cap->no);
-            startWorkerTask(cap);
-            return;
+            if (startWorkerTask(cap)) {
+                return;
+            }
         }
     }
 
     // If we have an unbound thread on the run queue, or if there's
     // anything else to do, give the Capability to a worker thread.
     if (always_wakeup ||
-        !emptyRunQueue(cap) || !emptyInbox(cap) ||
+        !emptyRunQueue(cap) || !emptyInbox(cap) || !emptyStealQueue(cap) ||
+#if defined(USE_IOURING)
+        ioURingNeedsWaiter(cap) ||
+#endif
         (!cap->disabled && !emptySparkPoolCap(cap)) || globalWorkToDo()) {
         if (cap->spare_workers) {
             giveCapabilityToTask(cap, cap->spare_workers);
@@ -612,7 +861,10 @@ enqueueWorker (Capability* cap USED_IF_THREADS)
     ASSERT(!task->stopped);
     ASSERT(task->worker);
 
-    if (cap->n_spare_workers < MAX_SPARE_WORKERS)
+    // See Note [Worker pool]
+    if (RtsFlags.ParFlags.workerIdleTimeout != 0 ||
+        cap->n_spare_workers < MAX_SPARE_WORKERS ||
+        cap->n_spare_workers < RtsFlags.ParFlags.minSpareWorkers)
     {
         task->next = cap->spare_workers;
         cap->spare_workers = task;
@@ -632,6 +884,194 @@ enqueueWorker (Capability* cap USED_IF_THREADS)
 
 #endif
 
+/* ----------------------------------------------------------------------------
+ * Note [Safe foreign call fast path]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * A safe foreign call releases the Capability in suspendThread(), and
+ * gets one back in resumeThread().  When the call is short and nobody
+ * else wants the Capability meanwhile, both are wasted: releasing may
+ * wake or even create a worker, which finds nothing to do and goes
+ * back to sleep, and returning goes through cap->lock again.
+ *
+ * So with --ffi-grace=<t> (default 20us, 0 disables) suspendThread()
+ * may instead keep the Capability, by setting cap->ffi_reservation to
+ * the calling Task and leaving cap->running_task alone.  Everyone else
+ * sees a Capability that is in use.  When the call returns,
+ * resumeThread() takes the Capability back with a single cas() on
+ * cap->ffi_reservation, without taking any lock.
+ *
+ * Any Task that wants the Capability while it is reserved, and would
+ * otherwise have waited for it or interrupted it, calls
+ * breakCapabilityReservation_() with cap->lock held.  If its cas()
+ * beats the returning Task, it now owns the Capability in place of the
+ * Task in the foreign call, and proceeds as if the Capability had been
+ * free; that Task then comes back through the usual slow path.  The
+ * places that do this are waitForCapability(), tryGrabCapability(),
+ * prodCapability() and shutdownCapability(), which between them cover
+ * the GC, other synchronisations and new in-calls, and sendMessage()
+ * and hs_try_putmvar(), which are how threads on other Capabilities
+ * and C code wake up threads on this one.
+ *
+ * Because nothing else watches the clock, we only reserve the
+ * Capability if the reservation is likely to be both cheap and short:
+ *
+ *   - there is nothing else to do on this Capability (see
+ *     tryReserveCapability()), so holding on to it delays nobody, and
+ *
+ *   - the calling Task's safe foreign calls take less than the grace
+ *     period on average (task->ffi_call_avg, a moving average updated by
+ *     resumeThread()).  Tasks making long calls, such as the I/O
+ *     manager waiting in epoll, release the Capability as before: a
+ *     reservation would almost always end up being broken, which costs
+ *     more than not making it.
+ *
+ * +RTS -s reports how many safe calls were made and how many of them
+ * returned through the fast path.
+ * ------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS)
+
+bool
+tryReserveCapability (Capability *cap, Task *task)
+{
+    Time grace = RtsFlags.ParFlags.ffiGracePeriod;
+
+    if (grace == 0 || (Time)task->ffi_call_avg >= grace) {
+        return false;
+    }
+
+    // Anything that would make releaseCapability_() hand the Capability
+    // to another Task means it is wanted elsewhere.
+    if (cap->disabled || cap->n_returning_tasks != 0 || pending_sync ||
+        !emptyRunQueue(cap) || !emptyStealQueue(cap) ||
+#if defined(USE_IOURING)
+        ioURingNeedsWaiter(cap) ||
+#endif
+        !emptySparkPoolCap(cap) || globalWorkToDo()) {
+        return false;
+    }
+
+    // Messages can arrive without cap->lock, so we must check for them
+    // after taking the reservation; see Note [Lock-free inbox] in
+    // Messages.c
+    cap->ffi_reservation = (StgWord)task;
+    store_load_barrier();
+    if (!emptyInbox(cap)) {
+        cap->ffi_reservation = 0;
+        return false;
+    }
+    return true;
+}
+
+bool
+breakCapabilityReservation_ (Capability *cap)
+{
+    StgWord task = cap->ffi_reservation;
+
+    if (task == 0) {
+        return false;
+    }
+    if (cas(&cap->ffi_reservation, task, 0) != task) {
+        // the Task got there first
+        return false;
+    }
+    debugTrace(DEBUG_sched, "breaking reservation of capability %d",
+               cap->no);
+    return true;
+}
+
+#endif
+
+/* ----------------------------------------------------------------------------
+ * Note [Worker pool]
+ * ~~~~~~~~~~~~~~~~~~
+ *
+ * Each Capability keeps the worker Tasks it has no work for on
+ * cap->spare_workers, asleep in waitForWorkerCapability().  By default
+ * it keeps at most MAX_SPARE_WORKERS of them, and a worker that finds
+ * the list full exits.  A burst of blocking safe foreign calls then
+ * costs an OS thread creation for every call beyond that, and an exit
+ * for every one of them when the burst is over.  Three flags change
+ * this:
+ *
+ *   --min-workers=<n>  startSpareWorkerTask() puts <n> workers on each
+ *                      Capability's spare_workers list when the
+ *                      Capability is created, and they never exit for
+ *                      being idle.
+ *
+ *   --worker-idle-timeout=<t>  Spare workers are no longer limited to
+ *                      MAX_SPARE_WORKERS.  Instead, a spare worker that
+ *                      has not been woken up for <t> removes itself from
+ *                      the list and exits (retireSpareWorker()), unless
+ *                      that would leave fewer than --min-workers.
+ *
+ *   --max-workers=<n>  startWorkerTask() fails when <n> workers exist
+ *                      already.  releaseCapability_() then leaves the
+ *                      Capability free, to be picked up by the next Task
+ *                      returning from a foreign call.  If all the workers
+ *                      are blocked in foreign calls waiting for Haskell
+ *                      code to run, the program deadlocks: the limit is a
+ *                      safety net, not a tuning knob.
+ *
+ * cap->workers_created, workers_reused (a spare worker woken up to run
+ * the Capability) and workers_retired count what happens to the pool;
+ * they are reported by +RTS -s and by EVENT_WORKER_COUNTERS.
+ * ------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS)
+
+/* A spare worker has been asleep for --worker-idle-timeout.  If it is
+ * still surplus to requirements, take it off the spare_workers list and
+ * exit; otherwise return, and keep waiting.
+ */
+static void
+retireSpareWorker (Task *task)
+{
+    Capability *cap;
+    Task *t, *prev;
+
+    ACQUIRE_LOCK(&task->lock);
+    cap = task->cap;
+    RELEASE_LOCK(&task->lock);
+
+    ACQUIRE_LOCK(&cap->lock);
+
+    // Workers are only woken up with cap->lock held, so if we have not
+    // been woken up yet, nobody can hand us the Capability now.
+    if (task->wakeup == TASK_WAKEUP_PENDING ||
+        cap->n_spare_workers <= RtsFlags.ParFlags.minSpareWorkers) {
+        RELEASE_LOCK(&cap->lock);
+        return;
+    }
+
+    prev = NULL;
+    for (t = cap->spare_workers; t != NULL && t != task; t = t->next) {
+        prev = t;
+    }
+    if (t == NULL) {
+        RELEASE_LOCK(&cap->lock);
+        return;
+    }
+    if (prev == NULL) {
+        cap->spare_workers = task->next;
+    } else {
+        prev->next = task->next;
+    }
+    task->next = NULL;
+    cap->n_spare_workers--;
+    cap->workers_retired++;
+
+    debugTrace(DEBUG_sched, "spare worker on capability %d idle, exiting",
+               cap->no);
+    // hold the lock until after workerTaskStop; c.f. enqueueWorker()
+    workerTaskStop(task);
+    RELEASE_LOCK(&cap->lock);
+    shutdownThread();
+}
+
+#endif
+
 /* ----------------------------------------------------------------------------
  * waitForWorkerCapability(task)
  *
@@ -641,16 +1081,24 @@ enqueueWorker (Capability* cap USED_IF_THREADS)
 
 #if defined(THREADED_RTS)
 
-static Capability * waitForWorkerCapability (Task *task)
+Capability * waitForWorkerCapability (Task *task)
 {
     Capability *cap;
+    Time timeout;
+
+    // See Note [Worker pool]
+    timeout = task->incall->tso == NULL
+        ? RtsFlags.ParFlags.workerIdleTimeout : 0;
 
     for (;;) {
+        if (!waitForWakeup(task, timeout)) {
+            retireSpareWorker(task);
+            continue;
+        }
+
+        // cap->lock not held; task->lock synchronises with migration
         ACQUIRE_LOCK(&task->lock);
-        // task->lock held, cap->lock not held
-        if (!task->wakeup) waitCondition(&task->cond, &task->lock);
         cap = task->cap;
-        task->wakeup = false;
         RELEASE_LOCK(&task->lock);
 
         debugTrace(DEBUG_sched, "woken up on capability %d", cap->no);
@@ -683,6 +1131,7 @@ static Capability * waitForWorkerCapability (Task *task)
             cap->spare_workers = task->next;
             task->next = NULL;
             cap->n_spare_workers--;
+            cap->workers_reused++;
         }
 
         cap->running_task = task;
@@ -690,6 +1139,7 @@ static Capability * waitForWorkerCapability (Task *task)
         break;
     }
 
+    traceCapHandoff(cap, task);
     return cap;
 }
 
@@ -711,11 +1161,11 @@ static Capability * waitForReturnCapability (Task *task)
     Capability *cap;
 
     for (;;) {
+        waitForWakeup(task, 0);
+
+        // cap->lock not held; task->lock synchronises with migration
         ACQUIRE_LOCK(&task->lock);
-        // task->lock held, cap->lock not held
-        if (!task->wakeup) waitCondition(&task->cond, &task->lock);
         cap = task->cap;
-        task->wakeup = false;
         RELEASE_LOCK(&task->lock);
 
         // now check whether we should wake up...
@@ -734,6 +1184,7 @@ static Capability * waitForReturnCapability (Task *task)
         RELEASE_LOCK(&cap->lock);
     }
 
+    traceCapHandoff(cap, task);
     return cap;
 }
 
@@ -798,8 +1249,8 @@ void waitForCapability (Capability **pCap, Task *task)
     debugTrace(DEBUG_sched, "returning; I want capability %d", cap->no);
 
     ACQUIRE_LOCK(&cap->lock);
-    if (!cap->running_task) {
-        // It's free; just grab it
+    if (!cap->running_task || breakCapabilityReservation_(cap)) {
+        // It's free (or only reserved); just grab it
         cap->running_task = task;
         RELEASE_LOCK(&cap->lock);
     } else {
@@ -872,7 +1323,7 @@ yieldCapability (Capability** pCap, Task *task, bool gcAllowed)
     debugTrace(DEBUG_sched, "giving up capability %d", cap->no);
 
     // We must now release the capability and wait to be woken up again.
-    task->wakeup = false;
+    clearWakeup(task);
 
     ACQUIRE_LOCK(&cap->lock);
 
@@ -954,7 +1405,7 @@ void
 prodCapability (Capability *cap, Task *task)
 {
     ACQUIRE_LOCK(&cap->lock);
-    if (!cap->running_task) {
+    if (!cap->running_task || breakCapabilityReservation_(cap)) {
         cap->running_task = task;
         releaseCapability_(cap,true);
     }
@@ -976,10 +1427,10 @@ bool
 tryGrabCapability (Capability *cap, Task *task)
 {
     int r;
-    if (cap->running_task != NULL) return false;
+    if (cap->running_task != NULL && cap->ffi_reservation == 0) return false;
     r = TRY_ACQUIRE_LOCK(&cap->lock);
     if (r != 0) return false;
-    if (cap->running_task != NULL) {
+    if (cap->running_task != NULL && !breakCapabilityReservation_(cap)) {
         RELEASE_LOCK(&cap->lock);
         return false;
     }
@@ -1029,7 +1480,7 @@ shutdownCapability (Capability *cap USED_IF_THREADS,
         debugTrace(DEBUG_sched,
                    "shutting down capability %d, attempt %d", cap->no, i);
         ACQUIRE_LOCK(&cap->lock);
-        if (cap->running_task) {
+        if (cap->running_task && !breakCapabilityReservation_(cap)) {
             RELEASE_LOCK(&cap->lock);
             debugTrace(DEBUG_sched, "not owner, yielding");
             yieldThread();
@@ -1094,6 +1545,7 @@ shutdownCapability (Capability *cap USED_IF_THREADS,
         }
 
         traceSparkCounters(cap);
+        traceWorkerCounters(cap);
         RELEASE_LOCK(&cap->lock);
         break;
     }
@@ -1123,10 +1575,16 @@ shutdownCapabilities(Task *task, bool safe)
 static void
 freeCapability (Capability *cap)
 {
+    stmFreeCapability(cap);
     stgFree(cap->mut_lists);
     stgFree(cap->saved_mut_lists);
 #if defined(THREADED_RTS)
     freeSparkPool(cap->sparks);
+    stgFree(cap->spark_overflow);
+    freeWSDeque(cap->steal_queue);
+#if defined(USE_IOURING)
+    freeIOURing(cap);
+#endif
 #endif
     traceCapsetRemoveCap(CAPSET_OSPROCESS_DEFAULT, cap->no);
     traceCapsetRemoveCap(CAPSET_CLOCKDOMAIN_DEFAULT, cap->no);
@@ -1157,11 +1615,25 @@ freeCapabilities (void)
    for which (c `mod` n == 0), for Capability c and thread n.
    ------------------------------------------------------------------------ */
 
+#if defined(THREADED_RTS)
+static void
+traverseStealQueue (evac_fn evac, void *user, Capability *cap)
+{
+    WSDeque *q = cap->steal_queue;
+    StgWord i;
+
+    for (i = q->top; i < q->bottom; i++) {
+        evac(user, (StgClosure **)(void *)&q->elements[i & q->moduloSize]);
+    }
+}
+#endif
+
 void
 markCapability (evac_fn evac, void *user, Capability *cap,
                 bool no_mark_sparks USED_IF_THREADS)
 {
     InCall *incall;
+    uint32_t i;
 
     // Each GC thread is responsible for following roots from the
     // Capability of the same number.  There will usually be the same
@@ -1170,6 +1642,9 @@ markCapability (evac_fn evac, void *user, Capability *cap,
     // thread's index plus a multiple of the number of GC threads.
     evac(user, (StgClosure **)(void *)&cap->run_queue_hd);
     evac(user, (StgClosure **)(void *)&cap->run_queue_tl);
+    for (i = 0; i < TSO_PRIO_CLASSES; i++) {
+        evac(user, (StgClosure **)(void *)&cap->run_queue_prio_tl[i]);
+    }
 #if defined(THREADED_RTS)
     evac(user, (StgClosure **)(void *)&cap->inbox);
 #endif
@@ -1179,6 +1654,8 @@ markCapability (evac_fn evac, void *user, Capability *cap,
     }
 
 #if defined(THREADED_RTS)
+    traverseStealQueue(evac, user, cap);
+
     if (!no_mark_sparks) {
         traverseSparkQueue (evac, user, cap);
     }
@@ -1200,7 +1677,7 @@ markCapabilities (evac_fn evac, void *user)
 #if defined(THREADED_RTS)
 bool checkSparkCountInvariant (void)
 {
-    SparkCounters sparks = { 0, 0, 0, 0, 0, 0 };
+    SparkCounters sparks = { 0, 0, 0, 0, 0, 0, 0, 0 };
     StgWord64 remaining = 0;
     uint32_t i;
 
@@ -1208,10 +1685,11 @@ bool checkSparkCountInvariant (void)
         sparks.created   += capabilities[i]->spark_stats.created;
         sparks.dud       += capabilities[i]->spark_stats.dud;
         sparks.overflowed+= capabilities[i]->spark_stats.overflowed;
+        sparks.dropped   += capabilities[i]->spark_stats.dropped;
         sparks.converted += capabilities[i]->spark_stats.converted;
         sparks.gcd       += capabilities[i]->spark_stats.gcd;
         sparks.fizzled   += capabilities[i]->spark_stats.fizzled;
-        remaining        += sparkPoolSize(capabilities[i]->sparks);
+        remaining        += sparkPoolSizeCap(capabilities[i]);
     }
 
     /* The invariant is
@@ -67,6 +67,13 @@ struct Capability_ {
     StgTSO *run_queue_tl;
     uint32_t n_run_queue;
 
+    // The run queue is ordered by priority class.  These are the last
+    // thread of each class on it (or END_TSO_QUEUE), and how many
+    // threads have been taken off it while each class was waiting.
+    // See Note [Priority classes] in Schedule.c.
+    StgTSO *run_queue_prio_tl[TSO_PRIO_CLASSES];
+    uint32_t run_queue_waits[TSO_PRIO_CLASSES];
+
     // Tasks currently making safe foreign calls.  Doubly-linked.
     // When returning, a task first acquires the Capability before
     // removing itself from this list, so that the GC can find all
@@ -112,6 +119,11 @@ struct Capability_ {
     // See Note [allocation accounting] in Storage.c
     W_ total_allocated;
 
+    // Bytes to allocate before the next allocation-site sample, or 0
+    // if sampling is off.  See Note [Allocation-site sampling] in
+    // AllocSample.c
+    W_ alloc_sample_countdown;
+
 #if defined(THREADED_RTS)
     // Worker Tasks waiting in the wings.  Singly-linked.
     Task *spare_workers;
@@ -121,7 +133,6 @@ struct Capability_ {
     //    running_task
     //    returning_tasks_{hd,tl}
     //    wakeup_queue
-    //    inbox
     //    putMVars
     Mutex lock;
 
@@ -134,9 +145,9 @@ struct Capability_ {
     Task *returning_tasks_tl;
     uint32_t n_returning_tasks;
 
-    // Messages, or END_TSO_QUEUE.
-    // Locks required: cap->lock
-    Message *inbox;
+    // Messages, or END_TSO_QUEUE.  Pushed onto with cas(), and emptied
+    // with xchg() by the owner; see Note [Lock-free inbox] in Messages.c
+    Message * volatile inbox;
 
     // putMVars are really messages, but they're allocated with malloc() so they
     // can't go on the inbox queue: the GC would get confused.
@@ -144,19 +155,96 @@ struct Capability_ {
 
     SparkPool *sparks;
 
+    // Sparks that did not fit in the spark pool, oldest first, in
+    // spark_overflow[spark_overflow_hd .. spark_overflow_tl-1].  Only the
+    // owner touches these.  See Note [Spark overflow] in Sparks.c
+    StgClosure **spark_overflow;
+    uint32_t spark_overflow_hd;
+    uint32_t spark_overflow_tl;
+    uint32_t spark_overflow_size;
+
+    // Newly created threads that other Capabilities may steal.  See
+    // Note [Thread stealing] in Capability.c
+    WSDeque *steal_queue;
+
     // Stats on spark creation/conversion
     SparkCounters spark_stats;
+
+    // The Task making a safe foreign call that may take this Capability
+    // straight back when the call returns, or 0.  Set by the Task
+    // itself with cap->lock held; cleared either by the Task with a
+    // cas(), or by another Task holding cap->lock.  See Note [Safe
+    // foreign call fast path] in Capability.c
+    volatile StgWord ffi_reservation;
+
+    // Safe foreign calls made on this Capability, and how many of them
+    // returned through the fast path
+    StgWord ffi_calls;
+    StgWord ffi_fast_returns;
+
+    // Workers started for this Capability, spare workers woken up to
+    // run it, and spare workers that exited after --worker-idle-timeout.
+    // See Note [Worker pool] in Capability.c
+    StgWord workers_created;
+    StgWord workers_reused;
+    StgWord workers_retired;
+
+    // Messages received, by type, and the number of times the inbox was
+    // emptied.  See Note [Lock-free inbox] in Messages.c
+    StgWord msgs_wakeup;
+    StgWord msgs_throwto;
+    StgWord msgs_blackhole;
+    StgWord inbox_batches;
+
+    // When this Capability stopped for the current sync (0 if it has
+    // not, or was idle), and the thread it was running when the sync
+    // started.  See Note [Time to stop] in Stats.c
+    Time sync_stopped_at;
+    StgThreadID sync_thread;
 #if !defined(mingw32_HOST_OS)
     // IO manager for this cap
     int io_manager_control_wr_fd;
+
+    // io_uring for this cap, or NULL.  See Note [io_uring I/O manager]
+    // in posix/IOURing.c
+    struct IOURing_ *io_uring;
 #endif
 #endif
 
     // Per-capability STM-related data
     StgTVarWatchQueue *free_tvar_watch_queues;
-    StgTRecChunk *free_trec_chunks;
     StgTRecHeader *free_trec_headers;
     uint32_t transaction_tokens;
+    // Top-level transactions that committed, and that failed to commit,
+    // by whether they wrote to a TVar.  See Note [Read-only commits] in
+    // STM.c
+    StgWord stm_commits;
+    StgWord stm_aborts;
+    StgWord stm_ro_commits;
+    StgWord stm_ro_aborts;
+    // Threads blocked in retry that commits on this Capability woke, and
+    // did not wake with +RTS --stm-precise-wakeup; threads on this
+    // Capability that were woken but went back to sleep at once, or ran
+    // their transaction again only to retry.  See Note [STM wakeups] in
+    // STM.c
+    StgWord stm_wakeups;
+    StgWord stm_wakeups_avoided;
+    StgWord stm_spurious_wakeups;
+    StgWord stm_spurious_reruns;
+    // TRec indexes built on this Capability since the last GC.
+    // See Note [TRec index] in STM.c
+    struct TRecIndex_ *trec_indexes;
+    // The TRec chunk arena: free chunks of each size class, the slabs
+    // they are carved from, and the size class that the next top-level
+    // transaction should start with.  See Note [TRec chunk arena] in STM.c
+    StgTRecChunk *free_trec_chunks[TREC_CHUNK_CLASSES];
+    struct TRecSlab_ *trec_slabs;
+    StgWord8 *trec_slab_free;
+    StgWord8 *trec_slab_end;
+    StgWord trec_slab_bytes;
+    uint32_t trec_chunk_hint;
+    StgWord stm_chunks_carved;
+    StgWord stm_chunks_reused;
 } // typedef Capability is defined in RtsAPI.h
   // We never want a Capability to overlap a cache line with anything
   // else, so round it up to a cache line size:
@@ -316,10 +404,34 @@ void prodCapability (Capability *cap, Task *task);
 //
 void prodAllCapabilities (void);
 
-// Attempt to gain control of a Capability if it is free.
+// Attempt to gain control of a Capability if it is free, or only
+// reserved for a safe foreign call.
 //
 bool tryGrabCapability (Capability *cap, Task *task);
 
+// Sleep until given a Capability, for a worker on cap->spare_workers or
+// a bound Task.  A spare worker may exit here instead; see Note [Worker
+// pool] in Capability.c
+//
+Capability * waitForWorkerCapability (Task *task);
+
+// Called by suspendThread() with cap->lock held: keep the Capability
+// for the calling Task during its foreign call, if nobody else is
+// likely to need it.  See Note [Safe foreign call fast path]
+//
+bool tryReserveCapability (Capability *cap, Task *task);
+
+// Called with cap->lock held by a Task that wants a Capability owned by
+// somebody else.  If it was only reserved for a safe foreign call, the
+// reservation is cancelled and the caller now owns the Capability.
+//
+bool breakCapabilityReservation_ (Capability *cap);
+
+// Called by resumeThread(): take back the Capability reserved by
+// tryReserveCapability(), unless the reservation has been broken.
+//
+INLINE_HEADER bool reclaimCapability (Capability *cap, Task *task);
+
 // Try to find a spark to run
 //
 StgClosure *findSpark (Capability *cap);
@@ -328,6 +440,22 @@ StgClosure *findSpark (Capability *cap);
 //
 bool anySparks (void);
 
+// Put a new thread on the steal queue rather than the run queue, if
+// it may be migrated.  Returns false if the caller should put it on
+// the run queue instead.
+//
+bool pushStealableThread (Capability *cap, StgTSO *tso);
+
+// Move any threads left on our steal queue to our run queue
+//
+void reclaimStealableThreads (Capability *cap);
+
+// Try to steal threads from other Capabilities' steal queues
+//
+void stealThreads (Capability *cap);
+
+INLINE_HEADER bool emptyStealQueue (Capability *cap);
+
 INLINE_HEADER bool emptySparkPoolCap (Capability *cap);
 INLINE_HEADER uint32_t sparkPoolSizeCap  (Capability *cap);
 INLINE_HEADER void    discardSparksCap  (Capability *cap);
@@ -339,6 +467,13 @@ INLINE_HEADER void    discardSparksCap  (Capability *cap);
 //
 extern void grabCapability (Capability **pCap);
 
+// releaseCapability_() is empty in the non-threaded RTS, so there is
+// nothing to save.
+//
+INLINE_HEADER bool tryReserveCapability (Capability *cap STG_UNUSED,
+                                         Task *task STG_UNUSED)
+{ return false; }
+
 #endif /* !THREADED_RTS */
 
 // Shut down all capabilities.
@@ -425,17 +560,32 @@ recordClosureMutated (Capability *cap, StgClosure *p)
 
 
 #if defined(THREADED_RTS)
+INLINE_HEADER bool
+reclaimCapability (Capability *cap, Task *task)
+{
+    return cas(&cap->ffi_reservation, (StgWord)task, 0) == (StgWord)task;
+}
+
+INLINE_HEADER bool
+emptyStealQueue (Capability *cap)
+{ return looksEmptyWSDeque(cap->steal_queue); }
+
 INLINE_HEADER bool
 emptySparkPoolCap (Capability *cap)
 { return looksEmpty(cap->sparks); }
 
+// Includes the overflow list, which emptySparkPoolCap() does not look
+// at: other Capabilities cannot steal from it.
 INLINE_HEADER uint32_t
 sparkPoolSizeCap (Capability *cap)
-{ return sparkPoolSize(cap->sparks); }
+{ return sparkPoolSize(cap->sparks)
+      + (cap->spark_overflow_tl - cap->spark_overflow_hd); }
 
 INLINE_HEADER void
 discardSparksCap (Capability *cap)
-{ discardSparks(cap->sparks); }
+{ discardSparks(cap->sparks);
+  cap->spark_overflow_hd = 0;
+  cap->spark_overflow_tl = 0; }
 #endif
 
 INLINE_HEADER void
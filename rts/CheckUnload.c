@@ -228,11 +228,6 @@ static void searchHeapBlocks (HashTable *addrs, bdescr *bd)
                 break;
             }
 
-            case TREC_CHUNK:
-                prim = true;
-                size = sizeofW(StgTRecChunk);
-                break;
-
             default:
                 barf("heapCensus, unknown object: %d", info->type);
             }
@@ -274,7 +269,15 @@ static void searchCostCentres (HashTable *addrs, CostCentreStack *ccs)
 // this (a) when you have called unloadObj(), and (b) at a major GC,
 // which is much more expensive than the traversal we're doing here.
 //
-void checkUnload (StgClosure *static_objects)
+// Are there any objects waiting for checkUnload() to decide whether they
+// can be freed?  The GC doesn't settle static objects while this is true;
+// see Note [Settled static objects] in Storage.h.
+bool pendingUnloads (void)
+{
+    return unloaded_objects != NULL;
+}
+
+void checkUnload (StgClosure *static_objects, StgClosure *settled_objects)
 {
   uint32_t g, n;
   HashTable *addrs;
@@ -304,6 +307,16 @@ void checkUnload (StgClosure *static_objects)
       link = *STATIC_LINK(info, p);
   }
 
+  // Settled static objects are not on static_objects either.  The GC
+  // doesn't settle anything while unloads are pending, but an object may
+  // have been unloaded while this GC was running.
+  for (p = settled_objects; p != END_OF_CAF_LIST; p = link) {
+      p = UNTAG_STATIC_LIST_PTR(p);
+      checkAddress(addrs, p);
+      info = get_itbl(p);
+      link = *STATIC_LINK(info, p);
+  }
+
   // CAFs on revertible_caf_list are not on static_objects
   for (p = (StgClosure*)revertible_caf_list;
        p != END_OF_CAF_LIST;
@@ -12,6 +12,7 @@
 
 #include "BeginPrivate.h"
 
-void checkUnload (StgClosure *static_objects);
+void checkUnload (StgClosure *static_objects, StgClosure *settled_objects);
+bool pendingUnloads (void);
 
 #include "EndPrivate.h"
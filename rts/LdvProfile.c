@@ -79,7 +79,6 @@ processHeapClosureForDead( const StgClosure *c )
     case BCO:
     case PRIM:
     case MUT_PRIM:
-    case TREC_CHUNK:
         return size;
 
         /*
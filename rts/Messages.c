@@ -17,13 +17,41 @@
 
 /* ----------------------------------------------------------------------------
    Send a message to another Capability
+
+   Note [Lock-free inbox]
+   ~~~~~~~~~~~~~~~~~~~~~~
+
+   cap->inbox is a stack of Messages that any Capability may push onto
+   and only the owner of cap pops from.  Senders push with a cas(), and
+   scheduleProcessInbox() takes the whole stack at once with an xchg(),
+   so neither needs cap->lock.
+
+   The catch is that a Capability must never go idle with messages in
+   its inbox.  If the sender finds that cap->running_task is non-NULL,
+   and the Capability is not reserved by a Task in a foreign call (see
+   Note [Safe foreign call fast path] in Capability.c), it is enough to
+   interrupt the Capability: its owner will come back to the scheduler
+   and find the message.  Otherwise the sender takes cap->lock and wakes
+   up the Capability as before.
+
+   For this to work, a sender that misses the Capability going idle must
+   be seen by the Task releasing it, and vice versa.  The sender writes
+   cap->inbox (cas() is a full barrier) and then reads cap->running_task
+   and cap->ffi_reservation; releaseCapability_() writes
+   cap->running_task = NULL, and tryReserveCapability() writes
+   cap->ffi_reservation, and both issue a store_load_barrier() before
+   reading cap->inbox.  So either the sender sees that the Capability is
+   free or reserved, or the releasing Task sees the message and keeps
+   the Capability busy.
+
+   Each Capability counts the messages it receives, by type, for +RTS -s.
    ------------------------------------------------------------------------- */
 
 #if defined(THREADED_RTS)
 
 void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
 {
-    ACQUIRE_LOCK(&to_cap->lock);
+    Message *head;
 
 #if defined(DEBUG)
     {
@@ -38,12 +66,24 @@ void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
     }
 #endif
 
-    msg->link = to_cap->inbox;
-    to_cap->inbox = msg;
+    do {
+        head = to_cap->inbox;
+        msg->link = head;
+    } while (cas((StgVolatilePtr)&to_cap->inbox, (StgWord)head,
+                 (StgWord)msg) != (StgWord)head);
 
     recordClosureMutated(from_cap,(StgClosure*)msg);
 
-    if (to_cap->running_task == NULL) {
+    // See Note [Lock-free inbox]
+    if (to_cap->running_task != NULL && to_cap->ffi_reservation == 0) {
+        interruptCapability(to_cap);
+        return;
+    }
+
+    ACQUIRE_LOCK(&to_cap->lock);
+
+    if (to_cap->running_task == NULL ||
+        breakCapabilityReservation_(to_cap)) {
         to_cap->running_task = myTask();
             // precond for releaseCapability_()
         releaseCapability_(to_cap,false);
@@ -75,6 +115,7 @@ loop:
         StgTSO *tso = ((MessageWakeup *)m)->tso;
         debugTraceCap(DEBUG_sched, cap, "message: try wakeup thread %ld",
                       (W_)tso->id);
+        cap->msgs_wakeup++;
         tryWakeupThread(cap, tso);
     }
     else if (i == &stg_MSG_THROWTO_info)
@@ -91,6 +132,7 @@ loop:
 
         debugTraceCap(DEBUG_sched, cap, "message: throwTo %ld -> %ld",
                       (W_)t->source->id, (W_)t->target->id);
+        cap->msgs_throwto++;
 
         ASSERT(t->source->why_blocked == BlockedOnMsgThrowTo);
         ASSERT(t->source->block_info.closure == (StgClosure *)m);
@@ -116,6 +158,7 @@ loop:
         uint32_t r;
         MessageBlackHole *b = (MessageBlackHole*)m;
 
+        cap->msgs_blackhole++;
         r = messageBlackHole(cap, b);
         if (r == 0) {
             tryWakeupThread(cap, b->tso);
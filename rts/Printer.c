@@ -415,10 +415,6 @@ printClosure( const StgClosure *obj )
                    (W_)((StgCompactNFData *)obj)->totalW * (W_)sizeof(W_));
         break;
 
-    case TREC_CHUNK:
-        debugBelch("TREC_CHUNK\n");
-        break;
-
     default:
             //barf("printClosure %d",get_itbl(obj)->type);
             debugBelch("*** printClosure: unknown type %d ****\n",
@@ -21,6 +21,7 @@
 #include "Arena.h"
 #include "Printer.h"
 #include "Trace.h"
+#include "sm/GC.h"
 #include "sm/GCThread.h"
 
 #include <fs_rts.h>
@@ -971,195 +972,341 @@ heapCensusCompactList(Census *census, bdescr *bd)
  * Code to perform a heap census.
  * -------------------------------------------------------------------------- */
 static void
-heapCensusChain( Census *census, bdescr *bd )
+heapCensusBlock( Census *census, bdescr *bd )
 {
     StgPtr p;
     const StgInfoTable *info;
     size_t size;
     bool prim;
 
-    for (; bd != NULL; bd = bd->link) {
-
-        // HACK: pretend a pinned block is just one big ARR_WORDS
-        // owned by CCS_PINNED.  These blocks can be full of holes due
-        // to alignment constraints so we can't traverse the memory
-        // and do a proper census.
-        if (bd->flags & BF_PINNED) {
-            StgClosure arr;
-            SET_HDR(&arr, &stg_ARR_WORDS_info, CCS_PINNED);
-            heapProfObject(census, &arr, bd->blocks * BLOCK_SIZE_W, true);
-            continue;
-        }
-
-        p = bd->start;
+    // HACK: pretend a pinned block is just one big ARR_WORDS
+    // owned by CCS_PINNED.  These blocks can be full of holes due
+    // to alignment constraints so we can't traverse the memory
+    // and do a proper census.
+    if (bd->flags & BF_PINNED) {
+        StgClosure arr;
+        SET_HDR(&arr, &stg_ARR_WORDS_info, CCS_PINNED);
+        heapProfObject(census, &arr, bd->blocks * BLOCK_SIZE_W, true);
+        return;
+    }
 
-        // When we shrink a large ARR_WORDS, we do not adjust the free pointer
-        // of the associated block descriptor, thus introducing slop at the end
-        // of the object.  This slop remains after GC, violating the assumption
-        // of the loop below that all slop has been eliminated (#11627).
-        // Consequently, we handle large ARR_WORDS objects as a special case.
-        if (bd->flags & BF_LARGE
-            && get_itbl((StgClosure *)p)->type == ARR_WORDS) {
-            size = arr_words_sizeW((StgArrBytes *)p);
-            prim = true;
-            heapProfObject(census, (StgClosure *)p, size, prim);
-            continue;
-        }
+    p = bd->start;
+
+    // When we shrink a large ARR_WORDS, we do not adjust the free pointer
+    // of the associated block descriptor, thus introducing slop at the end
+    // of the object.  This slop remains after GC, violating the assumption
+    // of the loop below that all slop has been eliminated (#11627).
+    // Consequently, we handle large ARR_WORDS objects as a special case.
+    if (bd->flags & BF_LARGE
+        && get_itbl((StgClosure *)p)->type == ARR_WORDS) {
+        size = arr_words_sizeW((StgArrBytes *)p);
+        prim = true;
+        heapProfObject(census, (StgClosure *)p, size, prim);
+        return;
+    }
 
-        while (p < bd->free) {
-            info = get_itbl((const StgClosure *)p);
-            prim = false;
+    while (p < bd->free) {
+        info = get_itbl((const StgClosure *)p);
+        prim = false;
 
-            switch (info->type) {
+        switch (info->type) {
 
-            case THUNK:
-                size = thunk_sizeW_fromITBL(info);
-                break;
+        case THUNK:
+            size = thunk_sizeW_fromITBL(info);
+            break;
 
-            case THUNK_1_1:
-            case THUNK_0_2:
-            case THUNK_2_0:
-                size = sizeofW(StgThunkHeader) + 2;
-                break;
+        case THUNK_1_1:
+        case THUNK_0_2:
+        case THUNK_2_0:
+            size = sizeofW(StgThunkHeader) + 2;
+            break;
 
-            case THUNK_1_0:
-            case THUNK_0_1:
-            case THUNK_SELECTOR:
-                size = sizeofW(StgThunkHeader) + 1;
-                break;
+        case THUNK_1_0:
+        case THUNK_0_1:
+        case THUNK_SELECTOR:
+            size = sizeofW(StgThunkHeader) + 1;
+            break;
 
-            case FUN:
-            case BLACKHOLE:
-            case BLOCKING_QUEUE:
-            case FUN_1_0:
-            case FUN_0_1:
-            case FUN_1_1:
-            case FUN_0_2:
-            case FUN_2_0:
-            case CONSTR:
-            case CONSTR_NOCAF:
-            case CONSTR_1_0:
-            case CONSTR_0_1:
-            case CONSTR_1_1:
-            case CONSTR_0_2:
-            case CONSTR_2_0:
-                size = sizeW_fromITBL(info);
-                break;
+        case FUN:
+        case BLACKHOLE:
+        case BLOCKING_QUEUE:
+        case FUN_1_0:
+        case FUN_0_1:
+        case FUN_1_1:
+        case FUN_0_2:
+        case FUN_2_0:
+        case CONSTR:
+        case CONSTR_NOCAF:
+        case CONSTR_1_0:
+        case CONSTR_0_1:
+        case CONSTR_1_1:
+        case CONSTR_0_2:
+        case CONSTR_2_0:
+            size = sizeW_fromITBL(info);
+            break;
 
-            case IND:
-                // Special case/Delicate Hack: INDs don't normally
-                // appear, since we're doing this heap census right
-                // after GC.  However, GarbageCollect() also does
-                // resurrectThreads(), which can update some
-                // blackholes when it calls raiseAsync() on the
-                // resurrected threads.  So we know that any IND will
-                // be the size of a BLACKHOLE.
-                size = BLACKHOLE_sizeW();
-                break;
+        case IND:
+            // Special case/Delicate Hack: INDs don't normally
+            // appear, since we're doing this heap census right
+            // after GC.  However, GarbageCollect() also does
+            // resurrectThreads(), which can update some
+            // blackholes when it calls raiseAsync() on the
+            // resurrected threads.  So we know that any IND will
+            // be the size of a BLACKHOLE.
+            size = BLACKHOLE_sizeW();
+            break;
 
-            case BCO:
-                prim = true;
-                size = bco_sizeW((StgBCO *)p);
-                break;
+        case BCO:
+            prim = true;
+            size = bco_sizeW((StgBCO *)p);
+            break;
 
-            case MVAR_CLEAN:
-            case MVAR_DIRTY:
-            case TVAR:
-            case WEAK:
-            case PRIM:
-            case MUT_PRIM:
-            case MUT_VAR_CLEAN:
-            case MUT_VAR_DIRTY:
-                prim = true;
-                size = sizeW_fromITBL(info);
-                break;
+        case MVAR_CLEAN:
+        case MVAR_DIRTY:
+        case TVAR:
+        case WEAK:
+        case PRIM:
+        case MUT_PRIM:
+        case MUT_VAR_CLEAN:
+        case MUT_VAR_DIRTY:
+            prim = true;
+            size = sizeW_fromITBL(info);
+            break;
 
-            case AP:
-                size = ap_sizeW((StgAP *)p);
-                break;
+        case AP:
+            size = ap_sizeW((StgAP *)p);
+            break;
 
-            case PAP:
-                size = pap_sizeW((StgPAP *)p);
-                break;
+        case PAP:
+            size = pap_sizeW((StgPAP *)p);
+            break;
 
-            case AP_STACK:
-                size = ap_stack_sizeW((StgAP_STACK *)p);
-                break;
+        case AP_STACK:
+            size = ap_stack_sizeW((StgAP_STACK *)p);
+            break;
 
-            case ARR_WORDS:
-                prim = true;
-                size = arr_words_sizeW((StgArrBytes*)p);
-                break;
+        case ARR_WORDS:
+            prim = true;
+            size = arr_words_sizeW((StgArrBytes*)p);
+            break;
 
-            case MUT_ARR_PTRS_CLEAN:
-            case MUT_ARR_PTRS_DIRTY:
-            case MUT_ARR_PTRS_FROZEN_CLEAN:
-            case MUT_ARR_PTRS_FROZEN_DIRTY:
-                prim = true;
-                size = mut_arr_ptrs_sizeW((StgMutArrPtrs *)p);
-                break;
+        case MUT_ARR_PTRS_CLEAN:
+        case MUT_ARR_PTRS_DIRTY:
+        case MUT_ARR_PTRS_FROZEN_CLEAN:
+        case MUT_ARR_PTRS_FROZEN_DIRTY:
+            prim = true;
+            size = mut_arr_ptrs_sizeW((StgMutArrPtrs *)p);
+            break;
 
-            case SMALL_MUT_ARR_PTRS_CLEAN:
-            case SMALL_MUT_ARR_PTRS_DIRTY:
-            case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
-            case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
-                prim = true;
-                size = small_mut_arr_ptrs_sizeW((StgSmallMutArrPtrs *)p);
-                break;
+        case SMALL_MUT_ARR_PTRS_CLEAN:
+        case SMALL_MUT_ARR_PTRS_DIRTY:
+        case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
+        case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
+            prim = true;
+            size = small_mut_arr_ptrs_sizeW((StgSmallMutArrPtrs *)p);
+            break;
 
-            case TSO:
-                prim = true;
+        case TSO:
+            prim = true;
 #if defined(PROFILING)
-                if (RtsFlags.ProfFlags.includeTSOs) {
-                    size = sizeofW(StgTSO);
-                    break;
-                } else {
-                    // Skip this TSO and move on to the next object
-                    p += sizeofW(StgTSO);
-                    continue;
-                }
-#else
+            if (RtsFlags.ProfFlags.includeTSOs) {
                 size = sizeofW(StgTSO);
                 break;
+            } else {
+                // Skip this TSO and move on to the next object
+                p += sizeofW(StgTSO);
+                continue;
+            }
+#else
+            size = sizeofW(StgTSO);
+            break;
 #endif
 
-            case STACK:
-                prim = true;
+        case STACK:
+            prim = true;
 #if defined(PROFILING)
-                if (RtsFlags.ProfFlags.includeTSOs) {
-                    size = stack_sizeW((StgStack*)p);
-                    break;
-                } else {
-                    // Skip this TSO and move on to the next object
-                    p += stack_sizeW((StgStack*)p);
-                    continue;
-                }
-#else
+            if (RtsFlags.ProfFlags.includeTSOs) {
                 size = stack_sizeW((StgStack*)p);
                 break;
+            } else {
+                // Skip this TSO and move on to the next object
+                p += stack_sizeW((StgStack*)p);
+                continue;
+            }
+#else
+            size = stack_sizeW((StgStack*)p);
+            break;
 #endif
 
-            case TREC_CHUNK:
-                prim = true;
-                size = sizeofW(StgTRecChunk);
-                break;
+        case COMPACT_NFDATA:
+            barf("heapCensus, found compact object in the wrong list");
+            break;
 
-            case COMPACT_NFDATA:
-                barf("heapCensus, found compact object in the wrong list");
-                break;
+        default:
+            barf("heapCensus, unknown object: %d", info->type);
+        }
 
-            default:
-                barf("heapCensus, unknown object: %d", info->type);
-            }
+        heapProfObject(census,(StgClosure*)p,size,prim);
 
-            heapProfObject(census,(StgClosure*)p,size,prim);
+        p += size;
+    }
+}
 
-            p += size;
+static void
+heapCensusChain( Census *census, bdescr *bd )
+{
+    for (; bd != NULL; bd = bd->link) {
+        heapCensusBlock(census, bd);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Parallel heap census
+ *
+ * A census follows a GC.  If that GC used several GC threads, they are
+ * idle while we do the census, so we let them help: the block chains of
+ * the heap are handed out CENSUS_CHUNK_BLOCKS blocks at a time, and each
+ * thread counts the closures it finds into a Census of its own.  When
+ * all the threads are done, the per-thread censuses are merged into
+ * censuses[era].
+ *
+ * The GC side of this (waking up the GC threads and waiting for them)
+ * is gcParallelHeapCensus() in sm/GC.c.
+ * -------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS)
+
+#define CENSUS_CHUNK_BLOCKS 32
+
+static SpinLock  census_sync;        // protects the fields below
+static bdescr ** census_chains;      // the chains to traverse
+static uint32_t  census_n_chains;
+static uint32_t  census_next_chain;  // next chain to start on
+static bdescr *  census_next_bd;     // next block in the current chain
+
+static Census *  thread_censuses;    // indexed by GC thread
+
+// Claim up to CENSUS_CHUNK_BLOCKS consecutive blocks of some chain.
+// Returns the first block, and the number of blocks in *n_blocks.
+static bdescr *
+claimCensusBlocks( uint32_t *n_blocks )
+{
+    bdescr *start, *bd;
+    uint32_t n;
+
+    ACQUIRE_SPIN_LOCK(&census_sync);
+    while (census_next_bd == NULL && census_next_chain < census_n_chains) {
+        census_next_bd = census_chains[census_next_chain++];
+    }
+    start = census_next_bd;
+    for (bd = start, n = 0; bd != NULL && n < CENSUS_CHUNK_BLOCKS; n++) {
+        bd = bd->link;
+    }
+    census_next_bd = bd;
+    RELEASE_SPIN_LOCK(&census_sync);
+
+    *n_blocks = n;
+    return start;
+}
+
+// Called on each GC thread taking part in a parallel census.
+static void
+heapCensusWorker( uint32_t thread_index )
+{
+    Census *census;
+    bdescr *bd;
+    uint32_t n;
+
+    census = &thread_censuses[thread_index];
+    initEra(census);
+
+    while ((bd = claimCensusBlocks(&n)) != NULL) {
+        for (; n > 0; n--, bd = bd->link) {
+            heapCensusBlock(census, bd);
+        }
+    }
+}
+
+// Add the counts of one census to another.
+static void
+mergeCensus( Census *to, Census *from )
+{
+    counter *c, *d;
+
+    to->prim     += from->prim;
+    to->not_used += from->not_used;
+    to->used     += from->used;
+
+    for (c = from->ctrs; c != NULL; c = c->next) {
+        d = lookupHashTable(to->hash, (StgWord)c->identity);
+        if (d == NULL) {
+            d = arenaAlloc(to->arena, sizeof(counter));
+            initLDVCtr(d);
+            insertHashTable(to->hash, (StgWord)c->identity, d);
+            d->identity = c->identity;
+            d->next = to->ctrs;
+            to->ctrs = d;
+        }
+#if defined(PROFILING)
+        if (RtsFlags.ProfFlags.bioSelector != NULL) {
+            d->c.ldv.prim     += c->c.ldv.prim;
+            d->c.ldv.not_used += c->c.ldv.not_used;
+            d->c.ldv.used     += c->c.ldv.used;
+        } else
+#endif
+        {
+            d->c.resid += c->c.resid;
+        }
+    }
+}
+
+static void
+heapCensusParallel( Capability *cap, Census *census )
+{
+    uint32_t g, n, i;
+
+    census_n_chains = 0;
+    census_chains =
+        stgMallocBytes(RtsFlags.GcFlags.generations * (2 + 3 * n_capabilities)
+                       * sizeof(bdescr *), "heapCensusParallel");
+
+    for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        census_chains[census_n_chains++] = generations[g].blocks;
+        census_chains[census_n_chains++] = generations[g].large_objects;
+        for (n = 0; n < n_capabilities; n++) {
+            gen_workspace *ws = &gc_threads[n]->gens[g];
+            census_chains[census_n_chains++] = ws->todo_bd;
+            census_chains[census_n_chains++] = ws->part_list;
+            census_chains[census_n_chains++] = ws->scavd_list;
+        }
+        // there are few compact objects, and each is only one object
+        heapCensusCompactList(census, generations[g].compact_objects);
+    }
+    census_next_chain = 0;
+    census_next_bd = NULL;
+    initSpinLock(&census_sync);
+
+    thread_censuses = stgCallocBytes(n_capabilities, sizeof(Census),
+                                     "heapCensusParallel");
+
+    gcParallelHeapCensus(cap, heapCensusWorker);
+
+    for (i = 0; i < n_capabilities; i++) {
+        if (thread_censuses[i].hash != NULL) {
+            mergeCensus(census, &thread_censuses[i]);
+            freeEra(&thread_censuses[i]);
         }
     }
+
+    stgFree(thread_censuses);
+    thread_censuses = NULL;
+    stgFree(census_chains);
+    census_chains = NULL;
 }
 
-void heapCensus (Time t)
+#endif /* THREADED_RTS */
+
+void heapCensus (Capability *cap, Time t)
 {
   uint32_t g, n;
   Census *census;
@@ -1171,7 +1318,12 @@ void heapCensus (Time t)
   // calculate retainer sets if necessary
 #if defined(PROFILING)
   if (doingRetainerProfiling()) {
-      retainerProfile();
+      if (!retainerProfile(cap)) {
+          // The traversal will be continued by the next GC, and the census
+          // done then.  See Note [Incremental retainer profiling] in
+          // RetainerProfile.c.
+          return;
+      }
   }
 #endif
 
@@ -1180,18 +1332,25 @@ void heapCensus (Time t)
 #endif
 
   // Traverse the heap, collecting the census info
-  for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
-      heapCensusChain( census, generations[g].blocks );
-      // Are we interested in large objects?  might be
-      // confusing to include the stack in a heap profile.
-      heapCensusChain( census, generations[g].large_objects );
-      heapCensusCompactList ( census, generations[g].compact_objects );
-
-      for (n = 0; n < n_capabilities; n++) {
-          ws = &gc_threads[n]->gens[g];
-          heapCensusChain(census, ws->todo_bd);
-          heapCensusChain(census, ws->part_list);
-          heapCensusChain(census, ws->scavd_list);
+#if defined(THREADED_RTS)
+  if (n_gc_threads > 1) {
+      heapCensusParallel(cap, census);
+  } else
+#endif
+  {
+      for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
+          heapCensusChain( census, generations[g].blocks );
+          // Are we interested in large objects?  might be
+          // confusing to include the stack in a heap profile.
+          heapCensusChain( census, generations[g].large_objects );
+          heapCensusCompactList ( census, generations[g].compact_objects );
+
+          for (n = 0; n < n_capabilities; n++) {
+              ws = &gc_threads[n]->gens[g];
+              heapCensusChain(census, ws->todo_bd);
+              heapCensusChain(census, ws->part_list);
+              heapCensusChain(census, ws->scavd_list);
+          }
       }
   }
 
@@ -10,7 +10,7 @@
 
 #include "BeginPrivate.h"
 
-void        heapCensus         (Time t);
+void        heapCensus         (Capability *cap, Time t);
 uint32_t    initHeapProfiling  (void);
 void        endHeapProfiling   (void);
 bool        strMatchesSelector (const char* str, const char* sel);
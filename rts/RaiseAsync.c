@@ -259,8 +259,47 @@ check_target:
     traceThreadStatus(DEBUG_sched, target);
 #endif
 
+#if defined(THREADED_RTS)
+    // Test TSO_STEALABLE before reading target->cap: a thief sets
+    // target->cap and only then clears the flag.  See Note [Thread
+    // stealing] in Capability.c
+    if (*(volatile StgWord32 *)&target->flags & TSO_STEALABLE) {
+        // The target is on a steal queue, where another Capability
+        // may take it at any moment.  We must not wait for that while
+        // we hold our Capability.  If it is on our queue, take it back;
+        // otherwise send the message to the owner, which does the same
+        // when it handles it.  If a thief is still in the middle of
+        // taking it, send the message to ourselves and look again when
+        // we next handle our inbox.
+        load_load_barrier();
+        target_cap = *(Capability * volatile *)&target->cap;
+        if (target_cap == cap) {
+            reclaimStealableThreads(cap);
+            if (*(volatile StgWord32 *)&target->flags & TSO_STEALABLE) {
+                throwToSendMsg(cap, cap, msg);
+                return THROWTO_BLOCKED;
+            }
+            load_load_barrier();
+            goto retry;
+        }
+        throwToSendMsg(cap, target_cap, msg);
+        return THROWTO_BLOCKED;
+    }
+    load_load_barrier();
+#endif
+
     target_cap = target->cap;
-    if (target->cap != cap) {
+
+#if defined(THREADED_RTS)
+    // The target may have been stolen since we tested the flag.
+    load_load_barrier();
+    if ((*(volatile StgWord32 *)&target->flags & TSO_STEALABLE)
+        || *(Capability * volatile *)&target->cap != target_cap) {
+        goto retry;
+    }
+#endif
+
+    if (target_cap != cap) {
         throwToSendMsg(cap, target_cap, msg);
         return THROWTO_BLOCKED;
     }
@@ -700,6 +739,12 @@ removeFromQueues(Capability *cap, StgTSO *tso)
   }
 
 #if !defined(THREADED_RTS)
+#if defined(HAVE_SYS_EPOLL_H)
+  case BlockedOnRead:
+  case BlockedOnWrite:
+      removeBlockedOnFd(cap, tso);
+      goto done;
+#else
   case BlockedOnRead:
   case BlockedOnWrite:
 #if defined(mingw32_HOST_OS)
@@ -713,9 +758,10 @@ removeFromQueues(Capability *cap, StgTSO *tso)
       abandonWorkRequest(tso->block_info.async_result->reqID);
 #endif
       goto done;
+#endif
 
   case BlockedOnDelay:
-        removeThreadFromQueue(cap, &sleeping_queue, tso);
+        removeSleepingThread(tso);
         goto done;
 #endif
 
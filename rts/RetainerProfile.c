@@ -33,6 +33,8 @@
 #include "StablePtr.h" /* markStablePtrTable */
 #include "StableName.h" /* rememberOldStableNameAddresses */
 #include "sm/Storage.h" // for END_OF_STATIC_LIST
+#include "sm/GC.h" // for gcParallelHeapCensus
+#include "sm/GCThread.h" // for n_gc_threads
 
 /* Note [What is a retainer?]
    ~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -46,6 +48,60 @@ file.
 */
 
 
+/* Note [Parallel retainer profiling]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+When the GC that precedes a retainer census used more than one thread, the
+traversal is shared between the GC threads, using the same mechanism as the
+parallel heap census (see gcParallelHeapCensus()).  The roots are first
+collected into an array (collectRetainerRoots()), and each thread claims
+roots from it one at a time and traverses everything reachable from the
+root with its own traverseState.
+
+The threads share the retainer sets, so we have to be careful with the rs
+field of a closure, which any number of threads might be updating:
+
+  * The field is only ever changed with cas(): see maybeInitRetainerSet()
+    and addRetainerConcurrently().  Whichever thread succeeds in adding a
+    retainer r to the set of c goes on to traverse the children of c with
+    r; a thread that finds r already there stops, just as the serial
+    traversal does.
+
+  * The serial traversal takes a shortcut: when c is first visited from a
+    non-retainer parent cp, c inherits the whole retainer set of cp.  That
+    relies on the traversal of cp having visited all of its children, which
+    another thread may not have done yet, so the parallel traversal always
+    adds just r.  The results are the same; the serial traversal just does
+    fewer set operations.
+
+  * singleton() and addElement() hash-cons the retainer sets in a table
+    that is shared by all threads (see RetainerSet.c), so a retainer set is
+    still identified by its address in the census.  There is nothing to
+    merge afterwards except the visit counters in each traverseState.
+
+Note [Incremental retainer profiling]
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Traversing a large heap can make a retainer census pause the program for a
+long time.  With +RTS --retainer-slice=<n>, one traversal is spread over
+several GCs instead: each GC that is due a census only traverses from roots
+until about <n> objects have been visited, and the census itself is done at
+the GC that finishes the traversal.  Until then the scheduler makes every
+GC a census GC (see scheduleNeedHeapProfile()), so that the traversal makes
+progress at each GC, just as with +RTS -i0.
+
+flip is not changed between the slices of a traversal, and the rs field is
+copied along with the closure by the GC, so the retainer sets computed by
+earlier slices stay valid.  The roots are collected afresh at each slice
+because they can move or change between GCs, and we start again from the
+first root each time: a root that has already been traversed is cheap to
+visit again, because its retainer is already in its retainer set and the
+traversal stops there straight away.
+
+The result is an approximation of the retainer sets at the time of the
+census: a closure that was allocated after the slice that traversed its
+retainers, and is only reachable through closures that have already been
+traversed, is not visited and does not appear in the census.
+*/
+
 /*
   Note: what to change in order to plug-in a new retainer profiling scheme?
     (1) type retainer in ../includes/StgRetainerProf.h
@@ -79,8 +135,6 @@ StgWord flip = 0;     // flip bit
 #define setRetainerSetToNull(c)   \
   (c)->header.prof.hp.rs = (RetainerSet *)((StgWord)NULL | flip)
 
-static void retainStack(StgClosure *, retainer, StgPtr, StgPtr);
-static void retainClosure(StgClosure *, StgClosure *, retainer);
 #if defined(DEBUG_RETAINER)
 static void belongToHeap(StgPtr p);
 #endif
@@ -153,6 +207,11 @@ typedef struct {
 } stackElement;
 
 /*
+  A traverseState holds everything a single thread needs to traverse the
+  heap: its traverse stack and its statistics.  There is one for the
+  serial traversal, and one per GC thread for the parallel traversal
+  (see Note [Parallel retainer profiling]).
+
   Invariants:
     firstStack points to the first block group.
     currentStack points to the block group currently being used.
@@ -168,18 +227,36 @@ typedef struct {
     When a current stack becomes empty, stackTop is set to point to
     the topmost element on the previous block group so as to satisfy
     the invariants described above.
- */
-static bdescr *firstStack = NULL;
-static bdescr *currentStack;
-static stackElement *stackBottom, *stackTop, *stackLimit;
 
-/*
   currentStackBoundary is used to mark the current stack chunk.
   If stackTop == currentStackBoundary, it means that the current stack chunk
   is empty. It is the responsibility of the user to keep currentStackBoundary
   valid all the time if it is to be employed.
  */
-static stackElement *currentStackBoundary;
+typedef struct {
+    bdescr *firstStack;
+    bdescr *currentStack;
+    stackElement *stackBottom, *stackTop, *stackLimit;
+    stackElement *currentStackBoundary;
+
+    // true if other threads may be traversing the heap at the same time
+    bool parallel;
+
+    uint32_t numObjectVisited;
+    uint32_t timesAnyObjectVisited;
+} traverseState;
+
+static traverseState serialTraverseState;
+
+#if defined(THREADED_RTS)
+// one per GC thread, only during a parallel traversal
+static traverseState *parallelTraverseStates = NULL;
+#endif
+
+static void retainStack(traverseState *, StgClosure *, retainer,
+                        StgPtr, StgPtr);
+static void retainClosure(traverseState *, StgClosure *, StgClosure *,
+                          retainer);
 
 /*
   stackSize records the current size of the stack.
@@ -206,13 +283,13 @@ static int stackSize, maxStackSize;
  *  currentStack->link == s.
  * -------------------------------------------------------------------------- */
 static INLINE void
-newStackBlock( bdescr *bd )
+newStackBlock( traverseState *ts, bdescr *bd )
 {
-    currentStack = bd;
-    stackTop     = (stackElement *)(bd->start + BLOCK_SIZE_W * bd->blocks);
-    stackBottom  = (stackElement *)bd->start;
-    stackLimit   = (stackElement *)stackTop;
-    bd->free     = (StgPtr)stackLimit;
+    ts->currentStack = bd;
+    ts->stackTop     = (stackElement *)(bd->start + BLOCK_SIZE_W * bd->blocks);
+    ts->stackBottom  = (stackElement *)bd->start;
+    ts->stackLimit   = (stackElement *)ts->stackTop;
+    bd->free         = (StgPtr)ts->stackLimit;
 }
 
 /* -----------------------------------------------------------------------------
@@ -221,30 +298,33 @@ newStackBlock( bdescr *bd )
  *   s->link == currentStack.
  * -------------------------------------------------------------------------- */
 static INLINE void
-returnToOldStack( bdescr *bd )
+returnToOldStack( traverseState *ts, bdescr *bd )
 {
-    currentStack = bd;
-    stackTop = (stackElement *)bd->free;
-    stackBottom = (stackElement *)bd->start;
-    stackLimit = (stackElement *)(bd->start + BLOCK_SIZE_W * bd->blocks);
-    bd->free = (StgPtr)stackLimit;
+    ts->currentStack = bd;
+    ts->stackTop = (stackElement *)bd->free;
+    ts->stackBottom = (stackElement *)bd->start;
+    ts->stackLimit = (stackElement *)(bd->start + BLOCK_SIZE_W * bd->blocks);
+    bd->free = (StgPtr)ts->stackLimit;
 }
 
 /* -----------------------------------------------------------------------------
  *  Initializes the traverse stack.
+ *  Note:
+ *    Several threads may be allocating stack blocks at once during a
+ *    parallel traversal, so we use the locking block allocator.
  * -------------------------------------------------------------------------- */
 static void
-initializeTraverseStack( void )
+initializeTraverseStack( traverseState *ts )
 {
-    if (firstStack != NULL) {
-        freeChain(firstStack);
+    if (ts->firstStack != NULL) {
+        freeChain_lock(ts->firstStack);
     }
 
-    firstStack = allocGroup(BLOCKS_IN_STACK);
-    firstStack->link = NULL;
-    firstStack->u.back = NULL;
+    ts->firstStack = allocGroup_lock(BLOCKS_IN_STACK);
+    ts->firstStack->link = NULL;
+    ts->firstStack->u.back = NULL;
 
-    newStackBlock(firstStack);
+    newStackBlock(ts, ts->firstStack);
 }
 
 /* -----------------------------------------------------------------------------
@@ -253,44 +333,61 @@ initializeTraverseStack( void )
  *   firstStack != NULL
  * -------------------------------------------------------------------------- */
 static void
-closeTraverseStack( void )
+closeTraverseStack( traverseState *ts )
 {
-    freeChain(firstStack);
-    firstStack = NULL;
+    freeChain_lock(ts->firstStack);
+    ts->firstStack = NULL;
 }
 
 /* -----------------------------------------------------------------------------
  * Returns true if the whole stack is empty.
  * -------------------------------------------------------------------------- */
 static INLINE bool
-isEmptyRetainerStack( void )
+isEmptyRetainerStack( traverseState *ts )
 {
-    return (firstStack == currentStack) && stackTop == stackLimit;
+    return (ts->firstStack == ts->currentStack) &&
+           ts->stackTop == ts->stackLimit;
 }
 
 /* -----------------------------------------------------------------------------
  * Returns size of stack
  * -------------------------------------------------------------------------- */
-W_
-retainerStackBlocks( void )
+static W_
+traverseStackBlocks( traverseState *ts )
 {
     bdescr* bd;
     W_ res = 0;
 
-    for (bd = firstStack; bd != NULL; bd = bd->link)
+    for (bd = ts->firstStack; bd != NULL; bd = bd->link)
       res += bd->blocks;
 
     return res;
 }
 
+W_
+retainerStackBlocks( void )
+{
+    W_ res = traverseStackBlocks(&serialTraverseState);
+#if defined(THREADED_RTS)
+    uint32_t i;
+
+    if (parallelTraverseStates != NULL) {
+        for (i = 0; i < n_capabilities; i++) {
+            res += traverseStackBlocks(&parallelTraverseStates[i]);
+        }
+    }
+#endif
+    return res;
+}
+
 /* -----------------------------------------------------------------------------
  * Returns true if stackTop is at the stack boundary of the current stack,
  * i.e., if the current stack chunk is empty.
  * -------------------------------------------------------------------------- */
 static INLINE bool
-isOnBoundary( void )
+isOnBoundary( traverseState *ts )
 {
-    return stackTop == currentStackBoundary;
+    return ts->stackTop == ts->currentStackBoundary;
 }
 
 /* -----------------------------------------------------------------------------
@@ -375,7 +472,8 @@ find_srt( stackPos *info )
  *  Note: SRTs are considered to  be children as well.
  * -------------------------------------------------------------------------- */
 static INLINE void
-push( StgClosure *c, retainer c_child_r, StgClosure **first_child )
+push( traverseState *ts, StgClosure *c, retainer c_child_r,
+      StgClosure **first_child )
 {
     stackElement se;
     bdescr *nbd;      // Next Block Descriptor
@@ -545,11 +643,6 @@ push( StgClosure *c, retainer c_child_r, StgClosure **first_child )
             return;     // no child
         break;
 
-    case TREC_CHUNK:
-        *first_child = (StgClosure *)((StgTRecChunk *)c)->prev_chunk;
-        se.info.next.step = 0;  // entry no.
-        break;
-
         // cannot appear
     case PAP:
     case AP:
@@ -573,27 +666,27 @@ push( StgClosure *c, retainer c_child_r, StgClosure **first_child )
         return;
     }
 
-    if (stackTop - 1 < stackBottom) {
+    if (ts->stackTop - 1 < ts->stackBottom) {
 #if defined(DEBUG_RETAINER)
         // debugBelch("push() to the next stack.\n");
 #endif
         // currentStack->free is updated when the active stack is switched
         // to the next stack.
-        currentStack->free = (StgPtr)stackTop;
+        ts->currentStack->free = (StgPtr)ts->stackTop;
 
-        if (currentStack->link == NULL) {
-            nbd = allocGroup(BLOCKS_IN_STACK);
+        if (ts->currentStack->link == NULL) {
+            nbd = allocGroup_lock(BLOCKS_IN_STACK);
             nbd->link = NULL;
-            nbd->u.back = currentStack;
-            currentStack->link = nbd;
+            nbd->u.back = ts->currentStack;
+            ts->currentStack->link = nbd;
         } else
-            nbd = currentStack->link;
+            nbd = ts->currentStack->link;
 
-        newStackBlock(nbd);
+        newStackBlock(ts, nbd);
     }
 
     // adjust stackTop (acutal push)
-    stackTop--;
+    ts->stackTop--;
     // If the size of stackElement was huge, we would better replace the
     // following statement by either a memcpy() call or a switch statement
     // on the type of the element. Currently, the size of stackElement is
@@ -604,7 +697,7 @@ push( StgClosure *c, retainer c_child_r, StgClosure **first_child )
     // This is caused by the fact that there are execution paths through the
     // large switch statement above where some cases do not initialize this
     // field. Is this really harmless? Can we avoid the warning?
-    *stackTop = se;
+    *ts->stackTop = se;
 
 #if defined(DEBUG_RETAINER)
     stackSize++;
@@ -628,7 +721,7 @@ push( StgClosure *c, retainer c_child_r, StgClosure **first_child )
  *    is called only within popOff() and nowhere else.
  * -------------------------------------------------------------------------- */
 static void
-popOffReal(void)
+popOffReal(traverseState *ts)
 {
     bdescr *pbd;    // Previous Block Descriptor
 
@@ -636,13 +729,13 @@ popOffReal(void)
     // debugBelch("pop() to the previous stack.\n");
 #endif
 
-    ASSERT(stackTop + 1 == stackLimit);
-    ASSERT(stackBottom == (stackElement *)currentStack->start);
+    ASSERT(ts->stackTop + 1 == ts->stackLimit);
+    ASSERT(ts->stackBottom == (stackElement *)ts->currentStack->start);
 
-    if (firstStack == currentStack) {
+    if (ts->firstStack == ts->currentStack) {
         // The stack is completely empty.
-        stackTop++;
-        ASSERT(stackTop == stackLimit);
+        ts->stackTop++;
+        ASSERT(ts->stackTop == ts->stackLimit);
 #if defined(DEBUG_RETAINER)
         stackSize--;
         if (stackSize > maxStackSize) maxStackSize = stackSize;
@@ -656,13 +749,13 @@ popOffReal(void)
 
     // currentStack->free is updated when the active stack is switched back
     // to the previous stack.
-    currentStack->free = (StgPtr)stackLimit;
+    ts->currentStack->free = (StgPtr)ts->stackLimit;
 
     // find the previous block descriptor
-    pbd = currentStack->u.back;
+    pbd = ts->currentStack->u.back;
     ASSERT(pbd != NULL);
 
-    returnToOldStack(pbd);
+    returnToOldStack(ts, pbd);
 
 #if defined(DEBUG_RETAINER)
     stackSize--;
@@ -675,17 +768,17 @@ popOffReal(void)
 }
 
 static INLINE void
-popOff(void) {
+popOff(traverseState *ts) {
 #if defined(DEBUG_RETAINER)
     // debugBelch("\tpopOff(): stackTop = 0x%x, currentStackBoundary = 0x%x\n", stackTop, currentStackBoundary);
 #endif
 
-    ASSERT(stackTop != stackLimit);
-    ASSERT(!isEmptyRetainerStack());
+    ASSERT(ts->stackTop != ts->stackLimit);
+    ASSERT(!isEmptyRetainerStack(ts));
 
     // <= (instead of <) is wrong!
-    if (stackTop + 1 < stackLimit) {
-        stackTop++;
+    if (ts->stackTop + 1 < ts->stackLimit) {
+        ts->stackTop++;
 #if defined(DEBUG_RETAINER)
         stackSize--;
         if (stackSize > maxStackSize) maxStackSize = stackSize;
@@ -697,7 +790,7 @@ popOff(void) {
         return;
     }
 
-    popOffReal();
+    popOffReal(ts);
 }
 
 /* -----------------------------------------------------------------------------
@@ -717,7 +810,7 @@ popOff(void) {
  *    is empty.
  * -------------------------------------------------------------------------- */
 static INLINE void
-pop( StgClosure **c, StgClosure **cp, retainer *r )
+pop( traverseState *ts, StgClosure **c, StgClosure **cp, retainer *r )
 {
     stackElement *se;
 
@@ -726,12 +819,12 @@ pop( StgClosure **c, StgClosure **cp, retainer *r )
 #endif
 
     do {
-        if (isOnBoundary()) {     // if the current stack chunk is depleted
+        if (isOnBoundary(ts)) {     // if the current stack chunk is depleted
             *c = NULL;
             return;
         }
 
-        se = stackTop;
+        se = ts->stackTop;
 
         switch (get_itbl(se->c)->type) {
             // two children (fixed), no SRT
@@ -740,7 +833,7 @@ pop( StgClosure **c, StgClosure **cp, retainer *r )
             *c = se->c->payload[1];
             *cp = se->c;
             *r = se->c_child_r;
-            popOff();
+            popOff(ts);
             return;
 
             // three children (fixed), no SRT
@@ -753,7 +846,7 @@ pop( StgClosure **c, StgClosure **cp, retainer *r )
                 // no popOff
             } else {
                 *c = ((StgMVar *)se->c)->value;
-                popOff();
+                popOff(ts);
             }
             *cp = se->c;
             *r = se->c_child_r;
@@ -767,39 +860,11 @@ pop( StgClosure **c, StgClosure **cp, retainer *r )
                 // no popOff
             } else {
                 *c = ((StgWeak *)se->c)->finalizer;
-                popOff();
-            }
-            *cp = se->c;
-            *r = se->c_child_r;
-            return;
-
-        case TREC_CHUNK: {
-            // These are pretty complicated: we have N entries, each
-            // of which contains 3 fields that we want to follow.  So
-            // we divide the step counter: the 2 low bits indicate
-            // which field, and the rest of the bits indicate the
-            // entry number (starting from zero).
-            TRecEntry *entry;
-            uint32_t entry_no = se->info.next.step >> 2;
-            uint32_t field_no = se->info.next.step & 3;
-            if (entry_no == ((StgTRecChunk *)se->c)->next_entry_idx) {
-                *c = NULL;
-                popOff();
-                return;
-            }
-            entry = &((StgTRecChunk *)se->c)->entries[entry_no];
-            if (field_no == 0) {
-                *c = (StgClosure *)entry->tvar;
-            } else if (field_no == 1) {
-                *c = entry->expected_value;
-            } else {
-                *c = entry->new_value;
+                popOff(ts);
             }
             *cp = se->c;
             *r = se->c_child_r;
-            se->info.next.step++;
             return;
-        }
 
         case TVAR:
         case CONSTR:
@@ -817,7 +882,7 @@ pop( StgClosure **c, StgClosure **cp, retainer *r )
         case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
             *c = find_ptrs(&se->info);
             if (*c == NULL) {
-                popOff();
+                popOff(ts);
                 break;
             }
             *cp = se->c;
@@ -869,7 +934,7 @@ pop( StgClosure **c, StgClosure **cp, retainer *r )
                 *r = se->c_child_r;
                 return;
             }
-            popOff();
+            popOff(ts);
             break;
 
             // no child (fixed), no SRT
@@ -947,7 +1012,17 @@ static INLINE void
 maybeInitRetainerSet( StgClosure *c )
 {
     if (!isRetainerSetFieldValid(c)) {
+#if defined(THREADED_RTS)
+        // Another thread may be visiting c at the same time, and may
+        // already have given it a retainer set; only reset the field if
+        // it still holds the stale value we saw.
+        StgWord old = (StgWord)RSET(c);
+        if (((old & 1) ^ flip) != 0) {
+            cas((StgVolatilePtr)&RSET(c), old, (StgWord)NULL | flip);
+        }
+#else
         setRetainerSetToNull(c);
+#endif
     }
 }
 
@@ -1032,8 +1107,6 @@ isRetainer( StgClosure *c )
     case BCO:
     case ARR_WORDS:
     case COMPACT_NFDATA:
-        // STM
-    case TREC_CHUNK:
         // immutable arrays
     case MUT_ARR_PTRS_FROZEN_CLEAN:
     case MUT_ARR_PTRS_FROZEN_DIRTY:
@@ -1103,13 +1176,50 @@ associate( StgClosure *c, RetainerSet *s )
     RSET(c) = (RetainerSet *)((StgWord)s | flip);
 }
 
+#if defined(THREADED_RTS)
+/* -----------------------------------------------------------------------------
+ *  Adds the retainer r to the retainer set of *c, when other threads may be
+ *  updating the retainer set of *c at the same time.  Returns false if r
+ *  was already a member, in which case the caller must not go on to the
+ *  children of *c.  Otherwise sets *first_visit to true iff *c had no
+ *  retainer set before.
+ *  See Note [Parallel retainer profiling].
+ * -------------------------------------------------------------------------- */
+static bool
+addRetainerConcurrently( StgClosure *c, retainer r, bool *first_visit )
+{
+    StgWord old;
+    RetainerSet *rs, *nrs;
+
+    while (true) {
+        maybeInitRetainerSet(c);
+        old = (StgWord)RSET(c);
+        rs = (RetainerSet *)(old ^ flip);
+
+        if (rs == NULL) {
+            nrs = singleton(r);
+        } else if (isMember(r, rs)) {
+            return false;
+        } else {
+            nrs = addElement(r, rs);
+        }
+
+        if (cas((StgVolatilePtr)&RSET(c), old, (StgWord)nrs | flip) == old) {
+            *first_visit = (rs == NULL);
+            return true;
+        }
+        // someone else changed the retainer set of c; try again
+    }
+}
+#endif
+
 /* -----------------------------------------------------------------------------
    Call retainClosure for each of the closures covered by a large bitmap.
    -------------------------------------------------------------------------- */
 
 static void
-retain_large_bitmap (StgPtr p, StgLargeBitmap *large_bitmap, uint32_t size,
-                     StgClosure *c, retainer c_child_r)
+retain_large_bitmap (traverseState *ts, StgPtr p, StgLargeBitmap *large_bitmap,
+                     uint32_t size, StgClosure *c, retainer c_child_r)
 {
     uint32_t i, b;
     StgWord bitmap;
@@ -1118,7 +1228,7 @@ retain_large_bitmap (StgPtr p, StgLargeBitmap *large_bitmap, uint32_t size,
     bitmap = large_bitmap->bitmap[b];
     for (i = 0; i < size; ) {
         if ((bitmap & 1) == 0) {
-            retainClosure((StgClosure *)*p, c, c_child_r);
+            retainClosure(ts, (StgClosure *)*p, c, c_child_r);
         }
         i++;
         p++;
@@ -1132,12 +1242,12 @@ retain_large_bitmap (StgPtr p, StgLargeBitmap *large_bitmap, uint32_t size,
 }
 
 static INLINE StgPtr
-retain_small_bitmap (StgPtr p, uint32_t size, StgWord bitmap,
-                     StgClosure *c, retainer c_child_r)
+retain_small_bitmap (traverseState *ts, StgPtr p, uint32_t size,
+                     StgWord bitmap, StgClosure *c, retainer c_child_r)
 {
     while (size > 0) {
         if ((bitmap & 1) == 0) {
-            retainClosure((StgClosure *)*p, c, c_child_r);
+            retainClosure(ts, (StgClosure *)*p, c, c_child_r);
         }
         p++;
         bitmap = bitmap >> 1;
@@ -1165,7 +1275,7 @@ retain_small_bitmap (StgPtr p, uint32_t size, StgWord bitmap,
  *    retainClosure() is invoked instead of evacuate().
  * -------------------------------------------------------------------------- */
 static void
-retainStack( StgClosure *c, retainer c_child_r,
+retainStack( traverseState *ts, StgClosure *c, retainer c_child_r,
              StgPtr stackStart, StgPtr stackEnd )
 {
     stackElement *oldStackBoundary;
@@ -1185,8 +1295,8 @@ retainStack( StgClosure *c, retainer c_child_r,
       record the current currentStackBoundary, which will be restored
       at the exit.
     */
-    oldStackBoundary = currentStackBoundary;
-    currentStackBoundary = stackTop;
+    oldStackBoundary = ts->currentStackBoundary;
+    ts->currentStackBoundary = ts->stackTop;
 
 #if defined(DEBUG_RETAINER)
     // debugBelch("retainStack() called: oldStackBoundary = 0x%x, currentStackBoundary = 0x%x\n", oldStackBoundary, currentStackBoundary);
@@ -1201,7 +1311,7 @@ retainStack( StgClosure *c, retainer c_child_r,
         switch(info->i.type) {
 
         case UPDATE_FRAME:
-            retainClosure(((StgUpdateFrame *)p)->updatee, c, c_child_r);
+            retainClosure(ts, ((StgUpdateFrame *)p)->updatee, c, c_child_r);
             p += sizeofW(StgUpdateFrame);
             continue;
 
@@ -1215,11 +1325,11 @@ retainStack( StgClosure *c, retainer c_child_r,
             bitmap = BITMAP_BITS(info->i.layout.bitmap);
             size   = BITMAP_SIZE(info->i.layout.bitmap);
             p++;
-            p = retain_small_bitmap(p, size, bitmap, c, c_child_r);
+            p = retain_small_bitmap(ts, p, size, bitmap, c, c_child_r);
 
         follow_srt:
             if (info->i.srt) {
-                retainClosure(GET_SRT(info),c,c_child_r);
+                retainClosure(ts, GET_SRT(info),c,c_child_r);
             }
             continue;
 
@@ -1227,11 +1337,11 @@ retainStack( StgClosure *c, retainer c_child_r,
             StgBCO *bco;
 
             p++;
-            retainClosure((StgClosure *)*p, c, c_child_r);
+            retainClosure(ts, (StgClosure *)*p, c, c_child_r);
             bco = (StgBCO *)*p;
             p++;
             size = BCO_BITMAP_SIZE(bco);
-            retain_large_bitmap(p, BCO_BITMAP(bco), size, c, c_child_r);
+            retain_large_bitmap(ts, p, BCO_BITMAP(bco), size, c, c_child_r);
             p += size;
             continue;
         }
@@ -1240,7 +1350,7 @@ retainStack( StgClosure *c, retainer c_child_r,
         case RET_BIG:
             size = GET_LARGE_BITMAP(&info->i)->size;
             p++;
-            retain_large_bitmap(p, GET_LARGE_BITMAP(&info->i),
+            retain_large_bitmap(ts, p, GET_LARGE_BITMAP(&info->i),
                                 size, c, c_child_r);
             p += size;
             // and don't forget to follow the SRT
@@ -1250,7 +1360,7 @@ retainStack( StgClosure *c, retainer c_child_r,
             StgRetFun *ret_fun = (StgRetFun *)p;
             const StgFunInfoTable *fun_info;
 
-            retainClosure(ret_fun->fun, c, c_child_r);
+            retainClosure(ts, ret_fun->fun, c, c_child_r);
             fun_info = get_fun_itbl(UNTAG_CONST_CLOSURE(ret_fun->fun));
 
             p = (P_)&ret_fun->payload;
@@ -1258,18 +1368,18 @@ retainStack( StgClosure *c, retainer c_child_r,
             case ARG_GEN:
                 bitmap = BITMAP_BITS(fun_info->f.b.bitmap);
                 size = BITMAP_SIZE(fun_info->f.b.bitmap);
-                p = retain_small_bitmap(p, size, bitmap, c, c_child_r);
+                p = retain_small_bitmap(ts, p, size, bitmap, c, c_child_r);
                 break;
             case ARG_GEN_BIG:
                 size = GET_FUN_LARGE_BITMAP(fun_info)->size;
-                retain_large_bitmap(p, GET_FUN_LARGE_BITMAP(fun_info),
+                retain_large_bitmap(ts, p, GET_FUN_LARGE_BITMAP(fun_info),
                                     size, c, c_child_r);
                 p += size;
                 break;
             default:
                 bitmap = BITMAP_BITS(stg_arg_bitmaps[fun_info->f.fun_type]);
                 size = BITMAP_SIZE(stg_arg_bitmaps[fun_info->f.fun_type]);
-                p = retain_small_bitmap(p, size, bitmap, c, c_child_r);
+                p = retain_small_bitmap(ts, p, size, bitmap, c, c_child_r);
                 break;
             }
             goto follow_srt;
@@ -1282,7 +1392,7 @@ retainStack( StgClosure *c, retainer c_child_r,
     }
 
     // restore currentStackBoundary
-    currentStackBoundary = oldStackBoundary;
+    ts->currentStackBoundary = oldStackBoundary;
 #if defined(DEBUG_RETAINER)
     // debugBelch("retainStack() finished: currentStackBoundary = 0x%x\n", currentStackBoundary);
 #endif
@@ -1297,7 +1407,8 @@ retainStack( StgClosure *c, retainer c_child_r,
  * ------------------------------------------------------------------------- */
 
 static INLINE StgPtr
-retain_PAP_payload (StgClosure *pap,    /* NOT tagged */
+retain_PAP_payload (traverseState *ts,
+                    StgClosure *pap,    /* NOT tagged */
                     retainer c_child_r, /* NOT tagged */
                     StgClosure *fun,    /* tagged */
                     StgClosure** payload, StgWord n_args)
@@ -1306,7 +1417,7 @@ retain_PAP_payload (StgClosure *pap,    /* NOT tagged */
     StgWord bitmap;
     const StgFunInfoTable *fun_info;
 
-    retainClosure(fun, pap, c_child_r);
+    retainClosure(ts, fun, pap, c_child_r);
     fun = UNTAG_CLOSURE(fun);
     fun_info = get_fun_itbl(fun);
     ASSERT(fun_info->i.type != PAP);
@@ -1316,22 +1427,22 @@ retain_PAP_payload (StgClosure *pap,    /* NOT tagged */
     switch (fun_info->f.fun_type) {
     case ARG_GEN:
         bitmap = BITMAP_BITS(fun_info->f.b.bitmap);
-        p = retain_small_bitmap(p, n_args, bitmap,
+        p = retain_small_bitmap(ts, p, n_args, bitmap,
                                 pap, c_child_r);
         break;
     case ARG_GEN_BIG:
-        retain_large_bitmap(p, GET_FUN_LARGE_BITMAP(fun_info),
+        retain_large_bitmap(ts, p, GET_FUN_LARGE_BITMAP(fun_info),
                             n_args, pap, c_child_r);
         p += n_args;
         break;
     case ARG_BCO:
-        retain_large_bitmap((StgPtr)payload, BCO_BITMAP(fun),
+        retain_large_bitmap(ts, (StgPtr)payload, BCO_BITMAP(fun),
                             n_args, pap, c_child_r);
         p += n_args;
         break;
     default:
         bitmap = BITMAP_BITS(stg_arg_bitmaps[fun_info->f.fun_type]);
-        p = retain_small_bitmap(p, n_args, bitmap, pap, c_child_r);
+        p = retain_small_bitmap(ts, p, n_args, bitmap, pap, c_child_r);
         break;
     }
     return p;
@@ -1354,7 +1465,8 @@ retain_PAP_payload (StgClosure *pap,    /* NOT tagged */
  *    *c0 can be TSO (as well as AP_STACK).
  * -------------------------------------------------------------------------- */
 static void
-retainClosure( StgClosure *c0, StgClosure *cp0, retainer r0 )
+retainClosure( traverseState *ts, StgClosure *c0, StgClosure *cp0,
+               retainer r0 )
 {
     // c = Current closure                          (possibly tagged)
     // cp = Current closure's Parent                (NOT tagged)
@@ -1384,7 +1496,7 @@ retainClosure( StgClosure *c0, StgClosure *cp0, retainer r0 )
 loop:
     //debugBelch("loop");
     // pop to (c, cp, r);
-    pop(&c, &cp, &r);
+    pop(ts, &c, &cp, &r);
 
     if (c == NULL) {
 #if defined(DEBUG_RETAINER)
@@ -1493,7 +1605,26 @@ inner_loop:
 
     // The above objects are ignored in computing the average number of times
     // an object is visited.
-    timesAnyObjectVisited++;
+    ts->timesAnyObjectVisited++;
+
+#if defined(THREADED_RTS)
+    if (ts->parallel) {
+        bool first_visit;
+
+        if (!addRetainerConcurrently(c, r, &first_visit)) {
+            goto loop;          // r was already in the set; nothing to do
+        }
+        if (first_visit) {
+            ts->numObjectVisited++;
+            c_child_r = isRetainer(c) ? getRetainerFrom(c) : r;
+        } else {
+            if (isRetainer(c))
+                goto loop;      // no need to process child
+            c_child_r = r;
+        }
+        goto process_children;
+    }
+#endif
 
     // If this is the first visit to c, initialize its retainer set.
     maybeInitRetainerSet(c);
@@ -1512,7 +1643,7 @@ inner_loop:
     // (c, cp, r, s, R_r) is available, so compute the retainer set for *c.
     if (retainerSetOfc == NULL) {
         // This is the first visit to *c.
-        numObjectVisited++;
+        ts->numObjectVisited++;
 
         if (s == NULL)
             associate(c, singleton(r));
@@ -1553,6 +1684,9 @@ inner_loop:
     // now, RSET() of all of *c, *cp, and *r is valid.
     // (c, c_child_r) are available.
 
+#if defined(THREADED_RTS)
+process_children:
+#endif
     // process child
 
     // Special case closures: we process these all in one go rather
@@ -1560,7 +1694,7 @@ inner_loop:
     // would be hard.
     switch (typeOfc) {
     case STACK:
-        retainStack(c, c_child_r,
+        retainStack(ts, c, c_child_r,
                     ((StgStack *)c)->sp,
                     ((StgStack *)c)->stack + ((StgStack *)c)->stack_size);
         goto loop;
@@ -1569,16 +1703,16 @@ inner_loop:
     {
         StgTSO *tso = (StgTSO *)c;
 
-        retainClosure((StgClosure*) tso->stackobj,           c, c_child_r);
-        retainClosure((StgClosure*) tso->blocked_exceptions, c, c_child_r);
-        retainClosure((StgClosure*) tso->bq,                 c, c_child_r);
-        retainClosure((StgClosure*) tso->trec,               c, c_child_r);
+        retainClosure(ts, (StgClosure*) tso->stackobj,           c, c_child_r);
+        retainClosure(ts, (StgClosure*) tso->blocked_exceptions, c, c_child_r);
+        retainClosure(ts, (StgClosure*) tso->bq,                 c, c_child_r);
+        retainClosure(ts, (StgClosure*) tso->trec,               c, c_child_r);
         if (   tso->why_blocked == BlockedOnMVar
                || tso->why_blocked == BlockedOnMVarRead
                || tso->why_blocked == BlockedOnBlackHole
                || tso->why_blocked == BlockedOnMsgThrowTo
             ) {
-            retainClosure(tso->block_info.closure, c, c_child_r);
+            retainClosure(ts, tso->block_info.closure, c, c_child_r);
         }
         goto loop;
     }
@@ -1586,36 +1720,36 @@ inner_loop:
     case BLOCKING_QUEUE:
     {
         StgBlockingQueue *bq = (StgBlockingQueue *)c;
-        retainClosure((StgClosure*) bq->link,           c, c_child_r);
-        retainClosure((StgClosure*) bq->bh,             c, c_child_r);
-        retainClosure((StgClosure*) bq->owner,          c, c_child_r);
+        retainClosure(ts, (StgClosure*) bq->link,           c, c_child_r);
+        retainClosure(ts, (StgClosure*) bq->bh,             c, c_child_r);
+        retainClosure(ts, (StgClosure*) bq->owner,          c, c_child_r);
         goto loop;
     }
 
     case PAP:
     {
         StgPAP *pap = (StgPAP *)c;
-        retain_PAP_payload(c, c_child_r, pap->fun, pap->payload, pap->n_args);
+        retain_PAP_payload(ts, c, c_child_r, pap->fun, pap->payload, pap->n_args);
         goto loop;
     }
 
     case AP:
     {
         StgAP *ap = (StgAP *)c;
-        retain_PAP_payload(c, c_child_r, ap->fun, ap->payload, ap->n_args);
+        retain_PAP_payload(ts, c, c_child_r, ap->fun, ap->payload, ap->n_args);
         goto loop;
     }
 
     case AP_STACK:
-        retainClosure(((StgAP_STACK *)c)->fun, c, c_child_r);
-        retainStack(c, c_child_r,
+        retainClosure(ts, ((StgAP_STACK *)c)->fun, c, c_child_r);
+        retainStack(ts, c, c_child_r,
                     (StgPtr)((StgAP_STACK *)c)->payload,
                     (StgPtr)((StgAP_STACK *)c)->payload +
                              ((StgAP_STACK *)c)->size);
         goto loop;
     }
 
-    push(c, c_child_r, &first_child);
+    push(ts, c, c_child_r, &first_child);
 
     // If first_child is null, c has no child.
     // If first_child is not null, the top stack element points to the next
@@ -1634,22 +1768,22 @@ inner_loop:
  *  Compute the retainer set for every object reachable from *tl.
  * -------------------------------------------------------------------------- */
 static void
-retainRoot(void *user STG_UNUSED, StgClosure **tl)
+retainRoot( traverseState *ts, StgClosure **tl )
 {
     StgClosure *c;
 
     // We no longer assume that only TSOs and WEAKs are roots; any closure can
     // be a root.
 
-    ASSERT(isEmptyRetainerStack());
-    currentStackBoundary = stackTop;
+    ASSERT(isEmptyRetainerStack(ts));
+    ts->currentStackBoundary = ts->stackTop;
 
     c = UNTAG_CLOSURE(*tl);
     maybeInitRetainerSet(c);
     if (c != &stg_END_TSO_QUEUE_closure && isRetainer(c)) {
-        retainClosure(c, c, getRetainerFrom(c));
+        retainClosure(ts, c, c, getRetainerFrom(c));
     } else {
-        retainClosure(c, c, CCS_SYSTEM);
+        retainClosure(ts, c, c, CCS_SYSTEM);
     }
 
     // NOT TRUE: ASSERT(isMember(getRetainerFrom(*tl), retainerSetOf(*tl)));
@@ -1658,21 +1792,41 @@ retainRoot(void *user STG_UNUSED, StgClosure **tl)
 }
 
 /* -----------------------------------------------------------------------------
- *  Compute the retainer set for each of the objects in the heap.
+ *  The roots of the current traversal, collected by collectRetainerRoots().
+ *  Threads claim them in order by incrementing nextRetainerRoot.
+ *  sliceVisits counts the objects visited so far in this slice of an
+ *  incremental traversal (see Note [Incremental retainer profiling]).
  * -------------------------------------------------------------------------- */
+static StgClosure **retainerRoots = NULL;
+static uint32_t numRetainerRoots = 0;
+static uint32_t retainerRootsSize = 0;
+static volatile StgWord nextRetainerRoot;
+static volatile StgWord sliceVisits;
+
+// true between the first and the last slice of a traversal
+static bool traversalInProgress = false;
+
+static void
+collectRetainerRoot( void *user STG_UNUSED, StgClosure **root )
+{
+    if (numRetainerRoots == retainerRootsSize) {
+        retainerRootsSize = stg_max(1024, 2 * retainerRootsSize);
+        retainerRoots = stgReallocBytes(retainerRoots,
+                                        retainerRootsSize * sizeof(StgClosure *),
+                                        "collectRetainerRoot");
+    }
+    retainerRoots[numRetainerRoots++] = *root;
+}
+
 static void
-computeRetainerSet( void )
+collectRetainerRoots( void )
 {
     StgWeak *weak;
     uint32_t g, n;
-    StgPtr ml;
-    bdescr *bd;
-#if defined(DEBUG_RETAINER)
-    RetainerSet *rtl;
-    RetainerSet tmpRetainerSet;
-#endif
 
-    markCapabilities(retainRoot, NULL); // for scheduler roots
+    numRetainerRoots = 0;
+
+    markCapabilities(collectRetainerRoot, NULL); // for scheduler roots
 
     // This function is called after a major GC, when key, value, and finalizer
     // all are guaranteed to be valid, or reachable.
@@ -1687,16 +1841,116 @@ computeRetainerSet( void )
     }
     for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
         for (weak = generations[g].weak_ptr_list; weak != NULL; weak = weak->link) {
-            // retainRoot((StgClosure *)weak);
-            retainRoot(NULL, (StgClosure **)&weak);
+            collectRetainerRoot(NULL, (StgClosure **)&weak);
         }
     }
 
     // Consider roots from the stable ptr table.
-    markStablePtrTable(retainRoot, NULL);
+    markStablePtrTable(collectRetainerRoot, NULL);
+}
+
+/* -----------------------------------------------------------------------------
+ *  Claim roots and compute the retainer sets of everything reachable from
+ *  them, until there are no roots left or the slice is over.
+ * -------------------------------------------------------------------------- */
+static void
+traverseRetainerRoots( traverseState *ts )
+{
+    const StgWord limit = RtsFlags.ProfFlags.retainerSliceSize;
+    StgWord i;
+    uint32_t visits;
+
+    while (limit == 0 || sliceVisits < limit) {
+        i = atomic_inc(&nextRetainerRoot, 1) - 1;
+        if (i >= numRetainerRoots) {
+            break;
+        }
+        visits = ts->timesAnyObjectVisited;
+        retainRoot(ts, &retainerRoots[i]);
+        if (limit != 0) {
+            atomic_inc(&sliceVisits, ts->timesAnyObjectVisited - visits);
+        }
+    }
+}
+
+#if defined(THREADED_RTS)
+/* -----------------------------------------------------------------------------
+ *  Run by each GC thread during a parallel traversal.
+ *  See Note [Parallel retainer profiling].
+ * -------------------------------------------------------------------------- */
+static void
+retainerTraverseWorker( uint32_t thread_index )
+{
+    traverseState *ts = &parallelTraverseStates[thread_index];
+
+    ts->parallel = true;
+    initializeTraverseStack(ts);
+    traverseRetainerRoots(ts);
+}
+#endif
+
+/* -----------------------------------------------------------------------------
+ *  Compute the retainer set for each of the objects in the heap.
+ *  Returns false if the traversal stopped before all the roots had been
+ *  traversed; see Note [Incremental retainer profiling].
+ * -------------------------------------------------------------------------- */
+static bool
+computeRetainerSet( Capability *cap USED_IF_THREADS )
+{
+    traverseState *ts;
+    uint32_t g, n;
+    StgPtr ml;
+    bdescr *bd;
+#if defined(DEBUG_RETAINER)
+    RetainerSet *rtl;
+    RetainerSet tmpRetainerSet;
+#endif
+
+    collectRetainerRoots();
     // Remember old stable name addresses.
     rememberOldStableNameAddresses ();
 
+    nextRetainerRoot = 0;
+    sliceVisits = 0;
+
+#if defined(THREADED_RTS)
+    if (n_gc_threads > 1) {
+        parallelTraverseStates =
+            stgCallocBytes(n_capabilities, sizeof(traverseState),
+                           "computeRetainerSet");
+
+        gcParallelHeapCensus(cap, retainerTraverseWorker);
+
+        for (n = 0; n < n_capabilities; n++) {
+            ts = &parallelTraverseStates[n];
+            if (ts->firstStack != NULL) {
+                closeTraverseStack(ts);
+            }
+            numObjectVisited += ts->numObjectVisited;
+            timesAnyObjectVisited += ts->timesAnyObjectVisited;
+        }
+
+        stgFree(parallelTraverseStates);
+        parallelTraverseStates = NULL;
+    } else
+#endif
+    {
+        ts = &serialTraverseState;
+        ts->numObjectVisited = 0;
+        ts->timesAnyObjectVisited = 0;
+
+        initializeTraverseStack(ts);
+        traverseRetainerRoots(ts);
+        closeTraverseStack(ts);
+
+        numObjectVisited += ts->numObjectVisited;
+        timesAnyObjectVisited += ts->timesAnyObjectVisited;
+    }
+
+    if (nextRetainerRoot < numRetainerRoots) {
+        return false;
+    }
+
     // The following code resets the rs field of each unvisited mutable
     // object (computing sumOfNewCostExtra and updating costArray[] when
     // debugging retainer profiler).
@@ -1741,6 +1995,8 @@ computeRetainerSet( void )
           }
         }
     }
+
+    return true;
 }
 
 /* -----------------------------------------------------------------------------
@@ -1820,13 +2076,16 @@ resetStaticObjectForRetainerProfiling( StgClosure *static_objects )
  * Perform retainer profiling.
  * N is the oldest generation being profilied, where the generations are
  * numbered starting at 0.
+ * Returns true if the retainer sets are ready for a census, or false if we
+ * only did one slice of an incremental traversal that has not finished yet
+ * (see Note [Incremental retainer profiling]).
  * Invariants:
  * Note:
  *   This function should be called only immediately after major garbage
  *   collection.
  * ------------------------------------------------------------------------- */
-void
-retainerProfile(void)
+bool
+retainerProfile(Capability *cap)
 {
 #if defined(DEBUG_RETAINER)
   uint32_t i;
@@ -1839,6 +2098,12 @@ retainerProfile(void)
 
   stat_startRP();
 
+  if (traversalInProgress) {
+    // This is the next slice of an incremental traversal, so we must not
+    // flip again.
+    goto traverse;
+  }
+
   // We haven't flipped the bit yet.
 #if defined(DEBUG_RETAINER)
   debugBelch("Before traversing:\n");
@@ -1889,17 +2154,23 @@ retainerProfile(void)
 
   /*
     We initialize the traverse stack each time the retainer profiling is
-    performed (because the traverse stack size varies on each retainer profiling
-    and this operation is not costly anyhow). However, we just refresh the
-    retainer sets.
+    performed, in computeRetainerSet() (because the traverse stack size
+    varies on each retainer profiling and this operation is not costly
+    anyhow). However, we just refresh the retainer sets.
    */
-  initializeTraverseStack();
 #if defined(DEBUG_RETAINER)
   initializeAllRetainerSet();
 #else
   refreshAllRetainerSet();
 #endif
-  computeRetainerSet();
+  traversalInProgress = true;
+
+traverse:
+  if (!computeRetainerSet(cap)) {
+    stat_pauseRP();
+    return false;
+  }
+  traversalInProgress = false;
 
 #if defined(DEBUG_RETAINER)
   debugBelch("After traversing:\n");
@@ -1941,7 +2212,6 @@ retainerProfile(void)
 #endif
 
   // post-processing
-  closeTraverseStack();
 #if defined(DEBUG_RETAINER)
   closeAllRetainerSet();
 #else
@@ -1955,6 +2225,18 @@ retainerProfile(void)
     maxCStackSize, maxStackSize,
 #endif
     (double)timesAnyObjectVisited / numObjectVisited);
+
+  return true;
+}
+
+/* -----------------------------------------------------------------------------
+ * Returns true if an incremental traversal has been started but not
+ * finished, so that the next GC should do a census to continue it.
+ * ------------------------------------------------------------------------- */
+bool
+retainerProfilePending( void )
+{
+    return traversalInProgress;
 }
 
 /* -----------------------------------------------------------------------------
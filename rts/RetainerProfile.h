@@ -17,7 +17,8 @@
 
 void initRetainerProfiling ( void );
 void endRetainerProfiling  ( void );
-void retainerProfile       ( void );
+bool retainerProfile       ( Capability *cap );
+bool retainerProfilePending( void );
 void resetStaticObjectForRetainerProfiling( StgClosure *static_objects );
 
 // flip is either 1 or 0, changed at the beginning of retainerProfile()
@@ -28,6 +28,15 @@ static Arena *arena;            // arena in which we store retainer sets
 
 static int nextId;              // id of next retainer set
 
+#if defined(THREADED_RTS)
+// Taken when creating a retainer set, which several threads may try to do
+// at once during a parallel traversal (see Note [Parallel retainer
+// profiling] in RetainerProfile.c).  Looking up a set takes no lock: a new
+// set is filled in before it is linked into hashTable[], and sets are never
+// unlinked during a traversal.
+static SpinLock rs_sync;
+#endif
+
 /* -----------------------------------------------------------------------------
  * rs_MANY is a distinguished retainer set, such that
  *
@@ -70,6 +79,10 @@ initializeAllRetainerSet(void)
     for (i = 0; i < HASH_TABLE_SIZE; i++)
         hashTable[i] = NULL;
     nextId = 2;   // Initial value must be positive, 2 is MANY.
+
+#if defined(THREADED_RTS)
+    initSpinLock(&rs_sync);
+#endif
 }
 
 /* -----------------------------------------------------------------------------
@@ -100,6 +113,20 @@ closeAllRetainerSet(void)
     arenaFree(arena);
 }
 
+/* -----------------------------------------------------------------------------
+ *  Finds a singleton retainer set, or returns NULL if there is none.
+ * -------------------------------------------------------------------------- */
+STATIC_INLINE RetainerSet *
+findSingleton(retainer r, StgWord hk)
+{
+    RetainerSet *rs;
+
+    for (rs = hashTable[hash(hk)]; rs != NULL; rs = rs->link)
+        if (rs->num == 1 &&  rs->element[0] == r) return rs;    // found it
+
+    return NULL;
+}
+
 /* -----------------------------------------------------------------------------
  *  Finds or creates if needed a singleton retainer set.
  * -------------------------------------------------------------------------- */
@@ -110,8 +137,19 @@ singleton(retainer r)
     StgWord hk;
 
     hk = hashKeySingleton(r);
-    for (rs = hashTable[hash(hk)]; rs != NULL; rs = rs->link)
-        if (rs->num == 1 &&  rs->element[0] == r) return rs;    // found it
+    rs = findSingleton(r, hk);
+    if (rs != NULL) return rs;
+
+    ACQUIRE_SPIN_LOCK(&rs_sync);
+
+#if defined(THREADED_RTS)
+    // Another thread may have created it since we looked.
+    rs = findSingleton(r, hk);
+    if (rs != NULL) {
+        RELEASE_SPIN_LOCK(&rs_sync);
+        return rs;
+    }
+#endif
 
     // create it
     rs = arenaAlloc( arena, sizeofRetainerSet(1) );
@@ -122,11 +160,54 @@ singleton(retainer r)
     rs->element[0] = r;
 
     // The new retainer set is placed at the head of the linked list.
+    write_barrier();
     hashTable[hash(hk)] = rs;
 
+    RELEASE_SPIN_LOCK(&rs_sync);
+
     return rs;
 }
 
+/* -----------------------------------------------------------------------------
+ *  Finds the retainer set *rs augmented with r, or returns NULL if there
+ *  is none.  nl is the number of retainers in *rs less than r, and hk is
+ *  the hash key of the augmented set.
+ * -------------------------------------------------------------------------- */
+static RetainerSet *
+findAddElement(retainer r, RetainerSet *rs, uint32_t nl, StgWord hk)
+{
+    uint32_t i;
+    RetainerSet *nrs;
+
+    for (nrs = hashTable[hash(hk)]; nrs != NULL; nrs = nrs->link) {
+        // test *rs and *nrs for equality
+
+        // check their size
+        if (rs->num + 1 != nrs->num) continue;
+
+        // compare the first nl retainers and find the first non-matching one.
+        for (i = 0; i < nl; i++)
+            if (rs->element[i] != nrs->element[i]) break;
+        if (i < nl) continue;
+
+        // compare r itself
+        if (r != nrs->element[i]) continue;       // i == nl
+
+        // compare the remaining retainers
+        for (; i < rs->num; i++)
+            if (rs->element[i] != nrs->element[i + 1]) break;
+        if (i < rs->num) continue;
+
+#if defined(DEBUG_RETAINER)
+        // debugBelch("%p\n", nrs);
+#endif
+        // The set we are seeking already exists!
+        return nrs;
+    }
+
+    return NULL;
+}
+
 /* -----------------------------------------------------------------------------
  *   Finds or creates a retainer set *rs augmented with r.
  *   Invariants:
@@ -166,31 +247,19 @@ addElement(retainer r, RetainerSet *rs)
     // remaining (rs->num - nl) retainers.
 
     hk = hashKeyAddElement(r, rs);
-    for (nrs = hashTable[hash(hk)]; nrs != NULL; nrs = nrs->link) {
-        // test *rs and *nrs for equality
-
-        // check their size
-        if (rs->num + 1 != nrs->num) continue;
-
-        // compare the first nl retainers and find the first non-matching one.
-        for (i = 0; i < nl; i++)
-            if (rs->element[i] != nrs->element[i]) break;
-        if (i < nl) continue;
+    nrs = findAddElement(r, rs, nl, hk);
+    if (nrs != NULL) return nrs;
 
-        // compare r itself
-        if (r != nrs->element[i]) continue;       // i == nl
+    ACQUIRE_SPIN_LOCK(&rs_sync);
 
-        // compare the remaining retainers
-        for (; i < rs->num; i++)
-            if (rs->element[i] != nrs->element[i + 1]) break;
-        if (i < rs->num) continue;
-
-#if defined(DEBUG_RETAINER)
-        // debugBelch("%p\n", nrs);
-#endif
-        // The set we are seeking already exists!
+#if defined(THREADED_RTS)
+    // Another thread may have created it since we looked.
+    nrs = findAddElement(r, rs, nl, hk);
+    if (nrs != NULL) {
+        RELEASE_SPIN_LOCK(&rs_sync);
         return nrs;
     }
+#endif
 
     // create a new retainer set
     nrs = arenaAlloc( arena, sizeofRetainerSet(rs->num + 1) );
@@ -206,8 +275,11 @@ addElement(retainer r, RetainerSet *rs)
         nrs->element[i + 1] = rs->element[i];
     }
 
+    write_barrier();
     hashTable[hash(hk)] = nrs;
 
+    RELEASE_SPIN_LOCK(&rs_sync);
+
 #if defined(DEBUG_RETAINER)
     // debugBelch("%p\n", nrs);
 #endif
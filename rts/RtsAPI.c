@@ -699,8 +699,9 @@ void hs_try_putmvar (/* in */ int capability,
 #else
 
     ACQUIRE_LOCK(&cap->lock);
-    // If the capability is free, we can perform the tryPutMVar immediately
-    if (cap->running_task == NULL) {
+    // If the capability is free (or only reserved for a safe foreign
+    // call), we can perform the tryPutMVar immediately
+    if (cap->running_task == NULL || breakCapabilityReservation_(cap)) {
         cap->running_task = task;
         task->cap = cap;
         RELEASE_LOCK(&cap->lock);
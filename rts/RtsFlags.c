@@ -201,6 +201,8 @@ void initRtsFlagsDefaults(void)
     RtsFlags.ProfFlags.includeTSOs        = false;
     RtsFlags.ProfFlags.showCCSOnException = false;
     RtsFlags.ProfFlags.maxRetainerSetSize = 8;
+    RtsFlags.ProfFlags.retainerSliceSize  = 0;
+    RtsFlags.ProfFlags.allocSampleBytes   = 0;
     RtsFlags.ProfFlags.ccsLength          = 25;
     RtsFlags.ProfFlags.modSelector        = NULL;
     RtsFlags.ProfFlags.descrSelector      = NULL;
@@ -227,7 +229,10 @@ void initRtsFlagsDefaults(void)
 #else
     RtsFlags.MiscFlags.tickInterval     = DEFAULT_TICK_INTERVAL;
 #endif
-    RtsFlags.ConcFlags.ctxtSwitchTime   = USToTime(20000); // 20ms
+    // 20ms, or none with --alloc-slice; see normaliseRtsOpts()
+    RtsFlags.ConcFlags.ctxtSwitchTime   = -1;
+    RtsFlags.ConcFlags.prioAging        = 8;
+    RtsFlags.ConcFlags.allocSlice       = 0;
 
     RtsFlags.MiscFlags.install_signal_handlers = true;
     RtsFlags.MiscFlags.install_seh_handlers    = true;
@@ -236,6 +241,10 @@ void initRtsFlagsDefaults(void)
     RtsFlags.MiscFlags.machineReadable         = false;
     RtsFlags.MiscFlags.internalCounters        = false;
     RtsFlags.MiscFlags.linkerMemBase           = 0;
+    RtsFlags.MiscFlags.ioUring                 = false;
+    RtsFlags.MiscFlags.stmIndexThreshold       = 16;
+    RtsFlags.MiscFlags.stmIrrevocableAfter     = 16;
+    RtsFlags.MiscFlags.stmPreciseWakeup        = false;
 
 #if defined(THREADED_RTS)
     RtsFlags.ParFlags.nCapabilities     = 1;
@@ -247,6 +256,13 @@ void initRtsFlagsDefaults(void)
     RtsFlags.ParFlags.parGcNoSyncWithIdle   = 0;
     RtsFlags.ParFlags.parGcThreads      = 0; /* defaults to -N */
     RtsFlags.ParFlags.setAffinity       = 0;
+    RtsFlags.ParFlags.affinityMode      = AFFINITY_ROUND_ROBIN;
+    RtsFlags.ParFlags.ffiGracePeriod    = USToTime(20); // 20us
+    RtsFlags.ParFlags.minSpareWorkers   = 0;
+    RtsFlags.ParFlags.maxWorkers        = 0;
+    RtsFlags.ParFlags.workerIdleTimeout = 0;
+    RtsFlags.ParFlags.stmVersionClock   = false;
+    RtsFlags.ParFlags.autoCapsInterval  = 0;
 #endif
 
 #if defined(THREADED_RTS)
@@ -336,6 +352,9 @@ usage_text[] = {
 "    -hb<bio>...  closures with specified biographies (lag,drag,void,use)",
 "",
 "  -R<size>       Set the maximum retainer set size (default: 8)",
+"  --retainer-slice=<n>",
+"                 Spread each retainer census over several GCs, visiting",
+"                 about <n> objects at each (default: 0, all at once)",
 "",
 "  -L<chars>      Maximum length of a cost-centre stack in a heap profile",
 "                 (default: 25)",
@@ -365,6 +384,10 @@ usage_text[] = {
 #  endif
 "               -x    disable an event class, for any flag above",
 "             the initial enabled event classes are 'sgpu'",
+"",
+"  --alloc-sample=<size>",
+"             Sample one allocation in every <size> bytes and log the live",
+"             bytes of each allocation site at every major GC (needs -l)",
 #endif
 
 #if !defined(PROFILING)
@@ -421,13 +444,37 @@ usage_text[] = {
 "            (default: 1 for -A < 32M, 0 otherwise;"
 "             -qb alone turns off load-balancing)",
 "  -qn<n>    Use <n> threads for parallel GC (defaults to value of -N)",
-"  -qa       Use the OS to set thread affinity (experimental)",
+"  -qa[=<mode>]",
+"            Use the OS to set thread affinity (experimental); <mode> is",
+"            compact (fill each socket in turn) or spread (alternate",
+"            between sockets), one capability per physical core first",
+"            (Linux only; default: capability <i> on CPU <i>)",
 "  -qm       Don't automatically migrate threads between CPUs",
 "  -qi<n>    If a processor has been idle for the last <n> GCs, do not",
 "            wake it up for a non-load-balancing parallel GC.",
 "            (0 disables,  default: 0)",
+"  --ffi-grace=<secs>",
+"            Keep the capability reserved for safe foreign calls expected",
+"            to return within <secs> (0 disables, default: 0.00002)",
+"  --min-workers=<n>",
+"            Start <n> spare worker threads per capability, and keep",
+"            them (default: 0)",
+"  --max-workers=<n>",
+"            Run at most <n> worker threads in total (0: no limit, default)",
+"  --worker-idle-timeout=<secs>",
+"            Spare worker threads exit after being idle for <secs>",
+"            (default: 0, keep up to 6 spare workers per capability)",
+"  --stm-version-clock",
+"            Validate each STM read against a global version clock, and",
+"            skip commit-time validation when no transaction has committed",
+"            since (default: off)",
+"  --auto-caps[=<secs>]",
+"            Enable and disable capabilities with the load and the CPU",
+"            quota, up to the -N value, every <secs> (default: 1)",
 "  --numa[=<node_mask>]",
 "            Use NUMA, nodes given by <node_mask> (default: off)",
+"  --io-uring",
+"            Do I/O through io_uring where possible (Linux only)",
 #if defined(DEBUG)
 "  --debug-numa[=<num_nodes>]",
 "            Pretend NUMA: like --numa, but without the system calls.",
@@ -435,6 +482,21 @@ usage_text[] = {
 "",
 #endif
 #endif
+"  --stm-index-threshold=<n>",
+"            Look up the TVars of an STM transaction in a hash table once",
+"            it has accessed <n> of them (0 disables, default: 16)",
+"  --stm-irrevocable-after=<n>",
+"            Run an STM transaction that has failed to commit <n> times",
+"            in a row ahead of all others (0 disables, default: 16)",
+"  --stm-precise-wakeup",
+"            Wake a thread blocked in an STM retry only when a TVar it",
+"            read has been given a different value",
+"  --prio-aging=<n>",
+"            Run a thread waiting behind threads of a more urgent priority",
+"            class after at most <n> of them (0 disables, default: 8)",
+"  --alloc-slice=<size>",
+"            End a thread's timeslice when it has allocated <size> bytes,",
+"            instead of every -C interval (default: 0, off)",
 "  --install-signal-handlers=<yes|no>",
 "            Install signal handlers (default: yes)",
 #if defined(mingw32_HOST_OS)
@@ -898,6 +960,35 @@ error = true;
                       OPTION_SAFE;
                       RtsFlags.MiscFlags.internalCounters = true;
                   }
+                  else if (!strncmp("stm-index-threshold=",
+                                    &rts_argv[arg][2], 20)) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.stmIndexThreshold = (uint32_t)
+                          decodeSize(rts_argv[arg], 22, 0, HS_WORD32_MAX);
+                  }
+                  else if (!strncmp("stm-irrevocable-after=",
+                                    &rts_argv[arg][2], 22)) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.stmIrrevocableAfter =
+                          strtol(rts_argv[arg]+24, (char **) NULL, 10);
+                  }
+                  else if (strequal("stm-precise-wakeup",
+                                    &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.stmPreciseWakeup = true;
+                  }
+                  else if (!strncmp("prio-aging=",
+                                    &rts_argv[arg][2], 11)) {
+                      OPTION_SAFE;
+                      RtsFlags.ConcFlags.prioAging =
+                          strtol(rts_argv[arg]+13, (char **) NULL, 10);
+                  }
+                  else if (!strncmp("alloc-slice=",
+                                    &rts_argv[arg][2], 12)) {
+                      OPTION_SAFE;
+                      RtsFlags.ConcFlags.allocSlice =
+                          decodeSize(rts_argv[arg], 14, 0, HS_INT64_MAX);
+                  }
                   else if (strequal("info",
                                &rts_argv[arg][2])) {
                       OPTION_SAFE;
@@ -930,6 +1021,61 @@ error = true;
                       RtsFlags.GcFlags.numa = true;
                       RtsFlags.GcFlags.numaMask = mask;
                   }
+                  else if (!strncmp("ffi-grace=", &rts_argv[arg][2], 10)) {
+                      OPTION_SAFE;
+                      RtsFlags.ParFlags.ffiGracePeriod =
+                          fsecondsToTime(atof(rts_argv[arg]+12));
+                  }
+                  else if (!strncmp("min-workers=", &rts_argv[arg][2], 12)) {
+                      OPTION_SAFE;
+                      RtsFlags.ParFlags.minSpareWorkers =
+                          strtol(rts_argv[arg]+14, (char **) NULL, 10);
+                  }
+                  else if (!strncmp("max-workers=", &rts_argv[arg][2], 12)) {
+                      OPTION_SAFE;
+                      RtsFlags.ParFlags.maxWorkers =
+                          strtol(rts_argv[arg]+14, (char **) NULL, 10);
+                  }
+                  else if (!strncmp("worker-idle-timeout=",
+                                    &rts_argv[arg][2], 20)) {
+                      OPTION_SAFE;
+                      RtsFlags.ParFlags.workerIdleTimeout =
+                          fsecondsToTime(atof(rts_argv[arg]+22));
+                  }
+                  else if (strequal("stm-version-clock", &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.ParFlags.stmVersionClock = true;
+                  }
+                  else if (strequal("auto-caps", &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.ParFlags.autoCapsInterval = SecondsToTime(1);
+                  }
+                  else if (!strncmp("auto-caps=", &rts_argv[arg][2], 10)) {
+                      char *end;
+                      double secs;
+                      OPTION_SAFE;
+                      secs = strtod(rts_argv[arg]+12, &end);
+                      if (end == rts_argv[arg]+12 || *end != '\0'
+                          || !(secs > 0) || fsecondsToTime(secs) <= 0) {
+                          errorBelch("--auto-caps: interval must be a "
+                                     "number of seconds greater than 0");
+                          error = true;
+                      } else {
+                          RtsFlags.ParFlags.autoCapsInterval =
+                              fsecondsToTime(secs);
+                      }
+                  }
+                  else if (strequal("io-uring", &rts_argv[arg][2])) {
+#if defined(HAVE_LINUX_IO_URING_H)
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.ioUring = true;
+#else
+                      errorBelch("%s: This GHC build was compiled without io_uring support.",
+                                 rts_argv[arg]);
+                      error = true;
+                      break;
+#endif
+                  }
 #endif
 #if defined(DEBUG) && defined(THREADED_RTS)
                   else if (!strncmp("debug-numa", &rts_argv[arg][2], 10)) {
@@ -956,6 +1102,22 @@ error = true;
                       }
                   }
 #endif
+                  else if (!strncmp("alloc-sample=",
+                                    &rts_argv[arg][2], 13)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.ProfFlags.allocSampleBytes =
+                              decodeSize(rts_argv[arg], 15, 0, HS_WORD32_MAX);
+                      );
+                  }
+                  else if (!strncmp("retainer-slice=",
+                                    &rts_argv[arg][2], 15)) {
+                      OPTION_SAFE;
+                      PROFILING_BUILD_ONLY(
+                          RtsFlags.ProfFlags.retainerSliceSize =
+                              decodeSize(rts_argv[arg], 17, 0, HS_WORD32_MAX);
+                      );
+                  }
                   else if (!strncmp("long-gc-sync=", &rts_argv[arg][2], 13)) {
                       OPTION_SAFE;
                       if (rts_argv[arg][2] == '\0') {
@@ -1386,6 +1548,17 @@ error = true;
                     }
                     case 'a':
                         RtsFlags.ParFlags.setAffinity = true;
+                        if (rts_argv[arg][3] == '\0') {
+                            RtsFlags.ParFlags.affinityMode =
+                                AFFINITY_ROUND_ROBIN;
+                        } else if (strequal("=compact", &rts_argv[arg][3])) {
+                            RtsFlags.ParFlags.affinityMode = AFFINITY_COMPACT;
+                        } else if (strequal("=spread", &rts_argv[arg][3])) {
+                            RtsFlags.ParFlags.affinityMode = AFFINITY_SPREAD;
+                        } else {
+                            errorBelch("unknown RTS option: %s",rts_argv[arg]);
+                            error = true;
+                        }
                         break;
                     case 'm':
                         RtsFlags.ParFlags.migrate = false;
@@ -1570,10 +1743,24 @@ error = true;
 
 static void normaliseRtsOpts (void)
 {
+    bool timerSwitches = true;
+
     if (RtsFlags.MiscFlags.tickInterval < 0) {
         RtsFlags.MiscFlags.tickInterval = DEFAULT_TICK_INTERVAL;
     }
 
+    // With --alloc-slice, timeslices end after an amount of allocation
+    // rather than with the timer, unless -C was given too.  See
+    // Note [Allocation slices] in Schedule.c.
+    if (RtsFlags.ConcFlags.ctxtSwitchTime < 0) {
+        if (RtsFlags.ConcFlags.allocSlice > 0) {
+            RtsFlags.ConcFlags.ctxtSwitchTime = 0;
+            timerSwitches = false;
+        } else {
+            RtsFlags.ConcFlags.ctxtSwitchTime = USToTime(20000); // 20ms
+        }
+    }
+
     // If the master timer is disabled, turn off the other timers.
     if (RtsFlags.MiscFlags.tickInterval == 0) {
         RtsFlags.ConcFlags.ctxtSwitchTime  = 0;
@@ -1606,7 +1793,11 @@ static void normaliseRtsOpts (void)
         RtsFlags.ConcFlags.ctxtSwitchTicks =
             RtsFlags.ConcFlags.ctxtSwitchTime /
             RtsFlags.MiscFlags.tickInterval;
+    } else if (!timerSwitches) {
+        // --alloc-slice without -C: no context switches from the timer
+        RtsFlags.ConcFlags.ctxtSwitchTicks = -1;
     } else {
+        // -C0: context switch as often as possible
         RtsFlags.ConcFlags.ctxtSwitchTicks = 0;
     }
 
@@ -27,6 +27,8 @@
 #include "sm/BlockAlloc.h"
 #include "Trace.h"
 #include "StableName.h"
+#include "AllocSample.h"
+#include "AutoCaps.h"
 #include "StablePtr.h"
 #include "StaticPtrTable.h"
 #include "Hash.h"
@@ -230,6 +232,11 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
     /* Initialise libdw session pool */
     libdwPoolInit();
 
+    /* Initialise the allocation-site profiler (needs to be done before
+     * initScheduler(), which sets up the capabilities' countdowns).
+     */
+    initAllocSampling();
+
     /* initialise scheduler data structures (needs to be done before
      * initStorage()).
      */
@@ -326,6 +333,7 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
     // ditto.
 #if defined(THREADED_RTS)
     ioManagerStart();
+    startAutoCaps();
 #endif
 
     /* Record initialization times */
@@ -377,6 +385,10 @@ hs_exit_(bool wait_foreign)
 
     rtsConfig.onExitHook();
 
+#if defined(THREADED_RTS)
+    stopAutoCaps();
+#endif
+
     flushStdHandles();
 
     // sanity check
@@ -460,6 +472,9 @@ hs_exit_(bool wait_foreign)
     /* free the stable name table */
     exitStableNameTable();
 
+    /* free the allocation-site samples */
+    exitAllocSampling();
+
 #if defined(DEBUG)
     /* free the thread label table */
     freeThreadLabelTable();
@@ -297,6 +297,12 @@
    SymI_HasProto(setTimerManagerControlFd) \
    SymI_HasProto(setIOManagerWakeupFd)  \
    SymI_HasProto(ioManagerWakeup)       \
+   SymI_HasProto(ioURingEnabled)        \
+   SymI_HasProto(ioURingRead)           \
+   SymI_HasProto(ioURingWrite)          \
+   SymI_HasProto(ioURingAccept)         \
+   SymI_HasProto(ioURingTimeout)        \
+   SymI_HasProto(ioURingCancel)         \
    SymI_HasProto(blockUserSignals)      \
    SymI_HasProto(unblockUserSignals)
 #else
@@ -748,6 +754,10 @@
       SymI_HasProto(rts_setInCallCapability)                            \
       SymI_HasProto(rts_enableThreadAllocationLimit)                    \
       SymI_HasProto(rts_disableThreadAllocationLimit)                   \
+      SymI_HasProto(rts_setThreadPriority)                              \
+      SymI_HasProto(rts_getThreadPriority)                              \
+      SymI_HasProto(rts_setThreadAllocationSlice)                       \
+      SymI_HasProto(rts_getThreadAllocationSlice)                       \
       SymI_HasProto(rts_setMainThread)                                  \
       SymI_HasProto(setProgArgv)                                        \
       SymI_HasProto(startupHaskell)                                     \
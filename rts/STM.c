@@ -81,6 +81,9 @@
  * TVar's lock until it has added itself to the wait queue and marked its TSO as
  * BlockedOnSTM -- this makes sure that other threads will know to wake it.
  *
+ * With STM_FG_LOCKS, +RTS --stm-version-clock changes how the TVars that a
+ * transaction has read are validated; see Note [STM version clock].
+ *
  * ---------------------------------------------------------------------------*/
 
 #include "PosixSource.h"
@@ -95,6 +98,7 @@
 #include "SMPClosureOps.h"
 
 #include <stdio.h>
+#include <string.h>
 
 // ACQ_ASSERT is used for assertions which are only required for
 // THREADED_RTS builds with fine-grained locking.
@@ -139,16 +143,15 @@ static int shake(void) {
 #define FOR_EACH_ENTRY(_t,_x,CODE) do {                                         \
   StgTRecHeader *__t = (_t);                                                    \
   StgTRecChunk *__c = __t -> current_chunk;                                     \
-  StgWord __limit = __c -> next_entry_idx;                                      \
-  TRACE("%p : FOR_EACH_ENTRY, current_chunk=%p limit=%ld", __t, __c, __limit);  \
+  TRACE("%p : FOR_EACH_ENTRY, current_chunk=%p", __t, __c);                     \
   while (__c != END_STM_CHUNK_LIST) {                                           \
     StgWord __i;                                                                \
+    StgWord __limit = __c -> next_entry_idx;                                    \
     for (__i = 0; __i < __limit; __i ++) {                                      \
       TRecEntry *_x = &(__c -> entries[__i]);                                   \
       do { CODE } while (0);                                                    \
     }                                                                           \
     __c = __c -> prev_chunk;                                                    \
-    __limit = TREC_CHUNK_NUM_ENTRIES;                                           \
   }                                                                             \
  exit_for_each:                                                                 \
   if (false) goto exit_for_each;                                                \
@@ -158,8 +161,9 @@ static int shake(void) {
 
 /*......................................................................*/
 
-// if REUSE_MEMORY is defined then attempt to re-use descriptors, log chunks,
-// and wait queue entries without GC
+// if REUSE_MEMORY is defined then attempt to re-use descriptors and wait
+// queue entries without GC (log chunks are always re-used: see
+// Note [TRec chunk arena])
 
 #define REUSE_MEMORY
 
@@ -271,6 +275,8 @@ static StgBool cond_lock_tvar(StgTRecHeader *trec STG_UNUSED,
 #define IF_STM_FG_LOCKS(__X) do { __X } while (0)
 static const StgBool config_use_read_phase = true;
 
+#define USE_VERSION_CLOCK (RtsFlags.ParFlags.stmVersionClock)
+
 static void lock_stm(StgTRecHeader *trec STG_UNUSED) {
   TRACE("%p : lock_stm()", trec);
 }
@@ -352,7 +358,43 @@ static void unpark_tso(Capability *cap, StgTSO *tso) {
     tryWakeupThread(cap,tso);
 }
 
-static void unpark_waiters_on(Capability *cap, StgTVar *s) {
+/*
+ * Note [STM wakeups]
+ * ~~~~~~~~~~~~~~~~~~
+ *
+ * A thread that blocks in retry puts an entry on the watch queue of each
+ * TVar its transaction read, and a transaction that commits wakes all the
+ * threads on the queues of the TVars it writes.  A woken thread first
+ * checks, in stmReWait, whether any TVar it read has changed; if not it
+ * goes back to sleep, and otherwise it runs its transaction again.
+ *
+ * A commit that writes several TVars wakes each waiting thread once,
+ * however many of those TVars it waits on: the commit takes a fresh
+ * stamp from stm_wakeup_stamp when it finds its first waiter, and records
+ * it in the TRec of each thread it wakes (trec -> wakeup_stamp).  We
+ * hold the lock on the TVar whose queue the thread is on, so the thread
+ * is still blocked and its TRec cannot go away under us.
+ *
+ * With +RTS --stm-precise-wakeup the commit also does the waiter's check
+ * for the TVar it is writing: each watch queue entry records the value
+ * that the waiter read, and if that is the value being written, the
+ * write cannot make the waiter's transaction behave any differently, so
+ * we leave the waiter asleep.  If the waiter read some other TVar that
+ * has changed, the commit that changed it woke it.
+ *
+ * We count on each Capability the threads woken (stm_wakeups), the
+ * wakeups avoided by --stm-precise-wakeup (stm_wakeups_avoided), the
+ * woken threads that went straight back to sleep (stm_spurious_wakeups),
+ * and those that ran their transaction again only to retry once more
+ * (stm_spurious_reruns).  For the last, stmReWait sets TSO_STM_WOKEN when
+ * it decides to run the transaction again, and a commit or the next
+ * stmWait clears it.
+ */
+
+static volatile StgWord stm_wakeup_stamp = 0;
+
+static void unpark_waiters_on(Capability *cap, StgTVar *s,
+                              StgClosure *new_value, StgWord *stamp) {
   StgTVarWatchQueue *q;
   StgTVarWatchQueue *trail;
   TRACE("unpark_waiters_on tvar=%p", s);
@@ -366,7 +408,25 @@ static void unpark_waiters_on(Capability *cap, StgTVar *s) {
   for (;
        q != END_STM_WATCH_QUEUE;
        q = q -> prev_queue_entry) {
-      unpark_tso(cap, (StgTSO *)(q -> closure));
+      StgTSO *tso = (StgTSO *)(q -> closure);
+      StgTRecHeader *trec = tso -> trec;
+      ASSERT(trec -> state == TREC_WAITING);
+      if (RtsFlags.MiscFlags.stmPreciseWakeup &&
+          q -> expected_value == new_value) {
+        TRACE("tso=%p read the value written to tvar=%p, not waking",
+              tso, s);
+        cap -> stm_wakeups_avoided ++;
+        continue;
+      }
+      if (*stamp == 0) {
+        *stamp = atomic_inc(&stm_wakeup_stamp, 1);
+      } else if (trec -> wakeup_stamp == *stamp) {
+        // already woken by this commit
+        continue;
+      }
+      trec -> wakeup_stamp = *stamp;
+      cap -> stm_wakeups ++;
+      unpark_tso(cap, tso);
   }
 }
 
@@ -383,15 +443,6 @@ static StgTVarWatchQueue *new_stg_tvar_watch_queue(Capability *cap,
   return result;
 }
 
-static StgTRecChunk *new_stg_trec_chunk(Capability *cap) {
-  StgTRecChunk *result;
-  result = (StgTRecChunk *)allocate(cap, sizeofW(StgTRecChunk));
-  SET_HDR (result, &stg_TREC_CHUNK_info, CCS_SYSTEM);
-  result -> prev_chunk = END_STM_CHUNK_LIST;
-  result -> next_entry_idx = 0;
-  return result;
-}
-
 static StgTRecHeader *new_stg_trec_header(Capability *cap,
                                           StgTRecHeader *enclosing_trec) {
   StgTRecHeader *result;
@@ -399,7 +450,14 @@ static StgTRecHeader *new_stg_trec_header(Capability *cap,
   SET_HDR (result, &stg_TREC_HEADER_info, CCS_SYSTEM);
 
   result -> enclosing_trec = enclosing_trec;
-  result -> current_chunk = new_stg_trec_chunk(cap);
+  result -> current_chunk = END_STM_CHUNK_LIST;
+  result -> has_writes = false;
+  result -> read_version = 0;
+  result -> index = NULL;
+  result -> index_epoch = 0;
+  result -> irrevocable = false;
+  result -> conflict = 0;
+  result -> wakeup_stamp = 0;
 
   if (enclosing_trec == NO_TREC) {
     result -> state = TREC_ACTIVE;
@@ -438,25 +496,163 @@ static void free_stg_tvar_watch_queue(Capability *cap,
 #endif
 }
 
-static StgTRecChunk *alloc_stg_trec_chunk(Capability *cap) {
+/*......................................................................*/
+
+/*
+ * Note [TRec chunk arena]
+ * ~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * The entries of a TRec are held in a list of StgTRecChunks.  These used
+ * to be heap objects (TREC_CHUNK) recycled through a per-Capability free
+ * list, but stmPreGCHook had to drop that list at every GC, so a program
+ * running transactions went back to allocating chunks in the nursery after
+ * each GC, and a long-lived transaction with thousands of entries had its
+ * chunks copied by every GC.
+ *
+ * Chunks are now plain C structures, kept outside the heap.  Each
+ * Capability carves them from TREC_SLAB_SIZE slabs that it mallocs
+ * (cap -> trec_slabs), and keeps freed chunks on its own free lists
+ * (cap -> free_trec_chunks[]), which survive GC.  Slabs are only released
+ * at exit, by stmFreeCapability().  When the rest of the current slab is
+ * too small for the chunk we want, it is cut up into smaller chunks for
+ * the free lists before we start a new slab.
+ *
+ * A chunk of size class k holds TREC_CHUNK_NUM_ENTRIES << k entries.  Each
+ * chunk added to a TRec is one class bigger than the previous one, up to
+ * TREC_CHUNK_CLASSES - 1, so that a large TRec has few chunks.  A top-level
+ * transaction that fails to commit leaves the size class that would have
+ * held all of its entries in cap -> trec_chunk_hint, and the next top-level
+ * transaction started on that Capability (usually the same one, re-run)
+ * begins with a chunk of that class.
+ *
+ * The chunks belong to the TRec that points to them, which is still a heap
+ * object: the GC visits the entries of a TRec's chunks when it scavenges
+ * the TRec (see scavenge_trec_chunks() in sm/Scav.c and
+ * thread_trec_chunks() in sm/Compact.c).  A TRec therefore hands back all
+ * of its chunks when it is freed, and a free TRec has none, so that a TRec
+ * that is garbage never points into chunks that are in use elsewhere.
+ * A TRec that became garbage without being freed would keep its chunks
+ * until exit, but every path that finishes with a TRec frees it.
+ */
+
+#define TREC_SLAB_SIZE (64 * 1024)
+
+typedef struct TRecSlab_ {
+  struct TRecSlab_ *link;
+} TRecSlab;
+
+static StgWord trec_chunk_entries(uint32_t cls) {
+  return (StgWord)TREC_CHUNK_NUM_ENTRIES << cls;
+}
+
+static StgWord trec_chunk_bytes(uint32_t cls) {
+  return sizeof(StgTRecChunk) + trec_chunk_entries(cls) * sizeof(TRecEntry);
+}
+
+// The smallest size class that holds n entries
+static uint32_t trec_chunk_class(StgWord n) {
+  uint32_t cls = 0;
+  while (cls < TREC_CHUNK_CLASSES - 1 && trec_chunk_entries(cls) < n) {
+    cls ++;
+  }
+  return cls;
+}
+
+static void free_stg_trec_chunk(Capability *cap,
+                                StgTRecChunk *c) {
+  uint32_t cls = trec_chunk_class(c -> size);
+  ASSERT(trec_chunk_entries(cls) == c -> size);
+  c -> prev_chunk = cap -> free_trec_chunks[cls];
+  cap -> free_trec_chunks[cls] = c;
+}
+
+// Bytes left in the current slab
+static StgWord trec_slab_room(Capability *cap) {
+  return cap -> trec_slab_end - cap -> trec_slab_free;
+}
+
+static StgTRecChunk *carve_trec_chunk(Capability *cap, uint32_t cls) {
+  StgTRecChunk *c = (StgTRecChunk *)cap -> trec_slab_free;
+  cap -> trec_slab_free += trec_chunk_bytes(cls);
+  c -> size = trec_chunk_entries(cls);
+  return c;
+}
+
+static void new_trec_slab(Capability *cap) {
+  TRecSlab *slab;
+  int cls;
+
+  // Keep whatever is left of the current slab
+  for (cls = TREC_CHUNK_CLASSES - 1; cls >= 0; cls --) {
+    while (trec_slab_room(cap) >= trec_chunk_bytes(cls)) {
+      free_stg_trec_chunk(cap, carve_trec_chunk(cap, cls));
+      cap -> stm_chunks_carved ++;
+    }
+  }
+
+  slab = stgMallocBytes(TREC_SLAB_SIZE, "new_trec_slab");
+  slab -> link = cap -> trec_slabs;
+  cap -> trec_slabs = slab;
+  cap -> trec_slab_free = (StgWord8 *)(slab + 1);
+  cap -> trec_slab_end = (StgWord8 *)slab + TREC_SLAB_SIZE;
+  cap -> trec_slab_bytes += TREC_SLAB_SIZE;
+  TRACE("new TRec slab %p on cap %d", slab, cap -> no);
+}
+
+static StgTRecChunk *alloc_stg_trec_chunk(Capability *cap, uint32_t cls) {
   StgTRecChunk *result = NULL;
-  if (cap -> free_trec_chunks == END_STM_CHUNK_LIST) {
-    result = new_stg_trec_chunk(cap);
+  if (cap -> free_trec_chunks[cls] == END_STM_CHUNK_LIST) {
+    if (trec_slab_room(cap) < trec_chunk_bytes(cls)) {
+      new_trec_slab(cap);
+    }
+    result = carve_trec_chunk(cap, cls);
+    cap -> stm_chunks_carved ++;
   } else {
-    result = cap -> free_trec_chunks;
-    cap -> free_trec_chunks = result -> prev_chunk;
-    result -> prev_chunk = END_STM_CHUNK_LIST;
-    result -> next_entry_idx = 0;
+    result = cap -> free_trec_chunks[cls];
+    cap -> free_trec_chunks[cls] = result -> prev_chunk;
+    cap -> stm_chunks_reused ++;
   }
+  result -> prev_chunk = END_STM_CHUNK_LIST;
+  result -> next_entry_idx = 0;
   return result;
 }
 
-static void free_stg_trec_chunk(Capability *cap,
-                                StgTRecChunk *c) {
-#if defined(REUSE_MEMORY)
-  c -> prev_chunk = cap -> free_trec_chunks;
-  cap -> free_trec_chunks = c;
-#endif
+static void free_trec_slabs(Capability *cap) {
+  TRecSlab *slab, *next;
+  uint32_t cls;
+
+  for (slab = cap -> trec_slabs; slab != NULL; slab = next) {
+    next = slab -> link;
+    stgFree(slab);
+  }
+  cap -> trec_slabs = NULL;
+  cap -> trec_slab_free = NULL;
+  cap -> trec_slab_end = NULL;
+  for (cls = 0; cls < TREC_CHUNK_CLASSES; cls++) {
+    cap -> free_trec_chunks[cls] = END_STM_CHUNK_LIST;
+  }
+}
+
+static StgWord trec_num_entries(StgTRecHeader *trec) {
+  StgTRecChunk *c = trec -> current_chunk;
+  StgWord n = 0;
+  while (c != END_STM_CHUNK_LIST) {
+    n += c -> next_entry_idx;
+    c = c -> prev_chunk;
+  }
+  return n;
+}
+
+// The size class for the first chunk of a new TRec; see
+// Note [TRec chunk arena]
+static uint32_t first_trec_chunk_class(Capability *cap,
+                                       StgTRecHeader *enclosing_trec) {
+  uint32_t cls = 0;
+  if (enclosing_trec == NO_TREC) {
+    cls = cap -> trec_chunk_hint;
+    cap -> trec_chunk_hint = 0;
+  }
+  return cls;
 }
 
 static StgTRecHeader *alloc_stg_trec_header(Capability *cap,
@@ -468,7 +664,11 @@ static StgTRecHeader *alloc_stg_trec_header(Capability *cap,
     result = cap -> free_trec_headers;
     cap -> free_trec_headers = result -> enclosing_trec;
     result -> enclosing_trec = enclosing_trec;
-    result -> current_chunk -> next_entry_idx = 0;
+    result -> has_writes = false;
+    result -> index = NULL;
+    result -> irrevocable = false;
+    result -> conflict = 0;
+    result -> wakeup_stamp = 0;
     if (enclosing_trec == NO_TREC) {
       result -> state = TREC_ACTIVE;
     } else {
@@ -477,19 +677,25 @@ static StgTRecHeader *alloc_stg_trec_header(Capability *cap,
       result -> state = enclosing_trec -> state;
     }
   }
+  ASSERT(result -> current_chunk == END_STM_CHUNK_LIST);
+  result -> current_chunk =
+    alloc_stg_trec_chunk(cap, first_trec_chunk_class(cap, enclosing_trec));
   return result;
 }
 
+static void release_trec_index(StgTRecHeader *trec);
+
 static void free_stg_trec_header(Capability *cap,
                                  StgTRecHeader *trec) {
-#if defined(REUSE_MEMORY)
-  StgTRecChunk *chunk = trec -> current_chunk -> prev_chunk;
+  StgTRecChunk *chunk = trec -> current_chunk;
+  release_trec_index(trec);
   while (chunk != END_STM_CHUNK_LIST) {
     StgTRecChunk *prev_chunk = chunk -> prev_chunk;
     free_stg_trec_chunk(cap, chunk);
     chunk = prev_chunk;
   }
-  trec -> current_chunk -> prev_chunk = END_STM_CHUNK_LIST;
+  trec -> current_chunk = END_STM_CHUNK_LIST;
+#if defined(REUSE_MEMORY)
   trec -> enclosing_trec = cap -> free_trec_headers;
   cap -> free_trec_headers = trec;
 #endif
@@ -520,6 +726,7 @@ static void build_watch_queue_entries_for_trec(Capability *cap,
     q = alloc_stg_tvar_watch_queue(cap, (StgClosure*) tso);
     q -> next_queue_entry = fq;
     q -> prev_queue_entry = END_STM_WATCH_QUEUE;
+    q -> expected_value = e -> expected_value;
     if (fq != END_STM_WATCH_QUEUE) {
       fq -> prev_queue_entry = q;
     }
@@ -575,20 +782,24 @@ static TRecEntry *get_new_entry(Capability *cap,
                                 StgTRecHeader *t) {
   TRecEntry *result;
   StgTRecChunk *c;
-  int i;
+  StgWord i;
 
   c = t -> current_chunk;
   i = c -> next_entry_idx;
   ASSERT(c != END_STM_CHUNK_LIST);
 
-  if (i < TREC_CHUNK_NUM_ENTRIES) {
+  if (i < c -> size) {
     // Continue to use current chunk
     result = &(c -> entries[i]);
     c -> next_entry_idx ++;
   } else {
-    // Current chunk is full: allocate a fresh one
+    // Current chunk is full: allocate a fresh one, one size class bigger
     StgTRecChunk *nc;
-    nc = alloc_stg_trec_chunk(cap);
+    uint32_t cls = trec_chunk_class(c -> size);
+    if (cls < TREC_CHUNK_CLASSES - 1) {
+      cls ++;
+    }
+    nc = alloc_stg_trec_chunk(cap, cls);
     nc -> prev_chunk = c;
     nc -> next_entry_idx = 1;
     t -> current_chunk = nc;
@@ -600,37 +811,248 @@ static TRecEntry *get_new_entry(Capability *cap,
 
 /*......................................................................*/
 
-static void merge_update_into(Capability *cap,
-                              StgTRecHeader *t,
-                              StgTVar *tvar,
-                              StgClosure *expected_value,
-                              StgClosure *new_value)
-{
-  // Look for an entry in this trec
-  bool found = false;
-  FOR_EACH_ENTRY(t, e, {
-    StgTVar *s;
-    s = e -> tvar;
-    if (s == tvar) {
-      found = true;
-      if (e -> expected_value != expected_value) {
-        // Must abort if the two entries start from different values
-        TRACE("%p : update entries inconsistent at %p (%p vs %p)",
-              t, tvar, e -> expected_value, expected_value);
-        t -> state = TREC_CONDEMNED;
+/*
+ * Note [TRec index]
+ * ~~~~~~~~~~~~~~~~~
+ *
+ * Finding the entry for a TVar in a TRec means scanning its chunks, so a
+ * transaction that accesses N TVars does O(N^2) work.  Once a scan of a TRec
+ * has gone through +RTS --stm-index-threshold entries without finding the
+ * TVar, we build a TRecIndex for it: an open-addressing hash table from TVar
+ * to TRecEntry, which find_entry() uses from then on.  The default, 16, is
+ * one chunk's worth: from 32 TVars up, building the index then costs less
+ * than the scans it saves, and a larger threshold only delays that (with
+ * 64, a transaction of 64 TVars took nearly four times as long).
+ *
+ * Entries are only ever added to a TRec by get_new_entry(), so rather than
+ * updating the index at each place that adds one, the index remembers how
+ * far through the chunks it has got (chunk, next), and catch_up_trec_index()
+ * adds any newer entries before each lookup.  merge_update_into() and
+ * merge_read_into() work on nested transactions through find_entry() like
+ * everything else.
+ *
+ * The table is keyed on addresses of TVars, which the GC may move (the
+ * TRecChunks it points into stay put; see Note [TRec chunk arena]).  So an
+ * index only lasts until the next GC:
+ * TRecIndexes live outside the heap, on the list cap -> trec_indexes of the
+ * Capability that built them, and stmPreGCHook frees them all.  The TRec
+ * points to its index, but the index is used only while trec -> index_epoch
+ * matches trec_index_epoch, which stmPreGCHook advances; a TRec that
+ * survives the GC builds a new index when it next needs one.
+ *
+ * When a TRec is freed its index is marked unused (index -> trec = NULL),
+ * so that the Capability that built it can reuse it.  That may happen on
+ * another Capability if the thread has migrated, which is why the owner
+ * only ever takes indexes that are unused.
+ */
+
+typedef struct TRecIndex_ {
+  StgTRecHeader      *trec;     // NULL if unused
+  StgTRecChunk       *chunk;    // entries up to here are in the table
+  StgWord             next;     // ... and up to this one in chunk
+  StgWord             size;     // number of slots, a power of 2
+  StgWord             count;    // number of slots in use
+  TRecEntry         **slots;
+  struct TRecIndex_  *link;     // on cap -> trec_indexes
+} TRecIndex;
+
+#define TREC_INDEX_MIN_SIZE 128
+
+static volatile StgWord trec_index_epoch = 1;
+
+static StgWord trec_index_hash(TRecIndex *ix, StgTVar *tvar) {
+  // Fibonacci hashing: TVars are allocated a few words apart, so the low
+  // bits of their addresses are not enough on their own.
+#if SIZEOF_VOID_P == 8
+  return ((StgWord)tvar * 11400714819323198485ULL) >> 32 & (ix -> size - 1);
+#else
+  return ((StgWord)tvar * 2654435769UL) >> 8 & (ix -> size - 1);
+#endif
+}
+
+static void insert_trec_index(TRecIndex *ix, TRecEntry *e);
+
+static void grow_trec_index(TRecIndex *ix) {
+  TRecEntry **old = ix -> slots;
+  StgWord old_size = ix -> size;
+  StgWord i;
+
+  ix -> size = old_size * 2;
+  ix -> count = 0;
+  ix -> slots = stgCallocBytes(ix -> size, sizeof(TRecEntry *),
+                               "grow_trec_index");
+  for (i = 0; i < old_size; i++) {
+    if (old[i] != NULL) {
+      insert_trec_index(ix, old[i]);
+    }
+  }
+  stgFree(old);
+}
+
+static void insert_trec_index(TRecIndex *ix, TRecEntry *e) {
+  StgWord i;
+
+  if (2 * (ix -> count + 1) > ix -> size) {
+    grow_trec_index(ix);
+  }
+  for (i = trec_index_hash(ix, e -> tvar);
+       ix -> slots[i] != NULL;
+       i = (i + 1) & (ix -> size - 1)) {
+    ASSERT(ix -> slots[i] -> tvar != e -> tvar);
+  }
+  ix -> slots[i] = e;
+  ix -> count ++;
+}
+
+// Add the entries of trec added since the index was last brought up to date
+static void catch_up_trec_index(TRecIndex *ix, StgTRecHeader *trec) {
+  StgTRecChunk *c = trec -> current_chunk;
+  StgWord i;
+
+  if (c == ix -> chunk && c -> next_entry_idx == ix -> next) {
+    return;
+  }
+  while (c != ix -> chunk) {
+    for (i = 0; i < c -> next_entry_idx; i++) {
+      insert_trec_index(ix, &(c -> entries[i]));
+    }
+    c = c -> prev_chunk;
+  }
+  if (c != END_STM_CHUNK_LIST) {
+    for (i = ix -> next; i < c -> next_entry_idx; i++) {
+      insert_trec_index(ix, &(c -> entries[i]));
+    }
+  }
+  ix -> chunk = trec -> current_chunk;
+  ix -> next = trec -> current_chunk -> next_entry_idx;
+}
+
+static void build_trec_index(Capability *cap, StgTRecHeader *trec) {
+  TRecIndex *ix;
+
+  TRACE("%p : build_trec_index", trec);
+
+  for (ix = cap -> trec_indexes; ix != NULL; ix = ix -> link) {
+    if (ix -> trec == NULL) {
+      break;
+    }
+  }
+  if (ix == NULL) {
+    ix = stgMallocBytes(sizeof(TRecIndex), "build_trec_index");
+    ix -> size = TREC_INDEX_MIN_SIZE;
+    ix -> slots = stgMallocBytes(ix -> size * sizeof(TRecEntry *),
+                                 "build_trec_index");
+    ix -> link = cap -> trec_indexes;
+    cap -> trec_indexes = ix;
+  }
+  memset(ix -> slots, 0, ix -> size * sizeof(TRecEntry *));
+  ix -> trec = trec;
+  ix -> chunk = END_STM_CHUNK_LIST;
+  ix -> next = 0;
+  ix -> count = 0;
+  catch_up_trec_index(ix, trec);
+
+  trec -> index = ix;
+  trec -> index_epoch = trec_index_epoch;
+}
+
+static void release_trec_index(StgTRecHeader *trec) {
+  if (trec -> index != NULL && trec -> index_epoch == trec_index_epoch) {
+    // The owning Capability may pick the index up as soon as it sees
+    // trec == NULL
+    write_barrier();
+    trec -> index -> trec = NULL;
+  }
+  trec -> index = NULL;
+}
+
+static void free_trec_indexes(Capability *cap) {
+  TRecIndex *ix, *next;
+
+  for (ix = cap -> trec_indexes; ix != NULL; ix = next) {
+    next = ix -> link;
+    stgFree(ix -> slots);
+    stgFree(ix);
+  }
+  cap -> trec_indexes = NULL;
+}
+
+// find_entry : the entry for tvar in trec (not its enclosing TRecs), or NULL
+static TRecEntry *find_entry(Capability *cap,
+                             StgTRecHeader *trec,
+                             StgTVar *tvar) {
+  TRecEntry *result = NULL;
+  StgWord n = 0;
+
+  if (trec -> index != NULL && trec -> index_epoch == trec_index_epoch) {
+    TRecIndex *ix = trec -> index;
+    StgWord i;
+
+    ASSERT(ix -> trec == trec);
+    catch_up_trec_index(ix, trec);
+    for (i = trec_index_hash(ix, tvar);
+         ix -> slots[i] != NULL;
+         i = (i + 1) & (ix -> size - 1)) {
+      if (ix -> slots[i] -> tvar == tvar) {
+        return ix -> slots[i];
       }
-      e -> new_value = new_value;
+    }
+    return NULL;
+  }
+
+  FOR_EACH_ENTRY(trec, e, {
+    if (e -> tvar == tvar) {
+      result = e;
       BREAK_FOR_EACH;
     }
+    n ++;
   });
 
-  if (!found) {
+  if (result == NULL && RtsFlags.MiscFlags.stmIndexThreshold != 0 &&
+      n >= RtsFlags.MiscFlags.stmIndexThreshold) {
+    build_trec_index(cap, trec);
+  }
+
+  return result;
+}
+
+/*......................................................................*/
+
+// The version of the TVar seen by an entry goes wherever the entry is
+// copied, so that it can still be checked against the TVar; see
+// Note [STM version clock].
+#if defined(THREADED_RTS)
+#define COPY_ENTRY_VERSION(_to,_from) ((_to) -> num_updates = (_from) -> num_updates)
+#else
+#define COPY_ENTRY_VERSION(_to,_from) /* nothing */
+#endif
+
+static void merge_update_into(Capability *cap,
+                              StgTRecHeader *t,
+                              TRecEntry *from)
+{
+  StgTVar *tvar = from -> tvar;
+  StgClosure *expected_value = from -> expected_value;
+  StgClosure *new_value = from -> new_value;
+
+  // Look for an entry in this trec
+  TRecEntry *e = find_entry(cap, t, tvar);
+  if (e != NULL) {
+    if (e -> expected_value != expected_value) {
+      // Must abort if the two entries start from different values
+      TRACE("%p : update entries inconsistent at %p (%p vs %p)",
+            t, tvar, e -> expected_value, expected_value);
+      t -> state = TREC_CONDEMNED;
+    }
+    e -> new_value = new_value;
+  } else {
     // No entry so far in this trec
     TRecEntry *ne;
     ne = get_new_entry(cap, t);
     ne -> tvar = tvar;
     ne -> expected_value = expected_value;
     ne -> new_value = new_value;
+    COPY_ENTRY_VERSION(ne, from);
   }
 }
 
@@ -638,11 +1060,12 @@ static void merge_update_into(Capability *cap,
 
 static void merge_read_into(Capability *cap,
                             StgTRecHeader *trec,
-                            StgTVar *tvar,
-                            StgClosure *expected_value)
+                            TRecEntry *from)
 {
+  StgTVar *tvar = from -> tvar;
+  StgClosure *expected_value = from -> expected_value;
   StgTRecHeader *t;
-  bool found = false;
+  TRecEntry *e = NULL;
 
   //
   // See #7493
@@ -665,29 +1088,25 @@ static void merge_read_into(Capability *cap,
   // write e->new_value over the outer entry, because the inner entry
   // is the most up to date.
   //
-  for (t = trec; !found && t != NO_TREC; t = t -> enclosing_trec)
+  for (t = trec; e == NULL && t != NO_TREC; t = t -> enclosing_trec)
   {
-    FOR_EACH_ENTRY(t, e, {
-      if (e -> tvar == tvar) {
-        found = true;
-        if (e -> expected_value != expected_value) {
-            // Must abort if the two entries start from different values
-            TRACE("%p : read entries inconsistent at %p (%p vs %p)",
-                  t, tvar, e -> expected_value, expected_value);
-            t -> state = TREC_CONDEMNED;
-        }
-        BREAK_FOR_EACH;
-      }
-    });
+    e = find_entry(cap, t, tvar);
+    if (e != NULL && e -> expected_value != expected_value) {
+        // Must abort if the two entries start from different values
+        TRACE("%p : read entries inconsistent at %p (%p vs %p)",
+              t, tvar, e -> expected_value, expected_value);
+        t -> state = TREC_CONDEMNED;
+    }
   }
 
-  if (!found) {
+  if (e == NULL) {
     // No entry found
     TRecEntry *ne;
     ne = get_new_entry(cap, trec);
     ne -> tvar = tvar;
     ne -> expected_value = expected_value;
     ne -> new_value = expected_value;
+    COPY_ENTRY_VERSION(ne, from);
   }
 }
 
@@ -739,6 +1158,19 @@ static void revert_ownership(Capability *cap STG_UNUSED,
 
 /*......................................................................*/
 
+// record_conflict : remember in the top-level TRec of a nest that tvar
+// failed validation, for the EVENT_STM_ABORT posted if the transaction
+// fails to commit.  See Note [STM contention management].
+
+static void record_conflict(StgTRecHeader *trec, StgTVar *tvar) {
+  while (trec -> enclosing_trec != NO_TREC) {
+    trec = trec -> enclosing_trec;
+  }
+  trec -> conflict = (StgWord)tvar;
+}
+
+/*......................................................................*/
+
 // validate_and_acquire_ownership : this performs the twin functions
 // of checking that the TVars referred to by entries in trec hold the
 // expected values and:
@@ -775,25 +1207,33 @@ static StgBool validate_and_acquire_ownership (Capability *cap,
         TRACE("%p : trying to acquire %p", trec, s);
         if (!cond_lock_tvar(trec, s, e -> expected_value)) {
           TRACE("%p : failed to acquire %p", trec, s);
+          record_conflict(trec, s);
           result = false;
           BREAK_FOR_EACH;
         }
       } else {
         ASSERT(config_use_read_phase);
         IF_STM_FG_LOCKS({
-          TRACE("%p : will need to check %p", trec, s);
-          if (s -> current_value != e -> expected_value) {
-            TRACE("%p : doesn't match", trec);
-            result = false;
-            BREAK_FOR_EACH;
-          }
-          e -> num_updates = s -> num_updates;
-          if (s -> current_value != e -> expected_value) {
-            TRACE("%p : doesn't match (race)", trec);
-            result = false;
-            BREAK_FOR_EACH;
-          } else {
-            TRACE("%p : need to check version %ld", trec, e -> num_updates);
+          // With the version clock, e -> num_updates already holds the
+          // version seen when the TVar was read, and check_read_only will
+          // compare it with the TVar's if it needs to.
+          if (!USE_VERSION_CLOCK) {
+            TRACE("%p : will need to check %p", trec, s);
+            if (s -> current_value != e -> expected_value) {
+              TRACE("%p : doesn't match", trec);
+              record_conflict(trec, s);
+              result = false;
+              BREAK_FOR_EACH;
+            }
+            e -> num_updates = s -> num_updates;
+            if (s -> current_value != e -> expected_value) {
+              TRACE("%p : doesn't match (race)", trec);
+              record_conflict(trec, s);
+              result = false;
+              BREAK_FOR_EACH;
+            } else {
+              TRACE("%p : need to check version %ld", trec, e -> num_updates);
+            }
           }
         });
       }
@@ -835,6 +1275,7 @@ static StgBool check_read_only(StgTRecHeader *trec STG_UNUSED) {
         if (s -> current_value != e -> expected_value ||
             s -> num_updates != e -> num_updates) {
           TRACE("%p : mismatch", trec);
+          record_conflict(trec, s);
           result = false;
           BREAK_FOR_EACH;
         }
@@ -852,11 +1293,22 @@ void stmPreGCHook (Capability *cap) {
   lock_stm(NO_TREC);
   TRACE("stmPreGCHook");
   cap->free_tvar_watch_queues = END_STM_WATCH_QUEUE;
-  cap->free_trec_chunks = END_STM_CHUNK_LIST;
+  // Free TRecs have no chunks, so we can simply drop them; the chunks
+  // themselves are not in the heap and stay on cap->free_trec_chunks.
+  // See Note [TRec chunk arena]
   cap->free_trec_headers = NO_TREC;
+  // TVars and TRecs move, so every TRec index must be rebuilt; see
+  // Note [TRec index]
+  free_trec_indexes(cap);
+  atomic_inc(&trec_index_epoch, 1);
   unlock_stm(NO_TREC);
 }
 
+void stmFreeCapability (Capability *cap) {
+  free_trec_indexes(cap);
+  free_trec_slabs(cap);
+}
+
 /************************************************************************/
 
 // check_read_only relies on version numbers held in TVars' "num_updates"
@@ -896,6 +1348,197 @@ static void getToken(Capability *cap STG_UNUSED) {
 
 /*......................................................................*/
 
+/*
+ * Note [STM version clock]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * By default, a transaction that commits checks every TVar it has only read
+ * (validate_and_acquire_ownership then check_read_only), however long ago it
+ * read it.  A transaction that reads thousands of TVars pays for that on
+ * every commit, and in the meantime may run on an inconsistent view of
+ * memory until the scheduler next validates it.
+ *
+ * With +RTS --stm-version-clock we instead use a global version clock, as in
+ * TL2 (Dice, Shalev and Shavit, "Transactional Locking II", DISC 2006):
+ *
+ *   - Every commit that updates a TVar advances stm_clock, *after* locking the
+ *     TVars it updates, and stamps them with the new time (the "write
+ *     version") in their num_updates field before unlocking them.
+ *
+ *   - A top-level transaction records the time at which it starts in
+ *     trec -> read_version, and nested transactions copy it.
+ *
+ *   - When a transaction first reads a TVar, it records the version it saw
+ *     in the entry (read_current_value_and_version).  If the version is newer
+ *     than read_version, another transaction has committed to the TVar since
+ *     we started, so we check every entry of the nest against its TVar
+ *     (extend_read_version): if none has changed, we can move read_version up
+ *     to the current time; otherwise the nest is condemned.  The read still
+ *     returns the value it found, so a condemned transaction can go on
+ *     running on an inconsistent view, as without the clock, until the
+ *     scheduler next validates it or it tries to commit; only then is the
+ *     inconsistency acted on, and the transaction restarted.
+ *
+ *   - At commit, once the updated TVars are locked, if the clock shows that
+ *     no other transaction has committed since read_version, every TVar we
+ *     read still holds the value we saw and we skip check_read_only.  A
+ *     transaction that commits a write at time read_version+1 is in the same
+ *     position.  Otherwise check_read_only compares each TVar's version with
+ *     the one recorded when it was read.
+ *
+ * A transaction with a write version no later than our read_version locked
+ * its TVars before we read the clock, so we either saw its writes or waited
+ * for its locks in read_current_value; that is why the clock is advanced
+ * only after locking.  Read-only transactions do not advance the clock.
+ */
+
+#if defined(STM_FG_LOCKS)
+static volatile StgWord stm_clock = 0;
+
+// commit_version : called by stmCommitTransaction once the TVars updated
+// by trec are locked.  Returns the write version to stamp them with, and
+// sets *unchanged if no other transaction has committed since
+// trec -> read_version.
+static StgWord commit_version(StgTRecHeader *trec, StgBool *unchanged) {
+  StgBool updates = false;
+  StgWord result = 0;
+
+  FOR_EACH_ENTRY(trec, e, {
+    if (entry_is_update(e)) {
+      updates = true;
+      BREAK_FOR_EACH;
+    }
+  });
+
+  if (updates) {
+    result = atomic_inc(&stm_clock, 1);
+    *unchanged = (result == trec -> read_version + 1);
+  } else {
+    *unchanged = (stm_clock == trec -> read_version);
+  }
+  TRACE("%p : read version %lu, write version %lu", trec,
+        (unsigned long)trec -> read_version, (unsigned long)result);
+  return result;
+}
+#endif
+
+/*......................................................................*/
+
+/*
+ * Note [STM contention management]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * A transaction that fails to commit is normally re-run at once.  A long
+ * transaction that shares TVars with short ones can then fail for ever,
+ * because one of the short ones always commits first.  So tso->stm_retries
+ * counts the failed commits of the thread's current atomically block in a
+ * row (it is reset when the block commits or blocks in retry, and by
+ * stg_atomicallyzh when a block starts, in case the last one was left by an
+ * exception), and:
+ *
+ *   - From the second failure in a row, the thread backs off before
+ *     running the transaction again, by yielding 2^(stm_retries - 2)
+ *     times, at most 2^STM_MAX_BACKOFF_SHIFT.  stg_atomically_frame does
+ *     this by pushing stg_atomically_backoff_frame and yielding; the frame
+ *     yields again until stmBackoff() says that it is time to re-run the
+ *     transaction.  Meanwhile tso->trec is a new, empty TRec, so that the
+ *     rest of the RTS sees an ordinary thread inside atomically.
+ *
+ *   - After +RTS --stm-irrevocable-after=<n> failures in a row, the thread
+ *     must take the irrevocable token (stm_irrevocable) before running
+ *     again, and keeps yielding while another thread holds it.  While the
+ *     token is held, every other transaction that has written a TVar fails
+ *     to commit, so the holder can only fail because of commits that were
+ *     already under way when it took the token.  Read-only transactions
+ *     still commit: they cannot invalidate the holder.  This is not truly
+ *     irrevocable -- the transaction runs speculatively as usual -- but it
+ *     serialises the writers behind it.  The token is released when its
+ *     TRec (trec->irrevocable) commits or fails to, is aborted, or waits in
+ *     retry; a holder that failed takes it again when it restarts, unless
+ *     another starving thread got there first.
+ *
+ * Each failed commit posts an EVENT_STM_ABORT with one of the
+ * STM_ABORT_* reasons and the TVar that failed validation, which
+ * record_conflict() stores in the top-level TRec (trec->conflict).  The
+ * address identifies the TVar only until the next GC moves it.
+ */
+
+#define STM_MAX_BACKOFF_SHIFT 6
+
+static volatile StgWord stm_irrevocable = false;
+
+static void release_irrevocable(StgTRecHeader *trec) {
+  if (trec -> irrevocable) {
+    TRACE("%p : releasing the irrevocable token", trec);
+    trec -> irrevocable = false;
+    write_barrier();
+    stm_irrevocable = false;
+  }
+}
+
+// Called when a top-level transaction has committed (result) or failed to.
+static void commit_finished(Capability *cap, StgTRecHeader *trec,
+                            StgBool result, StgWord8 reason) {
+  StgTSO *tso = cap -> r.rCurrentTSO;
+
+  release_irrevocable(trec);
+  if (result) {
+    tso -> stm_retries = 0;
+    tso -> stm_backoff = 0;
+    tso -> flags &= ~TSO_STM_WOKEN;
+  } else {
+    if (tso -> stm_retries < STG_WORD16_MAX) {
+      tso -> stm_retries ++;
+    }
+    if (tso -> stm_retries >= 2) {
+      tso -> stm_backoff = 1 << stg_min(tso -> stm_retries - 2,
+                                        STM_MAX_BACKOFF_SHIFT);
+    }
+    // Start the re-run with a chunk big enough for all the entries that
+    // this attempt had; see Note [TRec chunk arena]
+    cap -> trec_chunk_hint = trec_chunk_class(trec_num_entries(trec));
+    if (reason == STM_ABORT_CONFLICT && trec -> conflict == 0) {
+      reason = STM_ABORT_OTHER;
+    }
+    traceStmAbort(cap, tso, trec -> conflict, reason);
+  }
+}
+
+StgBool stmBackoff(Capability *cap, StgTSO *tso) {
+  StgTRecHeader *trec = tso -> trec;
+  uint32_t irrevocable_after = RtsFlags.MiscFlags.stmIrrevocableAfter;
+
+  ASSERT(trec != NO_TREC && trec -> enclosing_trec == NO_TREC);
+
+  if (irrevocable_after != 0 && tso -> stm_retries >= irrevocable_after) {
+    if (cas(&stm_irrevocable, false, true) != false) {
+      TRACE("%p : waiting for the irrevocable token", trec);
+      // as in yield#, so that the thread goes to the back of the run queue
+      cap -> context_switch = 1;
+      return true;
+    }
+    TRACE("%p : took the irrevocable token after %d failures",
+          trec, tso -> stm_retries);
+    trec -> irrevocable = true;
+    tso -> stm_backoff = 0;
+  } else if (tso -> stm_backoff > 0) {
+    tso -> stm_backoff --;
+    cap -> context_switch = 1;
+    return true;
+  }
+
+  // trec has no entries yet, so it may as well start now rather than
+  // before we backed off.
+  IF_STM_FG_LOCKS({
+    if (USE_VERSION_CLOCK) {
+      trec -> read_version = stm_clock;
+    }
+  });
+  return false;
+}
+
+/*......................................................................*/
+
 StgTRecHeader *stmStartTransaction(Capability *cap,
                                    StgTRecHeader *outer) {
   StgTRecHeader *t;
@@ -906,6 +1549,11 @@ StgTRecHeader *stmStartTransaction(Capability *cap,
   getToken(cap);
 
   t = alloc_stg_trec_header(cap, outer);
+  IF_STM_FG_LOCKS({
+    if (USE_VERSION_CLOCK) {
+      t -> read_version = (outer == NO_TREC) ? stm_clock : outer -> read_version;
+    }
+  });
   TRACE("%p : stmStartTransaction()=%p", outer, t);
   return t;
 }
@@ -928,6 +1576,7 @@ void stmAbortTransaction(Capability *cap,
     // We're a top-level transaction: remove any watch queue entries that
     // we may have.
     TRACE("%p : aborting top-level transaction", trec);
+    release_irrevocable(trec);
 
     if (trec -> state == TREC_WAITING) {
       ASSERT(trec -> enclosing_trec == NO_TREC);
@@ -940,8 +1589,7 @@ void stmAbortTransaction(Capability *cap,
     TRACE("%p : retaining read-set into parent %p", trec, et);
 
     FOR_EACH_ENTRY(trec, e, {
-      StgTVar *s = e -> tvar;
-      merge_read_into(cap, et, s, e -> expected_value);
+      merge_read_into(cap, et, e);
     });
   }
 
@@ -1019,22 +1667,17 @@ StgBool stmValidateNestOfTransactions(Capability *cap, StgTRecHeader *trec) {
 
 /*......................................................................*/
 
-static TRecEntry *get_entry_for(StgTRecHeader *trec, StgTVar *tvar, StgTRecHeader **in) {
+static TRecEntry *get_entry_for(Capability *cap, StgTRecHeader *trec, StgTVar *tvar, StgTRecHeader **in) {
   TRecEntry *result = NULL;
 
   TRACE("%p : get_entry_for TVar %p", trec, tvar);
   ASSERT(trec != NO_TREC);
 
   do {
-    FOR_EACH_ENTRY(trec, e, {
-      if (e -> tvar == tvar) {
-        result = e;
-        if (in != NULL) {
-          *in = trec;
-        }
-        BREAK_FOR_EACH;
-      }
-    });
+    result = find_entry(cap, trec, tvar);
+    if (result != NULL && in != NULL) {
+      *in = trec;
+    }
     trec = trec -> enclosing_trec;
   } while (result == NULL && trec != NO_TREC);
 
@@ -1043,12 +1686,120 @@ static TRecEntry *get_entry_for(StgTRecHeader *trec, StgTVar *tvar, StgTRecHeade
 
 /*......................................................................*/
 
+/*
+ * Note [Read-only commits]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * A transaction that has not written to any TVar (trec -> has_writes, which
+ * stmCommitNestedTransaction passes on to the enclosing TRec) has no TVars
+ * to lock and no waiters to wake.  stmCommitTransaction hands it to
+ * commit_read_only(), which only checks that the TVars it read form a
+ * consistent snapshot:
+ *
+ *   - With STM_FG_LOCKS, without taking any locks: it records the version
+ *     of each TVar while checking its value, then check_read_only() checks
+ *     that none has changed since.  These are the same two passes as the
+ *     read phase of a read-write commit.  With --stm-version-clock each
+ *     read has already been checked against the transaction's read version
+ *     (Note [STM version clock]), so a transaction that has not been
+ *     condemned commits without looking at its TVars at all.
+ *
+ *   - Otherwise, under lock_stm(), by checking that every TVar still holds
+ *     the value that was read.
+ *
+ * Read-only commits, and read-only transactions that failed to commit, are
+ * counted apart from read-write ones, and reported by +RTS -s.
+ */
+
+static StgBool commit_read_only(StgTRecHeader *trec,
+                                StgInt64 max_commits_at_start STG_UNUSED) {
+  StgBool result;
+
+  TRACE("%p : commit_read_only()", trec);
+  result = (trec -> state != TREC_CONDEMNED) && !shake();
+
+#if defined(STM_FG_LOCKS)
+  if (result && !USE_VERSION_CLOCK) {
+    StgInt64 max_concurrent_commits;
+
+    FOR_EACH_ENTRY(trec, e, {
+      StgTVar *s;
+      s = e -> tvar;
+      ASSERT(entry_is_read_only(e));
+      if (s -> current_value != e -> expected_value) {
+        record_conflict(trec, s);
+        result = false;
+        BREAK_FOR_EACH;
+      }
+      e -> num_updates = s -> num_updates;
+      if (s -> current_value != e -> expected_value) {
+        record_conflict(trec, s);
+        result = false;
+        BREAK_FOR_EACH;
+      }
+    });
+
+    if (result) {
+      result = check_read_only(trec);
+    }
+
+    // See the comment on max_commits
+    max_concurrent_commits = ((max_commits - max_commits_at_start) +
+                              (n_capabilities * TOKEN_BATCH_SIZE));
+    if ((max_concurrent_commits >> 32) > 0) {
+      result = false;
+    }
+  }
+#else
+  if (result) {
+    lock_stm(trec);
+    FOR_EACH_ENTRY(trec, e, {
+      if (e -> tvar -> current_value != e -> expected_value) {
+        record_conflict(trec, e -> tvar);
+        result = false;
+        BREAK_FOR_EACH;
+      }
+    });
+    unlock_stm(trec);
+  }
+#endif
+
+  TRACE("%p : commit_read_only()=%d", trec, result);
+  return result;
+}
+
 StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
   StgInt64 max_commits_at_start = max_commits;
+  StgWord write_version STG_UNUSED = 0;
+  StgWord wakeup_stamp = 0; // see Note [STM wakeups]
 
   TRACE("%p : stmCommitTransaction()", trec);
   ASSERT(trec != NO_TREC);
 
+  if (!trec -> has_writes) {
+    // See Note [Read-only commits]
+    StgBool result = commit_read_only(trec, max_commits_at_start);
+    if (result) {
+      cap -> stm_ro_commits ++;
+    } else {
+      cap -> stm_ro_aborts ++;
+    }
+    commit_finished(cap, trec, result, STM_ABORT_CONFLICT);
+    free_stg_trec_header(cap, trec);
+    TRACE("%p : stmCommitTransaction()=%d", trec, result);
+    return result;
+  }
+
+  if (stm_irrevocable && !trec -> irrevocable) {
+    // Another transaction is irrevocable; see
+    // Note [STM contention management]
+    TRACE("%p : another transaction is irrevocable", trec);
+    cap -> stm_aborts ++;
+    commit_finished(cap, trec, false, STM_ABORT_IRREVOCABLE);
+    free_stg_trec_header(cap, trec);
+    return false;
+  }
+
   lock_stm(trec);
 
   ASSERT(trec -> enclosing_trec == NO_TREC);
@@ -1066,9 +1817,19 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
     if (config_use_read_phase) {
       StgInt64 max_commits_at_end;
       StgInt64 max_concurrent_commits;
-      TRACE("%p : doing read check", trec);
-      result = check_read_only(trec);
-      TRACE("%p : read-check %s", trec, result ? "succeeded" : "failed");
+      StgBool unchanged = false;
+      IF_STM_FG_LOCKS({
+        if (USE_VERSION_CLOCK) {
+          write_version = commit_version(trec, &unchanged);
+        }
+      });
+      if (unchanged) {
+        TRACE("%p : version clock unchanged, no read check", trec);
+      } else {
+        TRACE("%p : doing read check", trec);
+        result = check_read_only(trec);
+        TRACE("%p : read-check %s", trec, result ? "succeeded" : "failed");
+      }
 
       max_commits_at_end = max_commits;
       max_concurrent_commits = ((max_commits_at_end - max_commits_at_start) +
@@ -1093,9 +1854,16 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
 
           ACQ_ASSERT(tvar_is_locked(s, trec));
           TRACE("%p : writing %p to %p, waking waiters", trec, e -> new_value, s);
-          unpark_waiters_on(cap,s);
+          unpark_waiters_on(cap, s, e -> new_value, &wakeup_stamp);
           IF_STM_FG_LOCKS({
-            s -> num_updates ++;
+            if (USE_VERSION_CLOCK) {
+              // Readers must see the new version before the new value;
+              // see Note [STM version clock].
+              s -> num_updates = (StgInt)write_version;
+              write_barrier();
+            } else {
+              s -> num_updates ++;
+            }
           });
           unlock_tvar(cap, trec, s, e -> new_value, true);
         }
@@ -1108,6 +1876,13 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
 
   unlock_stm(trec);
 
+  if (result) {
+    cap -> stm_commits ++;
+  } else {
+    cap -> stm_aborts ++;
+  }
+  commit_finished(cap, trec, result, STM_ABORT_CONFLICT);
+
   free_stg_trec_header(cap, trec);
 
   TRACE("%p : stmCommitTransaction()=%d", trec, result);
@@ -1131,8 +1906,14 @@ StgBool stmCommitNestedTransaction(Capability *cap, StgTRecHeader *trec) {
     // We now know that all the updated locations hold their expected values.
 
     if (config_use_read_phase) {
-      TRACE("%p : doing read check", trec);
-      result = check_read_only(trec);
+      StgBool unchanged = false;
+      IF_STM_FG_LOCKS({
+        unchanged = USE_VERSION_CLOCK && stm_clock == trec -> read_version;
+      });
+      if (!unchanged) {
+        TRACE("%p : doing read check", trec);
+        result = check_read_only(trec);
+      }
     }
     if (result) {
       // We now know that all of the read-only locations held their expected values
@@ -1149,9 +1930,12 @@ StgBool stmCommitNestedTransaction(Capability *cap, StgTRecHeader *trec) {
         if (entry_is_update(e)) {
             unlock_tvar(cap, trec, s, e -> expected_value, false);
         }
-        merge_update_into(cap, et, s, e -> expected_value, e -> new_value);
+        merge_update_into(cap, et, e);
         ACQ_ASSERT(s -> current_value != (StgClosure *)trec);
       });
+      if (trec -> has_writes) {
+        et -> has_writes = true;
+      }
     } else {
         revert_ownership(cap, trec, false);
     }
@@ -1175,6 +1959,17 @@ StgBool stmWait(Capability *cap, StgTSO *tso, StgTRecHeader *trec) {
   ASSERT((trec -> state == TREC_ACTIVE) ||
          (trec -> state == TREC_CONDEMNED));
 
+  // Waiting is not contention; see Note [STM contention management]
+  release_irrevocable(trec);
+  tso -> stm_retries = 0;
+  tso -> stm_backoff = 0;
+
+  // See Note [STM wakeups]
+  if (tso -> flags & TSO_STM_WOKEN) {
+    tso -> flags &= ~TSO_STM_WOKEN;
+    cap -> stm_spurious_reruns ++;
+  }
+
   lock_stm(trec);
   bool result = validate_and_acquire_ownership(cap, trec, true, true);
   if (result) {
@@ -1233,6 +2028,7 @@ StgBool stmReWait(Capability *cap, StgTSO *tso) {
     ASSERT(trec -> state == TREC_WAITING);
     park_tso(tso);
     revert_ownership(cap, trec, true);
+    cap -> stm_spurious_wakeups ++;
   } else {
     // The transcation has become invalid.  We can now remove it from the wait
     // queues.
@@ -1240,6 +2036,7 @@ StgBool stmReWait(Capability *cap, StgTSO *tso) {
       remove_watch_queue_entries_for_trec (cap, trec);
     }
     free_stg_trec_header(cap, trec);
+    tso -> flags |= TSO_STM_WOKEN;
   }
   unlock_stm(trec);
 
@@ -1264,6 +2061,79 @@ static StgClosure *read_current_value(StgTRecHeader *trec STG_UNUSED, StgTVar *t
   return result;
 }
 
+#if defined(STM_FG_LOCKS)
+// extend_read_version : called when a transaction reads a TVar written since
+// its read version.  Checks that no TVar read by the nest has been written
+// since it was read, and if so moves the read version of the nest to the
+// current time.  See Note [STM version clock].
+static StgBool extend_read_version(StgTRecHeader *trec) {
+  StgTRecHeader *t;
+  StgWord now;
+  StgBool result = true;
+
+  now = stm_clock;
+  load_load_barrier();
+
+  for (t = trec; result && t != NO_TREC; t = t -> enclosing_trec) {
+    FOR_EACH_ENTRY(t, e, {
+      StgTVar *s = e -> tvar;
+      if (s -> current_value != e -> expected_value ||
+          s -> num_updates != e -> num_updates) {
+        TRACE("%p : TVar %p changed since read", trec, s);
+        record_conflict(trec, s);
+        result = false;
+        BREAK_FOR_EACH;
+      }
+    });
+  }
+
+  for (t = trec; t != NO_TREC; t = t -> enclosing_trec) {
+    if (result) {
+      t -> read_version = now;
+    } else {
+      t -> state = TREC_CONDEMNED;
+    }
+  }
+
+  TRACE("%p : extend_read_version to %lu %s", trec, (unsigned long)now,
+        result ? "succeeded" : "failed");
+  return result;
+}
+#endif
+
+// read_current_value_and_version : read_current_value, also returning the
+// version of the TVar that the value belongs to.  With the version clock,
+// also check that the value is consistent with the rest of the transaction.
+static StgClosure *read_current_value_and_version(StgTRecHeader *trec,
+                                                  StgTVar *tvar,
+                                                  StgInt *num_updates) {
+  StgClosure *result;
+
+#if defined(STM_FG_LOCKS)
+  if (USE_VERSION_CLOCK) {
+    // The version is written before the value is unlocked, so if the
+    // value has not changed around our read of the version, the version
+    // belongs to the value.
+    do {
+      result = read_current_value(trec, tvar);
+      load_load_barrier();
+      *num_updates = tvar -> num_updates;
+      load_load_barrier();
+    } while (tvar -> current_value != result);
+
+    if ((StgWord)*num_updates > trec -> read_version &&
+        trec -> state == TREC_ACTIVE) {
+      extend_read_version(trec);
+    }
+    return result;
+  }
+#endif
+
+  result = read_current_value(trec, tvar);
+  *num_updates = 0; // recorded at commit time instead
+  return result;
+}
+
 /*......................................................................*/
 
 StgClosure *stmReadTVar(Capability *cap,
@@ -1277,7 +2147,7 @@ StgClosure *stmReadTVar(Capability *cap,
   ASSERT(trec -> state == TREC_ACTIVE ||
          trec -> state == TREC_CONDEMNED);
 
-  entry = get_entry_for(trec, tvar, &entry_in);
+  entry = get_entry_for(cap, trec, tvar, &entry_in);
 
   if (entry != NULL) {
     if (entry_in == trec) {
@@ -1289,15 +2159,21 @@ StgClosure *stmReadTVar(Capability *cap,
       new_entry -> tvar = tvar;
       new_entry -> expected_value = entry -> expected_value;
       new_entry -> new_value = entry -> new_value;
+      COPY_ENTRY_VERSION(new_entry, entry);
       result = new_entry -> new_value;
     }
   } else {
     // No entry found
-    StgClosure *current_value = read_current_value(trec, tvar);
+    StgInt num_updates;
+    StgClosure *current_value =
+        read_current_value_and_version(trec, tvar, &num_updates);
     TRecEntry *new_entry = get_new_entry(cap, trec);
     new_entry -> tvar = tvar;
     new_entry -> expected_value = current_value;
     new_entry -> new_value = current_value;
+    IF_STM_FG_LOCKS({
+      new_entry -> num_updates = num_updates;
+    });
     result = current_value;
   }
 
@@ -1319,7 +2195,8 @@ void stmWriteTVar(Capability *cap,
   ASSERT(trec -> state == TREC_ACTIVE ||
          trec -> state == TREC_CONDEMNED);
 
-  entry = get_entry_for(trec, tvar, &entry_in);
+  trec -> has_writes = true;
+  entry = get_entry_for(cap, trec, tvar, &entry_in);
 
   if (entry != NULL) {
     if (entry_in == trec) {
@@ -1331,14 +2208,20 @@ void stmWriteTVar(Capability *cap,
       new_entry -> tvar = tvar;
       new_entry -> expected_value = entry -> expected_value;
       new_entry -> new_value = new_value;
+      COPY_ENTRY_VERSION(new_entry, entry);
     }
   } else {
     // No entry found
-    StgClosure *current_value = read_current_value(trec, tvar);
+    StgInt num_updates;
+    StgClosure *current_value =
+        read_current_value_and_version(trec, tvar, &num_updates);
     TRecEntry *new_entry = get_new_entry(cap, trec);
     new_entry -> tvar = tvar;
     new_entry -> expected_value = current_value;
     new_entry -> new_value = new_value;
+    IF_STM_FG_LOCKS({
+      new_entry -> num_updates = num_updates;
+    });
   }
 
   TRACE("%p : stmWriteTVar done", trec);
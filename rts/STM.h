@@ -49,6 +49,10 @@
 
 void stmPreGCHook(Capability *cap);
 
+/* Free the STM data held by a Capability, at shutdown */
+
+void stmFreeCapability(Capability *cap);
+
 /*----------------------------------------------------------------------
 
    Transaction context management
@@ -147,6 +151,15 @@ StgBool stmValidateNestOfTransactions(Capability *cap, StgTRecHeader *trec);
 StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec);
 StgBool stmCommitNestedTransaction(Capability *cap, StgTRecHeader *trec);
 
+/*
+ * Called after a failed commit, once a new transaction has been started
+ * in tso->trec, and again each time the thread has yielded.  Returns true
+ * if the thread should yield before running the transaction again.  See
+ * Note [STM contention management] in STM.c.
+ */
+
+StgBool stmBackoff(Capability *cap, StgTSO *tso);
+
 /*
  * Test whether the current transaction context is valid and, if so,
  * start the thread waiting for updates to any of the tvars it has
@@ -25,6 +25,7 @@
 #include "Updates.h"
 #include "Proftimer.h"
 #include "ProfHeap.h"
+#include "RetainerProfile.h"
 #include "Weak.h"
 #include "sm/GC.h" // waitForGcThreads, releaseGCThreads, N
 #include "sm/GCThread.h"
@@ -32,8 +33,11 @@
 #include "Capability.h"
 #include "Task.h"
 #include "AwaitEvent.h"
+#include "AutoCaps.h"
 #if defined(mingw32_HOST_OS)
 #include "win32/IOManager.h"
+#else
+#include "posix/IOURing.h"
 #endif
 #include "Trace.h"
 #include "RaiseAsync.h"
@@ -71,7 +75,6 @@
 // Blocked/sleeping threads
 StgTSO *blocked_queue_hd = NULL;
 StgTSO *blocked_queue_tl = NULL;
-StgTSO *sleeping_queue = NULL;    // perhaps replace with a hash table?
 #endif
 
 // Bytes allocated since the last time a HeapOverflow exception was thrown by
@@ -133,6 +136,7 @@ static void acquireAllCapabilities(Capability *cap, Task *task);
 static void releaseAllCapabilities(uint32_t n, Capability *cap, Task *task);
 static void startWorkerTasks (uint32_t from USED_IF_THREADS,
                               uint32_t to USED_IF_THREADS);
+static void startSpareWorkerTasks (uint32_t from, uint32_t to);
 #endif
 static void scheduleStartSignalHandlers (Capability *cap);
 static void scheduleCheckBlockedThreads (Capability *cap);
@@ -324,7 +328,7 @@ schedule (Capability *initialCapability, Task *task)
                            "thread %lu bound to another OS thread",
                            (unsigned long)t->id);
                 // no, bound to a different Haskell thread: pass to that thread
-                pushOnRunQueue(cap,t);
+                unpopRunQueue(cap,t);
                 continue;
             }
         } else {
@@ -335,7 +339,7 @@ schedule (Capability *initialCapability, Task *task)
                            (unsigned long)t->id);
                 // no, the current native thread is bound to a different
                 // Haskell thread, so pass it to any worker thread
-                pushOnRunQueue(cap,t);
+                unpopRunQueue(cap,t);
                 continue;
             }
         }
@@ -373,7 +377,8 @@ schedule (Capability *initialCapability, Task *task)
 
     /* context switches are initiated by the timer signal, unless
      * the user specified "context switch as often as possible", with
-     * +RTS -C0
+     * +RTS -C0 (ctxtSwitchTicks is -1 when --alloc-slice replaces the
+     * timer instead; see Note [Allocation slices])
      */
     if (RtsFlags.ConcFlags.ctxtSwitchTicks == 0
         && !emptyThreadQueues(cap)) {
@@ -436,6 +441,7 @@ run_thread:
         recent_activity = ACTIVITY_YES;
     }
 
+    traceRunQueueDelay(cap, t);
     traceEventRunThread(cap, t);
 
     switch (prev_what_next) {
@@ -530,6 +536,8 @@ run_thread:
         break;
 
     case ThreadBlocked:
+        // it gets a new slice when it is woken up
+        armAllocSlice(t);
         scheduleHandleThreadBlocked(t);
         break;
 
@@ -552,9 +560,57 @@ run_thread:
  * Run queue operations
  * -------------------------------------------------------------------------- */
 
+/*
+ * Note [Priority classes]
+ * ~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Each thread has a priority class, tso->prio: TSO_PRIO_HIGH,
+ * TSO_PRIO_NORMAL (the default) or TSO_PRIO_LOW, set from Haskell with
+ * GHC.Conc.setThreadPriority.  The run queue of a Capability is still a
+ * single doubly-linked list, but ordered by class: first the high
+ * threads, then the normal ones, then the low ones, each class in FIFO
+ * order.  cap->run_queue_prio_tl[c] is the last thread of class c on the
+ * queue, so appendToRunQueue() and pushOnRunQueue() find their place in
+ * constant time, and popRunQueue() still takes the first thread.
+ *
+ * A thread is queued according to tso->prio, and tso->run_queue_prio
+ * records the part of the queue it went into.  The queue operations only
+ * look at run_queue_prio, so setting the priority of a queued thread
+ * (rts_setThreadPriority() does not take the thread's Capability) only
+ * takes effect the next time the thread is queued.
+ *
+ * To stop the lower classes from starving, cap->run_queue_waits[c]
+ * counts the threads taken off the queue while class c was waiting
+ * behind a more urgent class.  Once it exceeds +RTS --prio-aging=<n>
+ * (default 8, 0 disables), ageRunQueue() moves the first thread of
+ * class c to the front of the queue, as a high thread, so that it runs
+ * next; when it is queued again it goes back to its own class.  If more
+ * than one class is due, the least urgent one goes first.  A thread that
+ * schedule() has taken off the queue but must leave to another Task goes
+ * back to the front with unpopRunQueue(), so that the Task that can run
+ * it sees it at the head (see shouldYieldCapability()).  All of this
+ * is skipped in popRunQueue() when the first and the last threads on the
+ * queue are in the same class, which is always the case in programs
+ * that do not use priorities.
+ *
+ * When the scheduler is traced, the RTS records when each thread is
+ * queued, and EVENT_RUN_QUEUE_DELAY gives the time the thread waited
+ * and its class each time it runs.
+ */
+
 static void
 removeFromRunQueue (Capability *cap, StgTSO *tso)
 {
+    uint32_t prio = tso->run_queue_prio;
+
+    if (cap->run_queue_prio_tl[prio] == tso) {
+        StgTSO *prev = tso->block_info.prev;
+        if (prev != END_TSO_QUEUE && prev->run_queue_prio == prio) {
+            cap->run_queue_prio_tl[prio] = prev;
+        } else {
+            cap->run_queue_prio_tl[prio] = END_TSO_QUEUE;
+        }
+    }
     if (tso->block_info.prev == END_TSO_QUEUE) {
         ASSERT(cap->run_queue_hd == tso);
         cap->run_queue_hd = tso->_link;
@@ -580,6 +636,45 @@ promoteInRunQueue (Capability *cap, StgTSO *tso)
     pushOnRunQueue(cap, tso);
 }
 
+/* Called by popRunQueue() when more than one priority class is waiting:
+ * move a thread of a class that has waited too long to the front of
+ * the run queue.  See Note [Priority classes].
+ */
+void
+ageRunQueue (Capability *cap)
+{
+    uint32_t head_prio, prio, aged;
+    StgTSO *t;
+
+    head_prio = cap->run_queue_hd->run_queue_prio;
+    cap->run_queue_waits[head_prio] = 0;
+
+    aged = TSO_PRIO_CLASSES;
+    for (prio = head_prio + 1; prio < TSO_PRIO_CLASSES; prio++) {
+        if (cap->run_queue_prio_tl[prio] == END_TSO_QUEUE) {
+            cap->run_queue_waits[prio] = 0;
+        } else if (++cap->run_queue_waits[prio] >
+                       RtsFlags.ConcFlags.prioAging
+                   && RtsFlags.ConcFlags.prioAging != 0) {
+            aged = prio;
+        }
+    }
+    if (aged == TSO_PRIO_CLASSES) {
+        return;
+    }
+
+    // The first thread of class aged follows the last thread of a more
+    // urgent class, and there is one: the first thread on the queue.
+    t = runQueuePrioTail(cap, aged - 1)->_link;
+    ASSERT(t != END_TSO_QUEUE && t->run_queue_prio == aged);
+    removeFromRunQueue(cap, t);
+    insertIntoRunQueue(cap, END_TSO_QUEUE, t, TSO_PRIO_HIGH, false);
+    cap->run_queue_waits[aged] = 0;
+
+    debugTrace(DEBUG_sched, "cap %d: aged thread %lu (priority class %d)",
+               cap->no, (unsigned long)t->id, aged);
+}
+
 /* ----------------------------------------------------------------------------
  * Setting up the scheduler loop
  * ------------------------------------------------------------------------- */
@@ -609,7 +704,16 @@ scheduleFindWork (Capability **pcap)
 
     scheduleCheckBlockedThreads(*pcap);
 
+#if defined(USE_IOURING)
+    // See Note [io_uring I/O manager] in posix/IOURing.c
+    ioURingPoll(*pcap);
+#endif
+
 #if defined(THREADED_RTS)
+    // See Note [Thread stealing] in Capability.c
+    reclaimStealableThreads(*pcap);
+    if (emptyRunQueue(*pcap)) { stealThreads(*pcap); }
+
     if (emptyRunQueue(*pcap)) { scheduleActivateSpark(*pcap); }
 #endif
 }
@@ -665,6 +769,16 @@ scheduleYield (Capability **pcap, Task *task)
         return;
     }
 
+#if defined(USE_IOURING)
+    // If we are waiting only for I/O, wait for it in the kernel
+    if (emptyRunQueue(cap) && emptyInbox(cap) &&
+        !shouldYieldCapability(cap,task,false) &&
+        ioURingWait(&cap,task)) {
+        *pcap = cap;
+        return;
+    }
+#endif
+
     // otherwise yield (sleep), and keep yielding if necessary.
     do {
         if (doIdleGCWork(cap, false)) {
@@ -748,6 +862,12 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
 
     if (n_free_caps > 0) {
         StgTSO *prev, *t, *next;
+        // the last thread of each priority class that we have kept, and
+        // whether we have passed the last thread of the class on the
+        // run queue; see Note [Priority classes]
+        StgTSO *kept_tl[TSO_PRIO_CLASSES];
+        bool passed_tl[TSO_PRIO_CLASSES];
+        uint32_t prio;
 
         debugTrace(DEBUG_sched,
                    "cap %d: %d threads, %d sparks, and %d free capabilities, sharing...",
@@ -770,6 +890,11 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
         // prev = the previous thread on this cap's run queue
         prev = END_TSO_QUEUE;
 
+        for (prio = 0; prio < TSO_PRIO_CLASSES; prio++) {
+            kept_tl[prio] = END_TSO_QUEUE;
+            passed_tl[prio] = false;
+        }
+
         // We're going to walk through the run queue, migrating threads to other
         // capabilities until we have only keep_threads left.  We might
         // encounter a thread that cannot be migrated, in which case we add it
@@ -781,6 +906,11 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
             next = t->_link;
             t->_link = END_TSO_QUEUE;
 
+            prio = t->run_queue_prio;
+            if (cap->run_queue_prio_tl[prio] == t) {
+                passed_tl[prio] = true;
+            }
+
             // Should we keep this thread?
             if (t->bound == task->incall // don't move my bound thread
                 || tsoLocked(t) // don't move a locked thread
@@ -792,6 +922,7 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
                 }
                 setTSOPrev(cap, t, prev);
                 prev = t;
+                kept_tl[prio] = t;
                 if (keep_threads > 0) keep_threads--;
             }
 
@@ -822,6 +953,14 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
         }
         cap->n_run_queue = n;
 
+        // The rest of the queue is intact, so a class whose last thread
+        // we did not reach keeps its last thread.
+        for (prio = 0; prio < TSO_PRIO_CLASSES; prio++) {
+            if (passed_tl[prio]) {
+                cap->run_queue_prio_tl[prio] = kept_tl[prio];
+            }
+        }
+
         IF_DEBUG(sanity, checkRunQueue(cap));
 
         // release the capabilities
@@ -875,7 +1014,7 @@ scheduleCheckBlockedThreads(Capability *cap USED_IF_NOT_THREADS)
     // run queue is empty, and there are no other tasks running, we
     // can wait indefinitely for something to happen.
     //
-    if ( !emptyQueue(blocked_queue_hd) || !emptyQueue(sleeping_queue) )
+    if ( !EMPTY_BLOCKED_QUEUE() || !EMPTY_SLEEPING_QUEUE() )
     {
         awaitEvent (emptyRunQueue(cap));
     }
@@ -979,7 +1118,7 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
 #if defined(THREADED_RTS)
     Message *m, *next;
     PutMVar *p, *pnext;
-    int r;
+    bool busy;
     Capability *cap = *pcap;
 
     while (!emptyInbox(cap)) {
@@ -989,25 +1128,29 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
             cap = *pcap;
         }
 
-        // don't use a blocking acquire; if the lock is held by
-        // another thread then just carry on.  This seems to avoid
-        // getting stuck in a message ping-pong situation with other
-        // processors.  We'll check the inbox again later anyway.
-        //
-        // We should really use a more efficient queue data structure
-        // here.  The trickiness is that we must ensure a Capability
-        // never goes idle if the inbox is non-empty, which is why we
-        // use cap->lock (cap->lock is released as the last thing
-        // before going idle; see Capability.c:releaseCapability()).
-        r = TRY_ACQUIRE_LOCK(&cap->lock);
-        if (r != 0) return;
-
-        m = cap->inbox;
-        p = cap->putMVars;
-        cap->inbox = (Message*)END_TSO_QUEUE;
-        cap->putMVars = NULL;
+        // Take all the messages at once, without cap->lock; see Note
+        // [Lock-free inbox] in Messages.c
+        m = (Message*)xchg((StgPtr)&cap->inbox, (StgWord)END_TSO_QUEUE);
+        if (m != (Message*)END_TSO_QUEUE) {
+            cap->inbox_batches++;
+        }
 
-        RELEASE_LOCK(&cap->lock);
+        // putMVars still need cap->lock.  Don't use a blocking acquire;
+        // if the lock is held by another thread then just carry on.
+        // This seems to avoid getting stuck in a message ping-pong
+        // situation with other processors.  We'll check again later
+        // anyway.
+        p = NULL;
+        busy = false;
+        if (cap->putMVars != NULL) {
+            if (TRY_ACQUIRE_LOCK(&cap->lock) == 0) {
+                p = cap->putMVars;
+                cap->putMVars = NULL;
+                RELEASE_LOCK(&cap->lock);
+            } else {
+                busy = true;
+            }
+        }
 
         while (m != (Message*)END_TSO_QUEUE) {
             next = m->link;
@@ -1023,6 +1166,8 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
             stgFree(p);
             p = pnext;
         }
+
+        if (busy) return;
     }
 #endif
 }
@@ -1089,6 +1234,7 @@ schedulePostRunThread (Capability *cap, StgTSO *t)
         throwToSelf(cap, t, allocationLimitExceeded_closure);
         ASSIGN_Int64((W_*)&(t->alloc_limit),
                      (StgInt64)RtsFlags.GcFlags.allocLimitGrace * BLOCK_SIZE);
+        armAllocSlice(t);
     }
 
   /* some statistics gathering in the parallel case */
@@ -1181,6 +1327,48 @@ scheduleHandleHeapOverflow( Capability *cap, StgTSO *t )
  * Handle a thread that returned to the scheduler with ThreadYielding
  * -------------------------------------------------------------------------- */
 
+/*
+ * Note [Allocation slices]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Normally a thread's timeslice ends when the timer sets
+ * cap->context_switch (see handle_tick() in Timer.c), which happens every
+ * -C interval for all the Capabilities at once, however long the running
+ * threads have had.  A thread may get anything from one heap block to a
+ * whole interval, depending on when it started and on timer jitter.
+ *
+ * With +RTS --alloc-slice=<size>, or for a thread that has been given a
+ * budget with GHC.Conc.setThreadAllocationSlice, the timeslice ends
+ * instead when the thread has allocated that many bytes.  We count with
+ * tso->alloc_limit, which the code generator and the RTS already
+ * decrease as the thread allocates (see closeNursery() in
+ * StgCmmForeign.hs, and allocate()); it only goes down, unless the
+ * program calls setAllocationCounter.  armAllocSlice() starts a slice by
+ * setting tso->slice_end to alloc_limit minus the budget, and sets
+ * TSO_ALLOC_SLICE.  When the heap check moves on to a new nursery block
+ * (stg_gc_noregs), it returns ThreadYielding if alloc_limit has dropped
+ * below slice_end, just as it does for the allocation limit, and
+ * scheduleHandleYield() puts the thread at the back of its class in the
+ * run queue with a new slice.  setThreadAllocationCounter# moves
+ * slice_end along with alloc_limit, so the slice keeps its budget.
+ *
+ * A thread gets a new slice when it is created, when it blocks, and
+ * when it is descheduled by a context switch or at the end of its slice;
+ * not when it returns to the scheduler for a GC, a stack overflow, or to
+ * let a GC on another Capability proceed.  So a slice is a fixed amount
+ * of allocation, rounded up to a whole nursery block, however often the
+ * thread is interrupted.
+ *
+ * With --alloc-slice, the timer no longer ends timeslices, unless -C is
+ * also given.  Then no high-frequency timer is needed for fairness
+ * between allocating threads, but a thread that does not allocate is
+ * never descheduled unless -C is given too (and the code is compiled with
+ * -fno-omit-yields).  Neither is interpreted code, which only checks for
+ * context switches.  An explicit -C0 still means a context switch at every
+ * heap block, which makes the allocation slice irrelevant: normaliseRtsOpts
+ * sets ctxtSwitchTicks to 0 for -C0 and to -1 for no timer switches at all.
+ */
+
 static bool
 scheduleHandleYield( Capability *cap, StgTSO *t, uint32_t prev_what_next )
 {
@@ -1209,6 +1397,15 @@ scheduleHandleYield( Capability *cap, StgTSO *t, uint32_t prev_what_next )
     // better than the alternative.
     if (cap->context_switch != 0) {
         cap->context_switch = 0;
+        armAllocSlice(t);
+        appendToRunQueue(cap,t);
+    } else if ((t->flags & TSO_ALLOC_SLICE) &&
+               PK_Int64((W_*)&(t->alloc_limit)) <
+               PK_Int64((W_*)&(t->slice_end))) {
+        // end of its slice; see Note [Allocation slices]
+        debugTrace(DEBUG_sched, "--<< thread %ld used up its slice",
+                   (long)t->id);
+        armAllocSlice(t);
         appendToRunQueue(cap,t);
     } else {
         pushOnRunQueue(cap,t);
@@ -1350,9 +1547,18 @@ scheduleNeedHeapProfile( bool ready_to_gc )
         (RtsFlags.ProfFlags.heapProfileInterval==0 &&
          RtsFlags.ProfFlags.doHeapProfile && ready_to_gc)) {
         return true;
-    } else {
-        return false;
     }
+
+#if defined(PROFILING)
+    // An incremental retainer traversal continues at every GC until it is
+    // finished.  See Note [Incremental retainer profiling] in
+    // RetainerProfile.c.
+    if (ready_to_gc && retainerProfilePending()) {
+        return true;
+    }
+#endif
+
+    return false;
 }
 
 /* -----------------------------------------------------------------------------
@@ -1381,7 +1587,9 @@ static void stopAllCapabilities (Capability **pCap, Task *task)
         was_syncing = requestSync(pCap, task, &sync, &prev_sync_type);
     } while (was_syncing);
 
+    stat_startSync();
     acquireAllCapabilities(*pCap,task);
+    stat_endSync(*pCap, SYNC_OTHER);
 
     pending_sync = 0;
 }
@@ -1469,6 +1677,10 @@ static void acquireAllCapabilities(Capability *cap, Task *task)
             if (tmpcap->no != i) {
                 barf("acquireAllCapabilities: got the wrong capability");
             }
+            // See Note [Time to stop] in Stats.c
+            if (tmpcap->sync_thread != 0) {
+                tmpcap->sync_stopped_at = getProcessElapsedTime();
+            }
         }
     }
     task->cap = cap;
@@ -1648,6 +1860,7 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
     }
 
     stat_startGCSync(gc_threads[cap->no]);
+    stat_startSync();
 
 #if defined(DEBUG)
     unsigned int old_n_capabilities = n_capabilities;
@@ -1732,6 +1945,8 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
         ASSERT(checkSparkCountInvariant());
     }
 
+    stat_endSync(cap, gc_type);
+
 #endif
 
     IF_DEBUG(scheduler, printAllThreads());
@@ -1752,7 +1967,7 @@ delete_threads_and_gc:
         // figure out that any remaining sparks are garbage.
         for (i = 0; i < n_capabilities; i++) {
             capabilities[i]->spark_stats.gcd +=
-                sparkPoolSize(capabilities[i]->sparks);
+                sparkPoolSizeCap(capabilities[i]);
             // No race here since all Caps are stopped.
             discardSparksCap(capabilities[i]);
         }
@@ -1806,6 +2021,7 @@ delete_threads_and_gc:
     }
 
     traceSparkCounters(cap);
+    traceWorkerCounters(cap);
 
     switch (recent_activity) {
     case ACTIVITY_INACTIVE:
@@ -2036,6 +2252,13 @@ forkProcess(HsStablePtr *entry
         // all Tasks, because they correspond to OS threads that are
         // now gone.
 
+#if !defined(THREADED_RTS) && defined(HAVE_SYS_EPOLL_H)
+        // The epoll instance is shared with the parent, so forget our
+        // registrations before deleteThread_() takes the threads
+        // blocked on I/O off fd_waiters.
+        resetBlockedOnFd();
+#endif
+
         for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
           for (t = generations[g].threads; t != END_TSO_QUEUE; t = next) {
                 next = t->global_link;
@@ -2080,6 +2303,10 @@ forkProcess(HsStablePtr *entry
             cap->returning_tasks_tl = NULL;
             cap->n_returning_tasks = 0;
 #endif
+#if defined(USE_IOURING)
+            // The rings are shared with the parent
+            resetIOURingAfterFork(cap);
+#endif
 
             // Release all caps except 0, we'll use that for starting
             // the IO manager and running the client action below.
@@ -2108,6 +2335,7 @@ forkProcess(HsStablePtr *entry
 
 #if defined(THREADED_RTS)
         ioManagerStartCap(&cap);
+        resetAutoCapsAfterFork();
 #endif
 
         // Install toplevel exception handlers, so interruption
@@ -2242,6 +2470,9 @@ setNumCapabilities (uint32_t new_n_capabilities USED_IF_THREADS)
         n_capabilities = enabled_capabilities = new_n_capabilities;
     }
 
+    // Fill the worker pools of any new Capabilities
+    startSpareWorkerTasks(old_n_capabilities, n_capabilities);
+
     // We're done: release the original Capabilities
     releaseAllCapabilities(old_n_capabilities, cap,task);
 
@@ -2288,8 +2519,8 @@ deleteAllThreads ()
     // being GC'd, and we don't want the "main thread has been GC'd" panic.
 
 #if !defined(THREADED_RTS)
-    ASSERT(blocked_queue_hd == END_TSO_QUEUE);
-    ASSERT(sleeping_queue == END_TSO_QUEUE);
+    ASSERT(EMPTY_BLOCKED_QUEUE());
+    ASSERT(EMPTY_SLEEPING_QUEUE());
 #endif
 }
 
@@ -2395,11 +2626,21 @@ suspendThread (StgRegTable *reg, bool interruptible)
   // Otherwise allocate() will write to invalid memory.
   cap->r.rCurrentTSO = NULL;
 
+#if defined(THREADED_RTS)
+  cap->ffi_calls++;
+  if (RtsFlags.ParFlags.ffiGracePeriod != 0) {
+      task->ffi_call_start = getMonotonicNSec();
+  }
+#endif
+
   ACQUIRE_LOCK(&cap->lock);
 
   suspendTask(cap,task);
   cap->in_haskell = false;
-  releaseCapability_(cap,false);
+  // See Note [Safe foreign call fast path] in Capability.c
+  if (!tryReserveCapability(cap,task)) {
+      releaseCapability_(cap,false);
+  }
 
   RELEASE_LOCK(&cap->lock);
 
@@ -2431,11 +2672,25 @@ resumeThread (void *task_)
     cap = incall->suspended_cap;
     task->cap = cap;
 
-    // Wait for permission to re-enter the RTS with the result.
-    waitForCapability(&cap,task);
-    // we might be on a different capability now... but if so, our
-    // entry on the suspended_ccalls list will also have been
-    // migrated.
+#if defined(THREADED_RTS)
+    if (RtsFlags.ParFlags.ffiGracePeriod != 0) {
+        StgInt64 d = getMonotonicNSec() - task->ffi_call_start;
+        task->ffi_call_avg += (d - (StgInt64)task->ffi_call_avg) / 8;
+    }
+
+    // See Note [Safe foreign call fast path] in Capability.c
+    if (reclaimCapability(cap,task)) {
+        ASSERT_FULL_CAPABILITY_INVARIANTS(cap,task);
+        cap->ffi_fast_returns++;
+    } else
+#endif
+    {
+        // Wait for permission to re-enter the RTS with the result.
+        waitForCapability(&cap,task);
+        // we might be on a different capability now... but if so, our
+        // entry on the suspended_ccalls list will also have been
+        // migrated.
+    }
 
     // Remove the thread from the suspended list
     recoverSuspendedTask(cap,task);
@@ -2486,6 +2741,14 @@ resumeThread (void *task_)
 void
 scheduleThread(Capability *cap, StgTSO *tso)
 {
+#if defined(THREADED_RTS)
+    // Let idle Capabilities take the thread before we get round to
+    // schedulePushWork().  See Note [Thread stealing] in Capability.c
+    if (pushStealableThread(cap,tso)) {
+        return;
+    }
+#endif
+
     // The thread goes at the *end* of the run-queue, to avoid possible
     // starvation of any threads already on the queue.
     appendToRunQueue(cap,tso);
@@ -2592,6 +2855,29 @@ startWorkerTasks (uint32_t from USED_IF_THREADS, uint32_t to USED_IF_THREADS)
 #endif
 }
 
+#if defined(THREADED_RTS)
+/* ---------------------------------------------------------------------------
+ * Fill the worker pools of Capabilities from--to (+RTS --min-workers).
+ * See Note [Worker pool] in Capability.c.
+ * -------------------------------------------------------------------------- */
+
+static void
+startSpareWorkerTasks (uint32_t from, uint32_t to)
+{
+    uint32_t i, n;
+    Capability *cap;
+
+    for (i = from; i < to; i++) {
+        cap = capabilities[i];
+        ACQUIRE_LOCK(&cap->lock);
+        for (n = 0; n < RtsFlags.ParFlags.minSpareWorkers; n++) {
+            startSpareWorkerTask(cap);
+        }
+        RELEASE_LOCK(&cap->lock);
+    }
+}
+#endif
+
 /* ---------------------------------------------------------------------------
  * initScheduler()
  *
@@ -2607,7 +2893,7 @@ initScheduler(void)
 #if !defined(THREADED_RTS)
   blocked_queue_hd  = END_TSO_QUEUE;
   blocked_queue_tl  = END_TSO_QUEUE;
-  sleeping_queue    = END_TSO_QUEUE;
+  initSleepingQueue();
 #endif
 
   sched_state    = SCHED_RUNNING;
@@ -2638,6 +2924,9 @@ initScheduler(void)
    * worker task hogging it.
    */
   startWorkerTasks(1, n_capabilities);
+#if defined(THREADED_RTS)
+  startSpareWorkerTasks(0, n_capabilities);
+#endif
 
   RELEASE_LOCK(&sched_mutex);
 
@@ -2689,6 +2978,11 @@ freeScheduler( void )
     RELEASE_LOCK(&sched_mutex);
 #if defined(THREADED_RTS)
     closeMutex(&sched_mutex);
+#else
+    freeSleepingQueue();
+#if defined(HAVE_SYS_EPOLL_H)
+    freeBlockedOnFd();
+#endif
 #endif
 }
 
@@ -2698,7 +2992,10 @@ void markScheduler (evac_fn evac USED_IF_NOT_THREADS,
 #if !defined(THREADED_RTS)
     evac(user, (StgClosure **)(void *)&blocked_queue_hd);
     evac(user, (StgClosure **)(void *)&blocked_queue_tl);
-    evac(user, (StgClosure **)(void *)&sleeping_queue);
+    markSleepingQueue(evac, user);
+#if defined(HAVE_SYS_EPOLL_H)
+    markBlockedOnFd(evac, user);
+#endif
 #endif
 }
 
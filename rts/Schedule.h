@@ -11,6 +11,8 @@
 
 #include "rts/OSThreads.h"
 #include "Capability.h"
+#include "AwaitEvent.h"
+#include "SleepingQueue.h"
 #include "Trace.h"
 
 #include "BeginPrivate.h"
@@ -97,7 +99,6 @@ extern volatile StgWord recent_activity;
  */
 #if !defined(THREADED_RTS)
 extern  StgTSO *blocked_queue_hd, *blocked_queue_tl;
-extern  StgTSO *sleeping_queue;
 #endif
 
 extern bool heap_overflow;
@@ -119,7 +120,64 @@ void resurrectThreads (StgTSO *);
 
 /* END_TSO_QUEUE and friends now defined in includes/stg/MiscClosures.h */
 
-/* Add a thread to the end of the run queue.
+/* The last thread on the run queue whose priority class is prio or
+ * more urgent, or END_TSO_QUEUE if there is none.
+ */
+EXTERN_INLINE StgTSO *
+runQueuePrioTail (Capability *cap, uint32_t prio);
+
+EXTERN_INLINE StgTSO *
+runQueuePrioTail (Capability *cap, uint32_t prio)
+{
+    for (;;) {
+        if (cap->run_queue_prio_tl[prio] != END_TSO_QUEUE) {
+            return cap->run_queue_prio_tl[prio];
+        }
+        if (prio == 0) {
+            return END_TSO_QUEUE;
+        }
+        prio--;
+    }
+}
+
+/* Put a thread on the run queue just after prev (at the front if prev
+ * is END_TSO_QUEUE), as the last of its class if last is set and the
+ * first otherwise.
+ */
+EXTERN_INLINE void
+insertIntoRunQueue (Capability *cap, StgTSO *prev, StgTSO *tso,
+                    uint32_t prio, bool last);
+
+EXTERN_INLINE void
+insertIntoRunQueue (Capability *cap, StgTSO *prev, StgTSO *tso,
+                    uint32_t prio, bool last)
+{
+    StgTSO *next;
+
+    if (prev == END_TSO_QUEUE) {
+        next = cap->run_queue_hd;
+        cap->run_queue_hd = tso;
+        tso->block_info.prev = END_TSO_QUEUE;
+    } else {
+        next = prev->_link;
+        setTSOLink(cap, prev, tso);
+        setTSOPrev(cap, tso, prev);
+    }
+    if (next == END_TSO_QUEUE) {
+        tso->_link = END_TSO_QUEUE; // no write barrier req'd
+        cap->run_queue_tl = tso;
+    } else {
+        setTSOLink(cap, tso, next);
+        setTSOPrev(cap, next, tso);
+    }
+    tso->run_queue_prio = prio;
+    if (last || cap->run_queue_prio_tl[prio] == END_TSO_QUEUE) {
+        cap->run_queue_prio_tl[prio] = tso;
+    }
+    cap->n_run_queue++;
+}
+
+/* Add a thread to the end of its priority class on the run queue.
  * NOTE: tso->link should be END_TSO_QUEUE before calling this macro.
  * ASSUMES: cap->running_task is the current task.
  */
@@ -130,18 +188,16 @@ EXTERN_INLINE void
 appendToRunQueue (Capability *cap, StgTSO *tso)
 {
     ASSERT(tso->_link == END_TSO_QUEUE);
-    if (cap->run_queue_hd == END_TSO_QUEUE) {
-        cap->run_queue_hd = tso;
-        tso->block_info.prev = END_TSO_QUEUE;
-    } else {
-        setTSOLink(cap, cap->run_queue_tl, tso);
-        setTSOPrev(cap, tso, cap->run_queue_tl);
+    insertIntoRunQueue(cap, runQueuePrioTail(cap, tso->prio), tso,
+                       tso->prio, true);
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        tso->run_queue_time = (StgWord)getMonotonicNSec();
     }
-    cap->run_queue_tl = tso;
-    cap->n_run_queue++;
 }
 
-/* Push a thread on the beginning of the run queue.
+/* Push a thread on the beginning of its priority class on the run
+ * queue; this is the beginning of the run queue unless threads of a
+ * more urgent class are waiting.
  * ASSUMES: cap->running_task is the current task.
  */
 EXTERN_INLINE void
@@ -150,18 +206,26 @@ pushOnRunQueue (Capability *cap, StgTSO *tso);
 EXTERN_INLINE void
 pushOnRunQueue (Capability *cap, StgTSO *tso)
 {
-    setTSOLink(cap, tso, cap->run_queue_hd);
-    tso->block_info.prev = END_TSO_QUEUE;
-    if (cap->run_queue_hd != END_TSO_QUEUE) {
-        setTSOPrev(cap, cap->run_queue_hd, tso);
-    }
-    cap->run_queue_hd = tso;
-    if (cap->run_queue_tl == END_TSO_QUEUE) {
-        cap->run_queue_tl = tso;
+    insertIntoRunQueue(cap,
+                       tso->prio == 0 ? END_TSO_QUEUE
+                                      : runQueuePrioTail(cap, tso->prio - 1),
+                       tso, tso->prio, false);
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        tso->run_queue_time = (StgWord)getMonotonicNSec();
     }
-    cap->n_run_queue++;
 }
 
+/* Put a thread that popRunQueue() has just returned back where it was,
+ * at the front of the run queue, even if it was there out of turn.
+ */
+INLINE_HEADER void
+unpopRunQueue (Capability *cap, StgTSO *tso)
+{
+    insertIntoRunQueue(cap, END_TSO_QUEUE, tso, tso->run_queue_prio, false);
+}
+
+void ageRunQueue (Capability *cap);
+
 /* Pop the first thread off the runnable queue.
  */
 INLINE_HEADER StgTSO *
@@ -169,6 +233,13 @@ popRunQueue (Capability *cap)
 {
     StgTSO *t = cap->run_queue_hd;
     ASSERT(t != END_TSO_QUEUE);
+    // Only when threads of more than one class are waiting might one of
+    // them be due to run out of turn.
+    if (RTS_UNLIKELY(t->run_queue_prio !=
+                     cap->run_queue_tl->run_queue_prio)) {
+        ageRunQueue(cap);
+        t = cap->run_queue_hd;
+    }
     cap->run_queue_hd = t->_link;
     if (t->_link != END_TSO_QUEUE) {
         t->_link->block_info.prev = END_TSO_QUEUE;
@@ -177,6 +248,9 @@ popRunQueue (Capability *cap)
     if (cap->run_queue_hd == END_TSO_QUEUE) {
         cap->run_queue_tl = END_TSO_QUEUE;
     }
+    if (cap->run_queue_prio_tl[t->run_queue_prio] == t) {
+        cap->run_queue_prio_tl[t->run_queue_prio] = END_TSO_QUEUE;
+    }
     cap->n_run_queue--;
     return t;
 }
@@ -222,14 +296,24 @@ emptyRunQueue(Capability *cap)
 INLINE_HEADER void
 truncateRunQueue(Capability *cap)
 {
+    uint32_t prio;
+
     cap->run_queue_hd = END_TSO_QUEUE;
     cap->run_queue_tl = END_TSO_QUEUE;
+    for (prio = 0; prio < TSO_PRIO_CLASSES; prio++) {
+        cap->run_queue_prio_tl[prio] = END_TSO_QUEUE;
+        cap->run_queue_waits[prio] = 0;
+    }
     cap->n_run_queue = 0;
 }
 
 #if !defined(THREADED_RTS)
+#if defined(HAVE_SYS_EPOLL_H)
+#define EMPTY_BLOCKED_QUEUE()  (emptyBlockedOnFd())
+#else
 #define EMPTY_BLOCKED_QUEUE()  (emptyQueue(blocked_queue_hd))
-#define EMPTY_SLEEPING_QUEUE() (emptyQueue(sleeping_queue))
+#endif
+#define EMPTY_SLEEPING_QUEUE() (emptySleepingQueue())
 #endif
 
 INLINE_HEADER bool
@@ -0,0 +1,204 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * The queue of threads blocked in threadDelay (non-threaded RTS only)
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+
+#include "SleepingQueue.h"
+#include "RtsUtils.h"
+
+#if !defined(THREADED_RTS)
+
+/*
+ * Note [Sleeping queue]
+ * ~~~~~~~~~~~~~~~~~~~~~
+ *
+ * In the non-threaded RTS, a thread that calls threadDelay blocks with
+ * why_blocked == BlockedOnDelay, and the scheduler wakes it up from
+ * awaitEvent() once its target time has passed.  The threads are kept
+ * in a binary min-heap ordered by target time, so that
+ *
+ *   - blocking (insertSleepingThread) and waking up the earliest thread
+ *     (popSleepingThread) are O(log n), and finding the next target time
+ *     for awaitEvent()'s timeout is O(1);
+ *
+ *   - a thread that is interrupted by an asynchronous exception can be
+ *     removed in O(log n) (removeSleepingThread), because each sleeping
+ *     thread records its position in the heap in
+ *     tso->block_info.sleeping_index.
+ *
+ * The target time of each thread is kept in the heap alongside the TSO.
+ * Targets are compared with the same wrap-around trick as
+ * wakeUpSleepingThreads() in posix/Select.c.
+ *
+ * The heap lives outside the Haskell heap, and holds the only reference
+ * to a sleeping thread, so markSleepingQueue() treats every entry as a
+ * root.  A GC may move the TSOs but does not change their order.
+ */
+
+typedef struct {
+    StgWord  target;
+    StgTSO  *tso;
+} SleepingThread;
+
+static SleepingThread *sleeping_heap = NULL;
+static uint32_t n_sleeping = 0;
+static uint32_t sleeping_heap_size = 0;
+
+#define INIT_SLEEPING_HEAP_SIZE 64
+
+#define TARGET_BEFORE(a,b) (((long)(a) - (long)(b)) < 0)
+
+#define HEAP_PARENT(i) (((i) - 1) / 2)
+#define HEAP_LEFT(i)   (2 * (i) + 1)
+
+void
+initSleepingQueue (void)
+{
+    sleeping_heap_size = INIT_SLEEPING_HEAP_SIZE;
+    sleeping_heap = stgMallocBytes(sleeping_heap_size * sizeof(SleepingThread),
+                                   "initSleepingQueue");
+    n_sleeping = 0;
+}
+
+void
+freeSleepingQueue (void)
+{
+    stgFree(sleeping_heap);
+    sleeping_heap = NULL;
+    n_sleeping = 0;
+    sleeping_heap_size = 0;
+}
+
+bool
+emptySleepingQueue (void)
+{
+    return n_sleeping == 0;
+}
+
+STATIC_INLINE void
+setSleepingThread (uint32_t i, SleepingThread s)
+{
+    sleeping_heap[i] = s;
+    s.tso->block_info.sleeping_index = i;
+}
+
+static void
+siftUp (uint32_t i)
+{
+    SleepingThread s = sleeping_heap[i];
+
+    while (i > 0 && TARGET_BEFORE(s.target,
+                                  sleeping_heap[HEAP_PARENT(i)].target)) {
+        setSleepingThread(i, sleeping_heap[HEAP_PARENT(i)]);
+        i = HEAP_PARENT(i);
+    }
+    setSleepingThread(i, s);
+}
+
+static void
+siftDown (uint32_t i)
+{
+    SleepingThread s = sleeping_heap[i];
+    uint32_t child;
+
+    while ((child = HEAP_LEFT(i)) < n_sleeping) {
+        if (child + 1 < n_sleeping &&
+            TARGET_BEFORE(sleeping_heap[child + 1].target,
+                          sleeping_heap[child].target)) {
+            child++;
+        }
+        if (!TARGET_BEFORE(sleeping_heap[child].target, s.target)) {
+            break;
+        }
+        setSleepingThread(i, sleeping_heap[child]);
+        i = child;
+    }
+    setSleepingThread(i, s);
+}
+
+// Remove the entry at position i, filling the hole with the last entry.
+static void
+deleteSleepingThread (uint32_t i)
+{
+    n_sleeping--;
+    if (i == n_sleeping) {
+        return;
+    }
+    sleeping_heap[i] = sleeping_heap[n_sleeping];
+    if (i > 0 && TARGET_BEFORE(sleeping_heap[i].target,
+                               sleeping_heap[HEAP_PARENT(i)].target)) {
+        siftUp(i);
+    } else {
+        siftDown(i);
+    }
+}
+
+void
+insertSleepingThread (StgTSO *tso, StgWord target)
+{
+    ASSERT(tso->why_blocked == BlockedOnDelay);
+
+    if (n_sleeping == sleeping_heap_size) {
+        sleeping_heap_size *= 2;
+        sleeping_heap = stgReallocBytes(sleeping_heap,
+                                        sleeping_heap_size
+                                          * sizeof(SleepingThread),
+                                        "insertSleepingThread");
+    }
+
+    sleeping_heap[n_sleeping].target = target;
+    sleeping_heap[n_sleeping].tso    = tso;
+    n_sleeping++;
+    siftUp(n_sleeping - 1);
+}
+
+void
+removeSleepingThread (StgTSO *tso)
+{
+    uint32_t i = tso->block_info.sleeping_index;
+
+    ASSERT(i < n_sleeping && sleeping_heap[i].tso == tso);
+    deleteSleepingThread(i);
+}
+
+StgWord
+peekSleepingTarget (void)
+{
+    ASSERT(n_sleeping > 0);
+    return sleeping_heap[0].target;
+}
+
+StgTSO *
+popSleepingThread (void)
+{
+    StgTSO *tso;
+
+    ASSERT(n_sleeping > 0);
+    tso = sleeping_heap[0].tso;
+    deleteSleepingThread(0);
+    return tso;
+}
+
+StgWord
+sleepingThreadTarget (StgTSO *tso)
+{
+    return sleeping_heap[tso->block_info.sleeping_index].target;
+}
+
+void
+markSleepingQueue (evac_fn evac, void *user)
+{
+    uint32_t i;
+
+    for (i = 0; i < n_sleeping; i++) {
+        evac(user, (StgClosure **)(void *)&sleeping_heap[i].tso);
+    }
+}
+
+#endif /* !THREADED_RTS */
@@ -0,0 +1,42 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * The queue of threads blocked in threadDelay (non-threaded RTS only)
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "sm/GC.h" // for evac_fn below
+
+#include "BeginPrivate.h"
+
+#if !defined(THREADED_RTS)
+
+void    initSleepingQueue        ( void );
+void    freeSleepingQueue        ( void );
+
+bool    emptySleepingQueue       ( void );
+
+// Put a thread that has just blocked in threadDelay on the queue, to be
+// woken up at the given target time.
+void    insertSleepingThread     ( StgTSO *tso, StgWord target );
+
+// Remove a thread from the queue before its time, e.g. because it has
+// received an asynchronous exception.
+void    removeSleepingThread     ( StgTSO *tso );
+
+// The target time of the thread that is due to wake up first, and
+// removing that thread.  The queue must not be empty.
+StgWord peekSleepingTarget       ( void );
+StgTSO *popSleepingThread        ( void );
+
+// The target time of a thread on the queue
+StgWord sleepingThreadTarget     ( StgTSO *tso );
+
+void    markSleepingQueue        ( evac_fn evac, void *user );
+
+#endif /* !THREADED_RTS */
+
+#include "EndPrivate.h"
@@ -17,6 +17,8 @@
 #include "ThreadLabels.h"
 #include "sm/HeapAlloc.h"
 
+#include <string.h>
+
 #if defined(THREADED_RTS)
 
 SparkPool *
@@ -50,6 +52,100 @@ createSparkThread (Capability *cap)
     appendToRunQueue(cap,tso);
 }
 
+/*
+ * Note [Spark overflow]
+ * ~~~~~~~~~~~~~~~~~~~~~
+ *
+ * The spark pool is a fixed-size work-stealing deque (WSDeque) of
+ * +RTS -e<n> entries.  Programs that spark eagerly, e.g. a parMap over a
+ * long list, can fill it, and we used to silently drop any spark that did
+ * not fit; the work then had to be done sequentially by whoever demanded
+ * the value.
+ *
+ * Growing the deque itself is awkward, because thieves read its elements
+ * without taking a lock.  Instead each Capability has an overflow list,
+ * cap->spark_overflow, that only the owner touches.  newSpark() appends
+ * to it when the pool is full, and refillSparkPool() moves sparks back
+ * into the pool, oldest first, whenever there is room:
+ *
+ *   - in newSpark(), before pushing anything new, so that sparks enter
+ *     the pool in the order they were created;
+ *   - in findSpark(), when the Capability is looking for work;
+ *   - after GC, in pruneSparkQueue().
+ *
+ * The overflow list is bounded by SPARK_OVERFLOW_FACTOR times the pool
+ * size; past that, newSpark() really does drop the spark.  Sparks on the
+ * overflow list count as created (and also as overflowed), and dropped
+ * sparks are counted separately, so the invariant checked by
+ * checkSparkCountInvariant() still holds with the overflow list counted
+ * as part of the pool.
+ *
+ * The eventlog's EVENT_SPARK_COUNTERS has a fixed layout; its overflowed
+ * field carries the number of dropped sparks, which is what it always
+ * meant.
+ *
+ * Sparks that findSpark() steals in a batch from another Capability are
+ * pushed with pushSpark(), which ignores the bound: those sparks were
+ * already counted as created, and there are at most a few of them.
+ */
+
+// How many times bigger than the spark pool the overflow list may grow
+#define SPARK_OVERFLOW_FACTOR 8
+
+static bool
+overflowSpark (Capability *cap, StgClosure *p, bool bounded)
+{
+    uint32_t n = cap->spark_overflow_tl - cap->spark_overflow_hd;
+
+    if (cap->spark_overflow_tl == cap->spark_overflow_size) {
+        if (bounded && n >= (uint32_t)RtsFlags.ParFlags.maxLocalSparks
+                              * SPARK_OVERFLOW_FACTOR) {
+            return false;
+        }
+        if (cap->spark_overflow_hd > 0) {
+            // slide the live entries down to make room
+            memmove(cap->spark_overflow,
+                    cap->spark_overflow + cap->spark_overflow_hd,
+                    n * sizeof(StgClosure *));
+        } else {
+            cap->spark_overflow_size =
+                cap->spark_overflow_size == 0 ? 64
+                                              : cap->spark_overflow_size * 2;
+            cap->spark_overflow =
+                stgReallocBytes(cap->spark_overflow,
+                                cap->spark_overflow_size * sizeof(StgClosure *),
+                                "overflowSpark");
+        }
+        cap->spark_overflow_hd = 0;
+        cap->spark_overflow_tl = n;
+    }
+
+    cap->spark_overflow[cap->spark_overflow_tl++] = p;
+    return true;
+}
+
+void
+refillSparkPool (Capability *cap)
+{
+    while (cap->spark_overflow_hd < cap->spark_overflow_tl) {
+        if (!pushWSDeque(cap->sparks,
+                         cap->spark_overflow[cap->spark_overflow_hd])) {
+            return;
+        }
+        cap->spark_overflow_hd++;
+    }
+    cap->spark_overflow_hd = 0;
+    cap->spark_overflow_tl = 0;
+}
+
+void
+pushSpark (Capability *cap, StgClosure *p)
+{
+    if (cap->spark_overflow_tl != 0 || !pushWSDeque(cap->sparks,p)) {
+        overflowSpark(cap, p, false);
+    }
+}
+
 /* --------------------------------------------------------------------------
  * newSpark: create a new spark, as a result of calling "par"
  * Called directly from STG.
@@ -62,12 +158,20 @@ newSpark (StgRegTable *reg, StgClosure *p)
     SparkPool *pool = cap->sparks;
 
     if (!fizzledSpark(p)) {
-        if (pushWSDeque(pool,p)) {
+        if (RTS_UNLIKELY(cap->spark_overflow_tl != 0)) {
+            refillSparkPool(cap);
+        }
+        if (cap->spark_overflow_tl == 0 && pushWSDeque(pool,p)) {
             cap->spark_stats.created++;
             traceEventSparkCreate(cap);
-        } else {
-            /* overflowing the spark pool */
+        } else if (overflowSpark(cap, p, true)) {
+            /* pool full: keep it on the overflow list */
+            cap->spark_stats.created++;
             cap->spark_stats.overflowed++;
+            traceEventSparkCreate(cap);
+        } else {
+            /* overflow list full too: drop it */
+            cap->spark_stats.dropped++;
             traceEventSparkOverflow(cap);
         }
     } else {
@@ -78,6 +182,67 @@ newSpark (StgRegTable *reg, StgClosure *p)
     return 1;
 }
 
+/* --------------------------------------------------------------------------
+ * pruneSpark: after GC, return the new address of a spark worth keeping,
+ * or NULL (counting it as fizzled or GC'd) if it should be discarded.
+ * -------------------------------------------------------------------------- */
+
+static StgClosure *
+pruneSpark (Capability *cap, StgClosure *spark)
+{
+    StgClosure *tmp;
+    const StgInfoTable *info;
+
+    // We have to be careful here: in the parallel GC, another
+    // thread might evacuate this closure while we're looking at it,
+    // so grab the info pointer just once.
+    if (GET_CLOSURE_TAG(spark) != 0) {
+        // Tagged pointer is a value, so the spark has fizzled.  It
+        // probably never happens that we get a tagged pointer in
+        // the spark pool, because we would have pruned the spark
+        // during the previous GC cycle if it turned out to be
+        // evaluated, but it doesn't hurt to have this check for
+        // robustness.
+        cap->spark_stats.fizzled++;
+        traceEventSparkFizzle(cap);
+        return NULL;
+    }
+
+    info = spark->header.info;
+    if (IS_FORWARDING_PTR(info)) {
+        tmp = (StgClosure*)UN_FORWARDING_PTR(info);
+        /* if valuable work: shift inside the pool */
+        if (closure_SHOULD_SPARK(tmp)) {
+            return tmp;
+        }
+        cap->spark_stats.fizzled++;
+        traceEventSparkFizzle(cap);
+        return NULL;
+    } else if (HEAP_ALLOCED(spark)) {
+        if ((Bdescr((P_)spark)->flags & BF_EVACUATED)) {
+            if (closure_SHOULD_SPARK(spark)) {
+                return spark;
+            }
+            cap->spark_stats.fizzled++;
+            traceEventSparkFizzle(cap);
+            return NULL;
+        }
+        cap->spark_stats.gcd++;
+        traceEventSparkGC(cap);
+        return NULL;
+    } else {
+        if (INFO_PTR_TO_STRUCT(info)->type == THUNK_STATIC) {
+            // We can't tell whether a THUNK_STATIC is garbage or not.
+            // See also Note [STATIC_LINK fields]
+            // isAlive() also ignores static closures (see GCAux.c)
+            return spark;
+        }
+        cap->spark_stats.fizzled++;
+        traceEventSparkFizzle(cap);
+        return NULL;
+    }
+}
+
 /* --------------------------------------------------------------------------
  * Remove all sparks from the spark queues which should not spark any
  * more.  Called after GC. We assume exclusive access to the structure
@@ -89,10 +254,10 @@ void
 pruneSparkQueue (Capability *cap)
 {
     SparkPool *pool;
-    StgClosurePtr spark, tmp, *elements;
+    StgClosurePtr spark, *elements;
     uint32_t n, pruned_sparks; // stats only
     StgWord botInd,oldBotInd,currInd; // indices in array (always < size)
-    const StgInfoTable *info;
+    uint32_t i, j;
 
     n = 0;
     pruned_sparks = 0;
@@ -165,65 +330,13 @@ pruneSparkQueue (Capability *cap)
 
       /* check element at currInd. if valuable, evacuate and move to
          botInd, otherwise move on */
-      spark = elements[currInd];
-
-      // We have to be careful here: in the parallel GC, another
-      // thread might evacuate this closure while we're looking at it,
-      // so grab the info pointer just once.
-      if (GET_CLOSURE_TAG(spark) != 0) {
-          // Tagged pointer is a value, so the spark has fizzled.  It
-          // probably never happens that we get a tagged pointer in
-          // the spark pool, because we would have pruned the spark
-          // during the previous GC cycle if it turned out to be
-          // evaluated, but it doesn't hurt to have this check for
-          // robustness.
-          pruned_sparks++;
-          cap->spark_stats.fizzled++;
-          traceEventSparkFizzle(cap);
+      spark = pruneSpark(cap, elements[currInd]);
+      if (spark != NULL) {
+          elements[botInd] = spark; // keep entry (new address)
+          botInd++;
+          n++;
       } else {
-          info = spark->header.info;
-          if (IS_FORWARDING_PTR(info)) {
-              tmp = (StgClosure*)UN_FORWARDING_PTR(info);
-              /* if valuable work: shift inside the pool */
-              if (closure_SHOULD_SPARK(tmp)) {
-                  elements[botInd] = tmp; // keep entry (new address)
-                  botInd++;
-                  n++;
-              } else {
-                  pruned_sparks++; // discard spark
-                  cap->spark_stats.fizzled++;
-                  traceEventSparkFizzle(cap);
-              }
-          } else if (HEAP_ALLOCED(spark)) {
-              if ((Bdescr((P_)spark)->flags & BF_EVACUATED)) {
-                  if (closure_SHOULD_SPARK(spark)) {
-                      elements[botInd] = spark; // keep entry (new address)
-                      botInd++;
-                      n++;
-                  } else {
-                      pruned_sparks++; // discard spark
-                      cap->spark_stats.fizzled++;
-                      traceEventSparkFizzle(cap);
-                  }
-              } else {
-                  pruned_sparks++; // discard spark
-                  cap->spark_stats.gcd++;
-                  traceEventSparkGC(cap);
-              }
-          } else {
-              if (INFO_PTR_TO_STRUCT(info)->type == THUNK_STATIC) {
-                  // We can't tell whether a THUNK_STATIC is garbage or not.
-                  // See also Note [STATIC_LINK fields]
-                  // isAlive() also ignores static closures (see GCAux.c)
-                  elements[botInd] = spark; // keep entry (new address)
-                  botInd++;
-                  n++;
-              } else {
-                  pruned_sparks++; // discard spark
-                  cap->spark_stats.fizzled++;
-                  traceEventSparkFizzle(cap);
-              }
-          }
+          pruned_sparks++; // discard spark
       }
 
       currInd++;
@@ -243,11 +356,28 @@ pruneSparkQueue (Capability *cap)
     pool->bottom = (oldBotInd <= botInd) ? botInd : (botInd + pool->size);
     // first free place we did not use (corrected by wraparound)
 
+    // Now the overflow list, compacting it as we go
+    j = 0;
+    for (i = cap->spark_overflow_hd; i < cap->spark_overflow_tl; i++) {
+        spark = pruneSpark(cap, cap->spark_overflow[i]);
+        if (spark != NULL) {
+            cap->spark_overflow[j++] = spark;
+        } else {
+            pruned_sparks++;
+        }
+    }
+    cap->spark_overflow_hd = 0;
+    cap->spark_overflow_tl = j;
+
+    // The GC may have made room in the pool; see Note [Spark overflow]
+    refillSparkPool(cap);
+
     debugTrace(DEBUG_sparks, "pruned %d sparks", pruned_sparks);
 
     debugTrace(DEBUG_sparks,
-               "new spark queue len=%ld; (hd=%ld; tl=%ld)",
-               sparkPoolSize(pool), pool->bottom, pool->top);
+               "new spark queue len=%ld; (hd=%ld; tl=%ld); overflow len=%d",
+               sparkPoolSize(pool), pool->bottom, pool->top,
+               cap->spark_overflow_tl);
 
     ASSERT_WSDEQUE_INVARIANTS(pool);
 }
@@ -260,6 +390,7 @@ traverseSparkQueue (evac_fn evac, void *user, Capability *cap)
     StgClosure **sparkp;
     SparkPool *pool;
     StgWord top,bottom, modMask;
+    uint32_t i;
 
     pool = cap->sparks;
 
@@ -279,6 +410,10 @@ traverseSparkQueue (evac_fn evac, void *user, Capability *cap)
       top++;
     }
 
+    for (i = cap->spark_overflow_hd; i < cap->spark_overflow_tl; i++) {
+        evac( user , &cap->spark_overflow[i] );
+    }
+
     debugTrace(DEBUG_sparks,
                "traversed spark queue, len=%ld; (hd=%ld; tl=%ld)",
                sparkPoolSize(pool), pool->bottom, pool->top);
@@ -18,10 +18,12 @@
 typedef struct {
     StgWord created;
     StgWord dud;
-    StgWord overflowed;
+    StgWord overflowed; // kept on the overflow list; also counted in created
+    StgWord dropped;    // discarded because the overflow list was full
     StgWord converted;
     StgWord gcd;
     StgWord fizzled;
+    StgWord stolen;     // taken from another Capability's pool
 } SparkCounters;
 
 #if defined(THREADED_RTS)
@@ -47,6 +49,14 @@ void         createSparkThread (Capability *cap);
 void         traverseSparkQueue(evac_fn evac, void *user, Capability *cap);
 void         pruneSparkQueue   (Capability *cap);
 
+// Push a spark onto cap's own pool, or onto its overflow list if the
+// pool is full.  Never drops the spark.  Owner only.
+void         pushSpark         (Capability *cap, StgClosure *p);
+
+// Move sparks from cap's overflow list into its pool while there is
+// room.  Owner only.
+void         refillSparkPool   (Capability *cap);
+
 INLINE_HEADER void discardSparks  (SparkPool *pool);
 INLINE_HEADER long sparkPoolSize  (SparkPool *pool);
 
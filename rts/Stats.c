@@ -23,6 +23,8 @@
 #include "sm/GC.h"
 #include "ThreadPaused.h"
 #include "Messages.h"
+#include "Printer.h"
+#include "Trace.h"
 
 #include <string.h> // for memset
 
@@ -173,6 +175,13 @@ initStats0(void)
         .any_work = 0,
         .no_work = 0,
         .scav_find_work = 0,
+        .scavenged_static_objects = 0,
+        .skipped_static_objects = 0,
+        .syncs = 0,
+        .max_sync_stop_ns = 0,
+        .max_sync_stop_cap = 0,
+        .max_sync_stop_thread = 0,
+        .sync_stop_histogram = { 0 },
         .init_cpu_ns = 0,
         .init_elapsed_ns = 0,
         .mutator_cpu_ns = 0,
@@ -276,6 +285,101 @@ stat_startGCSync (gc_thread *gct)
     gct->gc_sync_start_elapsed = getProcessElapsedTime();
 }
 
+/* -----------------------------------------------------------------------------
+   Note [Time to stop]
+   ~~~~~~~~~~~~~~~~~~~
+
+   A sync (a GC, or stopAllCapabilities()) cannot start until every
+   Capability has stopped, and a Capability only stops when its thread
+   next comes back to the scheduler.  A thread in a loop that does not
+   allocate never does, and the whole program waits for it.
+
+   To find such threads we time every sync.  stat_startSync() is called
+   once the sync has been requested.  It takes the time, and for each
+   Capability the ID of the thread it is running.  Each Capability that was
+   running a thread then records in cap->sync_stopped_at when it stopped:
+   gcWorkerThread() for a parallel GC, and acquireAllCapabilities() for
+   the others.  Idle Capabilities (sync_thread == 0) are taken over
+   without waiting for a thread, so they leave sync_stopped_at at 0 and
+   are not counted.  stat_endSync() adds each of these times to
+   stats.sync_stop_histogram, keeps the slowest Capability and its thread
+   in stats.max_sync_stop_*, and posts the slowest of this sync as
+   EVENT_SYNC_STOP.
+
+   Only one sync can be in progress at a time, so the static variable
+   below needs no lock.
+   -------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS)
+
+static Time sync_start_elapsed;
+
+void
+stat_startSync (void)
+{
+    uint32_t i;
+    Capability *cap;
+    StgTSO *tso;
+
+    sync_start_elapsed = getProcessElapsedTime();
+
+    for (i = 0; i < n_capabilities; i++) {
+        cap = capabilities[i];
+        cap->sync_stopped_at = 0;
+        // The TSO cannot go away: nothing will GC until we do.
+        tso = (StgTSO *)VOLATILE_LOAD(&cap->r.rCurrentTSO);
+        cap->sync_thread = tso == NULL ? 0 : tso->id;
+    }
+}
+
+static uint32_t
+syncStopBucket (Time t)
+{
+    uint32_t b;
+    StgWord64 us = TimeToUS(t);
+
+    for (b = 0; us != 0 && b < SYNC_STOP_HISTOGRAM_SIZE - 1; b++) {
+        us >>= 1;
+    }
+    return b;
+}
+
+void
+stat_endSync (Capability *me, SyncType type)
+{
+    uint32_t i, n_waited;
+    Capability *cap, *slowest;
+    Time t, max;
+
+    n_waited = 0;
+    slowest = NULL;
+    max = 0;
+    for (i = 0; i < n_capabilities; i++) {
+        cap = capabilities[i];
+        if (cap == me || cap->sync_stopped_at == 0) continue;
+        t = cap->sync_stopped_at - sync_start_elapsed;
+        if (t < 0) t = 0;
+        stats.sync_stop_histogram[syncStopBucket(t)]++;
+        n_waited++;
+        if (slowest == NULL || t > max) {
+            slowest = cap;
+            max = t;
+        }
+    }
+
+    stats.syncs++;
+    if (slowest == NULL) return;
+
+    if (max > stats.max_sync_stop_ns) {
+        stats.max_sync_stop_ns = max;
+        stats.max_sync_stop_cap = slowest->no;
+        stats.max_sync_stop_thread = slowest->sync_thread;
+    }
+    traceSyncStop(me, type, n_waited, slowest->no, max, slowest->sync_thread);
+}
+
+#endif
+
 /* -----------------------------------------------------------------------------
    Called at the beginning of each GC
    -------------------------------------------------------------------------- */
@@ -314,7 +418,7 @@ stat_endGC (Capability *cap, gc_thread *gct, W_ live, W_ copied, W_ slop,
             uint32_t gen, uint32_t par_n_threads, W_ par_max_copied,
             W_ par_balanced_copied, W_ gc_spin_spin, W_ gc_spin_yield,
             W_ mut_spin_spin, W_ mut_spin_yield, W_ any_work, W_ no_work,
-            W_ scav_find_work)
+            W_ scav_find_work, W_ scavenged_static, W_ skipped_static)
 {
     // -------------------------------------------------
     // Collect all the stats about this GC in stats.gc. We always do this since
@@ -404,6 +508,8 @@ stat_endGC (Capability *cap, gc_thread *gct, W_ live, W_ copied, W_ slop,
             stats.max_slop_bytes = stats.gc.slop_bytes;
         }
         stats.cumulative_live_bytes += stats.gc.live_bytes;
+        stats.scavenged_static_objects += scavenged_static;
+        stats.skipped_static_objects += skipped_static;
     }
 
     // -------------------------------------------------
@@ -497,6 +603,22 @@ stat_startRP(void)
 }
 #endif /* PROFILING */
 
+/* -----------------------------------------------------------------------------
+   Called at the end of a slice of an incremental retainer profile that has
+   not finished yet (see Note [Incremental retainer profiling])
+   -------------------------------------------------------------------------- */
+#if defined(PROFILING)
+void
+stat_pauseRP(void)
+{
+    Time user, elapsed;
+    getProcessTimes( &user, &elapsed );
+
+    RP_tot_time += user - RP_start_time;
+    RPe_tot_time += elapsed - RPe_start_time;
+}
+#endif /* PROFILING */
+
 /* -----------------------------------------------------------------------------
    Called at the end of each Retainer Profiliing
    -------------------------------------------------------------------------- */
@@ -702,6 +824,14 @@ static void report_summary(const RTSSummaryStats* sum)
 
     statsPrintf("\n");
 
+    if (stats.major_gcs > 0) {
+        // See Note [Settled static objects] in Storage.h
+        statsPrintf("  Static objects: %" FMT_Word64 " scavenged, %"
+                    FMT_Word64 " skipped (settled)\n\n",
+                    stats.scavenged_static_objects,
+                    stats.skipped_static_objects);
+    }
+
 #if defined(THREADED_RTS)
     if (RtsFlags.ParFlags.parGcEnabled && sum->work_balance > 0) {
         // See Note [Work Balance]
@@ -710,21 +840,99 @@ static void report_summary(const RTSSummaryStats* sum)
                     sum->work_balance * 100);
     }
 
+    if (sum->gc_copy_races > 0) {
+        // See Note [Evacuation races] in sm/Evac.c
+        uint32_t t;
+        statsPrintf("  Parallel GC copy races: %" FMT_Word64 "\n",
+                    sum->gc_copy_races);
+        for (t = 0; t < N_CLOSURE_TYPES; t++) {
+            if (gc_copy_races[t] > 0) {
+                statsPrintf("    %-26s %14" FMT_Word64 "\n",
+                            closure_type_names[t], gc_copy_races[t]);
+            }
+        }
+        statsPrintf("\n");
+    }
+
     statsPrintf("  TASKS: %d "
                 "(%d bound, %d peak workers (%d total), using -N%d)\n\n",
                 taskCount, sum->bound_task_count,
                 peakWorkerCount, workerCount,
                 n_capabilities);
 
+    // See Note [Worker pool] in Capability.c
+    statsPrintf("  WORKERS: %" FMT_Word64 " started, %" FMT_Word64
+                " reused, %" FMT_Word64 " retired\n\n",
+                sum->workers_created, sum->workers_reused,
+                sum->workers_retired);
+
     statsPrintf("  SPARKS: %" FMT_Word64
                 "(%" FMT_Word " converted, %" FMT_Word " overflowed, %"
-                FMT_Word " dud, %" FMT_Word " GC'd, %" FMT_Word " fizzled)\n\n",
+                FMT_Word " dropped, %" FMT_Word " dud, %" FMT_Word " GC'd, %"
+                FMT_Word " fizzled, %" FMT_Word " stolen)\n\n",
                 sum->sparks_count,
                 sum->sparks.converted, sum->sparks.overflowed,
-                sum->sparks.dud, sum->sparks.gcd,
-                sum->sparks.fizzled);
+                sum->sparks.dropped, sum->sparks.dud, sum->sparks.gcd,
+                sum->sparks.fizzled, sum->sparks.stolen);
+
+    // See Note [Safe foreign call fast path] in Capability.c
+    statsPrintf("  SAFE FFI CALLS: %" FMT_Word64
+                " (%" FMT_Word64 " returned without a handoff)\n\n",
+                sum->ffi_calls, sum->ffi_fast_returns);
+
+    // See Note [Lock-free inbox] in Messages.c
+    statsPrintf("  MESSAGES: %" FMT_Word64 " (%" FMT_Word64 " wakeup, %"
+                FMT_Word64 " throwTo, %" FMT_Word64 " blackhole) in %"
+                FMT_Word64 " batches\n\n",
+                sum->msgs_wakeup + sum->msgs_throwto + sum->msgs_blackhole,
+                sum->msgs_wakeup, sum->msgs_throwto, sum->msgs_blackhole,
+                sum->inbox_batches);
+
+    // See Note [Time to stop]
+    if (stats.syncs > 0) {
+        uint32_t b;
+
+        statsPrintf("  SYNCS: %" FMT_Word64 " (slowest stop %.3fms, "
+                    "cap %" FMT_Word32 " running thread %" FMT_Word32 ")\n",
+                    stats.syncs, TimeToSecondsDbl(stats.max_sync_stop_ns) * 1e3,
+                    stats.max_sync_stop_cap, stats.max_sync_stop_thread);
+        statsPrintf("  time to stop:");
+        for (b = 0; b < SYNC_STOP_HISTOGRAM_SIZE; b++) {
+            if (stats.sync_stop_histogram[b] == 0) continue;
+            if (b == SYNC_STOP_HISTOGRAM_SIZE - 1) {
+                statsPrintf(" >=%" FMT_Word64 "us: ", (StgWord64)1 << (b-1));
+            } else {
+                statsPrintf(" <%" FMT_Word64 "us: ", (StgWord64)1 << b);
+            }
+            statsPrintf("%" FMT_Word64, stats.sync_stop_histogram[b]);
+        }
+        statsPrintf("\n\n");
+    }
 #endif
 
+    // See Note [Read-only commits] in STM.c
+    if (sum->stm_commits + sum->stm_aborts +
+        sum->stm_ro_commits + sum->stm_ro_aborts > 0) {
+        statsPrintf("  STM: %" FMT_Word64 " read-only commits (%" FMT_Word64
+                    " failed), %" FMT_Word64 " read-write commits (%"
+                    FMT_Word64 " failed)\n",
+                    sum->stm_ro_commits, sum->stm_ro_aborts,
+                    sum->stm_commits, sum->stm_aborts);
+        // See Note [STM wakeups] in STM.c
+        if (sum->stm_wakeups + sum->stm_wakeups_avoided > 0) {
+            statsPrintf("  STM wakeups: %" FMT_Word64 " (%" FMT_Word64
+                        " avoided), %" FMT_Word64 " back to sleep, %"
+                        FMT_Word64 " retried again\n",
+                        sum->stm_wakeups, sum->stm_wakeups_avoided,
+                        sum->stm_spurious_wakeups, sum->stm_spurious_reruns);
+        }
+        // See Note [TRec chunk arena] in STM.c
+        statsPrintf("  STM arena: %" FMT_Word64 "KB in slabs, %" FMT_Word64
+                    " chunks carved, %" FMT_Word64 " reused\n\n",
+                    sum->stm_arena_bytes / 1024,
+                    sum->stm_chunks_carved, sum->stm_chunks_reused);
+    }
+
     statsPrintf("  INIT    time  %7.3fs  (%7.3fs elapsed)\n",
                 TimeToSecondsDbl(stats.init_cpu_ns),
                 TimeToSecondsDbl(stats.init_elapsed_ns));
@@ -931,6 +1139,10 @@ static void report_machine_readable (const RTSSummaryStats * sum)
             stats.cumulative_par_max_copied_bytes);
     MR_STAT("cumulative_par_balanced_copied_bytes", FMT_Word64,
             stats.cumulative_par_balanced_copied_bytes);
+    MR_STAT("scavenged_static_objects", FMT_Word64,
+            stats.scavenged_static_objects);
+    MR_STAT("skipped_static_objects", FMT_Word64,
+            stats.skipped_static_objects);
 
     // next, the computed fields in RTSSummaryStats
 #if !defined(THREADED_RTS) // THREADED_RTS
@@ -943,6 +1155,17 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("productivity_cpu_percent", "f", sum->productivity_cpu_percent);
     MR_STAT("productivity_wall_percent", "f",
             sum->productivity_elapsed_percent);
+    MR_STAT("stm_commits", FMT_Word64, sum->stm_commits);
+    MR_STAT("stm_aborts", FMT_Word64, sum->stm_aborts);
+    MR_STAT("stm_ro_commits", FMT_Word64, sum->stm_ro_commits);
+    MR_STAT("stm_ro_aborts", FMT_Word64, sum->stm_ro_aborts);
+    MR_STAT("stm_wakeups", FMT_Word64, sum->stm_wakeups);
+    MR_STAT("stm_wakeups_avoided", FMT_Word64, sum->stm_wakeups_avoided);
+    MR_STAT("stm_spurious_wakeups", FMT_Word64, sum->stm_spurious_wakeups);
+    MR_STAT("stm_spurious_reruns", FMT_Word64, sum->stm_spurious_reruns);
+    MR_STAT("stm_arena_bytes", FMT_Word64, sum->stm_arena_bytes);
+    MR_STAT("stm_chunks_carved", FMT_Word64, sum->stm_chunks_carved);
+    MR_STAT("stm_chunks_reused", FMT_Word64, sum->stm_chunks_reused);
 
     // next, the THREADED_RTS fields in RTSSummaryStats
 
@@ -951,10 +1174,36 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("sparks_count", FMT_Word64, sum->sparks_count);
     MR_STAT("sparks_converted", FMT_Word, sum->sparks.converted);
     MR_STAT("sparks_overflowed", FMT_Word, sum->sparks.overflowed);
+    MR_STAT("sparks_dropped", FMT_Word, sum->sparks.dropped);
     MR_STAT("sparks_dud ", FMT_Word, sum->sparks.dud);
     MR_STAT("sparks_gcd", FMT_Word, sum->sparks.gcd);
     MR_STAT("sparks_fizzled", FMT_Word, sum->sparks.fizzled);
+    MR_STAT("sparks_stolen", FMT_Word, sum->sparks.stolen);
+    MR_STAT("ffi_calls", FMT_Word64, sum->ffi_calls);
+    MR_STAT("ffi_fast_returns", FMT_Word64, sum->ffi_fast_returns);
+    MR_STAT("workers_created", FMT_Word64, sum->workers_created);
+    MR_STAT("workers_reused", FMT_Word64, sum->workers_reused);
+    MR_STAT("workers_retired", FMT_Word64, sum->workers_retired);
+    MR_STAT("msgs_wakeup", FMT_Word64, sum->msgs_wakeup);
+    MR_STAT("msgs_throwto", FMT_Word64, sum->msgs_throwto);
+    MR_STAT("msgs_blackhole", FMT_Word64, sum->msgs_blackhole);
+    MR_STAT("inbox_batches", FMT_Word64, sum->inbox_batches);
+    MR_STAT("syncs", FMT_Word64, stats.syncs);
+    MR_STAT("max_sync_stop_seconds", "f",
+            TimeToSecondsDbl(stats.max_sync_stop_ns));
+    MR_STAT("max_sync_stop_cap", FMT_Word32, stats.max_sync_stop_cap);
+    MR_STAT("max_sync_stop_thread", FMT_Word32, stats.max_sync_stop_thread);
     MR_STAT("work_balance", "f", sum->work_balance);
+    MR_STAT("gc_copy_races", FMT_Word64, sum->gc_copy_races);
+    {
+        uint32_t t;
+        for (t = 0; t < N_CLOSURE_TYPES; t++) {
+            if (gc_copy_races[t] > 0) {
+                statsPrintf(" ,(\"gc_copy_races_%s\", \"%" FMT_Word64 "\")\n",
+                            closure_type_names[t], gc_copy_races[t]);
+            }
+        }
+    }
 
     // next, globals (other than internal counters)
     MR_STAT("n_capabilities", FMT_Word32, n_capabilities);
@@ -1150,15 +1399,27 @@ stat_exit (void)
                 sum.sparks.dud       += capabilities[i]->spark_stats.dud;
                 sum.sparks.overflowed+=
                   capabilities[i]->spark_stats.overflowed;
+                sum.sparks.dropped   += capabilities[i]->spark_stats.dropped;
                 sum.sparks.converted +=
                   capabilities[i]->spark_stats.converted;
                 sum.sparks.gcd       += capabilities[i]->spark_stats.gcd;
                 sum.sparks.fizzled   += capabilities[i]->spark_stats.fizzled;
+                sum.sparks.stolen    += capabilities[i]->spark_stats.stolen;
+                sum.ffi_calls        += capabilities[i]->ffi_calls;
+                sum.ffi_fast_returns += capabilities[i]->ffi_fast_returns;
+                sum.workers_created  += capabilities[i]->workers_created;
+                sum.workers_reused   += capabilities[i]->workers_reused;
+                sum.workers_retired  += capabilities[i]->workers_retired;
+                sum.msgs_wakeup      += capabilities[i]->msgs_wakeup;
+                sum.msgs_throwto     += capabilities[i]->msgs_throwto;
+                sum.msgs_blackhole   += capabilities[i]->msgs_blackhole;
+                sum.inbox_batches    += capabilities[i]->inbox_batches;
             }
 
+            // overflowed sparks are also counted in created
             sum.sparks_count = sum.sparks.created
                 + sum.sparks.dud
-                + sum.sparks.overflowed;
+                + sum.sparks.dropped;
 
             if (RtsFlags.ParFlags.parGcEnabled && stats.par_copied_bytes > 0) {
                 // See Note [Work Balance]
@@ -1169,6 +1430,11 @@ stat_exit (void)
                 sum.work_balance = 0;
             }
 
+            sum.gc_copy_races = 0;
+            for (i = 0; i < N_CLOSURE_TYPES; i++) {
+                sum.gc_copy_races += gc_copy_races[i];
+            }
+
 
     #else // THREADED_RTS
             sum.gc_cpu_percent     = stats.gc_cpu_ns
@@ -1177,6 +1443,26 @@ stat_exit (void)
                                   / stats.elapsed_ns;
     #endif // THREADED_RTS
 
+            {
+                uint32_t n;
+                for (n = 0; n < n_capabilities; n++) {
+                    sum.stm_commits    += capabilities[n]->stm_commits;
+                    sum.stm_aborts     += capabilities[n]->stm_aborts;
+                    sum.stm_ro_commits += capabilities[n]->stm_ro_commits;
+                    sum.stm_ro_aborts  += capabilities[n]->stm_ro_aborts;
+                    sum.stm_wakeups    += capabilities[n]->stm_wakeups;
+                    sum.stm_wakeups_avoided +=
+                        capabilities[n]->stm_wakeups_avoided;
+                    sum.stm_spurious_wakeups +=
+                        capabilities[n]->stm_spurious_wakeups;
+                    sum.stm_spurious_reruns +=
+                        capabilities[n]->stm_spurious_reruns;
+                    sum.stm_arena_bytes   += capabilities[n]->trec_slab_bytes;
+                    sum.stm_chunks_carved += capabilities[n]->stm_chunks_carved;
+                    sum.stm_chunks_reused += capabilities[n]->stm_chunks_reused;
+                }
+            }
+
             sum.fragmentation_bytes =
                 (uint64_t)(peak_mblocks_allocated
                          * BLOCKS_PER_MBLOCK
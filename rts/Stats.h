@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include "Capability.h" // for SyncType
 #include "GetTime.h"
 #include "sm/GC.h"
 #include "Sparks.h"
@@ -29,16 +30,22 @@ void      stat_startInit(void);
 void      stat_endInit(void);
 
 void      stat_startGCSync(struct gc_thread_ *_gct);
+#if defined(THREADED_RTS)
+void      stat_startSync(void);
+void      stat_endSync(Capability *me, SyncType type);
+#endif
 void      stat_startGC(Capability *cap, struct gc_thread_ *_gct);
 void      stat_endGC  (Capability *cap, struct gc_thread_ *_gct, W_ live,
                        W_ copied, W_ slop, uint32_t gen, uint32_t n_gc_threads,
                        W_ par_max_copied, W_ par_balanced_copied,
                        W_ gc_spin_spin, W_ gc_spin_yield, W_ mut_spin_spin,
                        W_ mut_spin_yield, W_ any_work, W_ no_work,
-                       W_ scav_find_work);
+                       W_ scav_find_work, W_ scavenged_static,
+                       W_ skipped_static);
 
 #if defined(PROFILING)
 void      stat_startRP(void);
+void      stat_pauseRP(void);
 void      stat_endRP(uint32_t,
 #if defined(DEBUG_RETAINER)
                             uint32_t, int,
@@ -98,11 +105,32 @@ typedef struct RTSSummaryStats_ {
     uint32_t bound_task_count;
     uint64_t sparks_count;
     SparkCounters sparks;
+    uint64_t ffi_calls;
+    uint64_t ffi_fast_returns;
+    uint64_t workers_created;
+    uint64_t workers_reused;
+    uint64_t workers_retired;
+    uint64_t msgs_wakeup;
+    uint64_t msgs_throwto;
+    uint64_t msgs_blackhole;
+    uint64_t inbox_batches;
     double work_balance;
+    uint64_t gc_copy_races;   // total of gc_copy_races[]
 #else // THREADED_RTS
     double gc_cpu_percent;
     double gc_elapsed_percent;
 #endif
+    uint64_t stm_commits;
+    uint64_t stm_aborts;
+    uint64_t stm_ro_commits;
+    uint64_t stm_ro_aborts;
+    uint64_t stm_wakeups;
+    uint64_t stm_wakeups_avoided;
+    uint64_t stm_spurious_wakeups;
+    uint64_t stm_spurious_reruns;
+    uint64_t stm_arena_bytes;
+    uint64_t stm_chunks_carved;
+    uint64_t stm_chunks_reused;
     uint64_t fragmentation_bytes;
     uint64_t average_bytes_used; // This is not shown in the '+RTS -s' report
     uint64_t alloc_rate;
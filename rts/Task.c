@@ -37,6 +37,17 @@ uint32_t peakWorkerCount;
 
 static int tasksInitialized = 0;
 
+#if defined(THREADED_RTS)
+// Spinning for a wakeup only makes sense with more than one processor
+static bool wakeup_spin_enabled = false;
+
+// Bounds on task->wakeup_spin, in iterations of busy_wait_nop().  See
+// Note [Task wakeup]
+#define INIT_WAKEUP_SPIN  256
+#define MIN_WAKEUP_SPIN   16
+#define MAX_WAKEUP_SPIN   8192
+#endif
+
 static void   freeTask  (Task *task);
 static Task * newTask   (bool);
 
@@ -78,6 +89,7 @@ initTaskManager (void)
         newThreadLocalKey(&currentTaskKey);
 #endif
         initMutex(&all_tasks_mutex);
+        wakeup_spin_enabled = getNumberOfProcessors() > 1;
 #endif
     }
 }
@@ -199,7 +211,8 @@ freeTask (Task *task)
     stgFree(task);
 }
 
-/* Must take all_tasks_mutex */
+/* Must take all_tasks_mutex.  Returns NULL if worker is true and there
+ * are already --max-workers workers. */
 static Task*
 newTask (bool worker)
 {
@@ -220,7 +233,13 @@ newTask (bool worker)
 #if defined(THREADED_RTS)
     initCondition(&task->cond);
     initMutex(&task->lock);
-    task->wakeup = false;
+    task->wakeup = TASK_WAKEUP_NONE;
+    task->wakeup_spin = INIT_WAKEUP_SPIN;
+    task->wakeup_time = 0;
+    task->wakeup_latency = 0;
+    task->wakeup_spun = false;
+    task->ffi_call_start = 0;
+    task->ffi_call_avg = 0;
     task->node = 0;
 #endif
 
@@ -228,6 +247,13 @@ newTask (bool worker)
 
     ACQUIRE_LOCK(&all_tasks_mutex);
 
+    if (worker && RtsFlags.ParFlags.maxWorkers != 0 &&
+        currentWorkerCount >= RtsFlags.ParFlags.maxWorkers) {
+        RELEASE_LOCK(&all_tasks_mutex);
+        freeTask(task);
+        return NULL;
+    }
+
     task->all_prev = NULL;
     task->all_next = all_tasks;
     if (all_tasks != NULL) {
@@ -379,6 +405,7 @@ discardTasksExcept (Task *keep)
     all_tasks = keep;
     keep->all_next = NULL;
     keep->all_prev = NULL;
+    currentWorkerCount = keep->worker ? 1 : 0;
     RELEASE_LOCK(&all_tasks_mutex);
 }
 
@@ -416,12 +443,148 @@ workerTaskStop (Task *task)
 
 #if defined(THREADED_RTS)
 
-static void* OSThreadProcAttr
-workerStart(Task *task)
+/* -----------------------------------------------------------------------------
+ * Sleeping and waking up Tasks
+ *
+ * Note [Task wakeup]
+ * ~~~~~~~~~~~~~~~~~~
+ *
+ * A Task waiting for a Capability (in waitForWorkerCapability() or
+ * waitForReturnCapability()) sleeps in waitForWakeup() until the Task
+ * releasing the Capability calls wakeTask() on it.  Code full of bound
+ * threads or safe foreign calls does this very often, and with a
+ * condition variable every handoff costs a mutex round trip on each side
+ * and a trip through the kernel to put the waiter to sleep and another
+ * to wake it up, even when the Capability is released a few
+ * microseconds later.
+ *
+ * On Linux we use task->wakeup directly as a futex word instead:
+ *
+ *   TASK_WAKEUP_NONE      nobody has woken us up yet
+ *   TASK_WAKEUP_PENDING   wakeTask() has been called
+ *   TASK_WAKEUP_SLEEPING  we are asleep in futexWait()
+ *
+ * wakeTask() swaps in PENDING and only enters the kernel if it swapped
+ * out SLEEPING.  waitForWakeup() first spins for up to task->wakeup_spin
+ * iterations waiting for PENDING, and only then swaps NONE for SLEEPING
+ * and goes to sleep.  It leaves NONE behind when it returns.
+ *
+ * The spin limit adapts to the waits we see.  If we went to sleep and
+ * the wakeup came less than WAKEUP_SPIN_NS after we started waiting,
+ * spinning longer would have saved a sleep, so we double the limit; if
+ * it came later than that, spinning was wasted, so we halve it.  On a
+ * single processor we never spin.
+ *
+ * task->lock is still needed to read task->cap, which can change while we
+ * are asleep (see the comment at the top of Task.h).  On other platforms
+ * waitForWakeup() and wakeTask() use task->cond, as they always did.
+ *
+ * When scheduler tracing is on, the Task posts an EVENT_CAP_HANDOFF once
+ * it owns the Capability, giving the time from wakeTask() to then and
+ * whether spinning caught the wakeup.
+ * -------------------------------------------------------------------------- */
+
+// A wait shorter than this would have been worth spinning for (ns)
+#define WAKEUP_SPIN_NS 20000
+
+bool
+waitForWakeup (Task *task, Time timeout)
+{
+    StgWord64 start, now;
+    bool slept = false;
+
+    task->wakeup_spun = false;
+    start = getMonotonicNSec();
+
+#if defined(USE_FUTEX_WAKEUP)
+    uint32_t i, expected;
+
+    if (task->wakeup != TASK_WAKEUP_PENDING && wakeup_spin_enabled) {
+        for (i = 0; i < task->wakeup_spin; i++) {
+            busy_wait_nop();
+            if (task->wakeup == TASK_WAKEUP_PENDING) {
+                task->wakeup_spun = true;
+                break;
+            }
+        }
+    }
+
+    expected = TASK_WAKEUP_NONE;
+    if (__atomic_compare_exchange_n(&task->wakeup, &expected,
+                                    TASK_WAKEUP_SLEEPING, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        slept = true;
+        do {
+            if (!futexWait(&task->wakeup, TASK_WAKEUP_SLEEPING, timeout)) {
+                // Timed out, unless wakeTask() got in just now
+                expected = TASK_WAKEUP_SLEEPING;
+                if (__atomic_compare_exchange_n(&task->wakeup, &expected,
+                                                TASK_WAKEUP_NONE, false,
+                                                __ATOMIC_SEQ_CST,
+                                                __ATOMIC_SEQ_CST)) {
+                    return false;
+                }
+            }
+        } while (task->wakeup == TASK_WAKEUP_SLEEPING);
+    }
+    task->wakeup = TASK_WAKEUP_NONE;
+#else
+    ACQUIRE_LOCK(&task->lock);
+    if (task->wakeup != TASK_WAKEUP_PENDING) {
+        slept = true;
+        if (timeout == 0) {
+            waitCondition(&task->cond, &task->lock);
+        } else if (!timedWaitCondition(&task->cond, &task->lock, timeout) &&
+                   task->wakeup != TASK_WAKEUP_PENDING) {
+            RELEASE_LOCK(&task->lock);
+            return false;
+        }
+    }
+    task->wakeup = TASK_WAKEUP_NONE;
+    RELEASE_LOCK(&task->lock);
+#endif
+
+    now = getMonotonicNSec();
+    task->wakeup_latency =
+        now > task->wakeup_time ? now - task->wakeup_time : 0;
+
+    // See Note [Task wakeup]
+    if (slept && wakeup_spin_enabled && task->wakeup_time > start) {
+        if (task->wakeup_time - start < WAKEUP_SPIN_NS) {
+            if (task->wakeup_spin < MAX_WAKEUP_SPIN) task->wakeup_spin *= 2;
+        } else {
+            if (task->wakeup_spin > MIN_WAKEUP_SPIN) task->wakeup_spin /= 2;
+        }
+    }
+    return true;
+}
+
+void
+wakeTask (Task *task)
+{
+    task->wakeup_time = getMonotonicNSec();
+
+#if defined(USE_FUTEX_WAKEUP)
+    if (__atomic_exchange_n(&task->wakeup, TASK_WAKEUP_PENDING,
+                            __ATOMIC_SEQ_CST) == TASK_WAKEUP_SLEEPING) {
+        futexWake(&task->wakeup, 1);
+    }
+#else
+    ACQUIRE_LOCK(&task->lock);
+    if (task->wakeup != TASK_WAKEUP_PENDING) {
+        task->wakeup = TASK_WAKEUP_PENDING;
+        signalCondition(&task->cond);
+    }
+    RELEASE_LOCK(&task->lock);
+#endif
+}
+
+static Capability *
+workerInit(Task *task)
 {
     Capability *cap;
 
-    // See startWorkerTask().
+    // See createWorkerTask().
     ACQUIRE_LOCK(&task->lock);
     cap = task->cap;
     RELEASE_LOCK(&task->lock);
@@ -436,19 +599,40 @@ workerStart(Task *task)
     // set the thread-local pointer to the Task:
     setMyTask(task);
 
-    newInCall(task);
-
     // Everything set up; emit the event before the worker starts working.
     traceTaskCreate(task, cap);
 
+    return cap;
+}
+
+static void* OSThreadProcAttr
+workerStart(Task *task)
+{
+    Capability *cap;
+
+    cap = workerInit(task);
+    scheduleWorker(cap,task);
+
+    return NULL;
+}
+
+static void* OSThreadProcAttr
+spareWorkerStart(Task *task)
+{
+    Capability *cap;
+
+    workerInit(task);
+    // We were put on cap->spare_workers by startSpareWorkerTask(); wait
+    // until somebody needs us.  See Note [Worker pool] in Capability.c.
+    cap = waitForWorkerCapability(task);
     scheduleWorker(cap,task);
 
     return NULL;
 }
 
 /* N.B. must take all_tasks_mutex */
-void
-startWorkerTask (Capability *cap)
+static bool
+createWorkerTask (Capability *cap, bool spare)
 {
   int r;
   OSThreadId tid;
@@ -456,8 +640,17 @@ startWorkerTask (Capability *cap)
 
   // A worker always gets a fresh Task structure.
   task = newTask(true);
+  if (task == NULL) {
+      debugTrace(DEBUG_sched, "not starting a worker: --max-workers=%d reached",
+                 RtsFlags.ParFlags.maxWorkers);
+      return false;
+  }
   task->stopped = false;
 
+  // Before the thread starts: a spare worker may be handed the
+  // Capability, which looks at task->incall, at any time.
+  newInCall(task);
+
   // The lock here is to synchronise with taskStart(), to make sure
   // that we have finished setting up the Task structure before the
   // worker thread reads it.
@@ -468,11 +661,21 @@ startWorkerTask (Capability *cap)
   task->cap = cap;
   task->node = cap->node;
 
-  // Give the capability directly to the worker; we can't let anyone
-  // else get in, because the new worker Task has nowhere to go to
-  // sleep so that it could be woken up again.
   ASSERT_LOCK_HELD(&cap->lock);
-  cap->running_task = task;
+  if (spare) {
+      // Put the worker straight on the spare_workers list, as if it had
+      // been through enqueueWorker().  Wakeups are sticky, so it does not
+      // matter if it is given the Capability before it goes to sleep.
+      task->next = cap->spare_workers;
+      cap->spare_workers = task;
+      cap->n_spare_workers++;
+  } else {
+      // Give the capability directly to the worker; we can't let anyone
+      // else get in, because the new worker Task has nowhere to go to
+      // sleep so that it could be woken up again.
+      cap->running_task = task;
+  }
+  cap->workers_created++;
 
   // Set the name of the worker thread to the original process name followed by
   // ":w", but only if we're on Linux where the program_invocation_short_name
@@ -493,7 +696,9 @@ startWorkerTask (Capability *cap)
 #else
   char * worker_name = "ghc_worker";
 #endif
-  r = createOSThread(&tid, worker_name, (OSThreadProc*)workerStart, task);
+  r = createOSThread(&tid, worker_name,
+                     (OSThreadProc*)(spare ? spareWorkerStart : workerStart),
+                     task);
   if (r != 0) {
     sysErrorBelch("failed to create OS thread");
     stg_exit(EXIT_FAILURE);
@@ -505,6 +710,20 @@ startWorkerTask (Capability *cap)
 
   // ok, finished with the Task struct.
   RELEASE_LOCK(&task->lock);
+
+  return true;
+}
+
+bool
+startWorkerTask (Capability *cap)
+{
+  return createWorkerTask(cap, false);
+}
+
+void
+startSpareWorkerTask (Capability *cap)
+{
+  createWorkerTask(cap, true);
 }
 
 void
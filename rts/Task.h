@@ -61,7 +61,7 @@
    If the Task is not currently owned by task->id, then the thread is
    either
 
-      (a) waiting on the condition task->cond.  The Task is either
+      (a) waiting in waitForWakeup().  The Task is either
          (1) a bound Task, the TSO will be on a queue somewhere
          (2) a worker task, on the spare_workers queue of task->cap.
 
@@ -123,11 +123,23 @@ typedef struct Task_ {
     Condition cond;             // used for sleeping & waking up this task
     Mutex lock;                 // lock for the condition variable
 
-    // this flag tells the task whether it should wait on task->cond
-    // or just continue immediately.  It's a workaround for the fact
-    // that signalling a condition variable doesn't do anything if the
-    // thread is already running, but we want it to be sticky.
-    bool wakeup;
+    // TASK_WAKEUP_PENDING tells the task that it should not sleep in
+    // waitForWakeup() but continue immediately: wakeups are sticky,
+    // unlike signalling a condition variable.  With futexes this is
+    // also the futex word.  See Note [Task wakeup] in Task.c
+    volatile uint32_t wakeup;
+
+    uint32_t  wakeup_spin;      // how long to spin before sleeping
+    StgWord64 wakeup_time;      // when wakeTask() was last called (ns)
+    StgWord64 wakeup_latency;   // for the last wakeup, time until we ran
+    bool      wakeup_spun;      // was the last wakeup caught by spinning?
+
+    // When the current safe foreign call started, and a moving average
+    // of how long our safe foreign calls take (ns).  Only maintained
+    // with --ffi-grace; see Note [Safe foreign call fast path] in
+    // Capability.c
+    StgWord64 ffi_call_start;
+    StgWord64 ffi_call_avg;
 #endif
 
     // If the task owns a Capability, task->cap points to it.  (occasionally a
@@ -246,15 +258,48 @@ INLINE_HEADER Task *myTask (void);
 // Workers are attached to the supplied Capability.  This Capability
 // should not currently have a running_task, because the new task
 // will become the running_task for that Capability.
-// Requires: sched_mutex.
+// Requires: sched_mutex.  Returns false, and starts nothing, if there
+// are already --max-workers workers.
+//
+bool startWorkerTask (Capability *cap);
+
+// Start a worker that goes straight onto cap->spare_workers, to wait for
+// work.  See Note [Worker pool] in Capability.c.
+// Requires: cap->lock.
 //
-void startWorkerTask (Capability *cap);
+void startSpareWorkerTask (Capability *cap);
 
 // Interrupts a worker task that is performing an FFI call.  The thread
 // should not be destroyed.
 //
 void interruptWorkerTask (Task *task);
 
+// Values of task->wakeup
+#define TASK_WAKEUP_NONE     0
+#define TASK_WAKEUP_PENDING  1
+#define TASK_WAKEUP_SLEEPING 2 // futexes only: asleep in futexWait()
+
+#if defined(linux_HOST_OS)
+#define USE_FUTEX_WAKEUP 1
+#endif
+
+// Wait until another thread calls wakeTask() on this Task, returning
+// immediately if it has already done so since we last returned.  Called
+// by the Task itself.  Returns false if the timeout (0 for none) expired
+// first.
+//
+bool waitForWakeup (Task *task, Time timeout);
+
+// Wake up a Task sleeping in waitForWakeup(), or make its next call
+// return immediately.
+//
+void wakeTask (Task *task);
+
+// Forget about any wakeup since waitForWakeup() last returned.
+//
+INLINE_HEADER void clearWakeup (Task *task)
+{ task->wakeup = TASK_WAKEUP_NONE; }
+
 #endif /* THREADED_RTS */
 
 // For stats
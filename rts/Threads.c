@@ -111,6 +111,14 @@ createThread(Capability *cap, W_ size)
     ASSIGN_Int64((W_*)&(tso->alloc_limit), 0);
 
     tso->trec = NO_TREC;
+    tso->stm_retries = 0;
+    tso->stm_backoff = 0;
+    tso->prio = TSO_PRIO_NORMAL;
+    tso->run_queue_prio = TSO_PRIO_NORMAL;
+    tso->run_queue_time = 0;
+    ASSIGN_Int64((W_*)&(tso->alloc_slice), 0);
+    ASSIGN_Int64((W_*)&(tso->slice_end), 0);
+    armAllocSlice(tso);
 
 #if defined(PROFILING)
     tso->prof.cccs = CCS_MAIN;
@@ -178,6 +186,66 @@ void rts_disableThreadAllocationLimit(StgPtr tso)
     ((StgTSO *)tso)->flags &= ~TSO_ALLOC_LIMIT;
 }
 
+/* ---------------------------------------------------------------------------
+ * Allocation slices
+ *
+ * See Note [Allocation slices] in Schedule.c.
+ * ------------------------------------------------------------------------ */
+
+void
+armAllocSlice (StgTSO *tso)
+{
+    StgInt64 slice;
+
+    slice = PK_Int64((W_*)&(tso->alloc_slice));
+    if (slice == 0) {
+        slice = (StgInt64)RtsFlags.ConcFlags.allocSlice;
+    }
+    if (slice > 0) {
+        ASSIGN_Int64((W_*)&(tso->slice_end),
+                     PK_Int64((W_*)&(tso->alloc_limit)) - slice);
+        tso->flags |= TSO_ALLOC_SLICE;
+    } else {
+        tso->flags &= ~TSO_ALLOC_SLICE;
+    }
+}
+
+// The new budget applies from the thread's next timeslice.
+void rts_setThreadAllocationSlice(StgPtr tso, HsInt bytes)
+{
+    if (bytes < 0) {
+        barf("rts_setThreadAllocationSlice: negative budget %" FMT_Int,
+             (StgInt)bytes);
+    }
+    ASSIGN_Int64((W_*)&(((StgTSO *)tso)->alloc_slice), (StgInt64)bytes);
+}
+
+HsInt rts_getThreadAllocationSlice(StgPtr tso)
+{
+    return (HsInt)PK_Int64((W_*)&(((StgTSO *)tso)->alloc_slice));
+}
+
+/* ---------------------------------------------------------------------------
+ * Getting and setting the priority class of a thread
+ *
+ * A queued thread stays where it is until it is next queued; see
+ * Note [Priority classes] in Schedule.c.
+ * ------------------------------------------------------------------------ */
+
+void rts_setThreadPriority(StgPtr tso, HsInt prio)
+{
+    if (prio < 0 || prio >= TSO_PRIO_CLASSES) {
+        barf("rts_setThreadPriority: invalid priority class %" FMT_Int,
+             (StgInt)prio);
+    }
+    ((StgTSO *)tso)->prio = (StgWord16)prio;
+}
+
+HsInt rts_getThreadPriority(StgPtr tso)
+{
+    return ((StgTSO *)tso)->prio;
+}
+
 /* -----------------------------------------------------------------------------
    Remove a thread from a queue.
    Fails fatally if the TSO is not on the queue.
@@ -830,7 +898,7 @@ printThreadBlockage(StgTSO *tso)
     debugBelch("is blocked on write to fd %d", (int)(tso->block_info.fd));
     break;
   case BlockedOnDelay:
-    debugBelch("is blocked until %ld", (long)(tso->block_info.target));
+    debugBelch("is blocked until %ld", (long)sleepingThreadTarget(tso));
     break;
 #endif
   case BlockedOnMVar:
@@ -36,6 +36,9 @@ bool removeThreadFromDeQueue   (Capability *cap, StgTSO **head, StgTSO **tail, S
 
 StgBool isThreadBound (StgTSO* tso);
 
+// Start a new allocation slice; see Note [Allocation slices] in Schedule.c
+void armAllocSlice (StgTSO *tso);
+
 // Overfow/underflow
 void threadStackOverflow  (Capability *cap, StgTSO *tso);
 W_   threadStackUnderflow (Capability *cap, StgTSO *tso);
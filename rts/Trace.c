@@ -209,6 +209,10 @@ static void traceSchedEvent_stderr (Capability *cap, EventTypeNum tag,
         debugBelch("cap %d: thread %" FMT_Word " migrating to cap %d\n",
                    cap->no, (W_)tso->id, (int)info1);
         break;
+    case EVENT_STEAL_THREAD:    // (cap, thread, victim_cap)
+        debugBelch("cap %d: stole thread %" FMT_Word " from cap %d\n",
+                   cap->no, (W_)tso->id, (int)info1);
+        break;
     case EVENT_THREAD_WAKEUP:   // (cap, thread, info1_cap)
         debugBelch("cap %d: waking up thread %" FMT_Word " on cap %d\n",
                    cap->no, (W_)tso->id, (int)info1);
@@ -614,6 +618,95 @@ void traceTaskDelete_ (Task *task)
     }
 }
 
+void traceCapHandoff_ (Capability *cap,
+                       Task       *task)
+{
+#if defined(THREADED_RTS)
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        debugBelch("cap %d: handed to task %" FMT_Word64 " after %" FMT_Word64
+                   "ns%s\n", cap->no, serialisableTaskId(task),
+                   task->wakeup_latency, task->wakeup_spun ? " (spun)" : "");
+    } else
+#endif
+    {
+        postCapHandoffEvent(cap, serialisableTaskId(task),
+                            task->wakeup_latency, task->wakeup_spun);
+    }
+#endif
+}
+
+void traceWorkerCounters_ (Capability *cap)
+{
+#if defined(THREADED_RTS)
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        debugBelch("cap %d: workers: %" FMT_Word " started, %" FMT_Word
+                   " reused, %" FMT_Word " retired\n", cap->no,
+                   cap->workers_created, cap->workers_reused,
+                   cap->workers_retired);
+    } else
+#endif
+    {
+        postWorkerCountersEvent(cap, cap->workers_created,
+                                cap->workers_reused, cap->workers_retired);
+    }
+#endif
+}
+
+void traceSyncStop_ (Capability *cap, SyncType type, uint32_t n_waited,
+                     uint32_t slowest, Time time, StgThreadID thread)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        debugBelch("cap %d: sync %d: waited for %d capabilities, slowest "
+                   "cap %d took %" FMT_Word64 "ns (thread %" FMT_Word32 ")\n",
+                   cap->no, (int)type, n_waited, slowest, TimeToNS(time),
+                   thread);
+    } else
+#endif
+    {
+        postSyncStopEvent(cap, (StgWord8)type, (EventCapNo)n_waited,
+                          (EventCapNo)slowest, TimeToNS(time),
+                          (EventThreadID)thread);
+    }
+}
+
+void traceStmAbort_ (Capability *cap, StgTSO *tso, StgWord tvar,
+                     StgWord8 reason)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        debugBelch("cap %d: thread %" FMT_Word ": STM transaction aborted "
+                   "(reason %d, TVar %p)\n",
+                   cap->no, (W_)tso->id, (int)reason, (void *)tvar);
+    } else
+#endif
+    {
+        postStmAbortEvent(cap, (EventThreadID)tso->id, (StgWord64)tvar,
+                          reason);
+    }
+}
+
+void traceRunQueueDelay_ (Capability *cap, StgTSO *tso)
+{
+    // run_queue_time wraps with the word, so this is right for delays
+    // of up to 2^32ns even on 32-bit platforms
+    StgWord delay = (StgWord)getMonotonicNSec() - tso->run_queue_time;
+
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        debugBelch("cap %d: thread %" FMT_Word " (priority class %d) "
+                   "waited %" FMT_Word "ns to run\n",
+                   cap->no, (W_)tso->id, (int)tso->prio, delay);
+    } else
+#endif
+    {
+        postRunQueueDelayEvent(cap, (EventThreadID)tso->id,
+                               (StgWord8)tso->prio, (StgWord64)delay);
+    }
+}
+
 void traceHeapProfBegin(StgWord8 profile_id)
 {
     if (eventlog_enabled) {
@@ -628,6 +721,13 @@ void traceHeapProfSampleBegin(StgInt era)
     }
 }
 
+void traceAllocSampleBegin(StgWord8 profile_id, StgInt era)
+{
+    if (eventlog_enabled) {
+        postAllocSampleBegin(profile_id, era);
+    }
+}
+
 void traceHeapProfSampleString(StgWord8 profile_id,
                                const char *label, StgWord residency)
 {
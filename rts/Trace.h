@@ -286,8 +286,22 @@ void traceTaskMigrate_ (Task       *task,
 
 void traceTaskDelete_ (Task       *task);
 
+void traceCapHandoff_ (Capability *cap,
+                       Task       *task);
+
+void traceWorkerCounters_ (Capability *cap);
+
+void traceSyncStop_ (Capability *cap, SyncType type, uint32_t n_waited,
+                     uint32_t slowest, Time time, StgThreadID thread);
+
+void traceStmAbort_ (Capability *cap, StgTSO *tso, StgWord tvar,
+                     StgWord8 reason);
+
+void traceRunQueueDelay_ (Capability *cap, StgTSO *tso);
+
 void traceHeapProfBegin(StgWord8 profile_id);
 void traceHeapProfSampleBegin(StgInt era);
+void traceAllocSampleBegin(StgWord8 profile_id, StgInt era);
 void traceHeapProfSampleString(StgWord8 profile_id,
                                const char *label, StgWord residency);
 #if defined(PROFILING)
@@ -332,9 +346,16 @@ void flushTrace(void);
 #define traceTaskCreate_(taskID, cap) /* nothing */
 #define traceTaskMigrate_(taskID, cap, new_cap) /* nothing */
 #define traceTaskDelete_(taskID) /* nothing */
+#define traceCapHandoff_(cap, task) /* nothing */
+#define traceWorkerCounters_(cap) /* nothing */
+#define traceSyncStop_(cap, type, n_waited, slowest, time, thread) \
+    /* nothing */
+#define traceStmAbort_(cap, tso, tvar, reason) /* nothing */
+#define traceRunQueueDelay_(cap, tso) /* nothing */
 #define traceHeapProfBegin(profile_id) /* nothing */
 #define traceHeapProfCostCentre(ccID, label, module, srcloc, is_caf) /* nothing */
 #define traceHeapProfSampleBegin(era) /* nothing */
+#define traceAllocSampleBegin(profile_id, era) /* nothing */
 #define traceHeapProfSampleCostCentre(profile_id, stack, residency) /* nothing */
 #define traceHeapProfSampleString(profile_id, label, residency) /* nothing */
 
@@ -368,6 +389,8 @@ void dtraceUserMarkerWrapper(Capability *cap, char *msg);
     HASKELLEVENT_THREAD_RUNNABLE(cap, tid)
 #define dtraceMigrateThread(cap, tid, new_cap)          \
     HASKELLEVENT_MIGRATE_THREAD(cap, tid, new_cap)
+#define dtraceStealThread(cap, tid, victim_cap)         \
+    HASKELLEVENT_STEAL_THREAD(cap, tid, victim_cap)
 #define dtraceThreadWakeup(cap, tid, other_cap)         \
     HASKELLEVENT_THREAD_WAKEUP(cap, tid, other_cap)
 #define dtraceGcStart(cap)                              \
@@ -466,6 +489,7 @@ void dtraceUserMarkerWrapper(Capability *cap, char *msg);
 #define dtraceStopThread(cap, tid, status, info)        /* nothing */
 #define dtraceThreadRunnable(cap, tid)                  /* nothing */
 #define dtraceMigrateThread(cap, tid, new_cap)          /* nothing */
+#define dtraceStealThread(cap, tid, victim_cap)         /* nothing */
 #define dtraceThreadWakeup(cap, tid, other_cap)         /* nothing */
 #define dtraceGcStart(cap)                              /* nothing */
 #define dtraceGcEnd(cap)                                /* nothing */
@@ -564,6 +588,15 @@ INLINE_HEADER void traceEventMigrateThread(Capability *cap     STG_UNUSED,
                         (EventCapNo)new_cap);
 }
 
+INLINE_HEADER void traceEventStealThread(Capability *cap        STG_UNUSED,
+                                         StgTSO     *tso        STG_UNUSED,
+                                         uint32_t    victim_cap STG_UNUSED)
+{
+    traceSchedEvent(cap, EVENT_STEAL_THREAD, tso, victim_cap);
+    dtraceStealThread((EventCapNo)cap->no, (EventThreadID)tso->id,
+                      (EventCapNo)victim_cap);
+}
+
 INLINE_HEADER void traceCapCreate(Capability *cap STG_UNUSED)
 {
     traceCapEvent(cap, EVENT_CAP_CREATE);
@@ -784,16 +817,18 @@ INLINE_HEADER void traceSparkCounters(Capability *cap STG_UNUSED)
 {
 #if defined(THREADED_RTS)
     if (RTS_UNLIKELY(TRACE_spark_sampled)) {
-        traceSparkCounters_(cap, cap->spark_stats, sparkPoolSize(cap->sparks));
+        traceSparkCounters_(cap, cap->spark_stats, sparkPoolSizeCap(cap));
     }
+    // The overflowed field has always meant sparks that were lost; see
+    // Note [Spark overflow] in Sparks.c
     dtraceSparkCounters((EventCapNo)cap->no,
                         cap->spark_stats.created,
                         cap->spark_stats.dud,
-                        cap->spark_stats.overflowed,
+                        cap->spark_stats.dropped,
                         cap->spark_stats.converted,
                         cap->spark_stats.gcd,
                         cap->spark_stats.fizzled,
-                        sparkPoolSize(cap->sparks));
+                        sparkPoolSizeCap(cap));
 #endif
 }
 
@@ -883,4 +918,57 @@ INLINE_HEADER void traceTaskDelete(Task *task STG_UNUSED)
     dtraceTaskDelete(serialisableTaskId(task));
 }
 
+// A Task that was woken up to take over cap now owns it.  See Note [Task
+// wakeup] in Task.c
+INLINE_HEADER void traceCapHandoff(Capability *cap  STG_UNUSED,
+                                   Task       *task STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceCapHandoff_(cap, task);
+    }
+}
+
+// See Note [Worker pool] in Capability.c
+INLINE_HEADER void traceWorkerCounters(Capability *cap STG_UNUSED)
+{
+#if defined(THREADED_RTS)
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceWorkerCounters_(cap);
+    }
+#endif
+}
+
+// See Note [Time to stop] in Stats.c
+INLINE_HEADER void traceSyncStop(Capability *cap     STG_UNUSED,
+                                 SyncType    type    STG_UNUSED,
+                                 uint32_t    n_waited STG_UNUSED,
+                                 uint32_t    slowest STG_UNUSED,
+                                 Time        time    STG_UNUSED,
+                                 StgThreadID thread  STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceSyncStop_(cap, type, n_waited, slowest, time, thread);
+    }
+}
+
+// See Note [STM contention management] in STM.c
+INLINE_HEADER void traceStmAbort(Capability *cap    STG_UNUSED,
+                                 StgTSO     *tso    STG_UNUSED,
+                                 StgWord     tvar   STG_UNUSED,
+                                 StgWord8    reason STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceStmAbort_(cap, tso, tvar, reason);
+    }
+}
+
+// See Note [Priority classes] in Schedule.c
+INLINE_HEADER void traceRunQueueDelay(Capability *cap STG_UNUSED,
+                                      StgTSO     *tso STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceRunQueueDelay_(cap, tso);
+    }
+}
+
 #include "EndPrivate.h"
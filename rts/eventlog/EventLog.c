@@ -16,6 +16,7 @@
 #include "RtsUtils.h"
 #include "Stats.h"
 #include "EventLog.h"
+#include "AllocSample.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -54,6 +55,7 @@ char *EventDesc[] = {
   [EVENT_STOP_THREAD]         = "Stop thread",
   [EVENT_THREAD_RUNNABLE]     = "Thread runnable",
   [EVENT_MIGRATE_THREAD]      = "Migrate thread",
+  [EVENT_STEAL_THREAD]        = "Steal thread",
   [EVENT_THREAD_WAKEUP]       = "Wakeup thread",
   [EVENT_THREAD_LABEL]        = "Thread label",
   [EVENT_CAP_CREATE]          = "Create capability",
@@ -99,6 +101,12 @@ char *EventDesc[] = {
   [EVENT_TASK_CREATE]         = "Task create",
   [EVENT_TASK_MIGRATE]        = "Task migrate",
   [EVENT_TASK_DELETE]         = "Task delete",
+  [EVENT_CAP_HANDOFF]         = "Capability handoff",
+  [EVENT_WORKER_COUNTERS]     = "Worker counters",
+  [EVENT_SYNC_STOP]           = "Slowest capability to stop for sync",
+  [EVENT_STM_ABORT]           = "STM transaction aborted",
+  [EVENT_RUN_QUEUE_DELAY]     = "Time in run queue",
+  [EVENT_ALLOC_SAMPLE_BEGIN]  = "Start of allocation-site sample",
   [EVENT_HACK_BUG_T9003]      = "Empty event for bug #9003",
   [EVENT_HEAP_PROF_BEGIN]     = "Start of heap profile",
   [EVENT_HEAP_PROF_COST_CENTRE]   = "Cost center definition",
@@ -287,6 +295,7 @@ postHeaderEvents(void)
             break;
 
         case EVENT_MIGRATE_THREAD:  // (cap, thread, new_cap)
+        case EVENT_STEAL_THREAD:    // (cap, thread, victim_cap)
         case EVENT_THREAD_WAKEUP:   // (cap, thread, other_cap)
             eventTypes[t].size =
                 sizeof(EventThreadID) + sizeof(EventCapNo);
@@ -409,6 +418,30 @@ postHeaderEvents(void)
             eventTypes[t].size = sizeof(EventTaskId);
             break;
 
+        case EVENT_CAP_HANDOFF:   // (taskId, latency, spun)
+            eventTypes[t].size =
+                sizeof(EventTaskId) + sizeof(StgWord64) + sizeof(StgWord8);
+            break;
+
+        case EVENT_WORKER_COUNTERS: // (created, reused, retired)
+            eventTypes[t].size = 3 * sizeof(StgWord64);
+            break;
+
+        case EVENT_SYNC_STOP: // (sync_type, n_waited, cap, time, thread)
+            eventTypes[t].size = sizeof(StgWord8) + 2 * sizeof(EventCapNo)
+                + sizeof(StgWord64) + sizeof(EventThreadID);
+            break;
+
+        case EVENT_STM_ABORT: // (thread, tvar, reason)
+            eventTypes[t].size = sizeof(EventThreadID) + sizeof(StgWord64)
+                + sizeof(StgWord8);
+            break;
+
+        case EVENT_RUN_QUEUE_DELAY: // (thread, prio, delay)
+            eventTypes[t].size = sizeof(EventThreadID) + sizeof(StgWord8)
+                + sizeof(StgWord64);
+            break;
+
         case EVENT_BLOCK_MARKER:
             eventTypes[t].size = sizeof(StgWord32) + sizeof(EventTimestamp) +
                 sizeof(EventCapNo);
@@ -430,6 +463,10 @@ postHeaderEvents(void)
             eventTypes[t].size = 8;
             break;
 
+        case EVENT_ALLOC_SAMPLE_BEGIN: // (profile_id, era)
+            eventTypes[t].size = sizeof(StgWord8) + sizeof(StgWord64);
+            break;
+
         case EVENT_HEAP_PROF_SAMPLE_STRING:
             eventTypes[t].size = EVENT_SIZE_DYNAMIC;
             break;
@@ -605,6 +642,7 @@ postSchedEvent (Capability *cap,
     }
 
     case EVENT_MIGRATE_THREAD:  // (cap, thread, new_cap)
+    case EVENT_STEAL_THREAD:    // (cap, thread, victim_cap)
     case EVENT_THREAD_WAKEUP:   // (cap, thread, other_cap)
     {
         postThreadID(eb,thread);
@@ -675,7 +713,8 @@ postSparkCountersEvent (Capability *cap,
     /* EVENT_SPARK_COUNTERS (crt,dud,ovf,cnv,gcd,fiz,rem) */
     postWord64(eb,counters.created);
     postWord64(eb,counters.dud);
-    postWord64(eb,counters.overflowed);
+    // ovf counts sparks that were lost, see Note [Spark overflow]
+    postWord64(eb,counters.dropped);
     postWord64(eb,counters.converted);
     postWord64(eb,counters.gcd);
     postWord64(eb,counters.fizzled);
@@ -985,6 +1024,85 @@ void postTaskDeleteEvent (EventTaskId taskId)
     RELEASE_LOCK(&eventBufMutex);
 }
 
+void postCapHandoffEvent (Capability *cap,
+                          EventTaskId taskId,
+                          StgWord64 latency,
+                          bool spun)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_CAP_HANDOFF);
+
+    postEventHeader(eb, EVENT_CAP_HANDOFF);
+    /* EVENT_CAP_HANDOFF (taskID, latency, spun) */
+    postTaskId(eb, taskId);
+    postWord64(eb, latency);
+    postWord8(eb, spun ? 1 : 0);
+}
+
+void postWorkerCountersEvent (Capability *cap,
+                              StgWord64 created,
+                              StgWord64 reused,
+                              StgWord64 retired)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_WORKER_COUNTERS);
+
+    postEventHeader(eb, EVENT_WORKER_COUNTERS);
+    /* EVENT_WORKER_COUNTERS (created, reused, retired) */
+    postWord64(eb, created);
+    postWord64(eb, reused);
+    postWord64(eb, retired);
+}
+
+void postSyncStopEvent (Capability *cap,
+                        StgWord8 sync_type,
+                        EventCapNo n_waited,
+                        EventCapNo slowest,
+                        StgWord64 time,
+                        EventThreadID thread)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_SYNC_STOP);
+
+    postEventHeader(eb, EVENT_SYNC_STOP);
+    /* EVENT_SYNC_STOP (sync_type, n_waited, cap, time, thread) */
+    postWord8(eb, sync_type);
+    postCapNo(eb, n_waited);
+    postCapNo(eb, slowest);
+    postWord64(eb, time);
+    postThreadID(eb, thread);
+}
+
+void postStmAbortEvent (Capability *cap,
+                        EventThreadID thread,
+                        StgWord64 tvar,
+                        StgWord8 reason)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_STM_ABORT);
+
+    postEventHeader(eb, EVENT_STM_ABORT);
+    /* EVENT_STM_ABORT (thread, tvar, reason) */
+    postThreadID(eb, thread);
+    postWord64(eb, tvar);
+    postWord8(eb, reason);
+}
+
+void postRunQueueDelayEvent (Capability *cap,
+                             EventThreadID thread,
+                             StgWord8 prio,
+                             StgWord64 delay)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_RUN_QUEUE_DELAY);
+
+    postEventHeader(eb, EVENT_RUN_QUEUE_DELAY);
+    /* EVENT_RUN_QUEUE_DELAY (thread, prio, delay) */
+    postThreadID(eb, thread);
+    postWord8(eb, prio);
+    postWord64(eb, delay);
+}
+
 void
 postEvent (Capability *cap, EventTypeNum tag)
 {
@@ -1141,8 +1259,12 @@ void postBlockMarker (EventsBuf *eb)
     postCapNo(eb, eb->capno);
 }
 
-static HeapProfBreakdown getHeapProfBreakdown(void)
+static HeapProfBreakdown getHeapProfBreakdown(StgWord8 profile_id)
 {
+    if (profile_id == ALLOC_SITE_HEAP_PROFILE_ID) {
+        return HEAP_PROF_BREAKDOWN_ALLOC_SITE;
+    }
+
     switch (RtsFlags.ProfFlags.doHeapProfile) {
     case HEAP_BY_CCS:
         return HEAP_PROF_BREAKDOWN_COST_CENTRE;
@@ -1190,7 +1312,7 @@ void postHeapProfBegin(StgWord8 profile_id)
     postPayloadSize(&eventBuf, len);
     postWord8(&eventBuf, profile_id);
     postWord64(&eventBuf, TimeToNS(flags->heapProfileInterval));
-    postWord32(&eventBuf, getHeapProfBreakdown());
+    postWord32(&eventBuf, getHeapProfBreakdown(profile_id));
     postString(&eventBuf, flags->modSelector);
     postString(&eventBuf, flags->descrSelector);
     postString(&eventBuf, flags->typeSelector);
@@ -1210,6 +1332,16 @@ void postHeapProfSampleBegin(StgInt era)
     RELEASE_LOCK(&eventBufMutex);
 }
 
+void postAllocSampleBegin(StgWord8 profile_id, StgInt era)
+{
+    ACQUIRE_LOCK(&eventBufMutex);
+    ensureRoomForEvent(&eventBuf, EVENT_ALLOC_SAMPLE_BEGIN);
+    postEventHeader(&eventBuf, EVENT_ALLOC_SAMPLE_BEGIN);
+    postWord8(&eventBuf, profile_id);
+    postWord64(&eventBuf, era);
+    RELEASE_LOCK(&eventBufMutex);
+}
+
 void postHeapProfSampleString(StgWord8 profile_id,
                               const char *label,
                               StgWord64 residency)
@@ -137,10 +137,61 @@ void postTaskMigrateEvent (EventTaskId taskId,
 
 void postTaskDeleteEvent (EventTaskId taskId);
 
+/*
+ * Post the time a Task took to start running on cap after being woken up
+ */
+void postCapHandoffEvent (Capability *cap,
+                          EventTaskId taskId,
+                          StgWord64 latency,
+                          bool spun);
+
+/*
+ * Post the worker pool counters of cap; see Note [Worker pool]
+ */
+void postWorkerCountersEvent (Capability *cap,
+                              StgWord64 created,
+                              StgWord64 reused,
+                              StgWord64 retired);
+
+/*
+ * Post the Capability that took longest to stop for a sync, how long it
+ * took, and the thread it was running; see Note [Time to stop] in Stats.c
+ */
+void postSyncStopEvent (Capability *cap,
+                        StgWord8 sync_type,
+                        EventCapNo n_waited,
+                        EventCapNo slowest,
+                        StgWord64 time,
+                        EventThreadID thread);
+
+/*
+ * Post the abort of a thread's STM transaction, with the address of the
+ * TVar that caused it (0 if unknown) and one of the STM_ABORT_* reasons
+ */
+void postStmAbortEvent (Capability *cap,
+                        EventThreadID thread,
+                        StgWord64 tvar,
+                        StgWord8 reason);
+
+/*
+ * Post the time in nanoseconds that a thread of priority class prio
+ * spent on the run queue before running
+ */
+void postRunQueueDelayEvent (Capability *cap,
+                             EventThreadID thread,
+                             StgWord8 prio,
+                             StgWord64 delay);
+
 void postHeapProfBegin(StgWord8 profile_id);
 
 void postHeapProfSampleBegin(StgInt era);
 
+/*
+ * Post the start of an allocation-site sample; see Note
+ * [Allocation-site sampling] in AllocSample.c
+ */
+void postAllocSampleBegin(StgWord8 profile_id, StgInt era);
+
 void postHeapProfSampleString(StgWord8 profile_id,
                               const char *label,
                               StgWord64 residency);
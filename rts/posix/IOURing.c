@@ -0,0 +1,733 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * The io_uring I/O manager (Linux, threaded RTS only)
+ *
+ * ---------------------------------------------------------------------------*/
+
+// Not POSIX, due to use of syscall() and MAP_POPULATE
+// #include "PosixSource.h"
+
+#include "Rts.h"
+
+#include "IOURing.h"
+#include "Capability.h"
+#include "Schedule.h"
+#include "Threads.h"
+#include "StablePtr.h"
+#include "RtsUtils.h"
+#include "Trace.h"
+
+#if defined(USE_IOURING)
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*
+ * Note [io_uring I/O manager]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * In the threaded RTS, a thread that finds a descriptor not ready
+ * normally registers it with the Haskell I/O manager (GHC.Event), blocks
+ * until the manager thread has seen the event, and then repeats the
+ * system call.  With +RTS --io-uring, GHC.IO.FD instead hands the read or
+ * write itself to the kernel through an io_uring, and the RTS wakes the
+ * thread when the operation has completed.  GHC.IO.URing also offers
+ * accept() and timeouts this way.
+ *
+ * Each Capability has its own ring, cap->io_uring, created by
+ * initCapability().  A request is submitted by an unsafe foreign call
+ * (ioURingRead() etc.) from the requesting thread, which passes a
+ * StablePtr to an empty MVar and then blocks in takeMVar.  The request
+ * occupies a slot of ring->reqs until it completes; the slot number,
+ * the Capability number and a generation count make up the request's
+ * id, which is what the kernel gives back to us as user_data.
+ *
+ * SQEs are not submitted one at a time.  The thread making a request
+ * blocks straight away, so the scheduler soon calls scheduleFindWork(),
+ * and ioURingPoll() then submits everything queued since the last time
+ * with one io_uring_enter() and reaps the completions.  For each
+ * completion we fill the MVar with the result (the return value of the
+ * system call, or minus the error code), which wakes the thread
+ * directly, and free the StablePtr.
+ *
+ * When the Capability runs out of work while requests are in flight, a
+ * worker Task waits in io_uring_enter() for a completion, with the
+ * Capability released (ioURingWait(), called from scheduleYield()), and
+ * takes the Capability back when woken up.  Only one Task waits per ring
+ * (ring->waiting), and it must be a worker: a bound Task waiting in the
+ * kernel could not be given the Capability when its own thread becomes
+ * runnable.  If the last Task to release the Capability is bound,
+ * releaseCapability_() starts a worker to do the waiting instead
+ * (ioURingNeedsWaiter()).
+ *
+ * If the requesting thread receives an asynchronous exception, it
+ * cancels the request with ioURingCancel() and waits, uninterruptibly,
+ * for the completion, so that the kernel is finished with the buffer
+ * before the exception propagates.  The thread may have migrated since,
+ * so any Capability can submit a cancellation to any ring; the ring's
+ * lock protects it.  The id's generation count makes cancelling a
+ * request that completed in the meantime harmless.
+ *
+ * Requests on a ring that has been disabled by setNumCapabilities()
+ * are reaped by Capability 0.
+ */
+
+#define IOURING_ENTRIES 256
+
+// user_data for requests we do not want to hear about (cancellations)
+#define IOURING_NO_REQ  0
+
+typedef struct {
+    StgStablePtr mvar;              // NULL <=> the slot is free
+    uint32_t     gen;
+    struct __kernel_timespec ts;    // for IORING_OP_TIMEOUT
+} IOURingRequest;
+
+typedef struct IOURing_ {
+    int ring_fd;
+
+    // The submission queue, shared with the kernel
+    void     *sq_ring;
+    size_t    sq_ring_size;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t  sq_mask;
+    uint32_t  sq_entries;
+    struct io_uring_sqe *sqes;
+    size_t    sqes_size;
+    uint32_t  sq_queued;            // filled in, not yet submitted
+
+    // The completion queue, shared with the kernel
+    void     *cq_ring;
+    size_t    cq_ring_size;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t  cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Requests in flight, indexed by slot
+    IOURingRequest *reqs;
+    uint32_t        n_slots;
+    uint32_t       *free_slots;
+    uint32_t        n_free_slots;
+    uint32_t        n_in_flight;
+
+    // true while a Task is waiting in ioURingWait()
+    volatile bool   waiting;
+
+    // Protects everything above
+    Mutex lock;
+} IOURing;
+
+static int
+sys_io_uring_setup (uint32_t entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter (int fd, uint32_t to_submit, uint32_t min_complete,
+                    uint32_t flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                   flags, NULL, 0);
+}
+
+static int
+sys_io_uring_register (int fd, uint32_t opcode, void *arg, uint32_t nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* -----------------------------------------------------------------------------
+ * Creating and destroying rings
+ * -------------------------------------------------------------------------- */
+
+static bool
+probeOps (int ring_fd)
+{
+    static const uint8_t ops[] = { IORING_OP_READ, IORING_OP_WRITE,
+                                   IORING_OP_ACCEPT, IORING_OP_TIMEOUT,
+                                   IORING_OP_ASYNC_CANCEL };
+    struct io_uring_probe *probe;
+    size_t size;
+    uint32_t i;
+    bool ok = true;
+
+    size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    probe = stgMallocBytes(size, "probeOps");
+    memset(probe, 0, size);
+
+    if (sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) != 0) {
+        ok = false;
+    } else {
+        for (i = 0; i < sizeof(ops); i++) {
+            if (ops[i] > probe->last_op ||
+                !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+                ok = false;
+            }
+        }
+    }
+
+    stgFree(probe);
+    return ok;
+}
+
+static IOURing *
+newIOURing (void)
+{
+    struct io_uring_params p;
+    IOURing *ring;
+    uint8_t *sq, *cq;
+    uint32_t i;
+    int fd;
+
+    memset(&p, 0, sizeof(p));
+    fd = sys_io_uring_setup(IOURING_ENTRIES, &p);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (!probeOps(fd)) {
+        close(fd);
+        errno = ENOSYS;
+        return NULL;
+    }
+
+    ring = stgMallocBytes(sizeof(IOURing), "newIOURing");
+    ring->ring_fd = fd;
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = p.cq_off.cqes +
+                         p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            goto fail;
+        }
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring != ring->sq_ring) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        goto fail;
+    }
+
+    sq = ring->sq_ring;
+    ring->sq_head    = (uint32_t *)(sq + p.sq_off.head);
+    ring->sq_tail    = (uint32_t *)(sq + p.sq_off.tail);
+    ring->sq_mask    = *(uint32_t *)(sq + p.sq_off.ring_mask);
+    ring->sq_entries = p.sq_entries;
+    ring->sq_queued  = 0;
+    // SQE i always lives in slot i of the array
+    for (i = 0; i < p.sq_entries; i++) {
+        ((uint32_t *)(sq + p.sq_off.array))[i] = i;
+    }
+
+    cq = ring->cq_ring;
+    ring->cq_head = (uint32_t *)(cq + p.cq_off.head);
+    ring->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+    ring->cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+    ring->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // Every request in flight can have a cancellation in flight too, so
+    // limit the number of requests to half the completion queue.
+    ring->n_slots = p.cq_entries / 2;
+    if (ring->n_slots > p.sq_entries) {
+        ring->n_slots = p.sq_entries;
+    }
+    ring->reqs = stgMallocBytes(ring->n_slots * sizeof(IOURingRequest),
+                                "newIOURing");
+    ring->free_slots = stgMallocBytes(ring->n_slots * sizeof(uint32_t),
+                                      "newIOURing");
+    for (i = 0; i < ring->n_slots; i++) {
+        ring->reqs[i].mvar = NULL;
+        ring->reqs[i].gen  = 0;
+        ring->free_slots[i] = ring->n_slots - 1 - i;
+    }
+    ring->n_free_slots = ring->n_slots;
+    ring->n_in_flight = 0;
+    ring->waiting = false;
+    initMutex(&ring->lock);
+
+    return ring;
+
+fail:
+    close(fd);
+    stgFree(ring);
+    return NULL;
+}
+
+static void
+destroyIOURing (IOURing *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->ring_fd);
+    closeMutex(&ring->lock);
+    stgFree(ring->reqs);
+    stgFree(ring->free_slots);
+    stgFree(ring);
+}
+
+void
+initIOURing (Capability *cap)
+{
+    cap->io_uring = NULL;
+
+    if (!RtsFlags.MiscFlags.ioUring || cap->no > 0xffff) {
+        return;
+    }
+
+    cap->io_uring = newIOURing();
+    if (cap->io_uring == NULL && cap->no == 0) {
+        // Don't advertise the io_uring manager to Haskell code at all
+        errorBelch("warning: --io-uring: io_uring is not available (%s); "
+                   "using the I/O manager thread instead", strerror(errno));
+        RtsFlags.MiscFlags.ioUring = false;
+    }
+}
+
+void
+freeIOURing (Capability *cap)
+{
+    IOURing *ring = cap->io_uring;
+
+    if (ring == NULL) {
+        return;
+    }
+    // A Task still waiting in ioURingWait() will touch the ring when it
+    // wakes up, so leave the ring alone.  This can only happen if a
+    // request is still in flight at hs_exit().
+    if (ring->waiting) {
+        return;
+    }
+    destroyIOURing(ring);
+    cap->io_uring = NULL;
+}
+
+/* In the child of forkProcess(), the rings are shared with the parent,
+ * and the threads waiting for their requests are gone: replace them.
+ */
+void
+resetIOURingAfterFork (Capability *cap)
+{
+    IOURing *ring = cap->io_uring;
+    uint32_t i;
+
+    if (ring == NULL) {
+        return;
+    }
+    for (i = 0; i < ring->n_slots; i++) {
+        if (ring->reqs[i].mvar != NULL) {
+            freeStablePtr(ring->reqs[i].mvar);
+        }
+    }
+    // The Task that was waiting, if any, does not exist in the child
+    ring->waiting = false;
+    destroyIOURing(ring);
+    initIOURing(cap);
+}
+
+/* -----------------------------------------------------------------------------
+ * Submission
+ * -------------------------------------------------------------------------- */
+
+#define REQ_ID(gen,cap_no,slot) \
+    (((StgWord64)(gen) << 32) | ((StgWord64)(cap_no) << 16) | (slot))
+#define REQ_CAP_NO(id)   ((uint32_t)((id) >> 16) & 0xffff)
+#define REQ_SLOT(id)     ((uint32_t)(id) & 0xffff)
+#define REQ_GEN(id)      ((uint32_t)((id) >> 32))
+
+// Pass the queued SQEs to the kernel.  Requires ring->lock.
+static void
+submitQueued (IOURing *ring)
+{
+    int r;
+
+    while (ring->sq_queued > 0) {
+        r = sys_io_uring_enter(ring->ring_fd, ring->sq_queued, 0, 0);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EBUSY) {
+                // Out of resources, or the completion queue is full: try
+                // again after the next ioURingPoll().
+                return;
+            }
+            sysErrorBelch("io_uring_enter");
+            stg_exit(EXIT_FAILURE);
+        }
+        ring->sq_queued -= r;
+    }
+}
+
+// Returns the next free SQE.  Requires ring->lock.
+static struct io_uring_sqe *
+getSQE (IOURing *ring)
+{
+    struct io_uring_sqe *sqe;
+    uint32_t tail = *ring->sq_tail;
+
+    if (tail - *(volatile uint32_t *)ring->sq_head >= ring->sq_entries) {
+        submitQueued(ring);
+        if (tail - *(volatile uint32_t *)ring->sq_head >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+    sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Make the SQE returned by getSQE() visible to the kernel.  Requires
+// ring->lock.
+static void
+queueSQE (IOURing *ring)
+{
+    write_barrier();
+    *(volatile uint32_t *)ring->sq_tail = *ring->sq_tail + 1;
+    ring->sq_queued++;
+}
+
+/* Start a request on the current Capability's ring.  Returns the id of
+ * the request, or 0 if it could not be made (the caller then falls back
+ * to the I/O manager thread).  The RTS owns mvar from now on.
+ */
+static StgWord64
+startRequest (uint8_t opcode, int fd, void *addr, uint32_t len,
+              StgWord64 off, uint32_t flags, StgWord64 timeout_us,
+              HsStablePtr mvar)
+{
+    Capability *cap = rts_unsafeGetMyCapability();
+    IOURing *ring = cap->io_uring;
+    IOURingRequest *req;
+    struct io_uring_sqe *sqe;
+    uint32_t slot;
+    StgWord64 id;
+
+    if (ring == NULL) {
+        return 0;
+    }
+
+    ACQUIRE_LOCK(&ring->lock);
+    if (ring->n_free_slots == 0 || (sqe = getSQE(ring)) == NULL) {
+        RELEASE_LOCK(&ring->lock);
+        return 0;
+    }
+
+    slot = ring->free_slots[--ring->n_free_slots];
+    req = &ring->reqs[slot];
+    req->mvar = mvar;
+    req->gen++;
+    if (req->gen == 0) {
+        req->gen = 1; // ids are never IOURING_NO_REQ
+    }
+    id = REQ_ID(req->gen, cap->no, slot);
+
+    sqe->opcode    = opcode;
+    sqe->fd        = fd;
+    sqe->user_data = id;
+    switch (opcode) {
+    case IORING_OP_TIMEOUT:
+        req->ts.tv_sec  = timeout_us / 1000000;
+        req->ts.tv_nsec = (timeout_us % 1000000) * 1000;
+        sqe->addr = (StgWord64)(StgWord)&req->ts;
+        sqe->len  = 1;
+        break;
+    case IORING_OP_ACCEPT:
+        sqe->addr         = (StgWord64)(StgWord)addr;
+        sqe->off          = off; // addr2: the socklen_t *
+        sqe->accept_flags = flags;
+        break;
+    default:
+        sqe->addr = (StgWord64)(StgWord)addr;
+        sqe->len  = len;
+        sqe->off  = off;
+        break;
+    }
+    queueSQE(ring);
+    ring->n_in_flight++;
+    RELEASE_LOCK(&ring->lock);
+
+    return id;
+}
+
+HsBool
+ioURingEnabled (void)
+{
+    return RtsFlags.MiscFlags.ioUring;
+}
+
+HsWord64
+ioURingRead (int fd, void *buf, size_t len, HsInt64 offset,
+             HsStablePtr mvar)
+{
+    return startRequest(IORING_OP_READ, fd, buf, (uint32_t)len,
+                        (StgWord64)offset, 0, 0, mvar);
+}
+
+HsWord64
+ioURingWrite (int fd, const void *buf, size_t len, HsInt64 offset,
+              HsStablePtr mvar)
+{
+    return startRequest(IORING_OP_WRITE, fd, (void *)buf, (uint32_t)len,
+                        (StgWord64)offset, 0, 0, mvar);
+}
+
+HsWord64
+ioURingAccept (int fd, void *addr, void *addrlen, int flags,
+               HsStablePtr mvar)
+{
+    return startRequest(IORING_OP_ACCEPT, fd, addr, 0,
+                        (StgWord64)(StgWord)addrlen, (uint32_t)flags, 0,
+                        mvar);
+}
+
+HsWord64
+ioURingTimeout (HsWord64 usecs, HsStablePtr mvar)
+{
+    return startRequest(IORING_OP_TIMEOUT, -1, NULL, 0, 0, 0, usecs, mvar);
+}
+
+void
+ioURingCancel (HsWord64 id)
+{
+    IOURing *ring;
+    struct io_uring_sqe *sqe;
+    uint32_t cap_no = REQ_CAP_NO(id);
+
+    if (cap_no >= n_capabilities) {
+        return;
+    }
+    ring = capabilities[cap_no]->io_uring;
+    if (ring == NULL) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&ring->lock);
+    sqe = getSQE(ring);
+    if (sqe != NULL) {
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->fd        = -1;
+        sqe->addr      = id;
+        sqe->user_data = IOURING_NO_REQ;
+        queueSQE(ring);
+        // Submit now: the owner of the ring may be waiting in the kernel
+        submitQueued(ring);
+    }
+    RELEASE_LOCK(&ring->lock);
+}
+
+/* -----------------------------------------------------------------------------
+ * Completion
+ * -------------------------------------------------------------------------- */
+
+#define MAX_COMPLETIONS 64
+
+typedef struct {
+    StgStablePtr mvar;
+    StgInt       res;
+} Completion;
+
+// Take up to MAX_COMPLETIONS completions off the queue.  Requires
+// ring->lock.
+static uint32_t
+takeCompletions (IOURing *ring, Completion *done)
+{
+    uint32_t head, tail, n = 0;
+    struct io_uring_cqe *cqe;
+    IOURingRequest *req;
+    uint32_t slot;
+
+    head = *ring->cq_head;
+    tail = *(volatile uint32_t *)ring->cq_tail;
+    load_load_barrier();
+
+    while (head != tail && n < MAX_COMPLETIONS) {
+        cqe = &ring->cqes[head & ring->cq_mask];
+        head++;
+        if (cqe->user_data == IOURING_NO_REQ) {
+            continue;
+        }
+        slot = REQ_SLOT(cqe->user_data);
+        req = &ring->reqs[slot];
+        ASSERT(req->mvar != NULL && req->gen == REQ_GEN(cqe->user_data));
+        done[n].mvar = req->mvar;
+        done[n].res  = cqe->res;
+        n++;
+        req->mvar = NULL;
+        ring->free_slots[ring->n_free_slots++] = slot;
+        ring->n_in_flight--;
+    }
+
+    // We must have read the CQEs before the kernel may reuse them
+    store_load_barrier();
+    *(volatile uint32_t *)ring->cq_head = head;
+    return n;
+}
+
+static void
+pollRing (Capability *cap, IOURing *ring)
+{
+    Completion done[MAX_COMPLETIONS];
+    uint32_t i, n;
+
+    do {
+        ACQUIRE_LOCK(&ring->lock);
+        submitQueued(ring);
+        n = takeCompletions(ring, done);
+        RELEASE_LOCK(&ring->lock);
+
+        for (i = 0; i < n; i++) {
+            debugTrace(DEBUG_sched, "io_uring request completed: %ld",
+                       (long)done[i].res);
+            performTryPutMVar(cap, (StgMVar *)deRefStablePtr(done[i].mvar),
+                              rts_mkInt(cap, done[i].res));
+            freeStablePtr(done[i].mvar);
+        }
+    } while (n == MAX_COMPLETIONS);
+}
+
+void
+ioURingPoll (Capability *cap)
+{
+    uint32_t i;
+
+    if (cap->io_uring != NULL) {
+        pollRing(cap, cap->io_uring);
+    }
+
+    // Nobody else will look at the rings of disabled Capabilities
+    if (cap->no == 0) {
+        for (i = enabled_capabilities; i < n_capabilities; i++) {
+            if (capabilities[i]->io_uring != NULL &&
+                capabilities[i]->io_uring->n_in_flight != 0) {
+                pollRing(cap, capabilities[i]->io_uring);
+            }
+        }
+    }
+}
+
+bool
+ioURingNeedsWaiter (Capability *cap)
+{
+    IOURing *ring = cap->io_uring;
+
+    return ring != NULL && ring->n_in_flight != 0 && !ring->waiting;
+}
+
+bool
+ioURingWait (Capability **pcap, Task *task)
+{
+    Capability *cap = *pcap;
+    IOURing *ring = cap->io_uring;
+    bool ready;
+    int r;
+
+    if (isBoundTask(task) || !ioURingNeedsWaiter(cap)) {
+        return false;
+    }
+
+    ring->waiting = true;
+
+    ACQUIRE_LOCK(&ring->lock);
+    submitQueued(ring);
+    ready = *(volatile uint32_t *)ring->cq_tail != *ring->cq_head;
+    RELEASE_LOCK(&ring->lock);
+
+    if (!ready) {
+        debugTrace(DEBUG_sched, "waiting for io_uring completions");
+        releaseCapability(cap);
+        r = sys_io_uring_enter(ring->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (r < 0 && errno != EINTR) {
+            sysErrorBelch("io_uring_enter");
+            stg_exit(EXIT_FAILURE);
+        }
+        ring->waiting = false;
+        waitForCapability(&cap, task);
+        *pcap = cap;
+    } else {
+        ring->waiting = false;
+    }
+
+    return true;
+}
+
+#else /* !USE_IOURING */
+
+/* Without io_uring support --io-uring is rejected, so Haskell code never
+ * gets as far as making a request.
+ */
+
+HsBool
+ioURingEnabled (void)
+{
+    return false;
+}
+
+HsWord64
+ioURingRead (int fd STG_UNUSED, void *buf STG_UNUSED, size_t len STG_UNUSED,
+             HsInt64 offset STG_UNUSED, HsStablePtr mvar STG_UNUSED)
+{
+    return 0;
+}
+
+HsWord64
+ioURingWrite (int fd STG_UNUSED, const void *buf STG_UNUSED,
+              size_t len STG_UNUSED, HsInt64 offset STG_UNUSED,
+              HsStablePtr mvar STG_UNUSED)
+{
+    return 0;
+}
+
+HsWord64
+ioURingAccept (int fd STG_UNUSED, void *addr STG_UNUSED,
+               void *addrlen STG_UNUSED, int flags STG_UNUSED,
+               HsStablePtr mvar STG_UNUSED)
+{
+    return 0;
+}
+
+HsWord64
+ioURingTimeout (HsWord64 usecs STG_UNUSED, HsStablePtr mvar STG_UNUSED)
+{
+    return 0;
+}
+
+void
+ioURingCancel (HsWord64 id STG_UNUSED)
+{
+}
+
+#endif /* USE_IOURING */
@@ -0,0 +1,41 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * The io_uring I/O manager (Linux, threaded RTS only)
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "Capability.h"
+#include "Task.h"
+
+#if defined(THREADED_RTS) && defined(HAVE_LINUX_IO_URING_H)
+#define USE_IOURING 1
+#endif
+
+#include "BeginPrivate.h"
+
+#if defined(USE_IOURING)
+
+void initIOURing          ( Capability *cap );
+void freeIOURing          ( Capability *cap );
+void resetIOURingAfterFork( Capability *cap );
+
+// Submit queued requests and wake up the threads whose requests have
+// completed.  Called from scheduleFindWork().
+void ioURingPoll          ( Capability *cap );
+
+// Called by a worker with nothing else to do: wait in the kernel for a
+// completion, with the Capability released.  Returns false if there is
+// nothing to wait for.
+bool ioURingWait          ( Capability **pcap, Task *task );
+
+// true if some request on cap is in flight and no Task is waiting for
+// it; releaseCapability_() then keeps a worker around to wait.
+bool ioURingNeedsWaiter   ( Capability *cap );
+
+#endif
+
+#include "EndPrivate.h"
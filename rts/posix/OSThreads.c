@@ -22,10 +22,14 @@
 
 #include "Rts.h"
 
+#include <errno.h>
+#include <time.h>
+
 #if defined(linux_HOST_OS)
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
+#include <linux/futex.h>
 #endif
 
 #if defined(HAVE_PTHREAD_H)
@@ -117,6 +121,43 @@ waitCondition ( Condition* pCond, Mutex* pMut )
   return (pthread_cond_wait(pCond,pMut) == 0);
 }
 
+bool
+timedWaitCondition ( Condition* pCond, Mutex* pMut, Time timeout )
+{
+  struct timespec ts;
+  Time t;
+
+  // condition variables use CLOCK_REALTIME by default
+  clock_gettime(CLOCK_REALTIME, &ts);
+  t = SecondsToTime(ts.tv_sec) + NSToTime(ts.tv_nsec) + timeout;
+  ts.tv_sec  = TimeToSeconds(t);
+  ts.tv_nsec = TimeToNS(t - SecondsToTime(ts.tv_sec));
+  return (pthread_cond_timedwait(pCond,pMut,&ts) != ETIMEDOUT);
+}
+
+#if defined(linux_HOST_OS)
+bool
+futexWait ( volatile uint32_t *addr, uint32_t val, Time timeout )
+{
+  struct timespec ts, *pts = NULL;
+
+  if (timeout != 0) {
+      ts.tv_sec  = TimeToSeconds(timeout);
+      ts.tv_nsec = TimeToNS(timeout - SecondsToTime(ts.tv_sec));
+      pts = &ts;
+  }
+  // EAGAIN (*addr != val) and EINTR are fine: the caller re-checks *addr
+  return !(syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, pts, NULL, 0)
+           == -1 && errno == ETIMEDOUT);
+}
+
+void
+futexWake ( volatile uint32_t *addr, uint32_t n )
+{
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+#endif
+
 void
 yieldThread(void)
 {
@@ -286,9 +327,183 @@ uint32_t getNumberOfProcessors (void)
 #endif /* defined(THREADED_RTS) */
 
 #if defined(HAVE_SCHED_H) && defined(HAVE_SCHED_SETAFFINITY)
+
+#if defined(linux_HOST_OS)
+/*
+ * Note [Topology-aware affinity]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Plain -qa puts Capability i on CPU i, whatever that CPU is.  Linux
+ * numbers the CPUs so that the second hardware thread of each core
+ * usually comes after all the first ones, but not always, and it
+ * interleaves the sockets on some machines and not on others.  So two
+ * busy Capabilities may share a core while other cores are idle, or be
+ * split between sockets when they would all fit on one.  Plain -qa also
+ * ignores the CPUs we are allowed to run on (our cpuset).
+ *
+ * With -qa=compact or -qa=spread, the first call to setThreadAffinity()
+ * reads the CPUs we may run on with sched_getaffinity(), and the socket
+ * (physical_package_id) and core (core_id) of each from
+ * /sys/devices/system/cpu/cpu<n>/topology.  It then puts them in order:
+ * first one hardware thread of every core, then the second thread of
+ * every core that has one, and so on.  Within each of those rounds,
+ *
+ *   - compact takes all the cores of one socket before the next, so that
+ *     the Capabilities share as few sockets, and as much cache, as
+ *     possible;
+ *
+ *   - spread takes one core of each socket in turn, which spreads the
+ *     memory bandwidth, and matches the way --numa assigns Capability i
+ *     to node i `mod` (number of nodes).
+ *
+ * Capability n is then pinned to the CPU at position n `mod` (number of
+ * CPUs).  GC threads are the workers of their Capabilities, so they get
+ * the same placement.  If the topology cannot be read, we fall back to
+ * the plain -qa placement.
+ */
+
+typedef struct {
+    uint32_t cpu;
+    int      package;   // physical_package_id: the socket
+    int      core;      // core_id: unique within the socket only
+    uint32_t thread;    // which hardware thread of its core, from 0
+    uint32_t index;     // which core of its socket, counting only cores
+                        // that have this thread
+} CpuPlace;
+
+static pthread_once_t cpu_order_once = PTHREAD_ONCE_INIT;
+static uint32_t cpu_order[CPU_SETSIZE];
+static uint32_t n_cpu_order = 0;  // 0: use the plain -qa placement
+
+static bool
+readTopologyId (uint32_t cpu, const char *name, int *id)
+{
+    char path[128];
+    FILE *f;
+    bool ok;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%" FMT_Word32 "/topology/%s",
+             cpu, name);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    ok = fscanf(f, "%d", id) == 1;
+    fclose(f);
+    return ok;
+}
+
+#define CMP_FIELD(a,b,f) \
+    if ((a)->f != (b)->f) { return (a)->f < (b)->f ? -1 : 1; }
+
+static int
+compareCompact (const void *x, const void *y)
+{
+    const CpuPlace *a = x, *b = y;
+    CMP_FIELD(a, b, thread);
+    CMP_FIELD(a, b, package);
+    CMP_FIELD(a, b, core);
+    CMP_FIELD(a, b, cpu);
+    return 0;
+}
+
+static int
+compareSpread (const void *x, const void *y)
+{
+    const CpuPlace *a = x, *b = y;
+    CMP_FIELD(a, b, thread);
+    CMP_FIELD(a, b, index);
+    CMP_FIELD(a, b, package);
+    CMP_FIELD(a, b, cpu);
+    return 0;
+}
+
+#undef CMP_FIELD
+
+// See Note [Topology-aware affinity]
+static void
+initCpuOrder (void)
+{
+    cpu_set_t cs;
+    CpuPlace *cpus;
+    uint32_t i, j, n;
+
+    // If we can't find out where we may run, or how the CPUs are laid
+    // out, quietly fall back to plain -qa.
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cs) != 0) {
+        IF_DEBUG(scheduler,
+                 debugBelch("-qa: sched_getaffinity failed (errno %d)\n",
+                            errno));
+        return;
+    }
+
+    n = 0;
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &cs)) {
+            n++;
+        }
+    }
+    if (n == 0) {
+        return;
+    }
+    cpus = stgMallocBytes(n * sizeof(CpuPlace), "initCpuOrder");
+
+    // In order of CPU number
+    n = 0;
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (!CPU_ISSET(i, &cs)) {
+            continue;
+        }
+        if (!readTopologyId(i, "physical_package_id", &cpus[n].package) ||
+            !readTopologyId(i, "core_id", &cpus[n].core)) {
+            IF_DEBUG(scheduler,
+                     debugBelch("-qa: cannot read the topology of CPU %"
+                                FMT_Word32 "; using -qa without a mode\n",
+                                i));
+            goto done;
+        }
+        cpus[n].cpu = i;
+        cpus[n].thread = 0;
+        for (j = 0; j < n; j++) {
+            if (cpus[j].package == cpus[n].package &&
+                cpus[j].core == cpus[n].core) {
+                cpus[n].thread++;
+            }
+        }
+        n++;
+    }
+
+    for (i = 0; i < n; i++) {
+        cpus[i].index = 0;
+        for (j = 0; j < n; j++) {
+            if (cpus[j].package == cpus[i].package &&
+                cpus[j].thread == cpus[i].thread &&
+                cpus[j].core < cpus[i].core) {
+                cpus[i].index++;
+            }
+        }
+    }
+
+    qsort(cpus, n, sizeof(CpuPlace),
+          RtsFlags.ParFlags.affinityMode == AFFINITY_SPREAD
+              ? compareSpread : compareCompact);
+
+    for (i = 0; i < n; i++) {
+        cpu_order[i] = cpus[i].cpu;
+    }
+    n_cpu_order = n;
+
+done:
+    stgFree(cpus);
+}
+#endif
+
 // Schedules the thread to run on CPU n of m.  m may be less than the
 // number of physical CPUs, in which case, the thread will be allowed
-// to run on CPU n, n+m, n+2m etc.
+// to run on CPU n, n+m, n+2m etc.  With -qa=compact or -qa=spread, the
+// thread runs on the nth CPU in topology order instead; see Note
+// [Topology-aware affinity].
 void
 setThreadAffinity (uint32_t n, uint32_t m)
 {
@@ -296,6 +511,18 @@ setThreadAffinity (uint32_t n, uint32_t m)
     cpu_set_t cs;
     uint32_t i;
 
+#if defined(linux_HOST_OS)
+    if (RtsFlags.ParFlags.affinityMode != AFFINITY_ROUND_ROBIN) {
+        pthread_once(&cpu_order_once, initCpuOrder);
+        if (n_cpu_order > 0) {
+            CPU_ZERO(&cs);
+            CPU_SET(cpu_order[n % n_cpu_order], &cs);
+            sched_setaffinity(0, sizeof(cpu_set_t), &cs);
+            return;
+        }
+    }
+#endif
+
     nproc = getNumberOfProcessors();
     CPU_ZERO(&cs);
     for (i = n; i < nproc; i+=m) {
@@ -22,6 +22,7 @@
 #include "AwaitEvent.h"
 #include "Stats.h"
 #include "GetTime.h"
+#include "Threads.h"
 
 # ifdef HAVE_SYS_SELECT_H
 #  include <sys/select.h>
@@ -31,7 +32,13 @@
 #  include <sys/types.h>
 # endif
 
+# ifdef HAVE_SYS_EPOLL_H
+#  include <sys/epoll.h>
+#  include <fcntl.h>
+# endif
+
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 
 #include "Clock.h"
@@ -39,10 +46,10 @@
 #if !defined(THREADED_RTS)
 
 // The target time for a threadDelay is stored in a one-word quantity
-// in the TSO (tso->block_info.target).  On a 32-bit machine we
-// therefore can't afford to use nanosecond resolution because it
-// would overflow too quickly, so instead we use millisecond
-// resolution.
+// in the sleeping queue (see Note [Sleeping queue] in SleepingQueue.c).
+// On a 32-bit machine we therefore can't afford to use nanosecond
+// resolution because it would overflow too quickly, so instead we use
+// millisecond resolution.
 
 #if SIZEOF_VOID_P == 4
 #define LowResTimeToTime(t)          (USToTime((t) * 1000))
@@ -98,14 +105,12 @@ static bool wakeUpSleepingThreads (LowResTime now)
     StgTSO *tso;
     bool flag = false;
 
-    while (sleeping_queue != END_TSO_QUEUE) {
-        tso = sleeping_queue;
-        if (((long)now - (long)tso->block_info.target) < 0) {
+    while (!emptySleepingQueue()) {
+        if (((long)now - (long)peekSleepingTarget()) < 0) {
             break;
         }
-        sleeping_queue = tso->_link;
+        tso = popSleepingThread();
         tso->why_blocked = NotBlocked;
-        tso->_link = END_TSO_QUEUE;
         IF_DEBUG(scheduler, debugBelch("Waking up sleeping thread %lu\n",
                                        (unsigned long)tso->id));
         // MainCapability: this code is !THREADED_RTS
@@ -115,17 +120,42 @@ static bool wakeUpSleepingThreads (LowResTime now)
     return flag;
 }
 
-static void GNUC3_ATTRIBUTE(__noreturn__)
-fdOutOfRange (int fd)
+/* Called when the system call waiting for I/O was interrupted by a
+ * signal.  Returns true if awaitEvent() should return to the scheduler
+ * straight away.
+ */
+static bool awaitEventInterrupted (void)
 {
-    errorBelch("file descriptor %d out of range for select (0--%d).\n"
-               "Recompile with -threaded to work around this.",
-               fd, (int)FD_SETSIZE);
-    stg_exit(EXIT_FAILURE);
+    /* We got a signal; could be one of ours.  If so, we need
+     * to start up the signal handler straight away, otherwise
+     * we could block for a long time before the signal is
+     * serviced.
+     */
+#if defined(RTS_USER_SIGNALS)
+    if (RtsFlags.MiscFlags.install_signal_handlers && signals_pending()) {
+        startSignalHandlers(&MainCapability);
+        return true;
+    }
+#endif
+
+    /* we were interrupted, return to the scheduler immediately.
+     */
+    if (sched_state >= SCHED_INTERRUPTING) {
+        return true;
+    }
+
+    /* check for threads that need waking up
+     */
+    wakeUpSleepingThreads(getLowResTimeOfDay());
+
+    /* If new runnable threads have arrived, stop waiting for
+     * I/O and run them.
+     */
+    return !emptyRunQueue(&MainCapability);
 }
 
 /*
- * State of individual file descriptor after a 'select()' poll.
+ * State of individual file descriptor after a poll.
  */
 enum FdState {
     RTS_FD_IS_READY = 0,
@@ -133,6 +163,471 @@ enum FdState {
     RTS_FD_IS_INVALID,
 };
 
+#if defined(HAVE_SYS_EPOLL_H)
+
+/*
+ * Note [awaitEvent with epoll]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Where epoll is available, threads blocked in waitRead# and waitWrite#
+ * are not kept on blocked_queue.  Rebuilding fd_sets from that queue on
+ * every call to awaitEvent() costs O(number of blocked threads), and
+ * select() cannot watch descriptors >= FD_SETSIZE at all.  Instead:
+ *
+ *   - fd_waiters[fd] holds the threads blocked reading and writing fd,
+ *     linked through tso->_link, and the events registered for fd with
+ *     the epoll instance epoll_fd.  blockOnFd(), called from
+ *     stg_waitReadzh and stg_waitWritezh, adds a thread and updates the
+ *     registration; removeBlockedOnFd() takes a thread away again when
+ *     it receives an asynchronous exception.
+ *
+ *   - awaitEvent() calls epoll_wait() and wakes up the threads waiting
+ *     for each event it returns, so its cost is in proportion to the
+ *     number of ready descriptors rather than the number of blocked
+ *     threads.  A descriptor stays registered for as long as some
+ *     thread is waiting for it.
+ *
+ *   - epoll refuses descriptors that it cannot poll, such as regular
+ *     files (EPERM), which select() reports as always ready, and bad
+ *     descriptors (EBADF), for which select() fails.  We put these on
+ *     pending_fds, and the next awaitEvent() wakes up their threads or
+ *     raises blockedOnBadFD in them (Trac #4934), like the select()
+ *     version.
+ *
+ *   - Closing a descriptor removes it from the epoll instance silently,
+ *     so a thread waiting on a descriptor that another thread closes
+ *     would never hear of it.  Only Haskell code can close a descriptor
+ *     behind our back, so each call to awaitEvent() sets fds_unchecked,
+ *     and before awaitEvent() blocks, revalidateFds() checks each
+ *     registered descriptor with fcntl() and puts the bad ones on
+ *     pending_fds as RTS_FD_IS_INVALID.  That costs O(highest fd), so it
+ *     is done at most once every FD_REVALIDATE_MS: until then the wait
+ *     is cut short to the time of the next check.  Once the check has
+ *     been done, awaitEvent() may block for as long as it likes.  A
+ *     descriptor that is closed and whose number is reused at once is
+ *     not noticed; its threads wait for the new file.
+ *
+ * The lists in fd_waiters are GC roots (see markBlockedOnFd()).  After
+ * forkProcess() the child shares the epoll instance with its parent, so
+ * it must not change the registrations: resetBlockedOnFd() forgets them
+ * and the child creates an epoll instance of its own.
+ */
+
+typedef struct {
+    StgTSO       *readers; // threads blocked in waitRead#, linked by _link
+    StgTSO       *writers; // threads blocked in waitWrite#
+    uint32_t      events;  // the events registered with epoll_fd, or 0
+    bool          pending; // true <=> fd is on pending_fds
+    enum FdState  state;   // if pending: RTS_FD_IS_READY or RTS_FD_IS_INVALID
+} FdWaiters;
+
+static int epoll_fd = -1;
+
+// Indexed by file descriptor
+static FdWaiters *fd_waiters = NULL;
+static uint32_t fd_waiters_size = 0;
+
+// Number of threads on the fd_waiters lists
+static uint32_t n_blocked_on_fd = 0;
+
+static int *pending_fds = NULL;
+static uint32_t n_pending_fds = 0;
+static uint32_t pending_fds_size = 0;
+
+#define INIT_FD_WAITERS_SIZE 64
+#define MAX_EPOLL_EVENTS     256
+
+// How often awaitEvent() may check for closed descriptors
+#define FD_REVALIDATE_MS     1000
+
+// true <=> Haskell code has run since revalidateFds() last ran
+static bool fds_unchecked = false;
+static Time last_revalidation = 0;
+
+static void ensureEpoll (void)
+{
+    if (epoll_fd < 0) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            sysErrorBelch("epoll_create1");
+            stg_exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static FdWaiters *getFdWaiters (int fd)
+{
+    uint32_t i, size;
+
+    if ((uint32_t)fd >= fd_waiters_size) {
+        size = fd_waiters_size == 0 ? INIT_FD_WAITERS_SIZE : fd_waiters_size;
+        while (size <= (uint32_t)fd) {
+            size *= 2;
+        }
+        fd_waiters = stgReallocBytes(fd_waiters, size * sizeof(FdWaiters),
+                                     "getFdWaiters");
+        for (i = fd_waiters_size; i < size; i++) {
+            fd_waiters[i].readers = END_TSO_QUEUE;
+            fd_waiters[i].writers = END_TSO_QUEUE;
+            fd_waiters[i].events  = 0;
+            fd_waiters[i].pending = false;
+        }
+        fd_waiters_size = size;
+    }
+    return &fd_waiters[fd];
+}
+
+static void addPendingFd (int fd, FdWaiters *w, enum FdState state)
+{
+    w->state = state;
+    if (w->pending) {
+        return;
+    }
+    w->pending = true;
+    if (n_pending_fds == pending_fds_size) {
+        pending_fds_size = pending_fds_size == 0 ? 16 : pending_fds_size * 2;
+        pending_fds = stgReallocBytes(pending_fds,
+                                      pending_fds_size * sizeof(int),
+                                      "addPendingFd");
+    }
+    pending_fds[n_pending_fds++] = fd;
+}
+
+/* Make the events registered for fd match the threads waiting for it.
+ */
+static void updateFdRegistration (int fd)
+{
+    FdWaiters *w = &fd_waiters[fd];
+    struct epoll_event ev;
+    uint32_t events = 0;
+    int op, r;
+
+    if (w->readers != END_TSO_QUEUE) events |= EPOLLIN;
+    if (w->writers != END_TSO_QUEUE) events |= EPOLLOUT;
+
+    // A pending fd is dealt with by the next awaitEvent() instead
+    if (events == w->events || w->pending) {
+        return;
+    }
+
+    ensureEpoll();
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = events;
+    ev.data.fd = fd;
+
+    if (events == 0) {
+        // This fails harmlessly if fd has been closed in the meantime
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+        w->events = 0;
+        return;
+    }
+
+    op = w->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    r = epoll_ctl(epoll_fd, op, fd, &ev);
+    if (r != 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+        // fd was closed, and the number reused for another descriptor
+        r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    } else if (r != 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+        // fd is still registered via another descriptor for the same file
+        r = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    if (r == 0) {
+        w->events = events;
+        return;
+    }
+
+    w->events = 0;
+    switch (errno) {
+    case EPERM:
+        addPendingFd(fd, w, RTS_FD_IS_READY);
+        break;
+    case EBADF:
+        addPendingFd(fd, w, RTS_FD_IS_INVALID);
+        break;
+    default:
+        sysErrorBelch("epoll_ctl");
+        stg_exit(EXIT_FAILURE);
+    }
+}
+
+/* Called from stg_waitReadzh and stg_waitWritezh, once tso->why_blocked
+ * and tso->block_info.fd have been set.
+ */
+void blockOnFd (StgTSO *tso)
+{
+    int fd = tso->block_info.fd;
+    FdWaiters *w;
+
+    if (fd < 0) {
+        errorBelch("file descriptor %d out of range", fd);
+        stg_exit(EXIT_FAILURE);
+    }
+
+    w = getFdWaiters(fd);
+
+    // tso is the current thread, so we can write its _link directly
+    if (tso->why_blocked == BlockedOnRead) {
+        tso->_link = w->readers;
+        w->readers = tso;
+    } else {
+        ASSERT(tso->why_blocked == BlockedOnWrite);
+        tso->_link = w->writers;
+        w->writers = tso;
+    }
+    n_blocked_on_fd++;
+
+    updateFdRegistration(fd);
+}
+
+void removeBlockedOnFd (Capability *cap, StgTSO *tso)
+{
+    int fd = tso->block_info.fd;
+    FdWaiters *w = &fd_waiters[fd];
+
+    if (tso->why_blocked == BlockedOnRead) {
+        removeThreadFromQueue(cap, &w->readers, tso);
+    } else {
+        removeThreadFromQueue(cap, &w->writers, tso);
+    }
+    n_blocked_on_fd--;
+
+    updateFdRegistration(fd);
+}
+
+bool emptyBlockedOnFd (void)
+{
+    return n_blocked_on_fd == 0;
+}
+
+void markBlockedOnFd (evac_fn evac, void *user)
+{
+    uint32_t i;
+
+    for (i = 0; i < fd_waiters_size; i++) {
+        if (fd_waiters[i].readers != END_TSO_QUEUE) {
+            evac(user, (StgClosure **)(void *)&fd_waiters[i].readers);
+        }
+        if (fd_waiters[i].writers != END_TSO_QUEUE) {
+            evac(user, (StgClosure **)(void *)&fd_waiters[i].writers);
+        }
+    }
+}
+
+void resetBlockedOnFd (void)
+{
+    uint32_t i;
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    for (i = 0; i < fd_waiters_size; i++) {
+        fd_waiters[i].events = 0;
+    }
+}
+
+void freeBlockedOnFd (void)
+{
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    stgFree(fd_waiters);
+    fd_waiters = NULL;
+    fd_waiters_size = 0;
+    n_blocked_on_fd = 0;
+    stgFree(pending_fds);
+    pending_fds = NULL;
+    n_pending_fds = 0;
+    pending_fds_size = 0;
+}
+
+static void wakeUpFdWaiters (StgTSO *tso, int fd, enum FdState state)
+{
+    StgTSO *next;
+
+    for (; tso != END_TSO_QUEUE; tso = next) {
+        next = tso->_link;
+        tso->_link = END_TSO_QUEUE;
+        n_blocked_on_fd--;
+
+        if (state == RTS_FD_IS_INVALID) {
+            /*
+             * Don't let RTS loop on such descriptors,
+             * pass an IOError to blocked threads (Trac #4934)
+             */
+            IF_DEBUG(scheduler,
+                debugBelch("Killing blocked thread %lu on bad fd=%i\n",
+                           (unsigned long)tso->id, fd));
+            raiseAsync(&MainCapability, tso,
+                (StgClosure *)blockedOnBadFD_closure, false, NULL);
+        } else {
+            IF_DEBUG(scheduler,
+                debugBelch("Waking up blocked thread %lu\n",
+                           (unsigned long)tso->id));
+            tso->why_blocked = NotBlocked;
+            pushOnRunQueue(&MainCapability,tso);
+        }
+    }
+}
+
+static void wakeUpFd (int fd, uint32_t events, enum FdState state)
+{
+    FdWaiters *w = &fd_waiters[fd];
+    StgTSO *tso;
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        tso = w->readers;
+        w->readers = END_TSO_QUEUE;
+        wakeUpFdWaiters(tso, fd, state);
+    }
+    if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        tso = w->writers;
+        w->writers = END_TSO_QUEUE;
+        wakeUpFdWaiters(tso, fd, state);
+    }
+}
+
+/* Find the registered descriptors that have been closed behind our
+ * back; see Note [awaitEvent with epoll].
+ */
+static void revalidateFds (void)
+{
+    uint32_t fd;
+
+    for (fd = 0; fd < fd_waiters_size; fd++) {
+        if (fd_waiters[fd].events == 0) {
+            continue;
+        }
+        if (fcntl(fd, F_GETFD) < 0 && errno == EBADF) {
+            fd_waiters[fd].events = 0;
+            addPendingFd(fd, &fd_waiters[fd], RTS_FD_IS_INVALID);
+        }
+    }
+}
+
+static void wakeUpPendingFds (void)
+{
+    uint32_t i;
+    int fd;
+
+    for (i = 0; i < n_pending_fds; i++) {
+        fd = pending_fds[i];
+        fd_waiters[fd].pending = false;
+        wakeUpFd(fd, EPOLLIN | EPOLLOUT, fd_waiters[fd].state);
+    }
+    n_pending_fds = 0;
+}
+
+/* Argument 'wait' says whether to wait for I/O to become available,
+ * or whether to just check and return immediately.  If there are
+ * other threads ready to run, we normally do the non-waiting variety,
+ * otherwise we wait (see Schedule.c).
+ */
+void
+awaitEvent(bool wait)
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int i, n, timeout;
+    LowResTime now;
+    Time since;
+
+    IF_DEBUG(scheduler,
+             debugBelch("scheduler: checking for threads blocked on I/O");
+             if (wait) {
+                 debugBelch(" (waiting)");
+             }
+             debugBelch("\n");
+             );
+
+    /* loop until we've woken up some threads.  This loop is needed
+     * because the epoll_wait timing isn't accurate, we sometimes sleep
+     * for a while but not long enough to wake up a thread in
+     * a threadDelay.
+     */
+    // See Note [awaitEvent with epoll]
+    fds_unchecked = true;
+
+    do {
+
+      now = getLowResTimeOfDay();
+      if (wakeUpSleepingThreads(now)) {
+          return;
+      }
+
+      wakeUpPendingFds();
+
+      if (!wait || !emptyRunQueue(&MainCapability)) {
+          // just poll
+          timeout = 0;
+      } else if (!emptySleepingQueue()) {
+          // epoll_wait() takes a timeout in milliseconds; round up,
+          // because we never want to wake up before the target.
+          Time min = LowResTimeToTime(peekSleepingTarget() - now);
+          if (TimeToUS(min) / 1000 >= INT_MAX) {
+              timeout = INT_MAX;
+          } else {
+              timeout = (int)((TimeToUS(min) + 999) / 1000);
+          }
+      } else {
+          timeout = -1;
+      }
+
+      // Before we block, look for descriptors closed since we last did
+      if (timeout != 0 && fds_unchecked && n_blocked_on_fd > 0) {
+          since = getProcessElapsedTime() - last_revalidation;
+          if (since >= MSToTime(FD_REVALIDATE_MS)) {
+              revalidateFds();
+              last_revalidation += since;
+              fds_unchecked = false;
+              if (n_pending_fds > 0) {
+                  continue;
+              }
+          } else {
+              int left = (int)((TimeToUS(MSToTime(FD_REVALIDATE_MS) - since)
+                                + 999) / 1000);
+              if (timeout < 0 || timeout > left) {
+                  timeout = left;
+              }
+          }
+      }
+
+      /* Check for any interesting events */
+
+      ensureEpoll();
+      n = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, timeout);
+      if (n < 0) {
+          if (errno != EINTR) {
+              sysErrorBelch("epoll_wait");
+              stg_exit(EXIT_FAILURE);
+          }
+          if (awaitEventInterrupted()) {
+              return;
+          }
+          continue;
+      }
+
+      for (i = 0; i < n; i++) {
+          wakeUpFd(events[i].data.fd, events[i].events, RTS_FD_IS_READY);
+          updateFdRegistration(events[i].data.fd);
+      }
+
+    } while (wait && sched_state == SCHED_RUNNING
+             && emptyRunQueue(&MainCapability));
+}
+
+#else /* !HAVE_SYS_EPOLL_H */
+
+static void GNUC3_ATTRIBUTE(__noreturn__)
+fdOutOfRange (int fd)
+{
+    errorBelch("file descriptor %d out of range for select (0--%d).\n"
+               "Recompile with -threaded to work around this.",
+               fd, (int)FD_SETSIZE);
+    stg_exit(EXIT_FAILURE);
+}
+
 static enum FdState fdPollReadState (int fd)
 {
     int r;
@@ -298,7 +793,7 @@ awaitEvent(bool wait)
           tv.tv_sec  = 0;
           tv.tv_usec = 0;
           ptv = &tv;
-      } else if (sleeping_queue != END_TSO_QUEUE) {
+      } else if (!emptySleepingQueue()) {
           /* SUSv2 allows implementations to have an implementation defined
            * maximum timeout for select(2). The standard requires
            * implementations to silently truncate values exceeding this maximum
@@ -317,7 +812,7 @@ awaitEvent(bool wait)
            */
           const time_t max_seconds = 2678400; // 31 * 24 * 60 * 60
 
-          Time min = LowResTimeToTime(sleeping_queue->block_info.target - now);
+          Time min = LowResTimeToTime(peekSleepingTarget() - now);
           tv.tv_sec  = TimeToSeconds(min);
           if (tv.tv_sec < max_seconds) {
               tv.tv_usec = TimeToUS(min) % 1000000;
@@ -343,32 +838,7 @@ awaitEvent(bool wait)
             }
           }
 
-          /* We got a signal; could be one of ours.  If so, we need
-           * to start up the signal handler straight away, otherwise
-           * we could block for a long time before the signal is
-           * serviced.
-           */
-#if defined(RTS_USER_SIGNALS)
-          if (RtsFlags.MiscFlags.install_signal_handlers && signals_pending()) {
-              startSignalHandlers(&MainCapability);
-              return; /* still hold the lock */
-          }
-#endif
-
-          /* we were interrupted, return to the scheduler immediately.
-           */
-          if (sched_state >= SCHED_INTERRUPTING) {
-              return; /* still hold the lock */
-          }
-
-          /* check for threads that need waking up
-           */
-          wakeUpSleepingThreads(getLowResTimeOfDay());
-
-          /* If new runnable threads have arrived, stop waiting for
-           * I/O and run them.
-           */
-          if (!emptyRunQueue(&MainCapability)) {
+          if (awaitEventInterrupted()) {
               return; /* still hold the lock */
           }
       }
@@ -455,4 +925,6 @@ awaitEvent(bool wait)
              && emptyRunQueue(&MainCapability));
 }
 
+#endif /* !HAVE_SYS_EPOLL_H */
+
 #endif /* THREADED_RTS */
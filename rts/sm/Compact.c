@@ -21,12 +21,14 @@
 #include "GC.h"
 #include "Compact.h"
 #include "Schedule.h"
+#include "STM.h"
 #include "Apply.h"
 #include "Trace.h"
 #include "Weak.h"
 #include "MarkWeak.h"
 #include "StablePtr.h"
 #include "StableName.h"
+#include "AllocSample.h"
 
 // Turn off inlining when debugging - it obfuscates things
 #if defined(DEBUG)
@@ -459,6 +461,25 @@ thread_TSO (StgTSO *tso)
 }
 
 
+// The chunks of a TRec are not heap objects, so we thread the pointers in
+// them when we meet the TRec; see Note [TRec chunk arena] in STM.c
+static void
+thread_trec_chunks (StgTRecHeader *trec)
+{
+    StgTRecChunk *tc;
+    StgWord i;
+
+    for (tc = trec->current_chunk; tc != END_STM_CHUNK_LIST;
+         tc = tc->prev_chunk) {
+        TRecEntry *e = &(tc->entries[0]);
+        for (i = 0; i < tc->next_entry_idx; i++, e++) {
+            thread_(&e->tvar);
+            thread(&e->expected_value);
+            thread(&e->new_value);
+        }
+    }
+}
+
 static void
 update_fwd_large( bdescr *bd )
 {
@@ -526,20 +547,6 @@ update_fwd_large( bdescr *bd )
         thread_PAP((StgPAP *)p);
         continue;
 
-    case TREC_CHUNK:
-    {
-        StgWord i;
-        StgTRecChunk *tc = (StgTRecChunk *)p;
-        TRecEntry *e = &(tc -> entries[0]);
-        thread_(&tc->prev_chunk);
-        for (i = 0; i < tc -> next_entry_idx; i ++, e++ ) {
-          thread_(&e->tvar);
-          thread(&e->expected_value);
-          thread(&e->new_value);
-        }
-        continue;
-    }
-
     default:
       barf("update_fwd_large: unknown/strange object  %d", (int)(info->type));
     }
@@ -614,11 +621,15 @@ thread_obj (const StgInfoTable *info, StgPtr p)
         return p + info->layout.payload.nptrs;
     }
 
+    case MUT_PRIM:
+        if (info == INFO_PTR_TO_STRUCT(&stg_TREC_HEADER_info)) {
+            thread_trec_chunks((StgTRecHeader *)p);
+        }
+        /* fallthrough */
     case FUN:
     case CONSTR:
     case CONSTR_NOCAF:
     case PRIM:
-    case MUT_PRIM:
     case MUT_VAR_CLEAN:
     case MUT_VAR_DIRTY:
     case TVAR:
@@ -723,20 +734,6 @@ thread_obj (const StgInfoTable *info, StgPtr p)
         return p + stack_sizeW(stack);
     }
 
-    case TREC_CHUNK:
-    {
-        StgWord i;
-        StgTRecChunk *tc = (StgTRecChunk *)p;
-        TRecEntry *e = &(tc -> entries[0]);
-        thread_(&tc->prev_chunk);
-        for (i = 0; i < tc -> next_entry_idx; i ++, e++ ) {
-          thread_(&e->tvar);
-          thread(&e->expected_value);
-          thread(&e->new_value);
-        }
-        return p + sizeofW(StgTRecChunk);
-    }
-
     default:
         barf("update_fwd: unknown/strange object  %d", (int)(info->type));
         return NULL;
@@ -1006,6 +1003,9 @@ compact(StgClosure *static_objects)
     // the stable name table
     threadStableNameTable((evac_fn)thread_root, NULL);
 
+    // the allocation-site samples
+    threadAllocSamples((evac_fn)thread_root, NULL);
+
     // the CAF list (used by GHCi)
     markCAFs((evac_fn)thread_root, NULL);
 
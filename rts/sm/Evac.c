@@ -84,6 +84,52 @@ alloc_for_copy (uint32_t size, uint32_t gen_no)
     return to;
 }
 
+/* -----------------------------------------------------------------------------
+   Lost evacuation races
+
+   Note [Evacuation races]
+   ~~~~~~~~~~~~~~~~~~~~~~~
+
+   With the parallel GC, two threads may try to evacuate the same object
+   at the same time.  Each thread copies the object into its own to-space
+   and then tries to install a forwarding pointer in the original with a
+   single CAS on the info pointer.  Exactly one CAS succeeds; the losing
+   thread
+
+     - gives back the space it allocated for its copy (the copy is always
+       the most recent allocation in its workspace, because nothing is
+       allocated between alloc_for_copy() and the CAS),
+     - bumps gct->copy_races[] for the closure type, and
+     - calls evacuate() again, which finds the winner's forwarding pointer
+       and does the failed_to_evac bookkeeping.
+
+   No thread ever spins waiting for another one to finish copying, and
+   the object is never visible as a WHITEHOLE.  The only closures that
+   are still locked with WHITEHOLE during GC are THUNK_SELECTORs under
+   evaluation in eval_thunk_selector(), because there the lock protects
+   the evaluation rather than the copy.
+
+   The per-closure-type counts are summed into gc_copy_races[] at the
+   end of each GC and reported by +RTS -s.
+   -------------------------------------------------------------------------- */
+
+#if defined(PARALLEL_GC)
+STATIC_INLINE void
+lost_copy_race (StgClosure **p, const StgInfoTable *info,
+                StgPtr to, uint32_t size)
+{
+    gen_workspace *ws;
+
+    ws = &gct->gens[Bdescr(to)->gen_no];
+    ASSERT(ws->todo_free == to + size);
+    ws->todo_free = to;
+
+    gct->copy_races[INFO_PTR_TO_STRUCT(info)->type]++;
+
+    evacuate(p); // does the failed_to_evac stuff
+}
+#endif
+
 /* -----------------------------------------------------------------------------
    The evacuate() code
    -------------------------------------------------------------------------- */
@@ -112,18 +158,10 @@ copy_tag(StgClosure **p, const StgInfoTable *info,
         const StgInfoTable *new_info;
         new_info = (const StgInfoTable *)cas((StgPtr)&src->header.info, (W_)info, MK_FORWARDING_PTR(to));
         if (new_info != info) {
-#if defined(PROFILING)
             // We copied this object at the same time as another
-            // thread.  We'll evacuate the object again and the copy
-            // we just made will be discarded at the next GC, but we
-            // may have copied it after the other thread called
-            // SET_EVACUAEE_FOR_LDV(), which would confuse the LDV
-            // profiler when it encounters this closure in
-            // processHeapClosureForDead.  So we reset the LDVW field
-            // here.
-            LDVW(to) = 0;
-#endif
-            return evacuate(p); // does the failed_to_evac stuff
+            // thread, and lost.  See Note [Evacuation races].
+            lost_copy_race(p, info, to, size);
+            return;
         } else {
             *p = TAG_CLOSURE(tag,(StgClosure*)to);
         }
@@ -179,44 +217,37 @@ copy_tag_nolock(StgClosure **p, const StgInfoTable *info,
 /* Special version of copy() for when we only want to copy the info
  * pointer of an object, but reserve some padding after it.  This is
  * used to optimise evacuation of TSOs.
+ *
+ * Returns true if this thread won the race to evacuate the object, in
+ * which case the caller is responsible for copying the rest of it.
  */
 static bool
-copyPart(StgClosure **p, StgClosure *src, uint32_t size_to_reserve,
-         uint32_t size_to_copy, uint32_t gen_no)
+copyPart(StgClosure **p, const StgInfoTable *info, StgClosure *src,
+         uint32_t size_to_reserve, uint32_t size_to_copy, uint32_t gen_no)
 {
     StgPtr to, from;
     uint32_t i;
-    StgWord info;
-
-#if defined(PARALLEL_GC)
-spin:
-        info = xchg((StgPtr)&src->header.info, (W_)&stg_WHITEHOLE_info);
-        if (info == (W_)&stg_WHITEHOLE_info) {
-#if defined(PROF_SPIN)
-            whitehole_gc_spin++;
-#endif
-            busy_wait_nop();
-            goto spin;
-        }
-    if (IS_FORWARDING_PTR(info)) {
-        src->header.info = (const StgInfoTable *)info;
-        evacuate(p); // does the failed_to_evac stuff
-        return false;
-    }
-#else
-    info = (W_)src->header.info;
-#endif
 
     to = alloc_for_copy(size_to_reserve, gen_no);
 
     from = (StgPtr)src;
-    to[0] = info;
+    to[0] = (W_)info;
     for (i = 1; i < size_to_copy; i++) { // unroll for small i
         to[i] = from[i];
     }
 
+#if defined(PARALLEL_GC)
+    // cas() is a full barrier, so the copy is visible before the
+    // forwarding pointer.  See Note [Evacuation races].
+    if (cas((StgPtr)&src->header.info, (W_)info, MK_FORWARDING_PTR(to))
+        != (W_)info) {
+        lost_copy_race(p, info, to, size_to_reserve);
+        return false;
+    }
+#else
     write_barrier();
     src->header.info = (const StgInfoTable*)MK_FORWARDING_PTR(to);
+#endif
     *p = (StgClosure *)to;
 
 #if defined(PROFILING)
@@ -349,6 +380,20 @@ evacuate_static_object (StgClosure **link_field, StgClosure *q)
     }
 }
 
+/* Like evacuate_static_object(), for the static constructors and
+ * functions that can be settled: count the ones that we skip because
+ * they are.  See Note [Settled static objects] in Storage.h.
+ */
+STATIC_INLINE void
+evacuate_settleable_static_object (StgClosure **link_field, StgClosure *q)
+{
+    if (((StgWord)*link_field & STATIC_BITS) == STATIC_FLAG_LIST) {
+        gct->skipped_static++;
+        return;
+    }
+    evacuate_static_object(link_field, q);
+}
+
 /* ----------------------------------------------------------------------------
    Evacuate an object inside a CompactNFData
 
@@ -529,7 +574,8 @@ loop:
 
       case FUN_STATIC:
           if (info->srt != 0 || info->layout.payload.ptrs != 0) {
-              evacuate_static_object(STATIC_LINK(info,(StgClosure *)q), q);
+              evacuate_settleable_static_object(
+                  STATIC_LINK(info,(StgClosure *)q), q);
           }
           return;
 
@@ -545,7 +591,8 @@ loop:
       case CONSTR_1_0:
       case CONSTR_2_0:
       case CONSTR_1_1:
-          evacuate_static_object(STATIC_LINK(info,(StgClosure *)q), q);
+          evacuate_settleable_static_object(
+              STATIC_LINK(info,(StgClosure *)q), q);
           return;
 
       case CONSTR_0_1:
@@ -840,7 +887,7 @@ loop:
           StgPtr r, s;
           bool mine;
 
-          mine = copyPart(p,(StgClosure *)stack, stack_sizeW(stack),
+          mine = copyPart(p,info,(StgClosure *)stack, stack_sizeW(stack),
                           sizeofW(StgStack), gen_no);
           if (mine) {
               new_stack = (StgStack *)*p;
@@ -854,10 +901,6 @@ loop:
       }
     }
 
-  case TREC_CHUNK:
-      copy(p,info,q,sizeofW(StgTRecChunk),gen_no);
-      return;
-
   default:
     barf("evacuate: strange closure type %d", (int)(INFO_PTR_TO_STRUCT(info)->type));
   }
@@ -1293,8 +1336,9 @@ bale_out:
     // pointer.  But don't forget: we still need to evacuate the thunk itself.
     SET_INFO((StgClosure *)p, (const StgInfoTable *)info_ptr);
     // THREADED_RTS: we just unlocked the thunk, so another thread
-    // might get in and update it.  copy() will lock it again and
-    // check whether it was updated in the meantime.
+    // might get in and update it.  copy() installs the forwarding
+    // pointer with a CAS against the info pointer we just restored, so
+    // it will notice if that happened (see Note [Evacuation races]).
     *q = (StgClosure *)p;
     if (evac) {
         copy(q,(const StgInfoTable *)info_ptr,(StgClosure *)p,THUNK_SELECTOR_sizeW(),bd->dest_no);
@@ -47,6 +47,7 @@
 #include "LdvProfile.h"
 #include "RaiseAsync.h"
 #include "StableName.h"
+#include "AllocSample.h"
 #include "StablePtr.h"
 #include "CheckUnload.h"
 #include "CNF.h"
@@ -119,7 +120,6 @@ uint32_t mutlist_MUTVARS,
     mutlist_MVARS,
     mutlist_TVAR,
     mutlist_TVAR_WATCH_QUEUE,
-    mutlist_TREC_CHUNK,
     mutlist_TREC_HEADER,
     mutlist_OTHERS;
 #endif
@@ -148,11 +148,27 @@ volatile StgWord64 waitForGcThreads_yield = 0;
 volatile StgWord64 whitehole_gc_spin = 0;
 #endif
 
+#if defined(THREADED_RTS)
+// Cumulative count of evacuations that lost a race with another GC
+// thread, indexed by closure type.  See Note [Evacuation races] in Evac.c.
+StgWord64 gc_copy_races[N_CLOSURE_TYPES];
+#endif
+
 bool work_stealing;
 
 uint32_t static_flag = STATIC_FLAG_B;
 uint32_t prev_static_flag = STATIC_FLAG_A;
 
+// Whether static objects may be settled during this GC.
+// See Note [Settled static objects] in Storage.h.
+bool settle_static_objects;
+
+#if defined(THREADED_RTS)
+// What the GC threads run during a parallel heap census.
+// See gcParallelHeapCensus().
+static void (*census_worker)(uint32_t thread_index);
+#endif
+
 DECLARE_GCT
 
 /* -----------------------------------------------------------------------------
@@ -173,6 +189,8 @@ static void wakeup_gc_threads       (uint32_t me, bool idle_cap[]);
 static void shutdown_gc_threads     (uint32_t me, bool idle_cap[]);
 static void collect_gct_blocks      (void);
 static void collect_pinned_object_blocks (void);
+static void collect_settled_static_objects (void);
+static void unsettleStaticObjects   (void);
 static void heapOverflow            (void);
 
 #if defined(DEBUG)
@@ -206,7 +224,7 @@ GarbageCollect (uint32_t collect_gen,
   generation *gen;
   StgWord live_blocks, live_words, par_max_copied, par_balanced_copied,
       gc_spin_spin, gc_spin_yield, mut_spin_spin, mut_spin_yield,
-      any_work, no_work, scav_find_work;
+      any_work, no_work, scav_find_work, scavenged_static, skipped_static;
 #if defined(THREADED_RTS)
   gc_thread *saved_gct;
 #endif
@@ -249,7 +267,6 @@ GarbageCollect (uint32_t collect_gen,
   mutlist_MVARS = 0;
   mutlist_TVAR = 0;
   mutlist_TVAR_WATCH_QUEUE = 0;
-  mutlist_TREC_CHUNK = 0;
   mutlist_TREC_HEADER = 0;
   mutlist_OTHERS = 0;
 #endif
@@ -271,6 +288,19 @@ GarbageCollect (uint32_t collect_gen,
       prev_static_flag = static_flag;
       static_flag =
           static_flag == STATIC_FLAG_A ? STATIC_FLAG_B : STATIC_FLAG_A;
+
+      // See Note [Settled static objects] in Storage.h
+      settle_static_objects = !pendingUnloads();
+#if defined(PROFILING)
+      if (RtsFlags.ProfFlags.doHeapProfile == HEAP_BY_RETAINER) {
+          settle_static_objects = false;
+      }
+#endif
+      if (!settle_static_objects) {
+          unsettleStaticObjects();
+      }
+  } else {
+      settle_static_objects = false;
   }
 
 #if defined(THREADED_RTS)
@@ -438,6 +468,9 @@ GarbageCollect (uint32_t collect_gen,
   // Now see which stable names are still alive.
   gcStableNameTable();
 
+  // ... and which allocation-site samples
+  gcAllocSamples(major_gc);
+
 #if defined(THREADED_RTS)
   if (n_gc_threads == 1) {
       for (n = 0; n < n_capabilities; n++) {
@@ -483,6 +516,8 @@ GarbageCollect (uint32_t collect_gen,
   any_work = 0;
   no_work = 0;
   scav_find_work = 0;
+  scavenged_static = 0;
+  skipped_static = 0;
   {
       uint32_t i;
       uint64_t par_balanced_copied_acc = 0;
@@ -490,6 +525,13 @@ GarbageCollect (uint32_t collect_gen,
 
       for (i=0; i < n_gc_threads; i++) {
           copied += gc_threads[i]->copied;
+          scavenged_static += gc_threads[i]->scavenged_static;
+          skipped_static += gc_threads[i]->skipped_static;
+#if defined(THREADED_RTS)
+          for (uint32_t t = 0; t < N_CLOSURE_TYPES; t++) {
+              gc_copy_races[t] += gc_threads[i]->copy_races[t];
+          }
+#endif
       }
       for (i=0; i < n_gc_threads; i++) {
           thread = gc_threads[i];
@@ -557,11 +599,11 @@ GarbageCollect (uint32_t collect_gen,
         copied +=  mut_list_size;
 
         debugTrace(DEBUG_gc,
-                   "mut_list_size: %lu (%d vars, %d arrays, %d MVARs, %d TVARs, %d TVAR_WATCH_QUEUEs, %d TREC_CHUNKs, %d TREC_HEADERs, %d others)",
+                   "mut_list_size: %lu (%d vars, %d arrays, %d MVARs, %d TVARs, %d TVAR_WATCH_QUEUEs, %d TREC_HEADERs, %d others)",
                    (unsigned long)(mut_list_size * sizeof(W_)),
                    mutlist_MUTVARS, mutlist_MUTARRS, mutlist_MVARS,
                    mutlist_TVAR, mutlist_TVAR_WATCH_QUEUE,
-                   mutlist_TREC_CHUNK, mutlist_TREC_HEADER,
+                   mutlist_TREC_HEADER,
                    mutlist_OTHERS);
     }
 
@@ -743,9 +785,13 @@ GarbageCollect (uint32_t collect_gen,
   // hs_free_stable_ptr(), both of which access the StablePtr table.
   stablePtrUnlock();
 
+  if (major_gc) {
+      collect_settled_static_objects();
+  }
+
   // Must be after stablePtrUnlock(), because it might free stable ptrs.
   if (major_gc) {
-      checkUnload (gct->scavenged_static_objects);
+      checkUnload (gct->scavenged_static_objects, settled_static_objects);
   }
 
 #if defined(PROFILING)
@@ -775,7 +821,7 @@ GarbageCollect (uint32_t collect_gen,
   if (do_heap_census) {
       debugTrace(DEBUG_sched, "performing heap census");
       RELEASE_SM_LOCK;
-      heapCensus(gct->gc_start_cpu);
+      heapCensus(cap, gct->gc_start_cpu);
       ACQUIRE_SM_LOCK;
   }
 
@@ -860,7 +906,8 @@ GarbageCollect (uint32_t collect_gen,
              live_blocks * BLOCK_SIZE_W - live_words /* slop */,
              N, n_gc_threads, par_max_copied, par_balanced_copied,
              gc_spin_spin, gc_spin_yield, mut_spin_spin, mut_spin_yield,
-             any_work, no_work, scav_find_work);
+             any_work, no_work, scav_find_work,
+             scavenged_static, skipped_static);
 
 #if defined(RTS_USER_SIGNALS)
   if (RtsFlags.MiscFlags.install_signal_handlers) {
@@ -1143,6 +1190,10 @@ gcWorkerThread (Capability *cap)
     //    measurements more accurate on Linux, perhaps because it syncs
     //    the CPU time across the multiple cores.  Without this, CPU time
     //    is heavily skewed towards GC rather than MUT.
+    // See Note [Time to stop] in Stats.c
+    if (cap->sync_thread != 0) {
+        cap->sync_stopped_at = getProcessElapsedTime();
+    }
     gct->wakeup = GC_THREAD_STANDING_BY;
     debugTrace(DEBUG_gc, "GC thread %d standing by...", gct->thread_index);
     ACQUIRE_SPIN_LOCK(&gct->gc_spin);
@@ -1174,6 +1225,19 @@ gcWorkerThread (Capability *cap)
     debugTrace(DEBUG_gc, "GC thread %d waiting to continue...",
                gct->thread_index);
     ACQUIRE_SPIN_LOCK(&gct->mut_spin);
+
+    // We may be asked to help with a heap census before we continue.
+    // See gcParallelHeapCensus().
+    while (gct->wakeup == GC_THREAD_CENSUS) {
+        census_worker(gct->thread_index);
+        RELEASE_SPIN_LOCK(&gct->mut_spin);
+        gct->wakeup = GC_THREAD_CENSUS_DONE;
+        ACQUIRE_SPIN_LOCK(&gct->gc_spin);
+        RELEASE_SPIN_LOCK(&gct->gc_spin);
+        gct->wakeup = GC_THREAD_WAITING_TO_CONTINUE;
+        ACQUIRE_SPIN_LOCK(&gct->mut_spin);
+    }
+
     debugTrace(DEBUG_gc, "GC thread %d on my way...", gct->thread_index);
 
     SET_GCT(saved_gct);
@@ -1297,6 +1361,65 @@ shutdown_gc_threads (uint32_t me USED_IF_THREADS,
 }
 
 #if defined(THREADED_RTS)
+/* ----------------------------------------------------------------------------
+   Parallel heap census
+
+   A heap census happens at the end of a GC, while the GC threads that took
+   part in the GC are waiting to continue.  gcParallelHeapCensus() makes
+   them run a worker function, such as heapCensusWorker() (see ProfHeap.c)
+   or the retainer traversal (see RetainerProfile.c), runs it on the
+   calling thread too, and returns when all the threads are done.
+
+   The handshake mirrors the one that starts and stops the GC threads: we
+   hold a thread's mut_spin while it waits to continue, so we let it go by
+   taking gc_spin and releasing mut_spin.  When it's done it releases
+   mut_spin, says GC_THREAD_CENSUS_DONE and waits for gc_spin; we swap the
+   locks back, and it goes back to waiting to continue.
+
+   This is called from outside the GC proper, so we must not use gct here
+   (see mark_root()).
+   ------------------------------------------------------------------------- */
+
+void
+gcParallelHeapCensus (Capability *cap, void (*worker)(uint32_t thread_index))
+{
+    const uint32_t me = cap->no;
+    uint32_t i;
+    bool census_thread[n_gc_threads];
+
+    // Released to the other threads along with mut_spin below.
+    census_worker = worker;
+
+    for (i = 0; i < n_gc_threads; i++) {
+        census_thread[i] = i != me &&
+            gc_threads[i]->wakeup == GC_THREAD_WAITING_TO_CONTINUE;
+        if (!census_thread[i]) continue;
+        gc_threads[i]->wakeup = GC_THREAD_CENSUS;
+        ACQUIRE_SPIN_LOCK(&gc_threads[i]->gc_spin);
+        RELEASE_SPIN_LOCK(&gc_threads[i]->mut_spin);
+    }
+
+    worker(me);
+
+    for (i = 0; i < n_gc_threads; i++) {
+        if (!census_thread[i]) continue;
+        while (gc_threads[i]->wakeup != GC_THREAD_CENSUS_DONE) {
+            busy_wait_nop();
+            write_barrier();
+        }
+        ACQUIRE_SPIN_LOCK(&gc_threads[i]->mut_spin);
+        RELEASE_SPIN_LOCK(&gc_threads[i]->gc_spin);
+    }
+
+    for (i = 0; i < n_gc_threads; i++) {
+        if (!census_thread[i]) continue;
+        while (gc_threads[i]->wakeup != GC_THREAD_WAITING_TO_CONTINUE) {
+            busy_wait_nop();
+            write_barrier();
+        }
+    }
+}
+
 void
 releaseGCThreads (Capability *cap USED_IF_THREADS, bool idle_cap[])
 {
@@ -1555,6 +1678,55 @@ collect_pinned_object_blocks (void)
     }
 }
 
+/* -----------------------------------------------------------------------------
+   Each GC thread keeps the static objects it settled during this GC on
+   a private list.  Here we append those lists to settled_static_objects.
+
+   unsettleStaticObjects() empties settled_static_objects again, so that
+   all the static objects on it are traversed by the next major GC.
+
+   See Note [Settled static objects] in Storage.h.
+   -------------------------------------------------------------------------- */
+
+static void
+collect_settled_static_objects (void)
+{
+    uint32_t i;
+    gc_thread *t;
+    StgClosure *tail;
+
+    for (i = 0; i < n_gc_threads; i++) {
+        t = gc_threads[i];
+        if (t->settled_static_objects != END_OF_CAF_LIST) {
+            tail = t->settled_static_objects_tail;
+            *STATIC_LINK(get_itbl(tail), tail) = settled_static_objects;
+            settled_static_objects = t->settled_static_objects;
+            n_settled_static_objects += t->n_settled_static_objects;
+        }
+        t->settled_static_objects = END_OF_CAF_LIST;
+        t->settled_static_objects_tail = NULL;
+        t->n_settled_static_objects = 0;
+    }
+
+    debugTrace(DEBUG_gc, "%" FMT_Word " settled static objects",
+               n_settled_static_objects);
+}
+
+static void
+unsettleStaticObjects (void)
+{
+    StgClosure *p, *next;
+
+    for (p = settled_static_objects; p != END_OF_CAF_LIST; p = next) {
+        p = UNTAG_STATIC_LIST_PTR(p);
+        next = *STATIC_LINK(get_itbl(p), p);
+        *STATIC_LINK(get_itbl(p), p) = NULL;
+    }
+
+    settled_static_objects = END_OF_CAF_LIST;
+    n_settled_static_objects = 0;
+}
+
 /* -----------------------------------------------------------------------------
    Initialise a gc_thread before GC
    -------------------------------------------------------------------------- */
@@ -1564,6 +1736,9 @@ init_gc_thread (gc_thread *t)
 {
     t->static_objects = END_OF_STATIC_OBJECT_LIST;
     t->scavenged_static_objects = END_OF_STATIC_OBJECT_LIST;
+    t->settled_static_objects = END_OF_CAF_LIST;
+    t->settled_static_objects_tail = NULL;
+    t->n_settled_static_objects = 0;
     t->scan_bd = NULL;
     t->mut_lists = t->cap->mut_lists;
     t->evac_gen_no = 0;
@@ -1575,6 +1750,9 @@ init_gc_thread (gc_thread *t)
     t->any_work = 0;
     t->no_work = 0;
     t->scav_find_work = 0;
+    t->scavenged_static = 0;
+    t->skipped_static = 0;
+    memset(t->copy_races, 0, sizeof(t->copy_races));
 }
 
 /* -----------------------------------------------------------------------------
@@ -1712,7 +1890,7 @@ static void
 resize_nursery (void)
 {
     const StgWord min_nursery =
-      RtsFlags.GcFlags.minAllocAreaSize * (StgWord)n_capabilities;
+      RtsFlags.GcFlags.minAllocAreaSize * (StgWord)enabled_capabilities;
 
     if (RtsFlags.GcFlags.generations == 1)
     {   // Two-space collector:
@@ -37,11 +37,12 @@ extern StgPtr mark_sp;
 
 extern bool work_stealing;
 
+extern bool settle_static_objects;
+
 #if defined(DEBUG)
 extern uint32_t mutlist_MUTVARS, mutlist_MUTARRS, mutlist_MVARS, mutlist_OTHERS,
     mutlist_TVAR,
     mutlist_TVAR_WATCH_QUEUE,
-    mutlist_TREC_CHUNK,
     mutlist_TREC_HEADER;
 #endif
 
@@ -51,6 +52,10 @@ extern volatile StgWord64 waitForGcThreads_spin;
 extern volatile StgWord64 waitForGcThreads_yield;
 #endif
 
+#if defined(THREADED_RTS)
+extern StgWord64 gc_copy_races[N_CLOSURE_TYPES];
+#endif
+
 void gcWorkerThread (Capability *cap);
 void initGcThreads (uint32_t from, uint32_t to);
 void freeGcThreads (void);
@@ -58,6 +63,8 @@ void freeGcThreads (void);
 #if defined(THREADED_RTS)
 void waitForGcThreads (Capability *cap, bool idle_cap[]);
 void releaseGCThreads (Capability *cap, bool idle_cap[]);
+void gcParallelHeapCensus (Capability *cap,
+                           void (*worker)(uint32_t thread_index));
 #endif
 
 #define WORK_UNIT_WORDS 128
@@ -121,6 +121,8 @@ typedef struct gen_workspace_ {
 #define GC_THREAD_STANDING_BY          1
 #define GC_THREAD_RUNNING              2
 #define GC_THREAD_WAITING_TO_CONTINUE  3
+#define GC_THREAD_CENSUS               4
+#define GC_THREAD_CENSUS_DONE          5
 
 typedef struct gc_thread_ {
     Capability *cap;
@@ -143,6 +145,13 @@ typedef struct gc_thread_ {
     StgClosure* static_objects;            // live static objects
     StgClosure* scavenged_static_objects;  // static objects scavenged so far
 
+    // Static objects settled during this GC, tagged with STATIC_FLAG_LIST.
+    // Appended to settled_static_objects at the end of GC; see
+    // Note [Settled static objects] in Storage.h.
+    StgClosure* settled_static_objects;
+    StgClosure* settled_static_objects_tail;
+    W_ n_settled_static_objects;
+
     W_ gc_count;                   // number of GCs this thread has done
 
     // block that is currently being scanned
@@ -186,6 +195,10 @@ typedef struct gc_thread_ {
     W_ any_work;
     W_ no_work;
     W_ scav_find_work;
+    W_ scavenged_static;
+    W_ skipped_static;      // settled static objects reached and skipped
+    W_ copy_races[N_CLOSURE_TYPES];  // lost evacuation races, by closure
+                                     // type; see Note [Evacuation races]
 
     Time gc_start_cpu;   // process CPU time
     Time gc_sync_start_elapsed;  // start of GC sync
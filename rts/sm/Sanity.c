@@ -24,6 +24,7 @@
 #include "GCThread.h"
 #include "Sanity.h"
 #include "Schedule.h"
+#include "STM.h"
 #include "Apply.h"
 #include "Printer.h"
 #include "Arena.h"
@@ -211,6 +212,25 @@ checkPAP (StgClosure *tagged_fun, StgClosure** payload, StgWord n_args)
 }
 
 
+// The chunks of a TRec are outside the heap; see Note [TRec chunk arena]
+// in STM.c
+static void
+checkTRecChunks( const StgTRecHeader *trec )
+{
+    const StgTRecChunk *tc;
+    uint32_t i;
+
+    for (tc = trec->current_chunk; tc != END_STM_CHUNK_LIST;
+         tc = tc->prev_chunk) {
+        ASSERT(tc->next_entry_idx <= tc->size);
+        for (i = 0; i < tc->next_entry_idx; i++) {
+            ASSERT(LOOKS_LIKE_CLOSURE_PTR(tc->entries[i].tvar));
+            ASSERT(LOOKS_LIKE_CLOSURE_PTR(tc->entries[i].expected_value));
+            ASSERT(LOOKS_LIKE_CLOSURE_PTR(tc->entries[i].new_value));
+        }
+    }
+}
+
 StgOffset
 checkClosure( const StgClosure* p )
 {
@@ -277,6 +297,9 @@ checkClosure( const StgClosure* p )
     case COMPACT_NFDATA:
         {
             uint32_t i;
+            if (p->header.info == &stg_TREC_HEADER_info) {
+                checkTRecChunks((const StgTRecHeader *)p);
+            }
             for (i = 0; i < info->layout.payload.ptrs; i++) {
                 ASSERT(LOOKS_LIKE_CLOSURE_PTR(p->payload[i]));
             }
@@ -411,19 +434,6 @@ checkClosure( const StgClosure* p )
         checkSTACK((StgStack*)p);
         return stack_sizeW((StgStack*)p);
 
-    case TREC_CHUNK:
-      {
-        uint32_t i;
-        StgTRecChunk *tc = (StgTRecChunk *)p;
-        ASSERT(LOOKS_LIKE_CLOSURE_PTR(tc->prev_chunk));
-        for (i = 0; i < tc -> next_entry_idx; i ++) {
-          ASSERT(LOOKS_LIKE_CLOSURE_PTR(tc->entries[i].tvar));
-          ASSERT(LOOKS_LIKE_CLOSURE_PTR(tc->entries[i].expected_value));
-          ASSERT(LOOKS_LIKE_CLOSURE_PTR(tc->entries[i].new_value));
-        }
-        return sizeofW(StgTRecChunk);
-      }
-
     default:
         barf("checkClosure (closure type %d)", info->type);
     }
@@ -849,6 +859,13 @@ checkRunQueue(Capability *cap)
          prev = tso, tso = tso->_link, n++) {
         ASSERT(prev == END_TSO_QUEUE || prev->_link == tso);
         ASSERT(tso->block_info.prev == prev);
+        // ordered by priority class; see Note [Priority classes]
+        ASSERT(tso->run_queue_prio < TSO_PRIO_CLASSES);
+        ASSERT(prev == END_TSO_QUEUE ||
+               prev->run_queue_prio <= tso->run_queue_prio);
+        ASSERT((cap->run_queue_prio_tl[tso->run_queue_prio] == tso) ==
+               (tso->_link == END_TSO_QUEUE ||
+                tso->_link->run_queue_prio != tso->run_queue_prio));
     }
     ASSERT(cap->run_queue_tl == prev);
     ASSERT(cap->n_run_queue == n);
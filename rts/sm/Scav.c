@@ -57,6 +57,7 @@
 #include "Trace.h"
 #include "Sanity.h"
 #include "Capability.h"
+#include "STM.h"
 #include "LdvProfile.h"
 #include "Hash.h"
 
@@ -122,7 +123,7 @@ scavengeTSO (StgTSO *tso)
     // in the THREADED_RTS, block_info.closure must always point to a
     // valid closure, because we assume this in throwTo().  In the
     // non-threaded RTS it might be a FD (for
-    // BlockedOnRead/BlockedOnWrite) or a time value (BlockedOnDelay)
+    // BlockedOnRead/BlockedOnWrite) or an index (BlockedOnDelay)
     else {
         tso->block_info.closure = (StgClosure *)END_TSO_QUEUE;
     }
@@ -388,6 +389,29 @@ scavenge_fun_srt(const StgInfoTable *info)
     }
 }
 
+/* -----------------------------------------------------------------------------
+   Scavenge the entries of a TRec.  Its chunks are not heap objects, so
+   the GC only reaches them through the TRec; see Note [TRec chunk arena]
+   in STM.c.
+   -------------------------------------------------------------------------- */
+
+static void
+scavenge_trec_chunks (StgTRecHeader *trec)
+{
+    StgTRecChunk *tc;
+    StgWord i;
+
+    for (tc = trec->current_chunk; tc != END_STM_CHUNK_LIST;
+         tc = tc->prev_chunk) {
+        TRecEntry *e = &(tc->entries[0]);
+        for (i = 0; i < tc->next_entry_idx; i++, e++) {
+            evacuate((StgClosure **)&e->tvar);
+            evacuate((StgClosure **)&e->expected_value);
+            evacuate((StgClosure **)&e->new_value);
+        }
+    }
+}
+
 /* -----------------------------------------------------------------------------
    Scavenge a block from the given scan pointer up to bd->free.
 
@@ -764,6 +788,10 @@ scavenge_block (bdescr *bd)
 
         gct->eager_promotion = false;
 
+        if (((StgClosure *)p)->header.info == &stg_TREC_HEADER_info) {
+            scavenge_trec_chunks((StgTRecHeader *)p);
+        }
+
         end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
         for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
             evacuate((StgClosure **)p);
@@ -775,24 +803,6 @@ scavenge_block (bdescr *bd)
         break;
       }
 
-    case TREC_CHUNK:
-      {
-        StgWord i;
-        StgTRecChunk *tc = ((StgTRecChunk *) p);
-        TRecEntry *e = &(tc -> entries[0]);
-        gct->eager_promotion = false;
-        evacuate((StgClosure **)&tc->prev_chunk);
-        for (i = 0; i < tc -> next_entry_idx; i ++, e++ ) {
-          evacuate((StgClosure **)&e->tvar);
-          evacuate((StgClosure **)&e->expected_value);
-          evacuate((StgClosure **)&e->new_value);
-        }
-        gct->eager_promotion = saved_eager_promotion;
-        gct->failed_to_evac = true; // mutable
-        p += sizeofW(StgTRecChunk);
-        break;
-      }
-
     default:
         barf("scavenge: unimplemented/strange closure type %d @ %p",
              info->type, p);
@@ -1158,6 +1168,10 @@ scavenge_mark_stack(void)
 
             gct->eager_promotion = false;
 
+            if (((StgClosure *)p)->header.info == &stg_TREC_HEADER_info) {
+                scavenge_trec_chunks((StgTRecHeader *)p);
+            }
+
             end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
             for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
                 evacuate((StgClosure **)p);
@@ -1168,23 +1182,6 @@ scavenge_mark_stack(void)
             break;
         }
 
-        case TREC_CHUNK:
-          {
-            StgWord i;
-            StgTRecChunk *tc = ((StgTRecChunk *) p);
-            TRecEntry *e = &(tc -> entries[0]);
-            gct->eager_promotion = false;
-            evacuate((StgClosure **)&tc->prev_chunk);
-            for (i = 0; i < tc -> next_entry_idx; i ++, e++ ) {
-              evacuate((StgClosure **)&e->tvar);
-              evacuate((StgClosure **)&e->expected_value);
-              evacuate((StgClosure **)&e->new_value);
-            }
-            gct->eager_promotion = saved_eager_promotion;
-            gct->failed_to_evac = true; // mutable
-            break;
-          }
-
         default:
             barf("scavenge_mark_stack: unimplemented/strange closure type %d @ %p",
                  info->type, p);
@@ -1476,6 +1473,10 @@ scavenge_one(StgPtr p)
 
         gct->eager_promotion = false;
 
+        if (((StgClosure *)p)->header.info == &stg_TREC_HEADER_info) {
+            scavenge_trec_chunks((StgTRecHeader *)p);
+        }
+
         end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
         for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
             evacuate((StgClosure **)p);
@@ -1487,23 +1488,6 @@ scavenge_one(StgPtr p)
 
     }
 
-    case TREC_CHUNK:
-      {
-        StgWord i;
-        StgTRecChunk *tc = ((StgTRecChunk *) p);
-        TRecEntry *e = &(tc -> entries[0]);
-        gct->eager_promotion = false;
-        evacuate((StgClosure **)&tc->prev_chunk);
-        for (i = 0; i < tc -> next_entry_idx; i ++, e++ ) {
-          evacuate((StgClosure **)&e->tvar);
-          evacuate((StgClosure **)&e->expected_value);
-          evacuate((StgClosure **)&e->new_value);
-        }
-        gct->eager_promotion = saved_eager_promotion;
-        gct->failed_to_evac = true; // mutable
-        break;
-      }
-
     case IND:
         // IND can happen, for example, when the interpreter allocates
         // a gigantic AP closure (more than one block), which ends up
@@ -1590,8 +1574,6 @@ scavenge_mutable_list(bdescr *bd, generation *gen)
                 mutlist_MVARS++; break;
             case TVAR:
                 mutlist_TVAR++; break;
-            case TREC_CHUNK:
-                mutlist_TREC_CHUNK++; break;
             case MUT_PRIM:
                 if (((StgClosure*)p)->header.info == &stg_TVAR_WATCH_QUEUE_info)
                     mutlist_TVAR_WATCH_QUEUE++;
@@ -1667,6 +1649,91 @@ scavenge_capability_mut_lists (Capability *cap)
     }
 }
 
+/* -----------------------------------------------------------------------------
+   Settled static objects
+
+   is_settled_static() tells whether a static object referred to by
+   another static object can never lead to anything the GC has to
+   visit; static_object_settles() tells whether a static object that
+   has just been scavenged can join settled_static_objects.  See Note
+   [Settled static objects] in Storage.h.
+   -------------------------------------------------------------------------- */
+
+static bool
+is_settled_static (StgClosure *q)
+{
+    const StgInfoTable *info;
+
+    q = UNTAG_CLOSURE(q);
+    if (HEAP_ALLOCED_GC(q)) {
+        return false;
+    }
+
+    info = get_itbl(q);
+    switch (info->type) {
+
+    case CONSTR_0_1:
+    case CONSTR_0_2:
+    case CONSTR_NOCAF:
+        return true;
+
+    case FUN_STATIC:
+        if (info->srt == 0 && info->layout.payload.ptrs == 0) {
+            return true;
+        }
+        /* fallthrough */
+
+    case CONSTR:
+    case CONSTR_1_0:
+    case CONSTR_2_0:
+    case CONSTR_1_1:
+        return ((StgWord)*STATIC_LINK(info,q) & STATIC_BITS)
+            == STATIC_FLAG_LIST;
+
+    default:
+        // THUNK_STATIC and IND_STATIC are CAFs, which can be updated to
+        // point into the heap at any time.
+        return false;
+    }
+}
+
+static bool
+static_object_settles (StgClosure *p, const StgInfoTable *info)
+{
+    StgPtr q, next;
+
+    switch (info->type) {
+
+    case FUN_STATIC:
+    {
+        StgFunInfoTable *fun_info = itbl_to_fun_itbl(info);
+        if (fun_info->i.srt &&
+            !is_settled_static((StgClosure*)GET_FUN_SRT(fun_info))) {
+            return false;
+        }
+    }
+    /* fallthrough */
+
+    case CONSTR:
+    case CONSTR_NOCAF:
+    case CONSTR_1_0:
+    case CONSTR_0_1:
+    case CONSTR_2_0:
+    case CONSTR_1_1:
+    case CONSTR_0_2:
+        next = (P_)p->payload + info->layout.payload.ptrs;
+        for (q = (P_)p->payload; q < next; q++) {
+            if (!is_settled_static((StgClosure *)*q)) {
+                return false;
+            }
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
 /* -----------------------------------------------------------------------------
    Scavenging the static objects.
 
@@ -1706,12 +1773,13 @@ scavenge_static(void)
     info = get_itbl(p);
     // make sure the info pointer is into text space
 
-    /* Take this object *off* the static_objects list,
-     * and put it on the scavenged_static_objects list.
+    /* Take this object *off* the static_objects list.  We put it on
+     * one of the other lists below, once we have scavenged it; until
+     * then the link field still carries static_flag, so the object is
+     * not traversed again in the meantime.
      */
     gct->static_objects = *STATIC_LINK(info,p);
-    *STATIC_LINK(info,p) = gct->scavenged_static_objects;
-    gct->scavenged_static_objects = flagged_p;
+    gct->scavenged_static++;
 
     switch (info -> type) {
 
@@ -1767,6 +1835,23 @@ scavenge_static(void)
     }
 
     ASSERT(gct->failed_to_evac == false);
+
+    /* Put the object on the settled list if nothing it refers to can
+     * change any more (see Note [Settled static objects] in Storage.h),
+     * and on the scavenged_static_objects list otherwise.
+     */
+    if (settle_static_objects && static_object_settles(p, info)) {
+        if (gct->settled_static_objects == END_OF_CAF_LIST) {
+            gct->settled_static_objects_tail = p;
+        }
+        *STATIC_LINK(info,p) = gct->settled_static_objects;
+        gct->settled_static_objects =
+            (StgClosure *)((StgWord)p | STATIC_FLAG_LIST);
+        gct->n_settled_static_objects++;
+    } else {
+        *STATIC_LINK(info,p) = gct->scavenged_static_objects;
+        gct->scavenged_static_objects = flagged_p;
+    }
   }
 }
 
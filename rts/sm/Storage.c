@@ -28,6 +28,7 @@
 #include "OSMem.h"
 #include "Trace.h"
 #include "GC.h"
+#include "AllocSample.h"
 #include "Evac.h"
 #if defined(ios_HOST_OS)
 #include "Hash.h"
@@ -43,6 +44,8 @@
 StgIndStatic  *dyn_caf_list        = NULL;
 StgIndStatic  *debug_caf_list      = NULL;
 StgIndStatic  *revertible_caf_list = NULL;
+StgClosure    *settled_static_objects = NULL; // Note [Settled static objects]
+W_             n_settled_static_objects = 0;
 bool           keepCAFs;
 
 W_ large_alloc_lim;    /* GC if n_large_blocks in any nursery
@@ -81,6 +84,7 @@ Mutex sm_mutex;
 
 static void allocNurseries (uint32_t from, uint32_t to);
 static void assignNurseriesToCapabilities (uint32_t from, uint32_t to);
+static StgPtr allocateAtSite (Capability *cap, W_ n, StgPtr site);
 
 static void
 initGeneration (generation *gen, int g)
@@ -186,6 +190,8 @@ initStorage (void)
   dyn_caf_list = (StgIndStatic*)END_OF_CAF_LIST;
   debug_caf_list = (StgIndStatic*)END_OF_CAF_LIST;
   revertible_caf_list = (StgIndStatic*)END_OF_CAF_LIST;
+  settled_static_objects = END_OF_CAF_LIST;
+  n_settled_static_objects = 0;
 
   if (RtsFlags.GcFlags.largeAllocLim > 0) {
       large_alloc_lim = RtsFlags.GcFlags.largeAllocLim * BLOCK_SIZE_W;
@@ -667,19 +673,37 @@ countNurseryBlocks (void)
 }
 
 //
-// Resize each of the nurseries to the specified size.
+// The number of nurseries that are not kept by a disabled Capability.
+// resetNurseries() gives nursery i to Capability i, and the disabled
+// Capabilities are the last ones.
+//
+STATIC_INLINE uint32_t
+activeNurseries (void)
+{
+    return n_nurseries - (n_capabilities - enabled_capabilities);
+}
+
+//
+// Resize each of the nurseries to the specified size, except that the
+// nursery of a disabled Capability is cut down to a single block (see
+// Note [Automatic capability scaling] in AutoCaps.c).
 //
 static void
-resizeNurseriesEach (W_ blocks)
+resizeNurseriesEach (W_ each_blocks)
 {
     uint32_t i, node;
     bdescr *bd;
-    W_ nursery_blocks;
+    W_ blocks, nursery_blocks;
     nursery *nursery;
 
     for (i = 0; i < n_nurseries; i++) {
         nursery = &nurseries[i];
         nursery_blocks = nursery->n_blocks;
+        if (i < n_capabilities && capabilities[i]->disabled) {
+            blocks = 1;
+        } else {
+            blocks = each_blocks;
+        }
         if (nursery_blocks == blocks) continue;
 
         node = capNoToNumaNode(i);
@@ -739,7 +763,7 @@ resizeNurseries (W_ blocks)
 {
     // If there are multiple nurseries, then we just divide the number
     // of available blocks between them.
-    resizeNurseriesEach(blocks / n_nurseries);
+    resizeNurseriesEach(blocks / activeNurseries());
 }
 
 bool
@@ -832,7 +856,7 @@ accountAllocation(Capability *cap, W_ n)
 StgPtr
 allocate (Capability *cap, W_ n)
 {
-    StgPtr p = allocateMightFail(cap, n);
+    StgPtr p = allocateAtSite(cap, n, __builtin_return_address(0));
     if (p == NULL) {
         reportHeapOverflow();
         // heapOverflow() doesn't exit (see #2592), but we aren't
@@ -852,6 +876,17 @@ allocate (Capability *cap, W_ n)
  */
 StgPtr
 allocateMightFail (Capability *cap, W_ n)
+{
+    return allocateAtSite(cap, n, __builtin_return_address(0));
+}
+
+/*
+ * The allocation itself.  site is the code that asked for the memory,
+ * for the allocation-site profiler (see Note [Allocation-site sampling]
+ * in AllocSample.c).
+ */
+static StgPtr
+allocateAtSite (Capability *cap, W_ n, StgPtr site)
 {
     bdescr *bd;
     StgPtr p;
@@ -890,6 +925,7 @@ allocateMightFail (Capability *cap, W_ n)
         bd->flags = BF_LARGE;
         bd->free = bd->start + n;
         cap->total_allocated += n;
+        allocSample(cap, bd->start, n * sizeof(W_), site);
         return bd->start;
     }
 
@@ -958,6 +994,7 @@ allocateMightFail (Capability *cap, W_ n)
     bd->free += n;
 
     IF_DEBUG(sanity, ASSERT(*((StgWord8*)p) == 0xaa));
+    allocSample(cap, p, n * sizeof(W_), site);
     return p;
 }
 
@@ -994,7 +1031,7 @@ allocatePinned (Capability *cap, W_ n)
     // If the request is for a large object, then allocate()
     // will give us a pinned object anyway.
     if (n >= LARGE_OBJECT_THRESHOLD/sizeof(W_)) {
-        p = allocateMightFail(cap, n);
+        p = allocateAtSite(cap, n, __builtin_return_address(0));
         if (p == NULL) {
             return NULL;
         } else {
@@ -1064,6 +1101,7 @@ allocatePinned (Capability *cap, W_ n)
 
     p = bd->free;
     bd->free += n;
+    allocSample(cap, p, n * sizeof(W_), __builtin_return_address(0));
     return p;
 }
 
@@ -195,4 +195,54 @@ extern StgIndStatic * dyn_caf_list;
 extern StgIndStatic * debug_caf_list;
 extern StgIndStatic * revertible_caf_list;
 
+/* -----------------------------------------------------------------------------
+   Note [Settled static objects]
+
+   Every major GC traverses all the live static objects, starting from
+   the roots and following SRTs and the pointer fields of static
+   constructors.  Most of these objects can never change: a static
+   constructor or function whose transitive closure contains no CAF
+   (THUNK_STATIC or IND_STATIC) refers only to other immutable static
+   objects, so traversing it again will never find anything new.
+
+   When scavenge_static() finds that every object a static object
+   refers to is itself settled, it puts the object on
+   settled_static_objects instead of the scavenged_static_objects list
+   of the GC thread.  The list is chained through the static link
+   field and tagged with STATIC_FLAG_LIST, exactly like the CAF lists,
+   so subsequent GCs ignore the object (see Note [STATIC_LINK fields]).
+   An object is settled if it is
+
+     - a static constructor or function with no pointers to follow
+       (CONSTR_NOCAF, CONSTR_0_1, CONSTR_0_2, FUN_STATIC with neither an
+       SRT nor pointer fields), or
+     - a static constructor or FUN_STATIC that is on
+       settled_static_objects (or was given STATIC_FLAG_LIST by the
+       compiler).
+
+   Objects settle bottom-up, one level per major GC, and a cycle of
+   static objects never settles; both are fine, since we fall back to
+   the normal traversal.
+
+   Settled objects are never removed from the list one at a time.
+   Instead, the whole list is discarded with unsettleStaticObjects()
+   when we need an accurate picture of the live static objects:
+
+     - checkUnload() needs every reachable static object in order to
+       decide whether some object code can be freed, so we unsettle at
+       the start of a major GC when there are pending unloads, and do
+       not settle anything during that GC.
+
+     - the retainer profiler computes retainer sets for static objects
+       found on scavenged_static_objects, so we never settle when
+       profiling by retainer set.
+
+   The number of static objects scavenged, and the number of times a
+   major GC reached a settled object and skipped it (counted in
+   evacuate_settleable_static_object()), are reported by +RTS -s.
+   -------------------------------------------------------------------------- */
+
+extern StgClosure * settled_static_objects;
+extern W_ n_settled_static_objects;
+
 #include "EndPrivate.h"
@@ -90,6 +90,16 @@ waitCondition ( Condition* pCond, Mutex* pMut )
   return true;
 }
 
+bool
+timedWaitCondition ( Condition* pCond, Mutex* pMut, Time timeout )
+{
+  DWORD r;
+  RELEASE_LOCK(pMut);
+  r = WaitForSingleObject(*pCond, TimeToMS(timeout));
+  ACQUIRE_LOCK(pMut);
+  return r != WAIT_TIMEOUT;
+}
+
 void
 yieldThread()
 {
@@ -108,6 +108,9 @@ class TestConfig:
         # Is readelf available?
         self.have_readelf = False
 
+        # Was the RTS built with the io_uring I/O manager?
+        self.have_io_uring = False
+
         # Are we testing an in-tree compiler?
         self.in_tree_compiler = True
 
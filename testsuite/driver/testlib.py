@@ -411,6 +411,9 @@ def have_gdb( ):
 def have_readelf( ):
     return config.have_readelf
 
+def have_io_uring( ):
+    return config.have_io_uring
+
 # ---
 
 def high_memory_usage(name, opts):
@@ -92,6 +92,8 @@ HAVE_DYNAMIC := $(shell if [ -f $(subst \,/,$(GHC_PRIM_LIBDIR))/GHC/PrimopWrappe
 HAVE_PROFILING := $(shell if [ -f $(subst \,/,$(GHC_PRIM_LIBDIR))/GHC/PrimopWrappers.p_hi ]; then echo YES; else echo NO; fi)
 HAVE_GDB := $(shell if gdb --version > /dev/null 2> /dev/null; then echo YES; else echo NO; fi)
 HAVE_READELF := $(shell if readelf --version > /dev/null 2> /dev/null; then echo YES; else echo NO; fi)
+RTS_INCLUDE_DIR := $(firstword $(subst include-dirs: ,,$(shell "$(GHC_PKG)" field rts include-dirs --simple-output)))
+HAVE_IO_URING := $(shell if grep -q 'define HAVE_LINUX_IO_URING_H 1' $(subst \,/,$(RTS_INCLUDE_DIR))/ghcautoconf.h 2> /dev/null; then echo YES; else echo NO; fi)
 
 ifeq "$(HAVE_VANILLA)" "YES"
 RUNTEST_OPTS += -e config.have_vanilla=True
@@ -149,6 +151,12 @@ else
 RUNTEST_OPTS += -e config.have_readelf=False
 endif
 
+ifeq "$(HAVE_IO_URING)" "YES"
+RUNTEST_OPTS += -e config.have_io_uring=True
+else
+RUNTEST_OPTS += -e config.have_io_uring=False
+endif
+
 ifeq "$(GhcDynamicByDefault)" "YES"
 RUNTEST_OPTS += -e config.ghc_dynamic_by_default=True
 CABAL_MINIMAL_BUILD = --enable-shared --disable-library-vanilla
@@ -0,0 +1,40 @@
+import Control.Concurrent
+import Control.Monad
+import Foreign.C.Types
+import GHC.RTS.Flags
+
+-- -qa=compact and -qa=spread pin each capability to a CPU chosen from
+-- the CPU topology.  Check that each capability's OS thread is pinned to
+-- the CPU that affinityModes_c.c works out for it.  See Note
+-- [Topology-aware affinity] in rts/posix/OSThreads.c
+
+foreign import ccall unsafe "pinnedCpu" pinnedCpu :: IO CInt
+foreign import ccall unsafe "expectedCpu" expectedCpu :: CInt -> CInt -> IO CInt
+
+-- Whether capability i's OS thread is where it should be.  If the
+-- topology cannot be read, the RTS falls back to plain -qa, which we
+-- don't check here.
+placedOn :: Bool -> Int -> IO Bool
+placedOn spread i = do
+  expected <- expectedCpu (if spread then 1 else 0) (fromIntegral i)
+  mv <- newEmptyMVar
+  _ <- forkOn i $ pinnedCpu >>= putMVar mv
+  actual <- takeMVar mv
+  return (expected < 0 || actual == expected)
+
+main :: IO ()
+main = do
+  flags <- getParFlags
+  print (setAffinity flags, affinityMode flags)
+  let spread = case affinityMode flags of
+                 AffinitySpread -> True
+                 _ -> False
+  results <- forM [0 .. 3] $ \i -> do
+    mv <- newEmptyMVar
+    _ <- forkOn i $ putMVar mv $! sum [1 .. 1000000 :: Int]
+    return mv
+  mapM takeMVar results >>= print . sum
+  mapM (placedOn spread) [0 .. 3] >>= print
+  -- a new capability gets a CPU too
+  setNumCapabilities 6
+  placedOn spread 5 >>= print
@@ -0,0 +1,98 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The CPU that the calling OS thread is pinned to, or -1 if it may run on
+ * more than one.
+ */
+int pinnedCpu (void)
+{
+    cpu_set_t cs;
+    int i;
+
+    if (sched_getaffinity(0, sizeof(cs), &cs) != 0 || CPU_COUNT(&cs) != 1) {
+        return -1;
+    }
+    for (i = 0; !CPU_ISSET(i, &cs); i++);
+    return i;
+}
+
+typedef struct { int cpu, package, core, thread, index; } Place;
+
+static int spread_order;
+
+static int readId (int cpu, const char *name)
+{
+    char path[128];
+    FILE *f;
+    int id = -1;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    f = fopen(path, "r");
+    if (f != NULL) {
+        if (fscanf(f, "%d", &id) != 1) id = -1;
+        fclose(f);
+    }
+    return id;
+}
+
+static int compare (const void *x, const void *y)
+{
+    const Place *a = x, *b = y;
+    if (a->thread != b->thread) return a->thread - b->thread;
+    if (spread_order) {
+        if (a->index != b->index) return a->index - b->index;
+        if (a->package != b->package) return a->package - b->package;
+    } else {
+        if (a->package != b->package) return a->package - b->package;
+        if (a->core != b->core) return a->core - b->core;
+    }
+    return a->cpu - b->cpu;
+}
+
+/* The CPU that Capability n should be pinned to with -qa=spread (spread
+ * != 0) or -qa=compact, worked out from the CPUs that the calling thread
+ * may run on; or -1 if the topology cannot be read.
+ */
+int expectedCpu (int spread, int n)
+{
+    cpu_set_t cs;
+    Place places[CPU_SETSIZE];
+    int i, j, count = 0;
+
+    if (sched_getaffinity(0, sizeof(cs), &cs) != 0) {
+        return -1;
+    }
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (!CPU_ISSET(i, &cs)) continue;
+        places[count].cpu = i;
+        places[count].package = readId(i, "physical_package_id");
+        places[count].core = readId(i, "core_id");
+        if (places[count].package < 0 || places[count].core < 0) {
+            return -1;
+        }
+        places[count].thread = 0;
+        for (j = 0; j < count; j++) {
+            if (places[j].package == places[count].package &&
+                places[j].core == places[count].core) {
+                places[count].thread++;
+            }
+        }
+        count++;
+    }
+    for (i = 0; i < count; i++) {
+        places[i].index = 0;
+        for (j = 0; j < count; j++) {
+            if (places[j].package == places[i].package &&
+                places[j].thread == places[i].thread &&
+                places[j].core < places[i].core) {
+                places[i].index++;
+            }
+        }
+    }
+    spread_order = spread;
+    qsort(places, count, sizeof(Place), compare);
+    return places[n % count].cpu;
+}
@@ -0,0 +1,32 @@
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+import Data.IORef
+import GHC.Conc
+import GHC.RTS.Flags
+
+-- With --alloc-slice there are no timer context switches, so the spinning
+-- thread only lets the other one run because it has used up its
+-- allocation slice.  See Note [Allocation slices] in rts/Schedule.c.
+
+main :: IO ()
+main = do
+  flags <- getConcFlags
+  print (allocSlice flags, ctxtSwitchTicks flags)
+
+  flag <- newIORef False
+  done <- newEmptyMVar
+  spinner <- forkIO $ do
+    let loop :: Int -> IO ()
+        loop i = do
+          stop <- readIORef flag
+          unless stop $ do
+            _ <- evaluate (length (show i))
+            loop (i + 1)
+    loop 0
+    putMVar done ()
+  setThreadAllocationSlice spinner 32768
+  threadAllocationSlice spinner >>= print
+  _ <- forkIO $ writeIORef flag True
+  takeMVar done
+  putStrLn "done"
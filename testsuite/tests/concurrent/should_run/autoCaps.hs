@@ -0,0 +1,42 @@
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import GHC.RTS.Flags
+import System.Posix.Process
+
+-- With --auto-caps the RTS enables and disables capabilities while the
+-- program runs: fewer while we are idle, and more while threads are
+-- waiting to run.  A child of forkProcess must also be able to exit.
+-- How far the number moves depends on the CPUs and CPU quota of the
+-- machine, so we only check that it stays between 1 and -N.
+-- See Note [Automatic capability scaling] in rts/AutoCaps.c
+
+main :: IO ()
+main = do
+  getParFlags >>= print . autoCapsInterval
+  initial <- getNumCapabilities
+  -- idle, so that capabilities are disabled
+  threadDelay 200000
+  n0 <- getNumCapabilities
+  -- busy, so that they are enabled again; watch the number while the
+  -- threads run, since it drops again once they have finished
+  running <- newIORef (8 :: Int)
+  results <- forM [1 .. 8] $ \i -> do
+    mv <- newEmptyMVar
+    _ <- forkIO $ do
+      putMVar mv $! sum [1 .. i * 3000000 :: Int]
+      atomicModifyIORef' running (\n -> (n - 1, ()))
+    return mv
+  let watch m = do
+        r <- readIORef running
+        n <- getNumCapabilities
+        if r == 0 then return (max m n)
+                   else threadDelay 5000 >> watch (max m n)
+  n1 <- watch n0
+  rs <- mapM takeMVar results
+  print (sum rs)
+  let inRange n = n >= 1 && n <= initial
+  print (initial, inRange n0, inRange n1)
+
+  pid <- forkProcess (return ())
+  getProcessStatus True False pid >>= print
@@ -0,0 +1,51 @@
+import Control.Concurrent
+import Control.Exception (try)
+import Control.Monad
+import System.IO.Error
+import System.Posix.IO
+import System.Posix.Resource
+
+-- Many threads blocked reading pipes at once, some of them on the same
+-- pipe, and a third of them interrupted before the pipe is written.
+-- There are enough pipes for descriptors above FD_SETSIZE (1024).  Then
+-- a thread blocked on a pipe that another thread closes must get an
+-- exception rather than wait forever.
+-- See Note [awaitEvent with epoll] in rts/posix/Select.c
+
+main :: IO ()
+main = do
+  lim <- getResourceLimit ResourceOpenFiles
+  let wanted = ResourceLimit 4096
+      soft = case hardLimit lim of
+               ResourceLimit h | h < 4096 -> ResourceLimit h
+               _ -> wanted
+  setResourceLimit ResourceOpenFiles lim { softLimit = soft }
+
+  let n = 600 :: Int
+      killed i = i `mod` 3 == 0
+  pipes <- replicateM n createPipe
+  print (maximum [ max r w | (r, w) <- pipes ] > 1024)
+  done <- newEmptyMVar
+  ts <- forM (zip [1..] pipes) $ \(i, (r, _)) -> do
+    t1 <- forkIO $ threadWaitRead r >> putMVar done i
+    t2 <- forkIO $ threadWaitRead r >> putMVar done i
+    return (i, [t1, t2])
+  yield
+  forM_ ts $ \(i, t) -> when (killed i) $ mapM_ killThread t
+  forM_ (zip [1..] pipes) $ \(i, (_, w)) ->
+    when (not (killed i)) $ void $ fdWrite w "x"
+  rs <- replicateM (2 * length (filter (not . killed) [1..n])) (takeMVar done)
+  print (sum rs)
+  forM_ pipes $ \(r, w) -> closeFd r >> closeFd w
+
+  -- close a pipe while a thread is blocked reading it
+  (r, w) <- createPipe
+  result <- newEmptyMVar
+  _ <- forkIO $ try (threadWaitRead r) >>= putMVar result
+  yield
+  closeFd r
+  res <- takeMVar result
+  case res :: Either IOError () of
+    Left e -> putStrLn (ioeGetLocation e)
+    Right () -> putStrLn "woke up without an exception"
+  closeFd w
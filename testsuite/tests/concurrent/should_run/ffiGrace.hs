@@ -0,0 +1,25 @@
+import Control.Concurrent
+import Control.Monad
+
+-- Short safe calls keep their capability reserved (+RTS --ffi-grace),
+-- while other threads keep waking each other up through MVars, which
+-- breaks the reservation.  See Note [Safe foreign call fast path] in
+-- rts/Capability.c
+
+foreign import ccall safe "sin" c_sin :: Double -> IO Double
+
+main :: IO ()
+main = do
+  let n = 4
+  mvs <- replicateM n newEmptyMVar
+  done <- newEmptyMVar
+  forM_ (zip3 [0 ..] mvs (tail (cycle mvs))) $ \(i, mv, next) ->
+    forkIO $ do
+      forM_ [1 .. 1000 :: Int] $ \j -> do
+        x <- c_sin (fromIntegral (i * j))
+        when (x > 1) $ error "sin"
+        when (i /= 0 || j > 1) $ takeMVar mv
+        putMVar next ()
+      putMVar done ()
+  replicateM_ n (takeMVar done)
+  print n
@@ -0,0 +1,21 @@
+import Control.Concurrent
+import Control.Monad
+
+-- MVar wakeups and throwTo between threads on different Capabilities,
+-- all of which go through the lock-free inboxes.  See Note [Lock-free
+-- inbox] in rts/Messages.c
+
+main :: IO ()
+main = do
+  n <- getNumCapabilities
+  done <- newEmptyMVar
+  forM_ [0 .. n - 1] $ \i -> forkOn i $ do
+    a <- newEmptyMVar
+    b <- newEmptyMVar
+    _ <- forkOn (i + 1) $ replicateM_ 10000 $ takeMVar a >>= putMVar b
+    forM_ [1 .. 10000 :: Int] $ \j -> putMVar a j >> takeMVar b
+    t <- forkOn (i + 1) $ forever yield
+    killThread t
+    putMVar done ()
+  replicateM_ n (takeMVar done)
+  putStrLn "done"
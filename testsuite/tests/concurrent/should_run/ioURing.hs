@@ -0,0 +1,76 @@
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+import Foreign
+import Foreign.C
+import qualified GHC.IO.FD as FD
+import GHC.IO.URing
+import System.IO
+import System.Posix.IO
+import System.Posix.Types
+
+-- Requests through the io_uring I/O manager: a read that has to wait for
+-- a writer, a read that is interrupted, a timeout, and a read through
+-- GHC.IO.FD on an O_NONBLOCK descriptor.  See
+-- Note [io_uring I/O manager] in rts/posix/IOURing.c
+--
+-- Where the kernel has no io_uring, every request returns Nothing, and
+-- we fall back on the ordinary operations as the callers in GHC.IO.FD
+-- do, so the output is the same either way.
+
+orElse :: IO (Maybe Int) -> IO Int -> IO Int
+orElse request fallback = request >>= maybe fallback return
+
+readFd :: Fd -> Ptr Word8 -> IO Int
+readFd fd buf = do
+  threadWaitRead fd
+  fromIntegral <$> fdReadBuf fd buf 16
+
+main :: IO ()
+main = do
+  hPutStrLn stderr ("uringEnabled: " ++ show uringEnabled)
+  (r, w) <- createPipe
+  let rfd = fromIntegral r
+      wfd = fromIntegral w
+
+  allocaBytes 16 $ \buf -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ (uringRead rfd buf 16 (-1) `orElse` readFd r buf)
+                    >>= putMVar done
+    threadDelay 10000
+    n <- withCStringLen "hello" $ \(s, len) ->
+           uringWrite wfd (castPtr s) (fromIntegral len) (-1)
+             `orElse` (fromIntegral <$> fdWriteBuf w (castPtr s)
+                                                   (fromIntegral len))
+    print n
+    m <- takeMVar done
+    print m
+    peekCStringLen (castPtr buf, 5) >>= putStrLn
+
+  -- killThread returns once the exception has been raised, but the
+  -- kernel may still be writing into buf until the thread has cancelled
+  -- its request, so wait for that before buf is freed.
+  allocaBytes 16 $ \buf -> do
+    cancelled <- newEmptyMVar
+    t <- forkIO $ void (uringRead rfd buf 16 (-1) `orElse` readFd r buf)
+                    `finally` putMVar cancelled ()
+    threadDelay 10000
+    killThread t
+    takeMVar cancelled
+    putStrLn "killed"
+
+  t <- uringTimeout 10000 `orElse` (threadDelay 10000 >> return (-62))
+  print (t == negate 62) -- ETIME
+
+  -- The kernel may fail a read on an O_NONBLOCK descriptor with EAGAIN
+  -- instead of waiting; GHC.IO.FD must then wait with threadWaitRead.
+  (r2, w2) <- createPipe
+  setFdOption r2 NonBlockingRead True
+  let fd = FD.FD { FD.fdFD = fromIntegral r2, FD.fdIsNonBlocking = 1 }
+  allocaBytes 16 $ \buf -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ FD.readRawBufferPtr "ioURing" fd buf 0 16 >>= putMVar done
+    threadDelay 10000
+    _ <- fdWrite w2 "world"
+    takeMVar done >>= print
+    peekCStringLen (castPtr buf, 5) >>= putStrLn
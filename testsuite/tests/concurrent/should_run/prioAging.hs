@@ -0,0 +1,26 @@
+import Control.Concurrent
+import GHC.Conc
+
+-- A high-priority thread that keeps yielding must not starve a
+-- low-priority one.  See Note [Priority classes] in rts/Schedule.c
+
+main :: IO ()
+main = do
+  me <- myThreadId
+  threadPriority me >>= print
+  setThreadPriority me HighPriority
+  threadPriority me >>= print
+  done <- newEmptyMVar
+  _ <- forkIO $ do
+    t <- myThreadId
+    setThreadPriority t LowPriority
+    threadPriority t >>= print
+    yield
+    putMVar done ()
+  let spin = do
+        r <- tryTakeMVar done
+        case r of
+          Nothing -> yield >> spin
+          Just () -> return ()
+  spin
+  putStrLn "done"
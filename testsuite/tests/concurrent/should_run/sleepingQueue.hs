@@ -0,0 +1,18 @@
+import Control.Concurrent
+import Control.Monad
+
+-- Many threads in threadDelay at once, with targets in no particular
+-- order, and a third of them interrupted before they wake up.  See
+-- Note [Sleeping queue] in rts/SleepingQueue.c
+
+main :: IO ()
+main = do
+  let n = 20000 :: Int
+      killed i = i `mod` 3 == 0
+  done <- newEmptyMVar
+  ts <- forM [1..n] $ \i -> forkIO $ do
+    threadDelay (if killed i then 100000000 else (i * 7919) `mod` 100000)
+    putMVar done i
+  forM_ (zip [1..] ts) $ \(i, t) -> when (killed i) $ killThread t
+  rs <- replicateM (length (filter (not . killed) [1..n])) (takeMVar done)
+  print (sum rs)
@@ -0,0 +1,13 @@
+import GHC.Conc
+import Control.Monad
+
+-- With a spark pool of 16 entries (+RTS -e16), sparks beyond the first 16
+-- go on the overflow list rather than being dropped.
+-- See Note [Spark overflow] in rts/Sparks.c
+
+main :: IO ()
+main = do
+  let xs = [ sum [1..n] | n <- [1..100 :: Integer] ]
+  forM_ xs $ \x -> x `par` return ()
+  numSparks >>= print
+  print (sum xs)
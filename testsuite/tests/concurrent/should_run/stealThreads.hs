@@ -0,0 +1,43 @@
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+import Data.IORef
+import GHC.Conc
+
+-- A burst of forkIO on one capability, with some of the new threads
+-- killed straight away, while they may still be on the steal queue.
+-- Then threads forked on capability 1 are killed from capability 0,
+-- while they may still be on capability 1's steal queue: every
+-- exception must arrive.  See Note [Thread stealing] in rts/Capability.c
+
+main :: IO ()
+main = do
+  results <- forM [1..1000] $ \i -> do
+    m <- newEmptyMVar
+    t <- forkIO $ putMVar m $! sum [1..i * 100 :: Integer]
+    when (i `mod` 3 == 0) $ killThread t
+    return (i, m)
+  rs <- forM results $ \(i, m) ->
+    if i `mod` 3 == 0 then return 0 else takeMVar m
+  print (sum rs)
+
+  finished <- newIORef False
+  tsVar <- newEmptyMVar
+  _ <- forkOn 1 $ do
+    ts <- replicateM 200 $ forkIO $ do
+      threadDelay 10000000
+      writeIORef finished True
+    putMVar tsVar ts
+    -- keep capability 1 busy, so that it does not run them itself yet
+    _ <- evaluate (sum [1 .. 2000000 :: Int])
+    return ()
+  ts <- takeMVar tsVar
+  mapM_ killThread ts
+  let dead t = do
+        s <- threadStatus t
+        case s of
+          ThreadFinished -> return ()
+          ThreadDied -> return ()
+          _ -> yield >> dead t
+  mapM_ dead ts
+  readIORef finished >>= print . not
@@ -0,0 +1,31 @@
+import Control.Concurrent
+import Control.Monad
+import GHC.Conc
+import System.Mem
+
+-- Large transactions whose log entries hold the only references to the
+-- new values while the GC runs, racing with a thread that makes some of
+-- them fail to commit.  The log chunks are outside the heap, so the GC
+-- has to find the entries through the TRec.  See Note [TRec chunk arena]
+-- in rts/STM.c
+
+main :: IO ()
+main = do
+  tvs <- replicateM 5000 (newTVarIO [0 :: Int])
+  c <- newTVarIO (0 :: Int)
+  done <- newEmptyMVar
+  _ <- forkIO $ do
+    replicateM_ 1000 $ do
+      atomically $ readTVar c >>= writeTVar c . (+ 1)
+      yield
+    putMVar done ()
+  forM_ [1 .. 20] $ \i -> atomically $ do
+    _ <- readTVar c
+    forM_ tvs $ \tv -> do
+      xs <- readTVar tv
+      writeTVar tv (map (+ 1) xs ++ [i])
+    unsafeIOToSTM performMajorGC
+  takeMVar done
+  vals <- mapM readTVarIO tvs
+  n <- readTVarIO c
+  print (all (== head vals) vals, sum (head vals), n)
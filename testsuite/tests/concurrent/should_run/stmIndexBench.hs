@@ -0,0 +1,37 @@
+import Control.Monad
+import GHC.Conc
+import System.CPUTime
+import System.Environment
+import Text.Printf
+
+-- Time transactions that access n TVars, to find where looking up TVars
+-- in a hash table beats scanning the transaction record.  See
+-- Note [TRec index] in rts/STM.c.  Compare, e.g.
+--
+--   ./stmIndexBench 8 16 32 64 128 256 1024 4096 +RTS --stm-index-threshold=0
+--   ./stmIndexBench 8 16 32 64 128 256 1024 4096 +RTS --stm-index-threshold=1
+--
+-- Each transaction adds 1 to every TVar, half of them in a nested
+-- transaction, so the result also checks that entries are found and merged
+-- correctly.
+
+main :: IO ()
+main = do
+  ns <- map read <$> getArgs
+  forM_ ns $ \n -> do
+    tvs <- replicateM n (newTVarIO (0 :: Int))
+    let reps = max 1 (200000 `div` n)
+        (as, bs) = splitAt (n `div` 2) tvs
+        incr tv = readTVar tv >>= writeTVar tv . (+ 1)
+    t0 <- getCPUTime
+    replicateM_ reps $ atomically $ do
+      mapM_ incr as
+      mapM_ incr bs `orElse` return ()
+      -- read everything again, through the index if there is one
+      s <- sum <$> mapM readTVar tvs
+      when (s == -1) retry
+    t1 <- getCPUTime
+    total <- atomically $ sum <$> mapM readTVar tvs
+    when (total /= n * reps) $ error ("wrong total for " ++ show n)
+    printf "%6d TVars: %8.0f ns per TVar access\n" n
+      (fromIntegral (t1 - t0) / 1000 / fromIntegral (3 * n * reps) :: Double)
@@ -0,0 +1,27 @@
+import Control.Concurrent
+import Control.Monad
+import GHC.Conc
+
+-- Read-only transactions, which commit without locking anything, racing
+-- with transfers between the same TVars.  See Note [Read-only commits] in
+-- rts/STM.c
+
+main :: IO ()
+main = do
+  tvs <- replicateM 16 (newTVarIO (1000 :: Int))
+  n <- getNumCapabilities
+  done <- newEmptyMVar
+  forM_ [1 .. n] $ \i -> forkIO $ do
+    forM_ [1 .. 20000] $ \j -> atomically $ do
+      let from = tvs !! ((i + j) `mod` 16)
+          to   = tvs !! ((i * j) `mod` 16)
+      a <- readTVar from
+      writeTVar from (a - 1)
+      b <- readTVar to
+      writeTVar to (b + 1)
+    putMVar done ()
+  oks <- forM [1 .. n * 200] $ \_ -> do
+    s <- atomically $ sum <$> mapM readTVar tvs
+    return (s == 16000)
+  replicateM_ n (takeMVar done)
+  print (and oks)
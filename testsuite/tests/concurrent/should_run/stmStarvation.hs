@@ -0,0 +1,40 @@
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import GHC.Conc
+
+-- Long transactions that read every TVar, racing with short transfers
+-- between the same TVars.  Without contention management the long ones
+-- can fail to commit for ever.  See Note [STM contention management] in
+-- rts/STM.c
+
+main :: IO ()
+main = do
+  tvs <- replicateM 256 (newTVarIO (100 :: Int))
+  total <- newTVarIO 0
+  stop <- newIORef False
+  n <- getNumCapabilities
+  done <- newEmptyMVar
+  forM_ [1 .. n] $ \i -> forkIO $ do
+    let loop j = do
+          s <- readIORef stop
+          unless s $ do
+            atomically $ do
+              let from = tvs !! ((i + j) `mod` 256)
+                  to   = tvs !! ((i * j) `mod` 256)
+              a <- readTVar from
+              writeTVar from (a - 1)
+              b <- readTVar to
+              writeTVar to (b + 1)
+            loop (j + 1)
+    loop 1
+    putMVar done ()
+  oks <- forM [1 .. 50 :: Int] $ \_ -> do
+    s <- atomically $ do
+      s <- sum <$> mapM readTVar tvs
+      writeTVar total s
+      return s
+    return (s == 25600)
+  writeIORef stop True
+  replicateM_ n (takeMVar done)
+  print (and oks)
@@ -0,0 +1,32 @@
+import Control.Concurrent
+import Control.Monad
+import GHC.Conc
+
+-- Transfers between TVars, with long read-only transactions summing all
+-- of them, under +RTS --stm-version-clock.  See Note [STM version clock]
+-- in rts/STM.c
+
+accounts :: Int
+accounts = 1000
+
+main :: IO ()
+main = do
+  tvs <- replicateM accounts (newTVarIO (100 :: Int))
+  n <- getNumCapabilities
+  done <- newEmptyMVar
+  forM_ [1 .. n] $ \i -> forkIO $ do
+    forM_ [1 .. 20000] $ \j -> do
+      let from = tvs !! ((i * j) `mod` accounts)
+          to   = tvs !! ((i * j * 7 + 1) `mod` accounts)
+      atomically $ do
+        a <- readTVar from
+        -- a nested transaction, to merge its entries into the outer one
+        (do when (a < 10) retry
+            writeTVar from (a - 10)) `orElse` return ()
+        b <- readTVar to
+        writeTVar to (b + if a >= 10 then 10 else 0)
+    putMVar done ()
+  sums <- replicateM 50 $ atomically $ sum <$> mapM readTVar tvs
+  replicateM_ n (takeMVar done)
+  total <- atomically $ sum <$> mapM readTVar tvs
+  print (all (== accounts * 100) (total : sums))
@@ -0,0 +1,32 @@
+import Control.Concurrent
+import Control.Monad
+import GHC.Conc
+
+-- Many threads blocked in retry on the same two TVars, woken by
+-- transactions that write both of them, some of which write back the
+-- values already there.  See Note [STM wakeups] in rts/STM.c
+
+main :: IO ()
+main = do
+  a <- newTVarIO (0 :: Int)
+  b <- newTVarIO (0 :: Int)
+  done <- newTVarIO (0 :: Int)
+  forM_ [1 .. 1000] $ \k -> forkIO $ do
+    atomically $ do
+      x <- readTVar a
+      y <- readTVar b
+      when (x + y < k) retry
+    atomically $ readTVar done >>= writeTVar done . (+ 1)
+  forM_ [1 .. 500 :: Int] $ \_ -> do
+    atomically $ do
+      x <- readTVar a
+      y <- readTVar b
+      writeTVar a x
+      writeTVar b y
+    atomically $ do
+      readTVar a >>= writeTVar a . (+ 1)
+      readTVar b >>= writeTVar b . (+ 1)
+  atomically $ do
+    n <- readTVar done
+    when (n < 1000) retry
+  readTVarIO done >>= print
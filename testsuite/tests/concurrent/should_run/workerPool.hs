@@ -0,0 +1,25 @@
+import Control.Concurrent
+import Control.Monad
+import Foreign.C.Types
+
+-- Many threads in blocking safe calls at once, in two bursts separated
+-- by more than the idle timeout, so that the pool grows, shrinks back to
+-- --min-workers and grows again.  See Note [Worker pool] in
+-- rts/Capability.c.  The Makefile checks the statistics from +RTS -t.
+
+foreign import ccall safe "usleep" c_usleep :: CUInt -> IO CInt
+
+burst :: Int -> IO ()
+burst n = do
+  done <- newEmptyMVar
+  replicateM_ n $ forkIO $ do
+    _ <- c_usleep 20000
+    putMVar done ()
+  replicateM_ n (takeMVar done)
+
+main :: IO ()
+main = do
+  burst 20
+  threadDelay 100000
+  burst 20
+  putStrLn "done"
@@ -0,0 +1,25 @@
+-- Exercise the allocation-site sampler (+RTS --alloc-sample): samples are
+-- taken both at heap checks and in allocate(), must survive minor and major
+-- GCs, and are reported to the eventlog at each major GC.  allocSample_c.c
+-- runs this with an eventlog writer that checks that the samples are there.
+
+module AllocSample where
+
+import Control.Exception (evaluate)
+import Data.IORef
+import System.Mem (performMajorGC, performMinorGC)
+
+foreign export ccall allocSampleMain :: IO ()
+
+allocSampleMain :: IO ()
+allocSampleMain = do
+  let xs = [1 .. 200000] :: [Int]
+  r <- newIORef (map (* 2) xs)
+  _ <- evaluate (sum xs)
+  performMinorGC
+  ys <- readIORef r
+  _ <- evaluate (length ys)
+  performMajorGC
+  print (sum ys)
+  writeIORef r []
+  performMajorGC
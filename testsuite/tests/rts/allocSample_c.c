@@ -0,0 +1,98 @@
+#include "Rts.h"
+#include "rts/EventLogFormat.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Collects the eventlog in memory, and then checks that it has the
+// allocation-site samples, each starting with EVENT_ALLOC_SAMPLE_BEGIN
+// rather than the heap profiler's EVENT_HEAP_PROF_SAMPLE_BEGIN.
+
+extern void allocSampleMain(void);
+
+#define ALLOC_SITE_HEAP_PROFILE_ID 1
+
+static uint8_t *log_buf = NULL;
+static size_t log_size = 0, log_capacity = 0;
+
+static bool writeLog (void *events, size_t size)
+{
+    if (log_size + size > log_capacity) {
+        log_capacity = (log_size + size) * 2;
+        log_buf = realloc(log_buf, log_capacity);
+        if (log_buf == NULL) {
+            return false;
+        }
+    }
+    memcpy(log_buf + log_size, events, size);
+    log_size += size;
+    return true;
+}
+
+static const EventLogWriter memoryWriter = {
+    .initEventLogWriter = NULL,
+    .writeEventLog = writeLog,
+    .flushEventLog = NULL,
+    .stopEventLogWriter = NULL
+};
+
+static size_t pos = 0;
+
+static uint32_t get (int bytes)
+{
+    uint32_t x = 0;
+    while (bytes-- > 0) {
+        x = (x << 8) | log_buf[pos++];
+    }
+    return x;
+}
+
+int main (int argc, char *argv[])
+{
+    static int sizes[0x10000];
+    uint32_t tag, n_begin = 0, n_string = 0, n_heap_begin = 0;
+    int size;
+
+    RtsConfig conf = defaultRtsConfig;
+    conf.rts_opts_enabled = RtsOptsAll;
+    conf.eventlog_writer = &memoryWriter;
+    hs_init_ghc(&argc, &argv, conf);
+    allocSampleMain();
+    hs_exit();
+
+    if (get(4) != EVENT_HEADER_BEGIN || get(4) != EVENT_HET_BEGIN) {
+        printf("bad header\n");
+        return 1;
+    }
+    while (get(4) == EVENT_ET_BEGIN) {
+        tag = get(2);
+        sizes[tag] = (int16_t)get(2);
+        pos += get(4);          // description
+        pos += get(4);          // extra info
+        get(4);                 // EVENT_ET_END
+    }
+    get(4);                     // EVENT_HEADER_END
+    get(4);                     // EVENT_DATA_BEGIN
+
+    while ((tag = get(2)) != EVENT_DATA_END) {
+        pos += 8;               // timestamp
+        size = sizes[tag] == -1 ? (int)get(2) : sizes[tag];
+        switch (tag) {
+        case EVENT_ALLOC_SAMPLE_BEGIN:
+            if (log_buf[pos] == ALLOC_SITE_HEAP_PROFILE_ID) n_begin++;
+            break;
+        case EVENT_HEAP_PROF_SAMPLE_STRING:
+            if (log_buf[pos] == ALLOC_SITE_HEAP_PROFILE_ID) n_string++;
+            break;
+        case EVENT_HEAP_PROF_SAMPLE_BEGIN:
+            n_heap_begin++;
+            break;
+        }
+        pos += size;
+    }
+
+    printf("allocation samples: %s\n", n_begin > 0 ? "yes" : "no");
+    printf("allocation sites: %s\n", n_string > 0 ? "yes" : "no");
+    printf("heap censuses: %u\n", n_heap_begin);
+    return 0;
+}
@@ -0,0 +1,33 @@
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import GHC.Stats
+import System.Mem
+
+-- Every GC with -N2 is a sync.  Capability 1 is kept busy while we GC from
+-- Capability 0, so that each sync has to wait for it; check that they
+-- are counted, and that the waits land in the histogram.  See Note
+-- [Time to stop] in rts/Stats.c
+
+main :: IO ()
+main = do
+  started <- newEmptyMVar
+  stop <- newIORef False
+  done <- newEmptyMVar
+  _ <- forkOn 1 $ do
+    putMVar started ()
+    let spin :: Int -> IO Int
+        spin n = do
+          s <- readIORef stop
+          if s then return n else yield >> spin (n + 1)
+    n <- spin 0
+    print (n > 0)
+    putMVar done ()
+  takeMVar started
+  replicateM_ 5 performGC
+  writeIORef stop True
+  takeMVar done
+  s <- getRTSStats
+  print (syncs s >= 5)
+  print (length (sync_stop_histogram s))
+  print (sum (sync_stop_histogram s) > 0)
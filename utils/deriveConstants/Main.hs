@@ -382,7 +382,10 @@ wanteds os = concat
           ,structField C    "Capability" "context_switch"
           ,structField C    "Capability" "interrupt"
           ,structField C    "Capability" "sparks"
+          ,structField C    "Capability" "spark_overflow_hd"
+          ,structField C    "Capability" "spark_overflow_tl"
           ,structField C    "Capability" "total_allocated"
+          ,structField C    "Capability" "alloc_sample_countdown"
           ,structField C    "Capability" "weak_ptr_list_hd"
           ,structField C    "Capability" "weak_ptr_list_tl"
 
@@ -449,6 +452,9 @@ wanteds os = concat
           ,closureField  C    "StgTSO"      "dirty"
           ,closureField  C    "StgTSO"      "bq"
           ,closureField  Both "StgTSO"      "alloc_limit"
+          ,closureField  C    "StgTSO"      "slice_end"
+          ,closureField  C    "StgTSO"      "stm_retries"
+          ,closureField  C    "StgTSO"      "stm_backoff"
           ,closureField_ Both "StgTSO_cccs" "StgTSO" "prof.cccs"
           ,closureField  Both "StgTSO"      "stackobj"
 